@@ -49,12 +49,14 @@
 #include <sys/exec.h>
 #include <sys/mman.h>
 #include <sys/param.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <xok/env.h>
 #include <xok/mmu.h>
 #include <xok/wk.h>
 #include "emubrk.h"
+#include "emustat.h"
 #include "handler.h"
 
 u_int __os_calls = 0;
@@ -153,6 +155,12 @@ main(int argc, char **argv, char **environ)
 
 //  move_ash_region();
 
+  if (argc > 1 && !strcmp("-s",argv[1]))
+    {
+      atexit(emu_stats_print);
+      argc--;
+      argv = &argv[1];
+    }
   if (argc <= 1)
     showusage = 1;
   else if (argc == 2)
@@ -169,7 +177,8 @@ main(int argc, char **argv, char **environ)
     {
       printf("Usage: %s [options] <binary filename> "
 	     "[<command line arguments for binary>]\n",argv[0]);
-      printf("\noptions: (one max)\n"
+      printf("\noptions: (-s and one of the others max)\n"
+	     "       -s  - syscall counts to stderr on exit\n"
 	     "       -d1 - loading msgs stdout\n"
 	     "       -d2 - syscall #'s to console\n"
 	     "       -d3 - syscall #'s to log file: emulate.log\n"
@@ -39,6 +39,7 @@
 #include <string.h>
 #include <sys/stat.h>
 #include "emustat.h"
+#include <exos/oscallstr.h>
 
 int emu_stat(const char *path, struct stat *sb)
 {
@@ -127,3 +128,44 @@ int emu_fstat(int fd, struct stat *sb)
   kprintf("{ %x }",osb->st_dev);
 */   
 }
+
+/*
+ * Call frequencies.  asm_start counts every OpenBSD system call it
+ * sees in __os_call_count_arr; with -s the counts are printed when the
+ * program exits, busiest first, marking the calls that take the fast
+ * path (see init_fastpath in handler.c).  A call that is near the top
+ * and not marked is a candidate for a fast path.
+ */
+
+extern u_int __os_call_count_arr[];
+extern int fast_handlers[];
+
+void emu_stats_print(void)
+{
+  int order[256];
+  u_int total = 0;
+  int i, j, t, n = 0;
+
+  for (i = 0; i < 256; i++)
+    if (__os_call_count_arr[i])
+      {
+	total += __os_call_count_arr[i];
+	order[n++] = i;
+      }
+
+  /* busiest first */
+  for (i = 1; i < n; i++)
+    for (j = i; j > 0 && __os_call_count_arr[order[j]] > __os_call_count_arr[order[j-1]]; j--)
+      {
+	t = order[j]; order[j] = order[j-1]; order[j-1] = t;
+      }
+
+  fprintf(stderr, "%-20s %4s %10s %6s\n", "syscall", "num", "calls", "%");
+  for (i = 0; i < n; i++)
+    fprintf(stderr, "%-20s %4d %10u %6.2f%s\n",
+	    oscallstr(order[i]),
+	    order[i], __os_call_count_arr[order[i]],
+	    100.0 * __os_call_count_arr[order[i]] / total,
+	    fast_handlers[order[i]] ? "  fast" : "");
+  fprintf(stderr, "total %u syscalls\n", total);
+}
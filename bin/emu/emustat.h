@@ -42,4 +42,6 @@ int emu_fstat(int fd, struct stat *sb);
 int emu_stat(const char *path, struct stat *sb);
 int emu_lstat(const char *path, struct stat *sb);
 
+void emu_stats_print(void);
+
 #endif
@@ -87,6 +87,9 @@ int handlers[256];
 int real_handlers[256];
 int nyt_handlers[256];
 int debug_handlers[256];
+int fast_handlers[256];
+int fast_nargs[256];
+int fast_rv64[256];
 
 extern int dlevel;
 
@@ -674,6 +677,39 @@ ssize_t readxx(int d, void *buf, size_t nbytes)
 
 extern void (asm_debug_handler)();
 extern void (__syscallx)();
+/*
+ * Calls that asm_start hands straight to their handler, on a copy of
+ * their nargs argument words (padding included), without saving
+ * anything in r_s or i_s.  So the handler must not look at or set r_s,
+ * as forkx, pipex or interim_lseek do; a call returning a quad in
+ * edx:eax says so with rv64.  handler 0 means the usual one.  Only
+ * used when syscalls are not being logged.
+ */
+static struct {
+  int scall, nargs, rv64;
+  void *handler;
+} fastpaths[] = {
+  { SYS_read, 3, 0, 0 },
+  { SYS_write, 3, 0, 0 },
+  { SYS_lseek, 5, 1, fast_lseek },
+  { SYS_gettimeofday, 2, 0, 0 },
+  { SYS_fstat, 2, 0, 0 },
+};
+
+void init_fastpath()
+{
+  int i, sc;
+
+  for (i=0; i < sizeof(fastpaths) / sizeof(fastpaths[0]); i++)
+    {
+      sc = fastpaths[i].scall;
+      fast_handlers[sc] = fastpaths[i].handler ? (int)fastpaths[i].handler :
+	real_handlers[sc];
+      fast_nargs[sc] = fastpaths[i].nargs;
+      fast_rv64[sc] = fastpaths[i].rv64;
+    }
+}
+
 void init_handlers()
 {
   int i;
@@ -956,8 +992,11 @@ void init_handlers()
     for (i=0; i < 256; i++)
       handlers[i] = debug_handlers[i];
   else
-    for (i=0; i < 256; i++)
-      handlers[i] = real_handlers[i];
+    {
+      for (i=0; i < 256; i++)
+	handlers[i] = real_handlers[i];
+      init_fastpath();
+    }
 }
 
 /*
@@ -1008,6 +1047,7 @@ void init_handlers()
   mmapx - ignore extra padding
   __syscallx - special to call the emulated syscall and not the libos one
   interim_lseek - padding and edx
+  fast_lseek - interim_lseek for the fast path, returns the quad itself
   mlock - not supported on libexos
   munlock - not supported on libexos
   undelete - not supported on libexos
@@ -39,6 +39,7 @@
 #define __HANDLER_H
 
 void init_handlers();
+void init_fastpath();
 
 struct reg_storage {
   u_int edi,esi,ebp,esp,ebx,edx,ecx,eax;
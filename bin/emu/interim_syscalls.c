@@ -119,6 +119,12 @@ int interim_lseek(int fildes, int pad, quad_t offset, int whence)
   return ((int*)&res)[0];
 }
 
+/* the same for asm_start's fast path, which passes edx:eax back as is */
+off_t fast_lseek(int fildes, int pad, quad_t offset, int whence)
+{
+  return lseek(fildes,offset,whence);
+}
+
 #define	POLLIN		0x0001
 #define	POLLPRI		0x0002
 #define	POLLOUT		0x0004
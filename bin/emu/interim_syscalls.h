@@ -44,6 +44,7 @@
 int interim___sysctl(int *name, u_int namelen, void *oldp, size_t *oldlenp, 
 		     void *newp, size_t newlen);
 int interim_lseek(int fildes, int pad, quad_t offset, int whence);
+off_t fast_lseek(int fildes, int pad, quad_t offset, int whence);
 int interim_setsockopt(int s, int level, int optname, const void *optval,
 		       int optlen);
 
@@ -0,0 +1,143 @@
+
+/*
+ * Copyright (C) 1997 Massachusetts Institute of Technology 
+ *
+ * This software is being provided by the copyright holders under the
+ * following license. By obtaining, using and/or copying this software,
+ * you agree that you have read, understood, and will comply with the
+ * following terms and conditions:
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose and without fee or royalty is
+ * hereby granted, provided that the full text of this NOTICE appears on
+ * ALL copies of the software and documentation or portions thereof,
+ * including modifications, that you make.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS," AND COPYRIGHT HOLDERS MAKE NO
+ * REPRESENTATIONS OR WARRANTIES, EXPRESS OR IMPLIED. BY WAY OF EXAMPLE,
+ * BUT NOT LIMITATION, COPYRIGHT HOLDERS MAKE NO REPRESENTATIONS OR
+ * WARRANTIES OF MERCHANTABILITY OR FITNESS FOR ANY PARTICULAR PURPOSE OR
+ * THAT THE USE OF THE SOFTWARE OR DOCUMENTATION WILL NOT INFRINGE ANY
+ * THIRD PARTY PATENTS, COPYRIGHTS, TRADEMARKS OR OTHER RIGHTS. COPYRIGHT
+ * HOLDERS WILL BEAR NO LIABILITY FOR ANY USE OF THIS SOFTWARE OR
+ * DOCUMENTATION.
+ *
+ * The name and trademarks of copyright holders may NOT be used in
+ * advertising or publicity pertaining to the software without specific,
+ * written prior permission. Title to copyright in this software and any
+ * associated documentation will at all times remain with copyright
+ * holders. See the file AUTHORS which should have accompanied this software
+ * for a list of all copyright holders.
+ *
+ * This file may be derived from previously copyrighted software. This
+ * copyright applies only to those changes made by the copyright
+ * holders listed in the AUTHORS file. The rest of this file is covered by
+ * the copyright notices, if any, listed below.
+ */
+
+/*
+ * Exec latency.  Each program is forked, exec'ed and waited for ITERS
+ * times, first with text and data mapped from the buffer cache (the
+ * default) and then with NO_DEMAND_LOAD set, which makes exec copy the
+ * whole binary as it used to.  The first run of each program is not
+ * timed so that its blocks are already in the buffer cache.
+ *
+ * usage: execbench [-n iters] [program ...]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#define ITERS 50
+
+static char *defprogs[] = {"/bin/true", "/bin/echo", "/bin/ls", "/bin/sh", 0};
+
+/* run prog once with its output thrown away, return 0 on success */
+static int
+run(char *prog) {
+  char *argv[4];
+  int pid, status;
+
+  argv[0] = prog;
+  argv[1] = NULL;
+  if (!strcmp(prog, "/bin/sh")) {
+    argv[1] = "-c";
+    argv[2] = "true";
+    argv[3] = NULL;
+  }
+
+  if ((pid = fork()) < 0) {
+    perror("fork");
+    exit(-1);
+  }
+  if (pid == 0) {
+    int fd = open("/dev/null", O_WRONLY);
+
+    if (fd >= 0) {
+      dup2(fd, 1);
+      close(fd);
+    }
+    execv(prog, argv);
+    _exit(127);
+  }
+  if (waitpid(pid, &status, 0) != pid)
+    return -1;
+  return (WIFEXITED(status) && WEXITSTATUS(status) == 127) ? -1 : 0;
+}
+
+/* average microseconds per fork+exec+wait of prog */
+static double
+measure(char *prog, int iters) {
+  struct timeval start, end;
+  int i;
+
+  if (run(prog) < 0) {
+    fprintf(stderr, "execbench: could not run %s\n", prog);
+    return -1;
+  }
+  gettimeofday(&start, NULL);
+  for (i = 0; i < iters; i++)
+    run(prog);
+  gettimeofday(&end, NULL);
+
+  return ((end.tv_sec - start.tv_sec) * 1000000.0 +
+	  (end.tv_usec - start.tv_usec)) / iters;
+}
+
+int
+main(int argc, char **argv) {
+  char **progs = defprogs;
+  int iters = ITERS;
+  double shared, copied;
+  int c;
+
+  while ((c = getopt(argc, argv, "n:")) != -1)
+    switch (c) {
+    case 'n':
+      iters = atoi(optarg);
+      break;
+    default:
+      fprintf(stderr, "usage: execbench [-n iters] [program ...]\n");
+      exit(-1);
+    }
+  if (iters <= 0) iters = ITERS;
+  if (optind < argc) progs = argv + optind;
+
+  printf("%-20s %12s %12s\n", "program", "shared(us)", "copied(us)");
+  for (; *progs; progs++) {
+    unsetenv("NO_DEMAND_LOAD");
+    shared = measure(*progs, iters);
+    setenv("NO_DEMAND_LOAD", "1", 1);
+    copied = measure(*progs, iters);
+    unsetenv("NO_DEMAND_LOAD");
+    if (shared < 0 || copied < 0) continue;
+    printf("%-20s %12.1f %12.1f\n", *progs, shared, copied);
+  }
+
+  return 0;
+}
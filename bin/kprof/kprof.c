@@ -0,0 +1,300 @@
+
+/*
+ * Copyright (C) 1997 Massachusetts Institute of Technology 
+ *
+ * This software is being provided by the copyright holders under the
+ * following license. By obtaining, using and/or copying this software,
+ * you agree that you have read, understood, and will comply with the
+ * following terms and conditions:
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose and without fee or royalty is
+ * hereby granted, provided that the full text of this NOTICE appears on
+ * ALL copies of the software and documentation or portions thereof,
+ * including modifications, that you make.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS," AND COPYRIGHT HOLDERS MAKE NO
+ * REPRESENTATIONS OR WARRANTIES, EXPRESS OR IMPLIED. BY WAY OF EXAMPLE,
+ * BUT NOT LIMITATION, COPYRIGHT HOLDERS MAKE NO REPRESENTATIONS OR
+ * WARRANTIES OF MERCHANTABILITY OR FITNESS FOR ANY PARTICULAR PURPOSE OR
+ * THAT THE USE OF THE SOFTWARE OR DOCUMENTATION WILL NOT INFRINGE ANY
+ * THIRD PARTY PATENTS, COPYRIGHTS, TRADEMARKS OR OTHER RIGHTS. COPYRIGHT
+ * HOLDERS WILL BEAR NO LIABILITY FOR ANY USE OF THIS SOFTWARE OR
+ * DOCUMENTATION.
+ *
+ * The name and trademarks of copyright holders may NOT be used in
+ * advertising or publicity pertaining to the software without specific,
+ * written prior permission. Title to copyright in this software and any
+ * associated documentation will at all times remain with copyright
+ * holders. See the file AUTHORS which should have accompanied this software
+ * for a list of all copyright holders.
+ *
+ * This file may be derived from previously copyrighted software. This
+ * copyright applies only to those changes made by the copyright
+ * holders listed in the AUTHORS file. The rest of this file is covered by
+ * the copyright notices, if any, listed below.
+ */
+
+/*
+ * Statistical profiler for the kernel and everything running on it.
+ * Samples the interrupted eip on every cpu, either at each clock tick
+ * or every so many events of a P6 performance counter (see sys_prof_ctl
+ * in xok/pctr.h), then attributes the samples to functions in the
+ * kernel, the shared library OS and each program using symlookup.
+ */
+
+#include <xok/sys_ucall.h>
+#include <xok/sysinfo.h>
+#include <xok/pctr.h>
+#include <xok/env.h>
+#include <xok/mmu.h>
+#include <exos/cap.h>
+#include <exos/vm-layout.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+extern char* symlookup(char *fname, u_int val);
+
+#define MAXIMAGES 64
+#define LIBEXOS "/usr/lib/libexos.so"
+
+struct sample {
+  u_int eip;
+  int image;			/* index into images, -1 if unknown */
+  char *sym;
+};
+
+static char *images[MAXIMAGES];
+static int nimages;
+
+static struct sample *samples;
+static int nsamples, maxsamples;
+
+static struct func {
+  int image;
+  char *sym;
+  int count;
+} *funcs;
+static int nfuncs;
+
+static void
+usage(void) {
+  extern char *__progname;
+  fprintf(stderr, "Usage: %s [-e event] [-c period] [-s seconds] "
+	  "[-k kernel] [-n count] [-l]\n", __progname);
+  fprintf(stderr, "-e  sample on P6 counter 0 events (event select and unit "
+	  "mask, in hex)\n    instead of clock ticks\n");
+  fprintf(stderr, "-c  events between samples (default 100000)\n");
+  fprintf(stderr, "-s  how long to profile for (default 10 seconds)\n");
+  fprintf(stderr, "-k  kernel image with symbols, such as xok.gdb\n");
+  fprintf(stderr, "-n  show the count hottest functions (default 30)\n");
+  fprintf(stderr, "-l  break functions down by source line\n");
+  exit(1);
+}
+
+static int
+image(char *name) {
+  int i;
+
+  for (i = 0; i < nimages; i++)
+    if (!strcmp(images[i], name)) return i;
+  if (nimages == MAXIMAGES) return -1;
+  images[nimages] = strdup(name);
+  return nimages++;
+}
+
+/* which image the eip sampled in envid belongs to */
+static int
+classify(u_int eip, u_int envid, char *kernel) {
+  static u_int lastenv = 0;
+  static int lastimage = -1;
+  struct Uenv cu;
+
+  if (eip >= ULIM)
+    return kernel ? image(kernel) : -1;
+  if (eip >= SHARED_LIBRARY_START && eip < SHARED_LIBRARY_START + 0x10000000)
+    return image(LIBEXOS);
+  if (envid == 0) return -1;
+  if (envid != lastenv) {
+    lastenv = envid;
+    lastimage = -1;
+    if (sys_rdu(CAP_ROOT, envid, &cu) >= 0 && cu.name[0])
+      lastimage = image((char *)cu.name);
+  }
+  return lastimage;
+}
+
+static void
+collect(void) {
+  static struct prof_sample ps[PROF_NSAMPLES];
+  int cpu, i, n;
+
+  for (cpu = 0; cpu < sys_get_num_cpus(); cpu++)
+    do {
+      n = sys_prof_read(CAP_ROOT, cpu, ps, PROF_NSAMPLES);
+      if (n <= 0) break;
+      if (nsamples + n > maxsamples) {
+	maxsamples = maxsamples ? maxsamples * 2 : 8 * PROF_NSAMPLES;
+	samples = realloc(samples, maxsamples * sizeof(*samples));
+	if (!samples) {
+	  fprintf(stderr, "out of memory\n");
+	  sys_prof_ctl(CAP_ROOT, PROF_STOP, 0, 0);
+	  exit(1);
+	}
+      }
+      /* keep the envid in image until classify() */
+      for (i = 0; i < n; i++) {
+	samples[nsamples].eip = ps[i].ps_eip;
+	samples[nsamples].image = (int)ps[i].ps_envid;
+	nsamples++;
+      }
+    } while (n == PROF_NSAMPLES);
+}
+
+static int
+bysample(const void *a, const void *b) {
+  const struct sample *sa = a, *sb = b;
+
+  if (sa->image != sb->image) return sa->image - sb->image;
+  if (sa->eip < sb->eip) return -1;
+  return sa->eip > sb->eip;
+}
+
+static int
+byfunc(const void *a, const void *b) {
+  const struct func *fa = a, *fb = b;
+
+  if (fa->image != fb->image) return fa->image - fb->image;
+  if (fa->sym == fb->sym) return 0;
+  if (!fa->sym) return -1;
+  if (!fb->sym) return 1;
+  return strcmp(fa->sym, fb->sym);
+}
+
+static int
+bycount(const void *a, const void *b) {
+  return ((const struct func *)b)->count - ((const struct func *)a)->count;
+}
+
+int
+main(int argc, char **argv) {
+  u_int event = 0, period = 100000;
+  int secs = 10, count = 30, lflag = 0;
+  char *kernel = NULL;
+  int ch, i, r, lost, unknown = 0;
+  u_quad_t end;
+
+  while ((ch = getopt(argc, argv, "e:c:s:k:n:l")) != -1)
+    switch (ch) {
+    case 'e':
+      event = strtoul(optarg, NULL, 16);
+      break;
+    case 'c':
+      period = atoi(optarg);
+      break;
+    case 's':
+      secs = atoi(optarg);
+      break;
+    case 'k':
+      kernel = optarg;
+      break;
+    case 'n':
+      count = atoi(optarg);
+      break;
+    case 'l':
+      lflag = 1;
+      break;
+    default:
+      usage();
+    }
+
+  r = event ? sys_prof_ctl(CAP_ROOT, PROF_PCTR, event, period)
+    : sys_prof_ctl(CAP_ROOT, PROF_TIMER, 0, 0);
+  if (r < 0) {
+    fprintf(stderr, "sys_prof_ctl: %d%s\n", r,
+	    event ? " (counter sampling needs a P6 and an SMP kernel)" : "");
+    return 1;
+  }
+
+  end = __sysinfo.si_system_ticks +
+    (u_quad_t)secs * 1000000 / __sysinfo.si_rate;
+  while (__sysinfo.si_system_ticks < end) {
+    collect();
+    usleep(100000);
+  }
+  lost = sys_prof_ctl(CAP_ROOT, PROF_STOP, 0, 0);
+  collect();
+
+  if (nsamples == 0) {
+    printf("no samples\n");
+    return 0;
+  }
+
+  for (i = 0; i < nsamples; i++)
+    samples[i].image = classify(samples[i].eip, (u_int)samples[i].image,
+				kernel);
+
+  /* symlookup only caches one image, so do them an image at a time */
+  qsort(samples, nsamples, sizeof(*samples), bysample);
+  for (i = 0; i < nsamples; i++) {
+    char *s, *colon;
+
+    samples[i].sym = NULL;
+    if (samples[i].image < 0) {
+      unknown++;
+      continue;
+    }
+    if (i > 0 && samples[i].image == samples[i-1].image &&
+	samples[i].eip == samples[i-1].eip) {
+      samples[i].sym = samples[i-1].sym;
+      continue;
+    }
+    s = symlookup(images[samples[i].image], samples[i].eip);
+    if (!s) continue;
+    if (!lflag && (colon = strchr(s, ':'))) *colon = 0;
+    if (i > 0 && samples[i-1].sym && samples[i].image == samples[i-1].image &&
+	!strcmp(s, samples[i-1].sym))
+      samples[i].sym = samples[i-1].sym;
+    else
+      samples[i].sym = strdup(s);
+  }
+
+  /* samples are sorted by address, so a function's samples are together */
+  funcs = malloc(nsamples * sizeof(*funcs));
+  if (!funcs) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  for (i = 0; i < nsamples; i++) {
+    if (samples[i].image < 0) continue;
+    if (nfuncs > 0 && funcs[nfuncs-1].image == samples[i].image &&
+	funcs[nfuncs-1].sym == samples[i].sym) {
+      funcs[nfuncs-1].count++;
+      continue;
+    }
+    funcs[nfuncs].image = samples[i].image;
+    funcs[nfuncs].sym = samples[i].sym;
+    funcs[nfuncs].count = 1;
+    nfuncs++;
+  }
+  qsort(funcs, nfuncs, sizeof(*funcs), byfunc);
+  for (i = 1, r = 0; i < nfuncs; i++)
+    if (byfunc(&funcs[r], &funcs[i]) == 0)
+      funcs[r].count += funcs[i].count;
+    else
+      funcs[++r] = funcs[i];
+  if (nfuncs) nfuncs = r + 1;
+  qsort(funcs, nfuncs, sizeof(*funcs), bycount);
+
+  printf("%d samples, %d dropped, %d outside known images\n", nsamples, lost,
+	 unknown);
+  printf("%7s %5s  %-24s %s\n", "samples", "%", "image", "function");
+  for (i = 0; i < nfuncs && i < count; i++)
+    printf("%7d %5d  %-24s %s\n", funcs[i].count,
+	   funcs[i].count * 100 / nsamples, images[funcs[i].image],
+	   funcs[i].sym ? funcs[i].sym : "?");
+  return 0;
+}
@@ -0,0 +1,134 @@
+
+/*
+ * Copyright (C) 1997 Massachusetts Institute of Technology 
+ *
+ * This software is being provided by the copyright holders under the
+ * following license. By obtaining, using and/or copying this software,
+ * you agree that you have read, understood, and will comply with the
+ * following terms and conditions:
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose and without fee or royalty is
+ * hereby granted, provided that the full text of this NOTICE appears on
+ * ALL copies of the software and documentation or portions thereof,
+ * including modifications, that you make.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS," AND COPYRIGHT HOLDERS MAKE NO
+ * REPRESENTATIONS OR WARRANTIES, EXPRESS OR IMPLIED. BY WAY OF EXAMPLE,
+ * BUT NOT LIMITATION, COPYRIGHT HOLDERS MAKE NO REPRESENTATIONS OR
+ * WARRANTIES OF MERCHANTABILITY OR FITNESS FOR ANY PARTICULAR PURPOSE OR
+ * THAT THE USE OF THE SOFTWARE OR DOCUMENTATION WILL NOT INFRINGE ANY
+ * THIRD PARTY PATENTS, COPYRIGHTS, TRADEMARKS OR OTHER RIGHTS. COPYRIGHT
+ * HOLDERS WILL BEAR NO LIABILITY FOR ANY USE OF THIS SOFTWARE OR
+ * DOCUMENTATION.
+ *
+ * The name and trademarks of copyright holders may NOT be used in
+ * advertising or publicity pertaining to the software without specific,
+ * written prior permission. Title to copyright in this software and any
+ * associated documentation will at all times remain with copyright
+ * holders. See the file AUTHORS which should have accompanied this software
+ * for a list of all copyright holders.
+ *
+ * This file may be derived from previously copyrighted software. This
+ * copyright applies only to those changes made by the copyright
+ * holders listed in the AUTHORS file. The rest of this file is covered by
+ * the copyright notices, if any, listed below.
+
+/*
+ * Large reads over NFS.  Each file is read from start to end with
+ * read()s of bsize bytes (8K by default, which the NFS client turns
+ * into 8K READ calls whose replies arrive as IP fragments), and the
+ * throughput is printed along with what the kernel's IP reassembly
+ * (si_ipfrag in sysinfo) did meanwhile.  The first pass over a file
+ * goes to the server; later passes (-n) show the client's cache.
+ *
+ * usage: nfsbench [-b bsize] [-n passes] file ...
+ */
+
+#include <xok/sysinfo.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/time.h>
+
+#define BSIZE 8192
+
+static void
+usage(void) {
+  fprintf(stderr, "usage: nfsbench [-b bsize] [-n passes] file ...\n");
+  exit(-1);
+}
+
+/* read file once, return the number of bytes read or -1 */
+static long
+readall(char *file, char *buf, int bsize) {
+  long total = 0;
+  int fd, n;
+
+  if ((fd = open(file, O_RDONLY)) < 0) {
+    perror(file);
+    return -1;
+  }
+  while ((n = read(fd, buf, bsize)) > 0)
+    total += n;
+  if (n < 0) {
+    perror(file);
+    total = -1;
+  }
+  close(fd);
+  return total;
+}
+
+int
+main(int argc, char **argv) {
+  struct ipfrag_stats before, after;
+  struct timeval start, end;
+  int bsize = BSIZE, passes = 1;
+  double usec;
+  long bytes;
+  char *buf;
+  int c, i;
+
+  while ((c = getopt(argc, argv, "b:n:")) != -1)
+    switch (c) {
+    case 'b':
+      bsize = atoi(optarg);
+      break;
+    case 'n':
+      passes = atoi(optarg);
+      break;
+    default:
+      usage();
+    }
+  if (optind == argc || bsize <= 0 || passes <= 0) usage();
+  if (!(buf = malloc(bsize))) {
+    fprintf(stderr, "nfsbench: out of memory\n");
+    exit(-1);
+  }
+
+  printf("%-24s %4s %10s %10s %10s %8s %8s\n", "file", "pass", "bytes",
+	 "KB/s", "frags", "dgrams", "dropped");
+  for (; optind < argc; optind++)
+    for (i = 0; i < passes; i++) {
+      before = __sysinfo.si_ipfrag;
+      gettimeofday(&start, NULL);
+      bytes = readall(argv[optind], buf, bsize);
+      gettimeofday(&end, NULL);
+      after = __sysinfo.si_ipfrag;
+      if (bytes < 0) break;
+
+      usec = (end.tv_sec - start.tv_sec) * 1000000.0 +
+	(end.tv_usec - start.tv_usec);
+      printf("%-24s %4d %10ld %10.1f %10qu %8qu %8qu\n", argv[optind], i,
+	     bytes, usec > 0 ? bytes / 1.024 / usec * 1000 : 0.0,
+	     after.is_frags - before.is_frags,
+	     after.is_delivered - before.is_delivered,
+	     (after.is_dropped - before.is_dropped) +
+	     (after.is_timeouts - before.is_timeouts) +
+	     (after.is_evicted - before.is_evicted));
+    }
+
+  return 0;
+}
@@ -0,0 +1,180 @@
+
+/*
+ * Copyright (C) 1997 Massachusetts Institute of Technology 
+ *
+ * This software is being provided by the copyright holders under the
+ * following license. By obtaining, using and/or copying this software,
+ * you agree that you have read, understood, and will comply with the
+ * following terms and conditions:
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose and without fee or royalty is
+ * hereby granted, provided that the full text of this NOTICE appears on
+ * ALL copies of the software and documentation or portions thereof,
+ * including modifications, that you make.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS," AND COPYRIGHT HOLDERS MAKE NO
+ * REPRESENTATIONS OR WARRANTIES, EXPRESS OR IMPLIED. BY WAY OF EXAMPLE,
+ * BUT NOT LIMITATION, COPYRIGHT HOLDERS MAKE NO REPRESENTATIONS OR
+ * WARRANTIES OF MERCHANTABILITY OR FITNESS FOR ANY PARTICULAR PURPOSE OR
+ * THAT THE USE OF THE SOFTWARE OR DOCUMENTATION WILL NOT INFRINGE ANY
+ * THIRD PARTY PATENTS, COPYRIGHTS, TRADEMARKS OR OTHER RIGHTS. COPYRIGHT
+ * HOLDERS WILL BEAR NO LIABILITY FOR ANY USE OF THIS SOFTWARE OR
+ * DOCUMENTATION.
+ *
+ * The name and trademarks of copyright holders may NOT be used in
+ * advertising or publicity pertaining to the software without specific,
+ * written prior permission. Title to copyright in this software and any
+ * associated documentation will at all times remain with copyright
+ * holders. See the file AUTHORS which should have accompanied this software
+ * for a list of all copyright holders.
+ *
+ * This file may be derived from previously copyrighted software. This
+ * copyright applies only to those changes made by the copyright
+ * holders listed in the AUTHORS file. The rest of this file is covered by
+ * the copyright notices, if any, listed below.
+ */
+
+/*
+ * Pipe throughput.  A child writes TOTAL bytes down a pipe in chunks of
+ * each size below and the parent reads them back.  Page aligned chunks
+ * of two pages or more are loaned to the reader rather than copied;
+ * the "unaligned" runs are the same sizes forced down the copy path.
+ * The first pass over each size also rewrites the buffer between writes
+ * and checks what comes out, to make sure loaned pages are copied when
+ * the writer reuses them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#define TOTAL   (8 * 1024 * 1024)
+#define MAXCHUNK (256 * 1024)
+#define NBPG    4096
+
+static int sizes[] = {64, 512, 4096, 16 * 1024, 64 * 1024, 256 * 1024, 0};
+
+static char *
+page_alloc(int n) {
+  char *p = malloc(n + 2 * NBPG);
+
+  if (p == NULL) {
+    perror("malloc");
+    exit(-1);
+  }
+  return (char *)(((unsigned)p + NBPG - 1) & ~(NBPG - 1));
+}
+
+static void
+fill(char *buf, int n, int seq) {
+  int i;
+
+  for (i = 0; i < n; i++)
+    buf[i] = (i + seq) % 251;
+}
+
+/* write total bytes in chunks of size; rewrite the buffer each time if
+   verify */
+static void
+writer(int fd, char *buf, int size, int verify) {
+  int left, n, r, seq = 0;
+
+  fill(buf, size, seq);
+  for (left = TOTAL; left > 0; left -= n) {
+    n = left < size ? left : size;
+    if (verify)
+      fill(buf, n, seq++);
+    if ((r = write(fd, buf, n)) != n) {
+      printf("write returned %d, wanted %d\n", r, n);
+      exit(-1);
+    }
+  }
+}
+
+/* read total bytes; when verifying, chunks are known to be whole writes
+   so check each one against what the writer put in it */
+static int
+reader(int fd, char *buf, int size, int verify) {
+  int got = 0, n, i, seq = 0, off = 0;
+
+  while (got < TOTAL) {
+    if ((n = read(fd, buf, size)) <= 0) {
+      printf("read returned %d after %d bytes\n", n, got);
+      return -1;
+    }
+    if (verify) {
+      for (i = 0; i < n; i++, off++) {
+	if (off == size) {
+	  off = 0;
+	  seq++;
+	}
+	if (buf[i] != (char)((off + seq) % 251)) {
+	  printf("bad byte at %d: read %d wanted %d\n",
+		 got + i, buf[i], (off + seq) % 251);
+	  return -1;
+	}
+      }
+    }
+    got += n;
+  }
+  return 0;
+}
+
+static int
+run(int size, int misalign, int verify) {
+  int fd[2];
+  int pid, status, r;
+  char *wbuf, *rbuf;
+  struct timeval s, t;
+  long usec;
+
+  if (pipe(fd) < 0) {
+    perror("pipe");
+    exit(-1);
+  }
+
+  gettimeofday(&s, NULL);
+  if ((pid = fork()) == 0) {
+    close(fd[0]);
+    wbuf = page_alloc(size) + misalign;
+    writer(fd[1], wbuf, size, verify);
+    close(fd[1]);
+    exit(0);
+  }
+  close(fd[1]);
+  rbuf = page_alloc(MAXCHUNK);
+  r = reader(fd[0], rbuf, size, verify);
+  close(fd[0]);
+  waitpid(pid, &status, 0);
+  gettimeofday(&t, NULL);
+
+  if (!verify) {
+    usec = (t.tv_sec - s.tv_sec) * 1000000 + t.tv_usec - s.tv_usec;
+    printf("%7d bytes%s: %d bytes in %ld usec, %ld KB/s\n", size,
+	   misalign ? " unaligned" : "", TOTAL, usec,
+	   usec ? (long)((double)TOTAL / 1024 * 1000000 / usec) : 0);
+  }
+  return r;
+}
+
+int
+main(int argc, char **argv) {
+  int i;
+
+  printf("PIPE THROUGHPUT\n");
+  for (i = 0; sizes[i]; i++) {
+    if (run(sizes[i], 0, 1) < 0) {
+      printf("FAILED\n");
+      return -1;
+    }
+    run(sizes[i], 0, 0);
+    if (sizes[i] >= 2 * NBPG)
+      run(sizes[i], 1, 0);
+  }
+  printf("DONE\n");
+  return 0;
+}
@@ -0,0 +1,154 @@
+
+/*
+ * Copyright (C) 1997 Massachusetts Institute of Technology 
+ *
+ * This software is being provided by the copyright holders under the
+ * following license. By obtaining, using and/or copying this software,
+ * you agree that you have read, understood, and will comply with the
+ * following terms and conditions:
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose and without fee or royalty is
+ * hereby granted, provided that the full text of this NOTICE appears on
+ * ALL copies of the software and documentation or portions thereof,
+ * including modifications, that you make.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS," AND COPYRIGHT HOLDERS MAKE NO
+ * REPRESENTATIONS OR WARRANTIES, EXPRESS OR IMPLIED. BY WAY OF EXAMPLE,
+ * BUT NOT LIMITATION, COPYRIGHT HOLDERS MAKE NO REPRESENTATIONS OR
+ * WARRANTIES OF MERCHANTABILITY OR FITNESS FOR ANY PARTICULAR PURPOSE OR
+ * THAT THE USE OF THE SOFTWARE OR DOCUMENTATION WILL NOT INFRINGE ANY
+ * THIRD PARTY PATENTS, COPYRIGHTS, TRADEMARKS OR OTHER RIGHTS. COPYRIGHT
+ * HOLDERS WILL BEAR NO LIABILITY FOR ANY USE OF THIS SOFTWARE OR
+ * DOCUMENTATION.
+ *
+ * The name and trademarks of copyright holders may NOT be used in
+ * advertising or publicity pertaining to the software without specific,
+ * written prior permission. Title to copyright in this software and any
+ * associated documentation will at all times remain with copyright
+ * holders. See the file AUTHORS which should have accompanied this software
+ * for a list of all copyright holders.
+ *
+ * This file may be derived from previously copyrighted software. This
+ * copyright applies only to those changes made by the copyright
+ * holders listed in the AUTHORS file. The rest of this file is covered by
+ * the copyright notices, if any, listed below.
+ */
+
+/*
+ * Shell pipeline startup.  Runs "sh -c pipeline" n times, with the
+ * output thrown away, and prints the average time from fork to the
+ * shell's exit; every process in the pipeline registers with procd,
+ * looks itself up and is waited for.  It then times the lookups that
+ * read procd's table (getpid, getppid, getpgrp, pid2envid and
+ * envid2pid) on their own.
+ *
+ * usage: pipebench [-n runs] [-l lookups] [pipeline]
+ */
+
+#include <exos/osdecl.h>
+#include <exos/process.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#define PIPELINE "echo hello | cat | cat | wc -c"
+
+static volatile int sink;	/* keeps the lookup loops from going away */
+
+static void
+usage(void) {
+  fprintf(stderr, "usage: pipebench [-n runs] [-l lookups] [pipeline]\n");
+  exit(-1);
+}
+
+static double
+elapsed(struct timeval *start, struct timeval *end) {
+  return (end->tv_sec - start->tv_sec) * 1000000.0 +
+    (end->tv_usec - start->tv_usec);
+}
+
+/* run the pipeline once, return microseconds taken or -1 */
+static double
+runpipe(char *pipeline) {
+  struct timeval start, end;
+  int pid, status, fd;
+
+  gettimeofday(&start, NULL);
+  if ((pid = fork()) < 0) {
+    perror("fork");
+    return -1;
+  }
+  if (pid == 0) {
+    if ((fd = open("/dev/null", O_WRONLY)) >= 0) {
+      dup2(fd, 1);
+      close(fd);
+    }
+    execl("/bin/sh", "sh", "-c", pipeline, (char *)NULL);
+    perror("/bin/sh");
+    _exit(-1);
+  }
+  if (waitpid(pid, &status, 0) != pid) {
+    perror("waitpid");
+    return -1;
+  }
+  gettimeofday(&end, NULL);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    fprintf(stderr, "pipebench: pipeline failed (status 0x%x)\n", status);
+    return -1;
+  }
+  return elapsed(&start, &end);
+}
+
+int
+main(int argc, char **argv) {
+  struct timeval start, end;
+  int runs = 20, lookups = 10000;
+  char *pipeline = PIPELINE;
+  double usec, total, best = 0;
+  pid_t pid;
+  int c, i;
+
+  while ((c = getopt(argc, argv, "l:n:")) != -1)
+    switch (c) {
+    case 'l':
+      lookups = atoi(optarg);
+      break;
+    case 'n':
+      runs = atoi(optarg);
+      break;
+    default:
+      usage();
+    }
+  if (optind < argc - 1 || runs <= 0 || lookups <= 0) usage();
+  if (optind < argc) pipeline = argv[optind];
+
+  /* the first run also pages in the binaries, so it is not counted */
+  if (runpipe(pipeline) < 0) exit(-1);
+  for (i = 0, total = 0; i < runs; i++) {
+    if ((usec = runpipe(pipeline)) < 0) exit(-1);
+    total += usec;
+    if (i == 0 || usec < best) best = usec;
+  }
+  printf("\"%s\": %d runs, %.0f usec avg, %.0f usec best\n", pipeline, runs,
+	 total / runs, best);
+
+  pid = getpid();
+#define TIMEIT(name, expr) \
+  gettimeofday(&start, NULL); \
+  for (i = 0; i < lookups; i++) sink += (expr); \
+  gettimeofday(&end, NULL); \
+  printf("%-12s %8.2f usec\n", name, elapsed(&start, &end) / lookups)
+
+  TIMEIT("getpid", getpid());
+  TIMEIT("getppid", getppid());
+  TIMEIT("getpgrp", getpgrp());
+  TIMEIT("pid2envid", pid2envid(pid));
+  TIMEIT("envid2pid", envid2pid(__envid));
+
+  return 0;
+}
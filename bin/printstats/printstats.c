@@ -170,6 +170,8 @@ void standard_stats(void) {
       struct network *xoknet = &__sysinfo.si_networks[i];
       printf ("%s:  %qd xmits and %qd rcvs (%qd discarded, %d+%d I/O errs)\n", xoknet->cardname, xoknet->xmits, xoknet->rcvs, xoknet->discards, xoknet->inerrs, xoknet->outerrs);
       printf ("           %qd interrupts (%qd for rcvs, %qd for xmits, %qd other)\n", xoknet->intrs, xoknet->rxintrs, xoknet->txintrs, xoknet->otherintrs);
+      if (xoknet->rxintrs)
+	 printf ("           %qd rcvs in interrupts, %qd in %qd polls (%qd per rcv interrupt)\n", xoknet->rxintrpkts, xoknet->rxpolled, xoknet->rxpolls, (xoknet->rxintrpkts + xoknet->rxpolled) / xoknet->rxintrs);
    }
    printf ("\n");
 
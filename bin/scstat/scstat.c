@@ -0,0 +1,181 @@
+
+/*
+ * Copyright (C) 1997 Massachusetts Institute of Technology 
+ *
+ * This software is being provided by the copyright holders under the
+ * following license. By obtaining, using and/or copying this software,
+ * you agree that you have read, understood, and will comply with the
+ * following terms and conditions:
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose and without fee or royalty is
+ * hereby granted, provided that the full text of this NOTICE appears on
+ * ALL copies of the software and documentation or portions thereof,
+ * including modifications, that you make.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS," AND COPYRIGHT HOLDERS MAKE NO
+ * REPRESENTATIONS OR WARRANTIES, EXPRESS OR IMPLIED. BY WAY OF EXAMPLE,
+ * BUT NOT LIMITATION, COPYRIGHT HOLDERS MAKE NO REPRESENTATIONS OR
+ * WARRANTIES OF MERCHANTABILITY OR FITNESS FOR ANY PARTICULAR PURPOSE OR
+ * THAT THE USE OF THE SOFTWARE OR DOCUMENTATION WILL NOT INFRINGE ANY
+ * THIRD PARTY PATENTS, COPYRIGHTS, TRADEMARKS OR OTHER RIGHTS. COPYRIGHT
+ * HOLDERS WILL BEAR NO LIABILITY FOR ANY USE OF THIS SOFTWARE OR
+ * DOCUMENTATION.
+ *
+ * The name and trademarks of copyright holders may NOT be used in
+ * advertising or publicity pertaining to the software without specific,
+ * written prior permission. Title to copyright in this software and any
+ * associated documentation will at all times remain with copyright
+ * holders. See the file AUTHORS which should have accompanied this software
+ * for a list of all copyright holders.
+ *
+ * This file may be derived from previously copyrighted software. This
+ * copyright applies only to those changes made by the copyright
+ * holders listed in the AUTHORS file. The rest of this file is covered by
+ * the copyright notices, if any, listed below.
+ */
+
+/*
+ * Show the kernel's per-syscall counts and cycle histograms (si_scstats
+ * in sysinfo), busiest syscalls first, and turn their collection on and
+ * off.
+ */
+
+#include <xok/sys_ucall.h>
+#include <xok/sysinfo.h>
+#include <xok/kerncallstr.h>
+#include <exos/cap.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static void
+usage(void) {
+  extern char *__progname;
+  fprintf(stderr, "Usage: %s [-edz] [-ch] [-n count]\n", __progname);
+  fprintf(stderr, "-e  start keeping syscall statistics\n");
+  fprintf(stderr, "-d  stop keeping syscall statistics\n");
+  fprintf(stderr, "-z  zero the statistics\n");
+  fprintf(stderr, "-c  show each CPU separately\n");
+  fprintf(stderr, "-h  show cycle histograms\n");
+  fprintf(stderr, "-n  only show the count busiest syscalls (default 20)\n");
+  exit(1);
+}
+
+/* add up syscall sn over the cpus in [lo, hi) */
+static void
+sum(struct scstat *ss, int sn, int lo, int hi) {
+  struct scstat *s;
+  int i, b;
+
+  bzero(ss, sizeof(*ss));
+  for (i = lo; i < hi; i++) {
+    s = &__sysinfo.si_scstats[i].sc_sys[sn];
+    ss->ss_count += s->ss_count;
+    ss->ss_cycles += s->ss_cycles;
+    if (s->ss_max > ss->ss_max) ss->ss_max = s->ss_max;
+    for (b = 0; b < SC_NBUCKETS; b++)
+      ss->ss_hist[b] += s->ss_hist[b];
+  }
+}
+
+static void
+show(int lo, int hi, int count, int hflag) {
+  static struct scstat ss[SC_NSYSCALLS];
+  int order[SC_NSYSCALLS];
+  u_int mhz = __sysinfo.si_mhz ? __sysinfo.si_mhz : 1;
+  unsigned long long total = 0;
+  int i, j, t, b, n = 0;
+  char *name;
+
+  for (i = 0; i < SC_NSYSCALLS; i++) {
+    sum(&ss[i], i, lo, hi);
+    total += ss[i].ss_cycles;
+    if (ss[i].ss_count) order[n++] = i;
+  }
+
+  /* busiest first */
+  for (i = 1; i < n; i++)
+    for (j = i; j > 0 && ss[order[j]].ss_cycles > ss[order[j-1]].ss_cycles;
+	 j--) {
+      t = order[j]; order[j] = order[j-1]; order[j-1] = t;
+    }
+
+  printf("%-20s %10s %10s %8s %8s %5s\n", "syscall", "calls", "usec",
+	 "mean", "max", "%");
+  for (i = 0; i < n && i < count; i++) {
+    struct scstat *s = &ss[order[i]];
+
+    name = kerncallstr(order[i]);
+    printf("%-15s 0x%02x %10u %10qu %8qu %8u %5qu\n", name ? name : "?",
+	   order[i], s->ss_count, s->ss_cycles / mhz,
+	   s->ss_cycles / s->ss_count, s->ss_max,
+	   total ? s->ss_cycles * 100 / total : 0);
+    if (!hflag) continue;
+    for (b = 0; b < SC_NBUCKETS; b++) {
+      if (s->ss_hist[b] == 0) continue;
+      if (b < SC_NBUCKETS - 1)
+	printf("    < %7u cycles: %u\n", 1 << (SC_BUCKET0 + b), s->ss_hist[b]);
+      else
+	printf("   >= %7u cycles: %u\n", 1 << (SC_BUCKET0 + b - 1),
+	       s->ss_hist[b]);
+    }
+  }
+  printf("total %qu usec in syscalls\n", total / mhz);
+}
+
+int
+main(int argc, char **argv) {
+  int ch, i, ncpus;
+  int cflag = 0, hflag = 0, count = 20;
+  int ctl = -1;
+
+  while ((ch = getopt(argc, argv, "edzchn:")) != -1)
+    switch (ch) {
+    case 'e':
+      if (ctl < 0) ctl = __sysinfo.si_scstat_enabled ? SCSTAT_ENABLE : 0;
+      ctl |= SCSTAT_ENABLE;
+      break;
+    case 'd':
+      if (ctl < 0) ctl = __sysinfo.si_scstat_enabled ? SCSTAT_ENABLE : 0;
+      ctl &= ~SCSTAT_ENABLE;
+      break;
+    case 'z':
+      if (ctl < 0) ctl = __sysinfo.si_scstat_enabled ? SCSTAT_ENABLE : 0;
+      ctl |= SCSTAT_RESET;
+      break;
+    case 'c':
+      cflag = 1;
+      break;
+    case 'h':
+      hflag = 1;
+      break;
+    case 'n':
+      count = atoi(optarg);
+      break;
+    default:
+      usage();
+    }
+
+  if (ctl >= 0) {
+    int r = sys_scstat_ctl(CAP_ROOT, ctl);
+    if (r < 0) {
+      fprintf(stderr, "sys_scstat_ctl: %d\n", r);
+      return 1;
+    }
+    return 0;
+  }
+
+  if (!__sysinfo.si_scstat_enabled)
+    printf("(syscall statistics are off, turn them on with -e)\n");
+  ncpus = sys_get_num_cpus();
+  if (!cflag)
+    show(0, ncpus, count, hflag);
+  else
+    for (i = 0; i < ncpus; i++) {
+      printf("cpu %d:\n", i);
+      show(i, i + 1, count, hflag);
+    }
+  return 0;
+}
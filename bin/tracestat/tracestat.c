@@ -0,0 +1,298 @@
+
+/*
+ * Copyright (C) 1997 Massachusetts Institute of Technology 
+ *
+ * This software is being provided by the copyright holders under the
+ * following license. By obtaining, using and/or copying this software,
+ * you agree that you have read, understood, and will comply with the
+ * following terms and conditions:
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose and without fee or royalty is
+ * hereby granted, provided that the full text of this NOTICE appears on
+ * ALL copies of the software and documentation or portions thereof,
+ * including modifications, that you make.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS," AND COPYRIGHT HOLDERS MAKE NO
+ * REPRESENTATIONS OR WARRANTIES, EXPRESS OR IMPLIED. BY WAY OF EXAMPLE,
+ * BUT NOT LIMITATION, COPYRIGHT HOLDERS MAKE NO REPRESENTATIONS OR
+ * WARRANTIES OF MERCHANTABILITY OR FITNESS FOR ANY PARTICULAR PURPOSE OR
+ * THAT THE USE OF THE SOFTWARE OR DOCUMENTATION WILL NOT INFRINGE ANY
+ * THIRD PARTY PATENTS, COPYRIGHTS, TRADEMARKS OR OTHER RIGHTS. COPYRIGHT
+ * HOLDERS WILL BEAR NO LIABILITY FOR ANY USE OF THIS SOFTWARE OR
+ * DOCUMENTATION.
+ *
+ * The name and trademarks of copyright holders may NOT be used in
+ * advertising or publicity pertaining to the software without specific,
+ * written prior permission. Title to copyright in this software and any
+ * associated documentation will at all times remain with copyright
+ * holders. See the file AUTHORS which should have accompanied this software
+ * for a list of all copyright holders.
+ *
+ * This file may be derived from previously copyrighted software. This
+ * copyright applies only to those changes made by the copyright
+ * holders listed in the AUTHORS file. The rest of this file is covered by
+ * the copyright notices, if any, listed below.
+ */
+
+/*
+ * Turn on kernel event tracing for a while and decode the per-CPU trace
+ * rings (see xok/trace.h) into counts and latency histograms: syscall
+ * latency, traps, how long envs run between context switches, packet
+ * classification time and disk request latency.  -r prints the events
+ * themselves instead.
+ */
+
+#include <xok/sys_ucall.h>
+#include <xok/sysinfo.h>
+#include <xok/trace.h>
+#include <exos/cap.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NBUCKETS 32		/* log2 of cycles */
+#define NSYSCALLS 256
+#define NTRAPS 256
+#define NPENDING 64		/* disk requests in flight we keep track of */
+
+struct hist {
+  u_quad_t count;
+  u_quad_t total;
+  u_quad_t max;
+  u_quad_t bucket[NBUCKETS];
+};
+
+static struct hist sys_hist, switch_hist, classify_hist, disk_hist;
+static struct hist sc_hist[NSYSCALLS];
+static u_quad_t trap_count[NTRAPS];
+static u_quad_t events, lost, unmatched;
+static int raw;
+
+static struct cpustate {
+  u_int pos;			/* next event we want from the ring */
+  u_int insys;			/* syscall number + 1 if in one */
+  u_quad_t systsc;
+  u_quad_t switchtsc;
+} cpus[NR_CPUS];
+
+static struct {
+  u_int bp;
+  u_quad_t tsc;
+} pending[NPENDING];
+
+static char *names[TR_NTYPES] = {
+  "", "syscall", "sysret", "trap", "switch", "classify", "diskreq", "diskdone"
+};
+
+static void
+hist_add(struct hist *h, u_quad_t v) {
+  int b = 0;
+
+  h->count++;
+  h->total += v;
+  if (v > h->max) h->max = v;
+  while (b < NBUCKETS - 1 && (v >> (b + 1)) != 0) b++;
+  h->bucket[b]++;
+}
+
+static void
+hist_print(char *what, struct hist *h) {
+  int b, last;
+  u_int mhz = __sysinfo.si_mhz ? __sysinfo.si_mhz : 1;
+
+  if (h->count == 0) return;
+  printf("%s: %qu, mean %qu usec, max %qu usec\n", what, h->count,
+	 h->total / h->count / mhz, h->max / mhz);
+  for (last = NBUCKETS - 1; last > 0 && h->bucket[last] == 0; last--);
+  for (b = 0; b <= last; b++) {
+    if (h->bucket[b] == 0) continue;
+    printf("  < %8qu cycles (%6qu usec): %qu\n", (u_quad_t)2 << b,
+	   ((u_quad_t)2 << b) / mhz, h->bucket[b]);
+  }
+}
+
+static void
+decode(int cpu, struct trace_ev *ev) {
+  struct cpustate *c = &cpus[cpu];
+  int i;
+
+  events++;
+  if (raw) {
+    printf("%d %qu %-8s env %-5d %08x %08x\n", cpu, ev->te_tsc,
+	   names[ev->te_type < TR_NTYPES ? ev->te_type : 0], ev->te_envid,
+	   ev->te_a0, ev->te_a1);
+    return;
+  }
+
+  switch (ev->te_type) {
+  case TR_SYSCALL:
+    c->insys = ev->te_a0 + 1;
+    c->systsc = ev->te_tsc;
+    break;
+  case TR_SYSRET:
+    if (c->insys == ev->te_a0 + 1) {
+      hist_add(&sys_hist, ev->te_tsc - c->systsc);
+      hist_add(&sc_hist[ev->te_a0 % NSYSCALLS], ev->te_tsc - c->systsc);
+    } else
+      unmatched++;
+    c->insys = 0;
+    break;
+  case TR_TRAP:
+    trap_count[ev->te_a0 % NTRAPS]++;
+    break;
+  case TR_SWITCH:
+    /* syscalls that switch away never return through the syscall path */
+    c->insys = 0;
+    if (c->switchtsc)
+      hist_add(&switch_hist, ev->te_tsc - c->switchtsc);
+    c->switchtsc = ev->te_tsc;
+    break;
+  case TR_CLASSIFY:
+    hist_add(&classify_hist, ev->te_a1);
+    break;
+  case TR_DISKREQ:
+    for (i = 0; i < NPENDING; i++)
+      if (pending[i].bp == 0) {
+	pending[i].bp = ev->te_a0;
+	pending[i].tsc = ev->te_tsc;
+	break;
+      }
+    break;
+  case TR_DISKDONE:
+    /* requests can complete on another CPU; the TSCs are close enough */
+    for (i = 0; i < NPENDING; i++)
+      if (pending[i].bp == ev->te_a0) {
+	hist_add(&disk_hist, ev->te_tsc - pending[i].tsc);
+	pending[i].bp = 0;
+	break;
+      }
+    if (i == NPENDING) unmatched++;
+    break;
+  }
+}
+
+/* decode whatever the CPUs have logged since we last looked */
+static void
+drain(void) {
+  struct trace_hdr *th = (struct trace_hdr *)UTRACE;
+  struct trace_ev ev, *ring;
+  u_int cpu, head;
+
+  for (cpu = 0; cpu < th->th_ncpus; cpu++) {
+    ring = TRACE_RING(th, cpu);
+    head = th->th_cpu[cpu].tc_head;
+    if (head - cpus[cpu].pos > TRACE_NEV) {
+      lost += head - cpus[cpu].pos - TRACE_NEV;
+      cpus[cpu].pos = head - TRACE_NEV;
+      cpus[cpu].insys = 0;
+      cpus[cpu].switchtsc = 0;
+    }
+    for (; cpus[cpu].pos != head; cpus[cpu].pos++) {
+      struct trace_ev *e = &ring[cpus[cpu].pos & (TRACE_NEV - 1)];
+      u_int seq = e->te_seq;
+
+      asm volatile ("" ::: "memory");
+      ev = *e;
+      asm volatile ("" ::: "memory");
+      if (seq != cpus[cpu].pos + 1 || e->te_seq != seq) {
+	/* overwritten before or while we were copying it */
+	lost++;
+	continue;
+      }
+      decode(cpu, &ev);
+    }
+  }
+}
+
+static u_int
+parse_types(char *s) {
+  u_int mask = 0;
+
+  for (; *s; s++)
+    switch (*s) {
+    case 's': mask |= (1 << TR_SYSCALL) | (1 << TR_SYSRET); break;
+    case 't': mask |= (1 << TR_TRAP); break;
+    case 'c': mask |= (1 << TR_SWITCH); break;
+    case 'p': mask |= (1 << TR_CLASSIFY); break;
+    case 'd': mask |= (1 << TR_DISKREQ) | (1 << TR_DISKDONE); break;
+    default:
+      fprintf(stderr, "unknown event type '%c'\n", *s);
+      exit(1);
+    }
+  return mask;
+}
+
+static void
+usage(void) {
+  extern char *__progname;
+  fprintf(stderr, "Usage: %s [-r] [-e stcpd] [-s seconds]\n", __progname);
+  fprintf(stderr, "-e  events to trace: s syscalls, t traps, c context "
+	  "switches,\n    p packet classification, d disk (default all)\n");
+  fprintf(stderr, "-s  how long to trace for (default 5 seconds)\n");
+  fprintf(stderr, "-r  print the raw events\n");
+  exit(1);
+}
+
+int
+main(int argc, char **argv) {
+  struct trace_hdr *th = (struct trace_hdr *)UTRACE;
+  u_int mask = TR_ALL;
+  int secs = 5;
+  int ch, old, i;
+  u_quad_t end;
+
+  while ((ch = getopt(argc, argv, "re:s:")) != -1)
+    switch (ch) {
+    case 'r':
+      raw = 1;
+      break;
+    case 'e':
+      mask = parse_types(optarg);
+      break;
+    case 's':
+      secs = atoi(optarg);
+      break;
+    default:
+      usage();
+    }
+
+  if ((old = sys_trace_ctl(CAP_ROOT, 0)) < 0) {
+    fprintf(stderr, "kernel not built with ENABLE_TRACE, or not root (%d)\n",
+	    old);
+    return 1;
+  }
+
+  /* start from wherever the rings are now */
+  for (i = 0; i < th->th_ncpus; i++)
+    cpus[i].pos = th->th_cpu[i].tc_head;
+
+  sys_trace_ctl(CAP_ROOT, mask);
+  end = __sysinfo.si_system_ticks +
+    (u_quad_t)secs * 1000000 / __sysinfo.si_rate;
+  while (__sysinfo.si_system_ticks < end) {
+    drain();
+    usleep(10000);
+  }
+  sys_trace_ctl(CAP_ROOT, old);
+  drain();
+
+  if (!raw) {
+    hist_print("syscalls", &sys_hist);
+    for (i = 0; i < NSYSCALLS; i++)
+      if (sc_hist[i].count)
+	printf("  syscall 0x%02x: %qu, mean %qu cycles, max %qu cycles\n", i,
+	       sc_hist[i].count, sc_hist[i].total / sc_hist[i].count,
+	       sc_hist[i].max);
+    for (i = 0; i < NTRAPS; i++)
+      if (trap_count[i])
+	printf("trap 0x%02x: %qu\n", i, trap_count[i]);
+    hist_print("run time between context switches", &switch_hist);
+    hist_print("packet classification", &classify_hist);
+    hist_print("disk requests", &disk_hist);
+  }
+  printf("%qu events, %qu lost, %qu unmatched\n", events, lost, unmatched);
+  return 0;
+}
@@ -48,6 +48,11 @@
 
 int ServerPort1 = 80;
 int MaxConns = WEB_MAX_CONNS;
+int KeepAlive = 1;
+int MaxKeepAliveRequests = 100;
+int KeepAliveTimeout = 15;
+int NumServers = 1;
+int ResponseCacheSize = 4096;
 
 #define WEB_CONFIG_MAXSTRINGLEN	63
 char ServerRoot[(WEB_CONFIG_MAXSTRINGLEN+1)];
@@ -173,6 +178,13 @@ void web_config (char *filename)
       found |= web_config_stringparam (line, "UserDir", UserDir, &unused);
       found |= web_config_stringparam (line, "DirectoryIndex", DirectoryIndex, &DirectoryIndexLen);
       found |= web_config_stringparam (line, "DefaultMimeType", DefaultMimeType, &unused);
+      if (found) continue;
+		/* "KeepAlive" is a prefix of "KeepAliveTimeout" */
+      if (found |= web_config_intparam (line, "KeepAliveTimeout", &KeepAliveTimeout)) continue;
+      found |= web_config_intparam (line, "KeepAlive", &KeepAlive);
+      found |= web_config_intparam (line, "MaxKeepAliveRequests", &MaxKeepAliveRequests);
+      found |= web_config_intparam (line, "NumServers", &NumServers);
+      found |= web_config_intparam (line, "ResponseCacheSize", &ResponseCacheSize);
       if (found) continue;
       if (found |= web_config_stringparam (line, "MimeTypeFile", MimeTypeFile, &unused)) {
          web_config_mimetypes (MimeTypeFile, &MimeTypes, &MimeTypeCount);
@@ -42,6 +42,11 @@
 /* globally visible config values */
 
 extern int MaxConns;
+extern int KeepAlive;
+extern int MaxKeepAliveRequests;
+extern int KeepAliveTimeout;
+extern int NumServers;
+extern int ResponseCacheSize;
 extern char ServerRoot[];
 extern char ErrorLog[];
 extern char TransferLog[];
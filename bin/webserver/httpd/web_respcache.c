@@ -0,0 +1,284 @@
+
+/*
+ * Copyright (C) 1997 Massachusetts Institute of Technology 
+ *
+ * This software is being provided by the copyright holders under the
+ * following license. By obtaining, using and/or copying this software,
+ * you agree that you have read, understood, and will comply with the
+ * following terms and conditions:
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose and without fee or royalty is
+ * hereby granted, provided that the full text of this NOTICE appears on
+ * ALL copies of the software and documentation or portions thereof,
+ * including modifications, that you make.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS," AND COPYRIGHT HOLDERS MAKE NO
+ * REPRESENTATIONS OR WARRANTIES, EXPRESS OR IMPLIED. BY WAY OF EXAMPLE,
+ * BUT NOT LIMITATION, COPYRIGHT HOLDERS MAKE NO REPRESENTATIONS OR
+ * WARRANTIES OF MERCHANTABILITY OR FITNESS FOR ANY PARTICULAR PURPOSE OR
+ * THAT THE USE OF THE SOFTWARE OR DOCUMENTATION WILL NOT INFRINGE ANY
+ * THIRD PARTY PATENTS, COPYRIGHTS, TRADEMARKS OR OTHER RIGHTS. COPYRIGHT
+ * HOLDERS WILL BEAR NO LIABILITY FOR ANY USE OF THIS SOFTWARE OR
+ * DOCUMENTATION.
+ *
+ * The name and trademarks of copyright holders may NOT be used in
+ * advertising or publicity pertaining to the software without specific,
+ * written prior permission. Title to copyright in this software and any
+ * associated documentation will at all times remain with copyright
+ * holders. See the file AUTHORS which should have accompanied this software
+ * for a list of all copyright holders.
+ *
+ * This file may be derived from previously copyrighted software. This
+ * copyright applies only to those changes made by the copyright
+ * holders listed in the AUTHORS file. The rest of this file is covered by
+ * the copyright notices, if any, listed below.
+ */
+
+
+/* Cache of complete responses, laid out as the TCP segments that carry */
+/* them.  Each entry holds the header and document bytes contiguously,  */
+/* plus the (unfolded) checksum of every mss-sized piece, so a cached   */
+/* response goes out with no copying from the buffer cache and no       */
+/* checksumming.  Entries are keyed by <inode, mss> since the segment   */
+/* boundaries depend on the mss.  Memory use is bounded: entries that   */
+/* are not being sent sit on an LRU list and are evicted as needed.     */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <exos/netinet/cksum.h>
+#include "web_respcache.h"
+
+#define RC_HASHBUCKETS	64
+
+#define rc_hash(inodenum,mss)	(((unsigned int) (inodenum) + (unsigned int) (mss)) & (RC_HASHBUCKETS - 1))
+
+static rc_entry_t *rc_hash[RC_HASHBUCKETS];
+static rc_entry_t *rc_lru_head = NULL;	/* least recently used */
+static rc_entry_t *rc_lru_tail = NULL;	/* most recently used */
+static int rc_maxbytes = 0;
+static int rc_bytes = 0;
+
+rc_stats_t web_respcache_stats;
+
+
+static void rc_addtolru (rc_entry_t *entry)
+{
+   entry->lru_next = NULL;
+   entry->lru_prev = rc_lru_tail;
+   if (rc_lru_tail) {
+      rc_lru_tail->lru_next = entry;
+   } else {
+      rc_lru_head = entry;
+   }
+   rc_lru_tail = entry;
+}
+
+
+static void rc_removefromlru (rc_entry_t *entry)
+{
+   if (entry->lru_prev) {
+      entry->lru_prev->lru_next = entry->lru_next;
+   } else {
+      assert (rc_lru_head == entry);
+      rc_lru_head = entry->lru_next;
+   }
+   if (entry->lru_next) {
+      entry->lru_next->lru_prev = entry->lru_prev;
+   } else {
+      assert (rc_lru_tail == entry);
+      rc_lru_tail = entry->lru_prev;
+   }
+   entry->lru_next = entry->lru_prev = NULL;
+}
+
+
+static void rc_removefromhash (rc_entry_t *entry)
+{
+   rc_entry_t **prevP = &rc_hash[rc_hash(entry->inodenum, entry->mss)];
+
+   while (*prevP != entry) {
+      assert (*prevP != NULL);
+      prevP = &(*prevP)->hash_next;
+   }
+   *prevP = entry->hash_next;
+   entry->hash_next = NULL;
+}
+
+
+static void rc_free (rc_entry_t *entry)
+{
+   rc_bytes -= entry->size;
+   assert (rc_bytes >= 0);
+   free (entry);
+}
+
+
+/* a maxbytes of 0 disables the cache */
+
+void web_respcache_init (int maxbytes)
+{
+   int i;
+
+   for (i=0; i<RC_HASHBUCKETS; i++) {
+      rc_hash[i] = NULL;
+   }
+   rc_maxbytes = maxbytes;
+   rc_bytes = 0;
+   bzero ((char *) &web_respcache_stats, sizeof(rc_stats_t));
+}
+
+
+/* Find the entry for <inodenum, mss>, dropping one filled from an */
+/* older version of the file.  Does not hold it or count a lookup. */
+
+static rc_entry_t * rc_find (int inodenum, int mss, int modtime)
+{
+   rc_entry_t *entry = rc_hash[rc_hash(inodenum, mss)];
+
+   while ((entry) && ((entry->inodenum != inodenum) || (entry->mss != mss))) {
+      entry = entry->hash_next;
+   }
+
+   if ((entry) && (entry->modtime != modtime)) {
+      web_respcache_stats.stales++;
+      rc_removefromhash (entry);
+      entry->stale = 1;
+      if (entry->refcnt == 0) {
+         rc_removefromlru (entry);
+         rc_free (entry);
+      }
+      entry = NULL;
+   }
+   return (entry);
+}
+
+
+/* Find the entry for <inodenum, mss>.  An entry filled from an older */
+/* version of the file is dropped.  The entry returned is held (off   */
+/* the LRU list) until web_respcache_release.                         */
+
+rc_entry_t * web_respcache_lookup (int inodenum, int mss, int modtime)
+{
+   rc_entry_t *entry = rc_find (inodenum, mss, modtime);
+
+   if (entry == NULL) {
+      web_respcache_stats.misses++;
+      return (NULL);
+   }
+
+   web_respcache_stats.hits++;
+   if (entry->refcnt == 0) {
+      rc_removefromlru (entry);
+   }
+   entry->refcnt++;
+   return (entry);
+}
+
+
+/* Get space for a new entry with room for <len> bytes of response.  */
+/* Returns NULL if it cannot be made to fit.  The caller fills in    */
+/* entry->data and then calls web_respcache_insert; until then the   */
+/* entry is invisible to lookups.                                    */
+
+rc_entry_t * web_respcache_alloc (int inodenum, int mss, int modtime, int len)
+{
+   rc_entry_t *entry;
+   int nsegs = (len + mss - 1) / mss;
+   int size = sizeof(rc_entry_t) + (nsegs * sizeof(unsigned int)) + len;
+
+   if (rc_maxbytes == 0) {
+      return (NULL);
+   }
+
+	/* no single response may take more than 1/4 of the cache */
+   if ((len <= 0) || (size > (rc_maxbytes / 4))) {
+      web_respcache_stats.toobig++;
+      return (NULL);
+   }
+
+   while ((rc_bytes + size) > rc_maxbytes) {
+      entry = rc_lru_head;
+      if (entry == NULL) {
+         return (NULL);		/* everything is in use */
+      }
+      web_respcache_stats.evictions++;
+      rc_removefromlru (entry);
+      rc_removefromhash (entry);
+      rc_free (entry);
+   }
+
+   entry = (rc_entry_t *) malloc (size);
+   if (entry == NULL) {
+      return (NULL);
+   }
+   rc_bytes += size;
+
+   entry->hash_next = NULL;
+   entry->lru_next = entry->lru_prev = NULL;
+   entry->inodenum = inodenum;
+   entry->mss = mss;
+   entry->modtime = modtime;
+   entry->refcnt = 1;
+   entry->stale = 0;
+   entry->size = size;
+   entry->len = len;
+   entry->nsegs = nsegs;
+   entry->sums = (unsigned int *) &entry[1];
+   entry->data = (char *) &entry->sums[nsegs];
+   return (entry);
+}
+
+
+/* Checksum each segment of a filled entry and make it visible.  The */
+/* caller still holds it.                                            */
+
+void web_respcache_insert (rc_entry_t *entry)
+{
+   rc_entry_t *old;
+   int i;
+
+   for (i=0; i<entry->nsegs; i++) {
+      int off = i * entry->mss;
+      int len = (entry->len - off) < entry->mss ? (entry->len - off) : entry->mss;
+      entry->sums[i] = inet_checksum ((unsigned short *) &entry->data[off], len, 0, 0);
+   }
+
+	/* someone else may have filled the same response in the meantime */
+   if ((old = rc_find (entry->inodenum, entry->mss, entry->modtime))) {
+      rc_removefromhash (old);
+      old->stale = 1;
+      if (old->refcnt == 0) {
+         rc_removefromlru (old);
+         rc_free (old);
+      }
+   }
+
+   entry->hash_next = rc_hash[rc_hash(entry->inodenum, entry->mss)];
+   rc_hash[rc_hash(entry->inodenum, entry->mss)] = entry;
+   web_respcache_stats.fills++;
+}
+
+
+void web_respcache_release (rc_entry_t *entry)
+{
+   assert (entry->refcnt > 0);
+   entry->refcnt--;
+   if (entry->refcnt == 0) {
+      if (entry->stale) {
+         rc_free (entry);
+      } else {
+         rc_addtolru (entry);
+      }
+   }
+}
+
+
+void web_respcache_printStats ()
+{
+   rc_stats_t *stats = &web_respcache_stats;
+
+   printf ("respcache: %d of %d bytes, hits %d, misses %d, fills %d, toobig %d, evictions %d, stales %d\n", rc_bytes, rc_maxbytes, stats->hits, stats->misses, stats->fills, stats->toobig, stats->evictions, stats->stales);
+}
@@ -0,0 +1,85 @@
+
+/*
+ * Copyright (C) 1997 Massachusetts Institute of Technology 
+ *
+ * This software is being provided by the copyright holders under the
+ * following license. By obtaining, using and/or copying this software,
+ * you agree that you have read, understood, and will comply with the
+ * following terms and conditions:
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose and without fee or royalty is
+ * hereby granted, provided that the full text of this NOTICE appears on
+ * ALL copies of the software and documentation or portions thereof,
+ * including modifications, that you make.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS," AND COPYRIGHT HOLDERS MAKE NO
+ * REPRESENTATIONS OR WARRANTIES, EXPRESS OR IMPLIED. BY WAY OF EXAMPLE,
+ * BUT NOT LIMITATION, COPYRIGHT HOLDERS MAKE NO REPRESENTATIONS OR
+ * WARRANTIES OF MERCHANTABILITY OR FITNESS FOR ANY PARTICULAR PURPOSE OR
+ * THAT THE USE OF THE SOFTWARE OR DOCUMENTATION WILL NOT INFRINGE ANY
+ * THIRD PARTY PATENTS, COPYRIGHTS, TRADEMARKS OR OTHER RIGHTS. COPYRIGHT
+ * HOLDERS WILL BEAR NO LIABILITY FOR ANY USE OF THIS SOFTWARE OR
+ * DOCUMENTATION.
+ *
+ * The name and trademarks of copyright holders may NOT be used in
+ * advertising or publicity pertaining to the software without specific,
+ * written prior permission. Title to copyright in this software and any
+ * associated documentation will at all times remain with copyright
+ * holders. See the file AUTHORS which should have accompanied this software
+ * for a list of all copyright holders.
+ *
+ * This file may be derived from previously copyrighted software. This
+ * copyright applies only to those changes made by the copyright
+ * holders listed in the AUTHORS file. The rest of this file is covered by
+ * the copyright notices, if any, listed below.
+ */
+
+
+/* Cache of complete responses (header plus document), laid out as the */
+/* TCP segments that carry them, indexed by <inode, MSS>.               */
+
+#ifndef __WEB_RESPCACHE_H__
+#define __WEB_RESPCACHE_H__
+
+struct rc_entry {
+   struct rc_entry *hash_next;		/* hash chain pointer */
+   struct rc_entry *lru_next;		/* LRU list pointers (unused entries only) */
+   struct rc_entry *lru_prev;
+   int inodenum;			/* <inodenum, mss> identify the entry */
+   int mss;
+   int modtime;				/* inode modTime when the entry was filled */
+   int refcnt;				/* number of queued responses using entry */
+   int stale;				/* replaced; free when last user is done */
+   int size;				/* bytes of memory charged to the entry */
+   int len;				/* length of response */
+   int nsegs;				/* number of mss-sized segments */
+   unsigned int *sums;			/* unfolded checksum of each segment */
+   char *data;				/* the response bytes */
+};
+typedef struct rc_entry rc_entry_t;
+
+struct rc_stats {
+   int hits;			/* lookups that found a usable entry */
+   int misses;			/* lookups that did not */
+   int fills;			/* entries filled */
+   int toobig;			/* responses too big to cache */
+   int evictions;		/* entries pushed out to make room */
+   int stales;			/* entries replaced because the file changed */
+};
+typedef struct rc_stats rc_stats_t;
+
+extern rc_stats_t web_respcache_stats;
+
+/* web_respcache.c prototypes */
+
+void web_respcache_init (int maxbytes);
+rc_entry_t * web_respcache_lookup (int inodenum, int mss, int modtime);
+rc_entry_t * web_respcache_alloc (int inodenum, int mss, int modtime, int len);
+void web_respcache_insert (rc_entry_t *entry);
+void web_respcache_release (rc_entry_t *entry);
+void web_respcache_printStats ();
+
+#define web_respcache_segment(entry,offset)	((offset) / (entry)->mss)
+
+#endif  /* __WEB_RESPCACHE_H__ */
@@ -53,6 +53,7 @@
 #include <exos/vm-layout.h>             /* for PAGESIZ */
 #include <fd/proc.h>
 #include <exos/tick.h>
+#include <exos/cap.h>			/* for CAP_ROOT */
 #else
 #define StaticAssert	assert
 #define PAGESIZ 4096
@@ -77,6 +78,9 @@
 #include "xio/xio_tcpcommon.h"
 #include <exos/netinet/cksum.h>
 #include "web_fs.h"
+#include "web_respcache.h"
+#include <sys/mman.h>
+#include <exos/locks.h>
 #if 0
 #include <sys/pctr.h>
 #endif
@@ -94,10 +98,35 @@
 
 #define WEB_MAX_INPUTMIMEHEADERS	64
 
+/* maximum number of responses on one persistent connection that can be */
+/* sent but not yet acknowledged (see webresp_t below)                   */
+#define WEB_MAX_PIPELINE	4
+
+/* offset of the minor version digit in the "HTTP/1.0" status line that */
+/* starts every header (pre-computed or built by web_construct_header)  */
+#define WEB_HTTPVERS_OFF	7
+
+/* upper bound on the number of server processes (see NumServers) */
+#define WEB_MAX_SERVERS		16
+
+/* maximum number of ServerPort directives */
+#define WEB_MAX_LISTENS		8
+
+/* size of the name cache shared by all of the server processes */
+#define WEB_NAMECACHE_SIZE	16384
+
 static int numconns = 0;
 
+/* checksum adjustment for turning "HTTP/1.0" into "HTTP/1.1" */
+static int httpvers_sumdelta = 0;
+
 #ifndef HIGHLEVEL
 static nc_t *namecache;
+static exos_lock_t *namecache_lock;
+static int servno = 0;
+static int numservers = 1;
+static int numlistens = 0;
+static int listenports[WEB_MAX_LISTENS];
 dinode_t *DocumentRootInode = NULL;
 int DocumentRootInodeNum = -1;
 static xio_dmxinfo_t dmxinfo;
@@ -111,17 +140,38 @@ static int writefds[WEB_MAX_CONNS];
 
 /* main structure defining state of a request */
 
+/* The tcb's congestion control and SACK state pushed the webreq past    */
+/* 2048 bytes, so without USEINPACKETS it now takes a page of its own.  */
 #ifdef USEINPACKETS
-#define WEB_REQT_SIZE		512
+#define WEB_REQT_SIZE		1024
 #define WEB_REQT_INBUFSIZE	4
 #else
-#define WEB_REQT_SIZE		2048
+#define WEB_REQT_SIZE		4096
 #define WEB_REQT_INBUFSIZE	1460
 #endif
 
+#ifdef HIGHLEVEL
+#define WEB_REQT_HDRSIZE	256
+#endif
+
 /* how often, in usecs, to check for timed-out packets */
 #define TIMEOUT_POLL_INTERVAL 100000 
 
+#ifndef HIGHLEVEL
+/* A response that has been (or is being) sent on a connection.  Responses */
+/* stay queued until acknowledged, so that retransmissions can be rebuilt  */
+/* from the cache at any connection offset (see MERGE_CACHERETRANS).       */
+typedef struct webresp {
+   dinode_t *inode;
+   int command;
+   int http11;		/* rewrite the status line to HTTP/1.1 */
+   int close;		/* send a FIN with the last byte */
+   uint base;		/* connection send_offset of the first byte */
+   uint len;		/* header plus document length */
+   rc_entry_t *cached;	/* prebuilt copy of the response, if any */
+} webresp_t;
+#endif
+
 typedef struct webreq {
 #ifndef HIGHLEVEL
    struct tcb tcb;
@@ -148,17 +198,35 @@ typedef struct webreq {
    int lastindex;
    int max_send_offset;
    int recompute_checksums;
+   int http11;		/* client spoke HTTP/1.1 (or later) */
+   int keepalive;	/* keep the connection open after this response */
+   int numreqs;		/* requests already answered on this connection */
+   int reqend;		/* start of pipelined data following this request */
+   time_t idlesince;	/* when the connection went idle between requests */
+   char *hdr;		/* header built by web_construct_header/bad_request */
+#ifndef HIGHLEVEL
+   uint nextbase;	/* connection offset at which the next response starts */
+   int respfirst;
+   int respcnt;
+   webresp_t resps[WEB_MAX_PIPELINE];
+#else
+   char hdrspace[WEB_REQT_HDRSIZE];
+#endif
    int inbuflen;
    char *inbuf;
    void *inpacket;
 #ifndef USEINPACKETS
-   char inbufspace[WEB_REQT_INBUFSIZE];
+   char inbufspace[(WEB_REQT_INBUFSIZE+1)];	/* +1 for reqrecv's terminator */
 #endif
 } webreq_t;
 
 static webreq_t *active_webreqs = NULL;
 static webreq_t *free_webreqs = NULL;
 
+#ifndef HIGHLEVEL
+static void webreq_dequeueresp (webreq_t *webreq);
+#endif
+
 #define WEBREQ_STATE_FREE	0x00000000
 #define WEBREQ_STATE_REQRECV	0x00000007
 #define WEBREQ_STATE_REQRECV_COMMAND	0x00000001
@@ -193,6 +261,19 @@ static webreq_t * webreq_alloc ()
    webreq->inpacket = NULL;
    webreq->recompute_checksums = 0;
    webreq->pathname = NULL;
+#ifdef HIGHLEVEL
+   webreq->inode = -1;
+#endif
+   webreq->hdr = NULL;
+   webreq->http11 = 0;
+   webreq->keepalive = 0;
+   webreq->numreqs = 0;
+   webreq->reqend = 0;
+#ifndef HIGHLEVEL
+   webreq->nextbase = 0;
+   webreq->respfirst = 0;
+   webreq->respcnt = 0;
+#endif
 
    numconns++;
 /*
@@ -237,6 +318,10 @@ static void webreq_free (webreq_t *webreq)
       webreq->inode = NULL;
    }
 
+   while (webreq->respcnt > 0) {
+      webreq_dequeueresp (webreq);
+   }
+
    if (webreq->inpacket != NULL) {
       xio_net_wrap_returnPacket (&nwinfo, webreq->inpacket);
    }
@@ -277,8 +362,31 @@ int translate_command (char *command)
 }
 	
 
+/* HTTP/1.1 connections are persistent unless the client says otherwise */
+
+static int translate_protocol (char *protocol)
+{
+   while (*protocol == ' ') {
+      protocol++;
+   }
+   if (strncasecmp (protocol, "HTTP/", 5) != 0) {
+      return (0);
+   }
+   return ((protocol[5] > '1') || ((protocol[5] == '1') && (protocol[6] == '.') && (protocol[7] >= '1') && (protocol[7] <= '9')));
+}
+
+
 void translate_mimeheader (webreq_t *webreq, char *buf)
 {
+   if (strncasecmp (buf, "Connection:", 11) == 0) {
+      buf += 11;
+      while (*buf == ' ') {
+         buf++;
+      }
+      if (strncasecmp (buf, "close", 5) == 0) {
+         webreq->keepalive = 0;
+      }
+   }
 }
 
 
@@ -295,6 +403,11 @@ void bad_request (webreq_t *webreq, int errorval)
       webreq->pathname = buf;
    }
    buf = (char *) ((uint)(buf + webreq->pathnamelen + 1 + 3) & 0xFFFFFFFC);
+   webreq->hdr = buf;
+
+	/* the error text overwrites any pipelined requests, so give up on */
+	/* keeping the connection open                                     */
+   webreq->keepalive = 0;
 
    if (webreq->command != WEBREQ_TYPE_OLDGET) {
       headerlen += web_error_header (buf, buflen, errorval);
@@ -332,8 +445,14 @@ printf ("why in bad request??\n");
 
 void web_construct_header (webreq_t *webreq)
 {
+#ifdef HIGHLEVEL
+	/* keep clear of any pipelined requests that follow in inbuf */
+   char *buf = &webreq->hdrspace[0];
+   int buflen = WEB_REQT_HDRSIZE;
+#else
    char *buf = (char *) ((uint)(webreq->pathname + webreq->pathnamelen + 1 + 3) & 0xFFFFFFFC);
    int buflen = WEB_REQT_INBUFSIZE - (buf - webreq->inbuf);
+#endif
    int headerlen = 0;
 #ifdef HIGHLEVEL
    struct stat statbuf;
@@ -343,11 +462,15 @@ void web_construct_header (webreq_t *webreq)
 
    assert (webreq->pathname);
 
+   webreq->hdr = buf;
    if (webreq->command == WEBREQ_TYPE_OLDGET) {
       webreq->tmpval = 0;
       return;
    }
    headerlen += web_header_goodstatus (buf, buflen);
+   if (webreq->http11) {
+      buf[WEB_HTTPVERS_OFF] = '1';
+   }
    headerlen += web_header_date ((buf + headerlen), (buflen - headerlen));
    headerlen += web_header_server ((buf + headerlen), (buflen - headerlen));
 
@@ -383,11 +506,15 @@ void web_construct_header (webreq_t *webreq)
 int web_server_nameToInum (webreq_t *webreq, int currdir, char *name, int namelen)
 {
    int nextdir;
+   int ret;
    dinode_t *inode;
 /*
    printf ("checking name cache: root %d, name %s, len %d\n", currdir, name, namelen);
 */
-   if (name_cache_findEntry(namecache, currdir, name, namelen, &nextdir) == 0) {
+   exos_lock_get_nb (namecache_lock);
+   ret = name_cache_findEntry(namecache, currdir, name, namelen, &nextdir);
+   exos_lock_release (namecache_lock);
+   if (ret == 0) {
       nextdir = web_alias_match (currdir, name, namelen);
       if (nextdir == -1) {
          inode = web_fs_getDInode (currdir, alfs_FSdev, (BUFFER_READ|BUFFER_ASYNC));
@@ -401,7 +528,9 @@ int web_server_nameToInum (webreq_t *webreq, int currdir, char *name, int namele
             goto nameToInum_done;
          }
       }
+      exos_lock_get_nb (namecache_lock);
       name_cache_addEntry (namecache, currdir, name, namelen, nextdir);
+      exos_lock_release (namecache_lock);
    }
 
 nameToInum_done:
@@ -418,6 +547,64 @@ printf ("Time to wait for I/O request: buffer %x, blkno %d, webreq %x\n", (u_int
    return (nextdir);
 }
 
+
+/* Move the document found by webreq_finddoc onto the connection's queue */
+/* of responses.  Its bytes follow those of every earlier response.      */
+
+static void webreq_queueresp (webreq_t *webreq)
+{
+   webresp_t *resp;
+
+   assert (webreq->respcnt < WEB_MAX_PIPELINE);
+   resp = &webreq->resps[((webreq->respfirst + webreq->respcnt) % WEB_MAX_PIPELINE)];
+   resp->inode = webreq->inode;
+   resp->command = webreq->command;
+   resp->http11 = webreq->http11;
+   resp->close = !webreq->keepalive;
+   resp->base = webreq->nextbase;
+   resp->len = webreq->inode->length + webreq->inode->headerlen;
+   resp->cached = NULL;
+   if (resp->command == WEBREQ_TYPE_GET) {
+      resp->cached = web_respcache_lookup (resp->inode->dinodeNum, webreq->tcb.mss, resp->inode->modTime);
+   }
+   webreq->nextbase += resp->len;
+   webreq->respcnt++;
+   webreq->inode = NULL;
+}
+
+
+/* Drop the oldest response on the connection's queue */
+
+static void webreq_dequeueresp (webreq_t *webreq)
+{
+   webresp_t *resp = &webreq->resps[webreq->respfirst];
+
+   assert (webreq->respcnt > 0);
+   web_fs_releaseDInode (resp->inode, alfs_FSdev, 0);
+   if (resp->cached) {
+      web_respcache_release (resp->cached);
+      resp->cached = NULL;
+   }
+   webreq->respfirst = (webreq->respfirst + 1) % WEB_MAX_PIPELINE;
+   webreq->respcnt--;
+}
+
+
+/* Release the documents of responses that have been completely acked */
+
+static void webreq_retireresps (webreq_t *webreq)
+{
+   uint acked = xio_tcp_acked_offset (&webreq->tcb);
+
+   while (webreq->respcnt > 0) {
+      webresp_t *resp = &webreq->resps[webreq->respfirst];
+      if (acked < (resp->base + resp->len)) {
+         break;
+      }
+      webreq_dequeueresp (webreq);
+   }
+}
+
 #endif  /* ! HIGHLEVEL */
 
 
@@ -503,6 +690,11 @@ printf ("resulting inodenum: %d\n", inode->dinodeNum);
    webreq->lastindex = 512;  /* bypass HTTP header contained at front of file */
    webreq->state = WEBREQ_STATE_SENDDOC;
    webreq->waitee = NULL;
+   if ((webreq->command == WEBREQ_TYPE_GET) || (webreq->command == WEBREQ_TYPE_OLDGET)) {
+      webreq_queueresp (webreq);
+   } else {
+      webreq->keepalive = 0;
+   }
 /*
 printf ("moving to senddoc: length %d\n", inode->length);
 */
@@ -546,6 +738,7 @@ void oldstyle_request (webreq_t *webreq, int i)
    webreq->pathnamelen = i - (webreq->pathname - webreq->inbuf);
    webreq->inbuf[i] = (char) 0;
    webreq->command = WEBREQ_TYPE_OLDGET;
+   webreq->keepalive = 0;
    webreq->state = WEBREQ_STATE_FINDDOC;
 }
 
@@ -662,6 +855,11 @@ printf ("pathname: %s\n", webreq->pathname);
 /*
 printf ("protocol: %s\n", &buf[webreq->lastindex]);
 */
+      webreq->http11 = translate_protocol (&buf[webreq->lastindex]);
+      webreq->keepalive = (KeepAlive) && (webreq->http11) && ((webreq->numreqs + 1) < MaxKeepAliveRequests);
+#ifdef USEINPACKETS
+      webreq->keepalive = 0;
+#endif
       webreq->lastindex = i;
       webreq->tmpval = 0;	/* used to count mime headers */
       webreq->state = WEBREQ_STATE_REQRECV_MIMEHEADER;
@@ -678,6 +876,7 @@ printf ("protocol: %s\n", &buf[webreq->lastindex]);
                i++;
             }
          }
+         webreq->reqend = i;
          webreq->lastindex = (int) webreq->pathname;
 #ifndef HIGHLEVEL
          webreq->tmpval = DocumentRootInodeNum;
@@ -704,196 +903,399 @@ printf ("MIME header: %s\n", &buf[(webreq->lastindex)]);
 }
 
 
-void webreq_senddoc (webreq_t *webreq)
+/* Start on the next request of a persistent connection.  Pipelined      */
+/* request bytes that arrived behind the one just answered are moved to  */
+/* the front of inbuf, where webreq_reqrecv picks them up.               */
+
+static void webreq_nextreq (webreq_t *webreq)
 {
+   int left = webreq->inbuflen - webreq->reqend;
 #ifndef HIGHLEVEL
-   dinode_t *inode = webreq->inode;
-   int resplen = (inode) ? (inode->length + inode->headerlen) : 0;
+   int oldwnd = xio_tcp_rcvwnd (&webreq->tcb);
+#endif
+
+   assert (left >= 0);
+   if (left > 0) {
+      bcopy (&webreq->inbuf[webreq->reqend], webreq->inbuf, left);
+   }
+   webreq->inbuflen = left;
+   webreq->reqend = 0;
+   webreq->lastindex = 0;
+   webreq->pathname = NULL;
+   webreq->hdr = NULL;
+   webreq->numreqs++;
+   webreq->idlesince = time (NULL);
+   webreq->state = WEBREQ_STATE_REQRECV_COMMAND;
+
+#ifndef HIGHLEVEL
+	/* reopen the part of the window consumed by web_server_gotdata */
+   xio_tcp_setrcvwnd (&webreq->tcb, (WEB_REQT_INBUFSIZE - left));
+   if (oldwnd == 0) {
+      xio_tcp_prepCtlPacket (&webreq->tcb);
+      xio_tcpcommon_sendPacket (&webreq->tcb, 0);
+   }
+#else
+   if (webreq->inode >= 0) {
+      close (webreq->inode);
+      webreq->inode = -1;
+   }
+#endif
+}
+
+
+/* Close a persistent connection that has no request in progress */
+
+static void webreq_closeconn (webreq_t *webreq)
+{
+   webreq->keepalive = 0;
+#ifndef HIGHLEVEL
+   xio_tcp_initiate_close (&webreq->tcb);
+   xio_tcpcommon_sendPacket (&webreq->tcb, 0);
+   webreq->max_send_offset = webreq->tcb.send_offset;
+#else
+   if (close (webreq->sockfd) != 0) {
+      printf ("webreq_closeconn: socket close failed (sockfd %d, errno %d)\n", webreq->sockfd, errno);
+      exit (0);
+   }
+   connfds[webreq->webreqno] = -1;
+#endif
+   webreq->state = WEBREQ_STATE_CLOSING;
+}
+
+
+#ifndef HIGHLEVEL
+
+/* Build the response cache entry for a queued GET from the document's  */
+/* blocks.  Returns 1 if resp->cached is now set, -1 if the response     */
+/* will not be cached, and 0 if we must wait for the disk.               */
+
+static int webreq_fillcache (webreq_t *webreq, webresp_t *resp)
+{
+   dinode_t *inode = resp->inode;
+   rc_entry_t *entry;
+   buffer_t *buffer;
+   int fileoff;
+   int endoff = 512 + inode->length;
+   char *dst;
+
+   entry = web_respcache_alloc (inode->dinodeNum, webreq->tcb.mss, inode->modTime, resp->len);
+   if (entry == NULL) {
+      return (-1);
+   }
+
+   dst = entry->data + inode->headerlen;
+   for (fileoff = 0; fileoff < endoff; ) {
+      int blkoff = fileoff % (BLOCK_SIZE-16);
+      int len = min (((BLOCK_SIZE-16) - blkoff), (endoff - fileoff));
+      buffer = web_fs_buffer_getBlock (alfs_FSdev, inode->dinodeNum, (fileoff / (BLOCK_SIZE-16)), (BUFFER_READ|BUFFER_ASYNC));
+      if (buffer == NULL) {
+         webreq->state |= WEBREQ_STATE_DISKWAIT;
+         webreq->waitee = web_fs_waitee;
+         entry->stale = 1;
+         web_respcache_release (entry);
+         return (0);
+      }
+      if (fileoff == 0) {
+         bcopy (buffer->buffer, entry->data, inode->headerlen);
+         blkoff = 512;
+         len -= 512;
+         fileoff = 512;
+      }
+      bcopy (&buffer->buffer[blkoff], dst, len);
+      web_fs_buffer_releaseBlock (buffer, 0);
+      dst += len;
+      fileoff += len;
+   }
+   assert (dst == (entry->data + entry->len));
+
+	/* checksums are taken with no datetime and an HTTP/1.0 status line; */
+	/* webreq_sendcached adds in the real values on the way out          */
+   bzero (&entry->data[datetimeoff], datetimelen);
+   entry->data[WEB_HTTPVERS_OFF] = '0';
+   web_respcache_insert (entry);
+   resp->cached = entry;
+   return (1);
+}
+
+
+/* Send (or resend) the part of a queued response at or beyond the TCB's */
+/* send_offset from its response cache entry.  Segment boundaries and    */
+/* checksums are the ones prebuilt for this mss, unless a retransmission */
+/* starts in the middle of a segment or the congestion window cuts one   */
+/* short, in which case TCP sends what it can and checksums it itself.   */
+
+static int webreq_sendcached (webreq_t *webreq, webresp_t *resp)
+{
+   rc_entry_t *entry = resp->cached;
+   int offset = webreq->tcb.send_offset - resp->base;
+
+   assert (entry->mss == webreq->tcb.mss);
+
+   while (offset < entry->len) {
+      int len = min (entry->mss, (entry->len - offset));
+      int flags = ((resp->close) && ((offset + len) == entry->len)) | TCP_SEND_MAXSIZEONLY;
+      int checksum = -1;
+      int voloff = 0;
+      int sent;
+
+      if (offset < (datetimeoff + datetimelen)) {
+         /* Slip in the current datetime string and protocol version */
+         bcopy (datetime, &entry->data[datetimeoff], datetimelen);
+         entry->data[WEB_HTTPVERS_OFF] = (resp->http11) ? '1' : '0';
+         voloff = datetimeoff + datetimelen - offset;
+      }
+      if (((offset % entry->mss) == 0) && (xio_tcp_seglen (&webreq->tcb, len, flags) == len)) {
+         checksum = entry->sums[web_respcache_segment(entry, offset)];
+         if (offset == 0) {
+            checksum += datetimesum;
+            if (resp->http11) {
+               checksum += httpvers_sumdelta;
+            }
+         }
+      }
+
+      sent = xio_tcp_prepDataPacket (&webreq->tcb, &entry->data[offset], len, NULL, 0, flags, checksum);
+      assert ((sent >= 0) && (sent <= len));
+      xio_tcpcommon_sendPacket (&webreq->tcb, voloff);
+      if (sent == 0) {
+         return (0);
+      }
+      offset += sent;
+   }
+   return (1);
+}
+
+
+/* Send (or resend) the part of a queued response at or beyond the TCB's */
+/* send_offset.  Returns 1 once all of it has been handed to TCP, 0 if   */
+/* we must wait for the window to open or for the disk.                  */
+
+static int webreq_sendresp (webreq_t *webreq, webresp_t *resp)
+{
+   dinode_t *inode = resp->inode;
+   int resplen = resp->len;
    int sent;
-   int sendfile = ((webreq->command == WEBREQ_TYPE_GET) || (webreq->command == WEBREQ_TYPE_OLDGET));
    int checksum = -1;
    int flags = TCP_SEND_MAXSIZEONLY;
    int offset;
    buffer_t *buffer = NULL;
 
-   DPRINTF (4, ("webreq_senddoc: command %d, length %d, sendfile %d, tmpval %d\n", webreq->command, ((inode) ? inode->length : -1), sendfile, webreq->tmpval));
+   DPRINTF (4, ("webreq_sendresp: command %d, length %d, base %d, send_offset %d\n", resp->command, inode->length, resp->base, webreq->tcb.send_offset));
 
 	/* GROK - I don't believe that "OLD_HEADER_CONSTRUCT will work!! */
 
-	/* This path is only used for HEAD requests and bad requests */
-   if ((!sendfile) && (webreq->tmpval > webreq->tcb.send_offset)) {
-/*
-printf ("send #1\n");
-*/
-      sent = xio_tcp_prepDataPacket (&webreq->tcb, 
-(char *) (((uint)(webreq->pathname + webreq->pathnamelen + 1 + 3) & 0xFFFFFFFC) + webreq->tcb.send_offset), (webreq->tmpval - webreq->tcb.send_offset), NULL, 0, (TCP_SEND_ALSOCLOSE|TCP_SEND_MAXSIZEONLY), -1);
-      xio_tcpcommon_sendPacket (&webreq->tcb, 0);
-      if (webreq->tmpval > webreq->tcb.send_offset) {
-         return;
+	/* Retrofit "to send" info with where the TCB says we are */
+   offset = webreq->tcb.send_offset - resp->base;
+
+   if ((resp->cached == NULL) && (resp->command == WEBREQ_TYPE_GET) && (offset == 0)) {
+      if (webreq_fillcache (webreq, resp) == 0) {
+         return (0);
       }
    }
-   if (sendfile) {
-	/* Retrofit "to send" info with where the TCB says we are */
-      offset = webreq->tcb.send_offset;
+   if (resp->cached) {
+      return (webreq_sendcached (webreq, resp));
+   }
 
 	/* and then continue as before... */
 //#ifndef OLD_HEADER_CONSTRUCT
-      while (offset < resplen) {
-         int fileoff = (offset < inode->headerlen) ? offset : (offset + 512 - inode->headerlen);
-         int blklen = min(((BLOCK_SIZE-16) - (max(512,fileoff)%(BLOCK_SIZE-16))), (resplen - offset - max(0,(inode->headerlen-offset))));
-         buffer_t *buffer2 = NULL;
-         int len1, len2;
-         char *data1;
-         char *data2 = NULL;
-         int blklen2 = 0;
-         int voloff = 0;
+   while (offset < resplen) {
+      int fileoff = (offset < inode->headerlen) ? offset : (offset + 512 - inode->headerlen);
+      int blklen = min(((BLOCK_SIZE-16) - (max(512,fileoff)%(BLOCK_SIZE-16))), (resplen - offset - max(0,(inode->headerlen-offset))));
+      buffer_t *buffer2 = NULL;
+      int len1, len2;
+      char *data1;
+      char *data2 = NULL;
+      int blklen2 = 0;
+      int voloff = 0;
+      if (buffer == NULL) {
+         buffer = web_fs_buffer_getBlock (alfs_FSdev, inode->dinodeNum, (fileoff / (BLOCK_SIZE-16)), (BUFFER_READ|BUFFER_ASYNC));
          if (buffer == NULL) {
-            buffer = web_fs_buffer_getBlock (alfs_FSdev, inode->dinodeNum, (fileoff / (BLOCK_SIZE-16)), (BUFFER_READ|BUFFER_ASYNC));
-            if (buffer == NULL) {
-               DPRINTF (4, ("blocked: webreq %p, web_fs_waitee %p\n", webreq, web_fs_waitee));
-               webreq->state |= WEBREQ_STATE_DISKWAIT;
-               webreq->waitee = web_fs_waitee;
-               return;
-            }
+            DPRINTF (4, ("blocked: webreq %p, web_fs_waitee %p\n", webreq, web_fs_waitee));
+            webreq->state |= WEBREQ_STATE_DISKWAIT;
+            webreq->waitee = web_fs_waitee;
+            return (0);
          }
+      }
 
-         if ((fileoff > inode->headerlen) && ((offset + blklen) < resplen) && (blklen < 1460)) {
-            buffer2 = web_fs_buffer_getBlock (alfs_FSdev, inode->dinodeNum, ((fileoff / (BLOCK_SIZE-16))+1), (BUFFER_READ|BUFFER_ASYNC));
-            if (buffer2 == NULL) {
-               DPRINTF (4, ("blocked (2): webreq %p, web_fs_waitee %p\n", webreq, web_fs_waitee));
-               webreq->state |= WEBREQ_STATE_DISKWAIT;
-               webreq->waitee = web_fs_waitee;
-               web_fs_buffer_releaseBlock (buffer, 0);
-               return;
-            }
-            data2 = buffer2->buffer;
-            blklen2 = min((BLOCK_SIZE-16), (resplen - (offset + blklen)));
+      if ((fileoff > inode->headerlen) && ((offset + blklen) < resplen) && (blklen < 1460)) {
+         buffer2 = web_fs_buffer_getBlock (alfs_FSdev, inode->dinodeNum, ((fileoff / (BLOCK_SIZE-16))+1), (BUFFER_READ|BUFFER_ASYNC));
+         if (buffer2 == NULL) {
+            DPRINTF (4, ("blocked (2): webreq %p, web_fs_waitee %p\n", webreq, web_fs_waitee));
+            webreq->state |= WEBREQ_STATE_DISKWAIT;
+            webreq->waitee = web_fs_waitee;
+            web_fs_buffer_releaseBlock (buffer, 0);
+            return (0);
          }
+         data2 = buffer2->buffer;
+         blklen2 = min((BLOCK_SIZE-16), (resplen - (offset + blklen)));
+      }
 
 /* GROK -- refigure out how to do this later... */
 //#ifndef OLD_HEADER_CONSTRUCT
-         if ((offset < inode->headerlen) && (webreq->command == WEBREQ_TYPE_GET)) {
-            /* Slip in the current datetime string */
-            if (offset == 0) {
-               bcopy (datetime, &buffer->buffer[datetimeoff], datetimelen);
-            }
-            voloff = datetimeoff + datetimelen;
+      if ((offset < inode->headerlen) && (resp->command == WEBREQ_TYPE_GET)) {
+         /* Slip in the current datetime string and protocol version */
+         if (offset == 0) {
+            bcopy (datetime, &buffer->buffer[datetimeoff], datetimelen);
+            buffer->buffer[WEB_HTTPVERS_OFF] = (resp->http11) ? '1' : '0';
+         }
+         voloff = datetimeoff + datetimelen;
 
 #ifdef PRECOMPUTE_CHECKSUMS
 	/* GROK -- can't use if retrans or not mult of 1460 in offset or size */
-            if ((min (webreq->tcb.mss, webreq->tcb.snd_wnd) != 1460) || (offset != 0)) {
+         if ((min (webreq->tcb.mss, webreq->tcb.snd_wnd) != 1460) || (offset != 0)) {
 if (webreq->recompute_checksums == 0) {
 kprintf ("connection can't use precomputed checksums: mss %d, snd_wnd %d, offset %d\n", webreq->tcb.mss, webreq->tcb.snd_wnd, offset);
 }
-               webreq->recompute_checksums = 1;
-            }
-            if ((webreq->recompute_checksums) || (webreq->tcb.snd_max > webreq->tcb.snd_next)) {
-               checksum = -1;
-            } else {
-               checksum = datetimesum + *((int *)&buffer->buffer[(BLOCK_SIZE-16)]);
+            webreq->recompute_checksums = 1;
+         }
+         if ((webreq->recompute_checksums) || (webreq->tcb.snd_max > webreq->tcb.snd_next)) {
+            checksum = -1;
+         } else {
+            checksum = datetimesum + *((int *)&buffer->buffer[(BLOCK_SIZE-16)]);
+            if (resp->http11) {
+               checksum += httpvers_sumdelta;
             }
+         }
 #endif
-            data1 = &buffer->buffer[offset];
-            len1 = inode->headerlen - offset;
-            data2 = &buffer->buffer[512];
-            len2 = blklen;
-         } else {
+         data1 = &buffer->buffer[offset];
+         len1 = inode->headerlen - offset;
+         data2 = &buffer->buffer[512];
+         len2 = blklen;
+      } else {
 #ifdef PRECOMPUTE_CHECKSUMS
-            if ((webreq->tcb.mss != 1460) || (webreq->command == WEBREQ_TYPE_OLDGET)) {
+         if ((webreq->tcb.mss != 1460) || (resp->command == WEBREQ_TYPE_OLDGET)) {
 if (webreq->recompute_checksums == 0) {
-kprintf ("connection can't use precomputed checksums: mss %d, snd_wnd %d, command %d\n", webreq->tcb.mss, webreq->tcb.snd_wnd, webreq->command);
+kprintf ("connection can't use precomputed checksums: mss %d, snd_wnd %d, command %d\n", webreq->tcb.mss, webreq->tcb.snd_wnd, resp->command);
 }
-               webreq->recompute_checksums = 1;
-            }
-            if ((webreq->recompute_checksums) || (webreq->tcb.snd_max > webreq->tcb.snd_next)) {
-               checksum = -1;
+            webreq->recompute_checksums = 1;
+         }
+         if ((webreq->recompute_checksums) || (webreq->tcb.snd_max > webreq->tcb.snd_next)) {
+            checksum = -1;
+         } else {
+            int firstsum = (fileoff < (BLOCK_SIZE-16)) ? (4 - (offset / 1460)) : (4 - (((fileoff % (BLOCK_SIZE-16)) + 1459) / 1460));
+            if ((blklen >= 1460) || (buffer2 == NULL)) {
+               checksum = *((int *)&buffer->buffer[(BLOCK_SIZE-(firstsum*sizeof(int)))]);
             } else {
-               int firstsum = (fileoff < (BLOCK_SIZE-16)) ? (4 - (offset / 1460)) : (4 - (((fileoff % (BLOCK_SIZE-16)) + 1459) / 1460));
-               if ((blklen >= 1460) || (buffer2 == NULL)) {
-                  checksum = *((int *)&buffer->buffer[(BLOCK_SIZE-(firstsum*sizeof(int)))]);
-               } else {
-                  firstsum = -1;
-                  checksum = *((int *)&buffer2->buffer[(BLOCK_SIZE-16)]);
-               }
+               firstsum = -1;
+               checksum = *((int *)&buffer2->buffer[(BLOCK_SIZE-16)]);
+            }
 /*
 printf ("firstsum %d, i %d, headerlen %d, sum %x\n", firstsum, i, inode->headerlen, checksum);
 */
-            }
-#endif
-            data1 = &buffer->buffer[(fileoff%(BLOCK_SIZE-16))];
-            len1 = blklen;
-            len2 = blklen2;
          }
+#endif
+         data1 = &buffer->buffer[(fileoff%(BLOCK_SIZE-16))];
+         len1 = blklen;
+         len2 = blklen2;
+      }
 
 #ifdef MERGE_PACKETS
-                    /* first part sets "CLOSEALSO" flag appropriately */
-         flags = (resplen == (len1+len2+offset)) | TCP_SEND_MAXSIZEONLY;
+                 /* first part sets "CLOSEALSO" flag appropriately */
+      flags = ((resp->close) && (resplen == (len1+len2+offset))) | TCP_SEND_MAXSIZEONLY;
 #endif
 
 //printf ("send: resplen %d, fileoff %d, offset %d, headerlen %d, len1 %d, len2 %d, flags %x, checksum %x\n", resplen, fileoff, offset, inode->headerlen, len1, len2, flags, checksum);
-         assert ((len1 + len2 + offset) <= resplen);
+      assert ((len1 + len2 + offset) <= resplen);
 
-         sent = xio_tcp_prepDataPacket (&webreq->tcb, data1, len1, data2, len2, flags, checksum);
-         if (! ((sent == 0) || (sent == 1460) || (sent == (len1+len2)) || ((sent == min(webreq->tcb.mss,webreq->tcb.snd_wnd)) && (webreq->recompute_checksums)))) {
-            kprintf ("sent %d, len1 %d, len2 %d, flags %x\n", sent, len1, len2, flags);
-         }
-         assert ((sent == 0) || (sent == 1460) || (sent == (len1+len2)) || ((sent == min(webreq->tcb.mss,webreq->tcb.snd_wnd)) && webreq->recompute_checksums));
-         xio_tcpcommon_sendPacket (&webreq->tcb, voloff);
+	/* precomputed sums cover a whole 1460-byte segment (or the tail); */
+	/* if the window cuts this one short, let TCP checksum what it sends */
+      if ((checksum != -1) && (xio_tcp_seglen (&webreq->tcb, (len1+len2), flags) != min((len1+len2), 1460))) {
+         checksum = -1;
+      }
 
-#ifndef MERGE_CACHERETRANS
-	/* GROK -- this is old and broken and kept only for reference */
-         {int tmplen = 18384 - xio_tcpbuffer_countOutBufferedData (&webreq->tcb);
-         sent = 0;
-         if (tmplen >= (inode->headerlen - j)) {
-            sent = xio_tcpbuffer_write (&webreq->tcb, &buffer->buffer[j], (inode->headerlen - j), webreq->write_offset);
-         }
-         if ((sent == (inode->headerlen - j)) && ((tmplen-sent) >= blklen)) {
-            sent += xio_tcpbuffer_write (&webreq->tcb, &buffer->buffer[i], blklen, (webreq->write_offset+sent));
-         }
-         webreq->write_offset += sent;
-         }
-#endif
+      sent = xio_tcp_prepDataPacket (&webreq->tcb, data1, len1, data2, len2, flags, checksum);
+      assert ((sent >= 0) && (sent <= (len1+len2)));
+      xio_tcpcommon_sendPacket (&webreq->tcb, voloff);
 
-         offset += sent;
+      offset += sent;
 
-         if (buffer2) {
-            web_fs_buffer_releaseBlock (buffer, 0);
-            buffer = buffer2;
-         }
+      if (buffer2) {
+         web_fs_buffer_releaseBlock (buffer, 0);
+         buffer = buffer2;
+      }
 
-         if (sent == 0) {
+      if (sent == 0) {
 /*
 printf ("couldn't send it all: blklen %d, sent %d\n", blklen, sent);
 */
-            web_fs_buffer_releaseBlock (buffer, 0);
-            return;
-         }
+         web_fs_buffer_releaseBlock (buffer, 0);
+         return (0);
+      }
+   }
+   return (1);
+}
+
+
+/* Push out every queued response from the TCB's send_offset onward.  On */
+/* a persistent connection a timeout can rewind send_offset into any     */
+/* response that is still unacknowledged.                                */
+
+static int webreq_sendqueued (webreq_t *webreq)
+{
+   int i;
+
+   for (i=0; i<webreq->respcnt; i++) {
+      webresp_t *resp = &webreq->resps[((webreq->respfirst + i) % WEB_MAX_PIPELINE)];
+      if (webreq->tcb.send_offset >= (resp->base + resp->len)) {
+         continue;
+      }
+      if (webreq_sendresp (webreq, resp) == 0) {
+         return (0);
+      }
+   }
+   return (1);
+}
+
+#endif  /* ! HIGHLEVEL */
+
+
+void webreq_senddoc (webreq_t *webreq)
+{
+#ifndef HIGHLEVEL
+   int sent;
+   int sendfile = ((webreq->command == WEBREQ_TYPE_GET) || (webreq->command == WEBREQ_TYPE_OLDGET));
+
+   DPRINTF (4, ("webreq_senddoc: command %d, sendfile %d, tmpval %d, queued %d\n", webreq->command, sendfile, webreq->tmpval, webreq->respcnt));
+
+	/* documents (including this one, if any) go out from the queue */
+   if (webreq_sendqueued (webreq) == 0) {
+      return;
+   }
+
+	/* This path is only used for HEAD requests and bad requests, which */
+	/* always end the connection.  The text follows any queued responses. */
+   if ((!sendfile) && (webreq->tmpval > (webreq->tcb.send_offset - webreq->nextbase))) {
+      int hdroff = webreq->tcb.send_offset - webreq->nextbase;
+/*
+printf ("send #1\n");
+*/
+      sent = xio_tcp_prepDataPacket (&webreq->tcb, (webreq->hdr + hdroff), (webreq->tmpval - hdroff), NULL, 0, (TCP_SEND_ALSOCLOSE|TCP_SEND_MAXSIZEONLY), -1);
+      xio_tcpcommon_sendPacket (&webreq->tcb, 0);
+      if (webreq->tmpval > (webreq->tcb.send_offset - webreq->nextbase)) {
+         return;
       }
    }
 
 #ifndef MERGE_PACKETS
-#ifndef MERGE_CACHERETRANS
-   if (webreq->write_offset > webreq->tcb.send_offset) {
-      webreq->docloseafterwrites = 1;
-   } else
-#endif
-   {
-      int ret = xio_tcp_initiate_close (&webreq->tcb);
-      assert (ret == 1);
+   if (!webreq->keepalive) {
+      xio_tcp_initiate_close (&webreq->tcb);
       xio_tcpcommon_sendPacket (&webreq->tcb, 0);
    }
 #endif
 
    webreq->max_send_offset = webreq->tcb.send_offset;
    webreq->waitee = NULL;
-   webreq->state = WEBREQ_STATE_CLOSING;
+   if ((sendfile) && (webreq->keepalive)) {
+      webreq_nextreq (webreq);
+   } else {
+      webreq->state = WEBREQ_STATE_CLOSING;
+   }
 
 #else  /* HIGHLEVEL */
    char buf[4096];
    int ret;
    if (webreq->tmpval) {
-      char *header = (char *) ((uint)(webreq->pathname + webreq->pathnamelen + 1 + 3) & 0xFFFFFFFC);                                       
-      ret = write (webreq->sockfd, header, webreq->tmpval);
+      ret = write (webreq->sockfd, webreq->hdr, webreq->tmpval);
       if (ret != webreq->tmpval) {
          printf ("write of header 'failed': ret %d, expected %d, errno %d\n", ret, webreq->tmpval, errno);
       }
@@ -913,6 +1315,10 @@ kprintf ("rolling back becuase write would block\n");
             return;
          }
       }
+      if (webreq->keepalive) {
+         webreq_nextreq (webreq);
+         return;
+      }
       if ((ret = close (webreq->inode)) != 0) {
          printf ("webreq_senddoc: file close failed (fd %d, ret %d, errno %d)\n", webreq->inode, ret, errno);
          exit (0);
@@ -998,6 +1404,8 @@ static inline int chknclr_diskwait (webreq_t *webreq)
 
 static int workon_webreq (webreq_t *webreq)
 {
+   int numreqs;
+
 //printf ("working on webreq: state %d\n", webreq->state);
    assert (webreq->state != WEBREQ_STATE_FREE);
 #ifndef HIGHLEVEL
@@ -1010,17 +1418,38 @@ static int workon_webreq (webreq_t *webreq)
       return (1);
    }
 #endif
+   if (webreq->state & WEBREQ_STATE_DISKWAIT) {
+      return (0);
+   }
+
+	/* between requests of a persistent connection: finish (re)sending */
+	/* earlier responses, and stop when the client has gone away       */
+   webreq_retireresps (webreq);
    if (webreq->state & WEBREQ_STATE_REQRECV) {
-      if (webreq->inbuflen > 0) {
-         webreq_reqrecv (webreq);
+      if ((webreq->tcb.send_offset < webreq->nextbase) && (webreq_sendqueued (webreq) == 0)) {
+         return (0);
+      }
+      if ((xio_tcp_finrecv (&webreq->tcb)) && (webreq->state == WEBREQ_STATE_REQRECV_COMMAND) && (webreq->inbuflen == 0)) {
+         webreq_closeconn (webreq);
+         return (0);
       }
    }
-   if (webreq->state == WEBREQ_STATE_FINDDOC) {
-      webreq_finddoc (webreq);
-   }
-   if (webreq->state == WEBREQ_STATE_SENDDOC) {
-      webreq_senddoc (webreq);
-   }
+
+	/* a single packet can carry several pipelined requests */
+   do {
+      numreqs = webreq->numreqs;
+      if ((webreq->state & WEBREQ_STATE_REQRECV) && (webreq->respcnt < WEB_MAX_PIPELINE)) {
+         if (webreq->inbuflen > 0) {
+            webreq_reqrecv (webreq);
+         }
+      }
+      if (webreq->state == WEBREQ_STATE_FINDDOC) {
+         webreq_finddoc (webreq);
+      }
+      if (webreq->state == WEBREQ_STATE_SENDDOC) {
+         webreq_senddoc (webreq);
+      }
+   } while ((webreq->numreqs != numreqs) && (webreq->state & WEBREQ_STATE_REQRECV) && (!(webreq->state & WEBREQ_STATE_DISKWAIT)));
    return (0);
 }
 
@@ -1036,14 +1465,89 @@ void web_server_setServerPort (int port)
 
 #else
    struct listentcb *listentcb = (struct listentcb *) malloc (sizeof(struct listentcb));
-   int demux_id = xio_net_wrap_getdpf_tcp (&nwinfo, port, -1);
-   assert (demux_id != -1);
+	/* the packet filter is installed by web_server_startlistens, once */
+	/* each server process has its own receive ring                    */
+   assert (numlistens < WEB_MAX_LISTENS);
+   listenports[numlistens++] = port;
    xio_tcp_initlistentcb (listentcb, INADDR_ANY, port);
    xio_tcp_demux_addlisten (&dmxinfo, (struct tcb *) listentcb, 0);
 #endif
 }
 
 
+#ifndef HIGHLEVEL
+
+/* Start (NumServers - 1) more copies of the server, each with its own  */
+/* event loop, receive ring and connections.  The listen ports are      */
+/* split among them by DPF (see web_server_startlistens), so the copies */
+/* never touch each other's connections.  The document blocks already   */
+/* live in the shared buffer cache; the name cache is put in a shared   */
+/* mapping before forking so that a lookup done by one server is a hit  */
+/* for all of them.  Each copy is then moved to its own CPU.            */
+
+static void web_server_forkservers ()
+{
+   int ncpus = sys_get_num_cpus ();
+   char *space;
+   int i;
+
+   numservers = (NumServers > 0) ? NumServers : ncpus;
+   numservers = min (numservers, WEB_MAX_SERVERS);
+	/* flows are split on the low bits of the client's port number */
+   while (numservers & (numservers - 1)) {
+      numservers &= numservers - 1;
+   }
+
+   space = mmap (NULL, (WEB_NAMECACHE_SIZE + PAGESIZ), (PROT_READ|PROT_WRITE), (MAP_SHARED|MAP_ANON), -1, (off_t) 0);
+   assert (space != (char *) MAP_FAILED);
+   namecache_lock = (exos_lock_t *) space;
+   exos_lock_init (namecache_lock);
+   namecache = name_cache_initspace ((nc_t *) (space + PAGESIZ), WEB_NAMECACHE_SIZE, 128);
+
+   for (i=1; i<numservers; i++) {
+      int pid = fork ();
+      assert (pid != -1);
+      if (pid == 0) {
+         servno = i;
+         break;
+      }
+   }
+
+   if ((servno % ncpus) != 0) {
+      struct Env *e = &__envs[envidx(__envid)];
+      int cpu = servno % ncpus;
+      int q;
+
+      if (sys_quantum_alloc (CAP_ROOT, -1, cpu, __envid) < 0) {
+         printf ("server %d: unable to get a quantum on cpu %d\n", servno, cpu);
+         return;
+      }
+	/* give up the quanta (on cpu 0) inherited from fork */
+      for (q=0; q<(QMAP_SIZE*8); q++) {
+         if (e->env_quanta[0][(q/8)] & (1 << (q%8))) {
+            sys_quantum_free (CAP_ROOT, q, 0);
+         }
+      }
+   }
+}
+
+
+/* install the packet filters for the listen ports.  With more than one */
+/* server, each one only gets its share of the flows.                   */
+
+static void web_server_startlistens ()
+{
+   int i;
+
+   for (i=0; i<numlistens; i++) {
+      int demux_id = xio_net_wrap_getdpf_tcpsteer (&nwinfo, listenports[i], numservers, servno);
+      assert (demux_id != -1);
+   }
+}
+
+#endif	/* ! HIGHLEVEL */
+
+
 int main (int argc, char **argv)
 {
 #if 0
@@ -1091,8 +1595,6 @@ int main (int argc, char **argv)
    twinfo = (xio_twinfo_t *) malloc (xio_twinfo_size (4096));
    /* pass in space for hash-table of packets in time-wait */
    xio_tcp_timewait_init (twinfo, 4096, web_pagealloc);
-   /* pass in pages for receive rings */
-   xio_net_wrap_init (&nwinfo, malloc(64*PAGESIZ), (64 * PAGESIZ));
 #endif
 
    web_config (argv[1]);
@@ -1102,8 +1604,14 @@ printf ("CONFIG DONE!\n");
    web_error_initmsgs ();
 
 #ifndef HIGHLEVEL
-   namecache = name_cache_init (16384, 128);
-   name_cache_addEntry (namecache, 0, "/", 1, DocumentRootInodeNum);
+   web_server_forkservers ();
+   web_respcache_init (ResponseCacheSize * 1024);
+   if (servno == 0) {
+      name_cache_addEntry (namecache, 0, "/", 1, DocumentRootInodeNum);
+   }
+   /* pass in pages for receive rings */
+   xio_net_wrap_init (&nwinfo, malloc(64*PAGESIZ), (64 * PAGESIZ));
+   web_server_startlistens ();
 
 #else	/* HIGHLEVEL */
    assert (mainfd >= 0);	/* must have init'd the listen by now */
@@ -1132,6 +1640,12 @@ printf ("CONFIG DONE!\n");
 
    web_datetime_init ();
 
+   {
+      char vers10[2] = { '.', '0' };
+      char vers11[2] = { '.', '1' };
+      httpvers_sumdelta = *((unsigned short *) vers11) - *((unsigned short *) vers10);
+   }
+
 printf ("Entering main loop\n");
 
    while (1) {
@@ -1142,7 +1656,8 @@ tmptime = time(NULL);
 if (tmptime >= deadtime) {
 #ifndef HIGHLEVEL
    extern int inpackets, outpackets;
-   printf ("****** Hit deadtime %d (in %d, out %d) (numconns %d, timewaiters %d, diskreqs %d)\n", (uint) deadtime, inpackets, outpackets, numconns, twinfo->timewaiter_cnt, web_fs_diskreqs_outstanding);
+   printf ("****** Hit deadtime %d (server %d) (in %d, out %d) (numconns %d, timewaiters %d, diskreqs %d)\n", (uint) deadtime, servno, inpackets, outpackets, numconns, twinfo->timewaiter_cnt, web_fs_diskreqs_outstanding);
+   web_respcache_printStats ();
 #else
    printf ("****** Hit deadtime %d (numconns %d)\n", (uint) deadtime, numconns);
 #endif
@@ -1163,6 +1678,9 @@ if (tmptime >= deadtime) {
 	       /* send new packet (if any) prepared by xio_tcp_timeout */
                xio_tcpcommon_sendPacket (&webreq->tcb, 0);
             }
+            if ((i) && (webreq->state == WEBREQ_STATE_REQRECV_COMMAND) && (webreq->inbuflen == 0) && (webreq->numreqs > 0) && ((tmptime - webreq->idlesince) >= KeepAliveTimeout)) {
+               webreq_closeconn (webreq);
+            }
             if (ret != 0) {
                if ((webreq->state == WEBREQ_STATE_CLOSING) && (webreq->tcb.send_offset < webreq->max_send_offset)) {
                   webreq->state = WEBREQ_STATE_SENDDOC;
@@ -1202,7 +1720,8 @@ if (tmptime >= deadtime) {
          } else if (webreq) { /* webreq is null if this is a new request */
             chknclr_diskwait (webreq);
 	    /* handle ack,fin,rst,seq no's,window updates, and prepare an ack */
-            xio_tcp_handlePacket (&webreq->tcb, packet->r[0].data, 0);
+	    /* shrink the window as inbuf fills; webreq_nextreq reopens it */
+            xio_tcp_handlePacket (&webreq->tcb, packet->r[0].data, TCP_RECV_ADJUSTRCVWND);
             if (webreq->tcb.indata) {
                int livedatalen = xio_tcp_getLiveInDataLen (&webreq->tcb);
                char *livedata = xio_tcp_getLiveInData (&webreq->tcb);
@@ -1304,7 +1823,12 @@ printf ("New connection accepted. webreq == %p\n", webreq);
                webreq->inbuflen += ret;
             }
 */
-            webreq_reqrecv (webreq);
+            if (ret == 0) {
+		/* client closed a persistent connection */
+               webreq_closeconn (webreq);
+            } else {
+               webreq_reqrecv (webreq);
+            }
          }
          if (webreq->state == WEBREQ_STATE_FINDDOC) {
             webreq_finddoc (webreq);
@@ -1315,6 +1839,16 @@ printf ("New connection accepted. webreq == %p\n", webreq);
       while (webreq) {
          if (webreq->state == WEBREQ_STATE_SENDDOC) {
             webreq_senddoc (webreq);
+		/* pick up any pipelined request that is already buffered */
+            if ((webreq->state & WEBREQ_STATE_REQRECV) && (webreq->inbuflen > 0)) {
+               webreq_reqrecv (webreq);
+               if (webreq->state == WEBREQ_STATE_FINDDOC) {
+                  webreq_finddoc (webreq);
+               }
+            }
+         }
+         if ((webreq->state == WEBREQ_STATE_REQRECV_COMMAND) && (webreq->inbuflen == 0) && (webreq->numreqs > 0) && ((tmptime - webreq->idlesince) >= KeepAliveTimeout)) {
+            webreq_closeconn (webreq);
          }
          if (webreq->state == WEBREQ_STATE_CLOSING) {
             webreq_t *tmp = webreq;
@@ -36,462 +36,302 @@
  */
 
 
-#include <stdio.h>
-#include <unistd.h>
-#include <sys/types.h>
-
-//#include <exos/tick.h>
+/*
+ * webblast: HTTP load generator.  Keeps a fixed number of connections to
+ * the server busy and reports completed requests per second.  With -k the
+ * connections are persistent (HTTP/1.1) and up to <depth> requests are
+ * pipelined on each; otherwise every request uses its own HTTP/1.0
+ * connection.  The server defaults to "localhost", so the whole run stays
+ * on the loopback device.
+ */
 
+#include <sys/types.h>
+#include <sys/time.h>
+#include <stdio.h>
 #include <stdlib.h>
-#include <assert.h>
-#include <fcntl.h>
+#include <unistd.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <assert.h>
 
 #include <sys/socket.h>
 #include <netinet/in.h>
 
 extern char *get_ip_from_name(const char *name);
 
-static int portno = 80;
+#define WEBBLAST_MAXCONNS	64
+#define WEBBLAST_MAXDEPTH	16
+#define WEBBLAST_BUFSIZE	8192
+
+typedef struct blastconn {
+   int fd;
+   int outstanding;	/* requests written but not yet answered */
+   int inheader;	/* still scanning the current response header */
+   int bodyleft;	/* body bytes of the current response still expected */
+   int hdrlen;
+   char hdr[1024];
+} blastconn_t;
 
-#define PAGESIZ 4096
+static blastconn_t conns[WEBBLAST_MAXCONNS];
 
-static int fd;
+static struct sockaddr_in servaddr;
+static char req[512];
+static int reqlen;
 
-static int numconns = 0;
-static int MaxConns = 1;
-static int *connfds = NULL;
+static int keepalive = 0;
+static int depth = 1;
+static int numconns = 1;
+static int totalreqs = 1000;
 
-static char pagebuf[32768+1];
-static char buf[8192];
+static int issued = 0;
+static int completed = 0;
+static int bytes = 0;
+static int connects = 0;
 
-static char *servername = NULL;
-static char *ip_addr = NULL;
-static struct sockaddr_in connaddr;
 
-typedef struct urlptr {
-   struct urlptr *next;
-   int len;
-   char line[(512 - sizeof(int) - sizeof (struct urlptr *))];
-} urlptr_t;
+static void usage (char *progname)
+{
+   fprintf (stderr, "Usage: %s [ -k ] [ -d <depth> ] [ -c <conns> ] [ -n <requests> ] [ -p <portno> ] [ <server> ] <docname>\n", progname);
+   exit (0);
+}
 
-urlptr_t *urlptr_extra = NULL;
 
-static void urlptr_allocateextra()
+static void blast_connect (blastconn_t *conn)
 {
-   urlptr_t *temp;
-   int i;
+   int ret;
 
-   if ((temp = (urlptr_t *) malloc(PAGESIZ)) == NULL) {
-      printf("Unable to allocate space for urlptr_t's\n");
-      exit(0);
+   if ((conn->fd = socket (AF_INET, SOCK_STREAM, IPPROTO_TCP)) == -1) {
+      perror ("Unable to create client socket");
+      exit (0);
    }
-   for (i=0; i<((PAGESIZ/sizeof(urlptr_t))-1); i++) {
-      temp[i].next = &temp[i+1];
+   if (connect (conn->fd, (struct sockaddr *) &servaddr, sizeof(servaddr)) == -1) {
+      perror ("Failed to connect");
+      exit (0);
+   }
+   if (((ret = fcntl (conn->fd, F_GETFL, 0)) < 0) || (fcntl (conn->fd, F_SETFL, (ret | O_NONBLOCK)) < 0)) {
+      printf ("blast_connect: unable to make socket nonblocking (errno %d)\n", errno);
+      exit (0);
    }
-   temp[((PAGESIZ/sizeof(urlptr_t))-1)].next = NULL;
-   urlptr_extra = temp;
+   conn->outstanding = 0;
+   conn->inheader = 1;
+   conn->hdrlen = 0;
+   conn->bodyleft = 0;
+   connects++;
 }
 
 
-static void free_urlptr(temp)
-urlptr_t *temp;
+static void blast_close (blastconn_t *conn)
 {
-   temp->next = urlptr_extra;
-   urlptr_extra = temp;
+   close (conn->fd);
+   conn->fd = -1;
 }
 
 
-static urlptr_t * get_urlptr()
-{
-   urlptr_t *temp = urlptr_extra;
+/* Top up the connection with new requests, up to the pipeline depth */
 
-   if (temp == NULL) {
-      urlptr_allocateextra();
-      temp = urlptr_extra;
+static void blast_issue (blastconn_t *conn)
+{
+   while ((conn->outstanding < depth) && (issued < totalreqs)) {
+      if (conn->fd == -1) {
+         blast_connect (conn);
+      }
+      if (write (conn->fd, req, reqlen) != reqlen) {
+         printf ("blast_issue: failed to write request (errno %d)\n", errno);
+         exit (0);
+      }
+      conn->outstanding++;
+      issued++;
    }
-   urlptr_extra = urlptr_extra->next;
-   temp->next = NULL;
-   return(temp);
 }
 
 
-void request_url (urlptr)
-urlptr_t *urlptr;
+/* Pull the Content-length out of a complete response header */
+
+static int blast_contentlength (char *hdr, int hdrlen)
 {
-   int newfd;
    int i;
 
-   if ((newfd = socket (AF_INET, SOCK_STREAM, IPPROTO_TCP)) == -1) {
-      fprintf (stderr, "Unable to create the main server TCP socket\n");
-      exit(0);
-   }
-
-   bzero ((char *) &connaddr, sizeof(connaddr));
-   connaddr.sin_family = AF_INET;
-   connaddr.sin_addr.s_addr = *((uint *) ip_addr);
-   connaddr.sin_port = htons (portno);
-
-   if (connect (newfd, (struct sockaddr *) &connaddr, sizeof(connaddr)) == -1) {
-      perror ("cannot establish connection to server\n");
-      exit(0);
-   }
-
-   if (write (newfd, urlptr->line, urlptr->len) != urlptr->len) {
-      printf ("failed to write entire include request\n");
-      exit (0);
-   }
-
-   for (i=0; i<MaxConns; i++) {
-      if (connfds[i] == -1) {
-         connfds[i] = newfd;
-         break;
+   for (i=0; i<(hdrlen - 15); i++) {
+      if (((i == 0) || (hdr[(i-1)] == '\n')) && (strncasecmp (&hdr[i], "Content-length:", 15) == 0)) {
+         return (atoi (&hdr[(i+15)]));
       }
    }
-   assert (i != MaxConns);
-   numconns++;
+   return (-1);
 }
 
 
-int string_compare (str1, str2, len)
-char *str1;
-char *str2;
-int len;
-{
-   int i;
-   char c1, c2;
+/* Consume response bytes.  Returns the number of responses completed. */
 
-   for (i=0; i<len; i++) {
-      c1 = str1[i];
-      c2 = str2[i];
-      if ((c1 >= 65) && (c1 <= 90)) {
-         c1 += 32;
-      }
-      if ((c2 >= 65) && (c2 <= 90)) {
-         c2 += 32;
+static int blast_consume (blastconn_t *conn, char *buf, int len)
+{
+   int done = 0;
+   int i = 0;
+
+   while (i < len) {
+      if (conn->inheader) {
+         char c = buf[i++];
+         if (conn->hdrlen < sizeof(conn->hdr)) {
+            conn->hdr[conn->hdrlen++] = c;
+         }
+         /* the header ends with an empty line, with or without CRs */
+         if ((c == '\n') && (conn->hdrlen >= 2) &&
+             ((conn->hdr[(conn->hdrlen-2)] == '\n') ||
+              ((conn->hdrlen >= 3) && (conn->hdr[(conn->hdrlen-2)] == '\r') && (conn->hdr[(conn->hdrlen-3)] == '\n')))) {
+            conn->bodyleft = blast_contentlength (conn->hdr, conn->hdrlen);
+            if ((conn->bodyleft < 0) && (keepalive)) {
+               printf ("response without a Content-length on a persistent connection\n");
+               exit (0);
+            }
+            conn->inheader = 0;
+            conn->hdrlen = 0;
+         }
+      } else {
+         int n = len - i;
+         if ((conn->bodyleft >= 0) && (n > conn->bodyleft)) {
+            n = conn->bodyleft;
+         }
+         i += n;
+         if (conn->bodyleft >= 0) {
+            conn->bodyleft -= n;
+         }
       }
-      if (c1 != c2) {
-         return (c1 - c2);
+      if ((!conn->inheader) && (conn->bodyleft == 0)) {
+         conn->inheader = 1;
+         conn->outstanding--;
+         done++;
       }
    }
-   return (0);
+   return (done);
 }
 
 
-urlptr_t *scan_for_urls (pagebuf, pagelen, base)
-char *pagebuf;
-int pagelen;
-char *base;
+static void blast_readable (blastconn_t *conn)
 {
-   urlptr_t *urllist = NULL;
-   urlptr_t *tmp = NULL;
-   int state = 0;
-   int i;
-   int cycle = 0;
+   char buf[WEBBLAST_BUFSIZE];
+   int ret;
 
-   for (i=0; i<pagelen; i++) {
-      if (cycle > 0) {
-         cycle--;
-         continue;
-      }
-      if (pagebuf[i] == ' ') {
-         continue;
+   while ((ret = read (conn->fd, buf, WEBBLAST_BUFSIZE)) > 0) {
+      bytes += ret;
+      completed += blast_consume (conn, buf, ret);
+   }
+   if ((ret == 0) || ((ret < 0) && (errno != EWOULDBLOCK) && (errno != EAGAIN))) {
+	/* an HTTP/1.0 response without a length ends at the close */
+      if ((!conn->inheader) && (conn->bodyleft < 0)) {
+         conn->outstanding--;
+         completed++;
       }
-      if (state == 0) {
-         if (pagebuf[i] == '<') {
-            state = 1;
-         }
-      } else if (state == 1) {
-         if (string_compare (&pagebuf[i], "body", 4) == 0) {
-            state = 3;
-/*
-         } else if (string_compare (&pagebuf[i], "base", 4) == 0) {
-            state = 2;
-*/
-         } else if (string_compare (&pagebuf[i], "img", 3) == 0) {
-            state = 4;
-         } else {
-            state = 0;
-         }
-      } else if (state == 2) {
-         if (string_compare (&pagebuf[i], "href=", 5) == 0) {
-            cycle = 4;
-            state = 5;
-         } else if (string_compare (&pagebuf[i], "</base>", 7) == 0) {
-            state = 0;
-         }
-      } else if (state == 3) {
-         if (string_compare (&pagebuf[i], "background=", 11) == 0) {
-            cycle = 10;
-            state = 5;
-         } else if (pagebuf[i] == '>') {
-            state = 0;
-         }
-      } else if (state == 4) {
-         if (string_compare (&pagebuf[i], "src=", 4) == 0) {
-            cycle = 3;
-            state = 5;
-         } else if (string_compare (&pagebuf[i], "</img>", 7) == 0) {
-            state = 0;
-         }
-      } else if (state == 5) {
-         if (pagebuf[i] == '"') {
-            if (urllist == NULL) {
-               tmp = get_urlptr ();
-               urllist = tmp;
-            } else {
-               tmp->next = get_urlptr ();
-               tmp = tmp->next;
-            }
-            tmp->next = NULL;
-            tmp->line[0] = 'G';
-            tmp->line[1] = 'E';
-            tmp->line[2] = 'T';
-            tmp->line[3] = ' ';
-            tmp->len = 4;
-            state = 6;
-         } else {
-            printf ("unexpected character in URL: %c\n", pagebuf[i]);
-            state = 0;
-         }
-      } else if (state == 6) {
-         if (pagebuf[i] != '"') {
-            if ((tmp->len == 4) && (string_compare (&pagebuf[i], "http:", 5) != 0)) {
-               bcopy (base, &tmp->line[4], strlen(base));
-               tmp->len += strlen(base);
-            } else {
-               tmp->len = 0;
-               state = 0;
-               continue;
-            }
-            tmp->line[tmp->len] = pagebuf[i];
-            tmp->len++;
-         } else {
-            assert (tmp->len > 4);
-            assert (tmp->len < (sizeof(tmp->line) - 20));
-                             /* must use this newline for Harvest */
-            bcopy (" HTTP/1.0\r\n\r\n", &tmp->line[tmp->len], 14);
-            tmp->len += 14;
-            state = 0;
-/*
-printf ("next url:\n%s", tmp->line);
-*/
-         }
+      if (conn->outstanding != 0) {
+         printf ("server closed connection with %d requests outstanding\n", conn->outstanding);
+         exit (0);
       }
+      blast_close (conn);
+   } else if ((!keepalive) && (conn->outstanding == 0)) {
+      blast_close (conn);
    }
-   return (urllist);
 }
 
 
-int main (argc, argv)
-int argc;
-char **argv;
+int main (int argc, char **argv)
 {
-   int ret = 0;
-   char *req;
-   int filesize = 0;
-   int bytes = 0;
-   int rate = 1000000; //ae_getrate ();
-   int bpms;
-   int ticks;
-   int time1;
-   FILE *urlfile;
-   char line[256];
-   int webpages = 0;
-   int pagebytes;
-   urlptr_t *urllist;
+   char *servername = "localhost";
+   char *docname;
+   char *ip_addr;
+   int portno = 80;
+   struct timeval start, end;
+   double secs;
+   fd_set readset;
+   int maxfd;
+   int ch;
    int i;
-   int repeatcount = 0;
-   int repeatmax = 1;
-   double totaltime = 0.0;
 
-   if ((argc != 3) && (argc != 4) && (argc != 5)) {
-      printf ("Usage: %s <server> <urlfile> [ <iters> <portno> ]\n", argv[0]);
-      exit (0);
+   while ((ch = getopt (argc, argv, "kd:c:n:p:")) != -1) {
+      switch (ch) {
+         case 'k': keepalive = 1; break;
+         case 'd': depth = atoi (optarg); break;
+         case 'c': numconns = atoi (optarg); break;
+         case 'n': totalreqs = atoi (optarg); break;
+         case 'p': portno = atoi (optarg); break;
+         default: usage (argv[0]);
+      }
    }
-
-   servername = argv[1];
-
-#ifdef EXOPC
-   ip_addr = get_ip_from_name (servername);
-#else
-   ip_addr = malloc(4);
-   ip_addr[0] = 128;
-   ip_addr[1] = 2;
-   ip_addr[2] = 252;
-   ip_addr[3] = 81;
-#endif
-   if (ip_addr == NULL) {
-      fprintf (stderr, "server %s is unknown (i.e., not listed in hosttable\n", argv[1]);
-      exit(1);
+   argc -= optind;
+   argv += optind;
+   if (argc == 2) {
+      servername = argv[0];
+      docname = argv[1];
+   } else if (argc == 1) {
+      docname = argv[0];
+   } else {
+      usage ("webblast");
    }
 
-repeat:
-   filesize = 0;
-   bytes = 0;
-
-   if ((urlfile = fopen (argv[2], "r")) == NULL) {
-      printf ("Unable to open specified list of URLs: %s\n", argv[2]);
+   if ((numconns < 1) || (numconns > WEBBLAST_MAXCONNS) || (depth < 1) || (depth > WEBBLAST_MAXDEPTH) || (totalreqs < 1)) {
+      printf ("need 1 <= conns <= %d, 1 <= depth <= %d and requests >= 1\n", WEBBLAST_MAXCONNS, WEBBLAST_MAXDEPTH);
       exit (0);
    }
-
-   if (argc >= 4) {
-      repeatmax = atoi (argv[3]);
-      assert (repeatmax > 0);
-      if (argc == 5) {
-         portno = atoi (argv[4]);
-         assert (portno > 0);
-      }
+   if ((!keepalive) && (depth != 1)) {
+      printf ("pipelining (-d) requires persistent connections (-k)\n");
+      exit (0);
    }
 
-   connfds = (int *) malloc (MaxConns * sizeof (int));
-   assert (connfds);
-   for (i=0; i<MaxConns; i++) {
-      connfds[i] = -1;
+   if ((ip_addr = get_ip_from_name (servername)) == NULL) {
+      fprintf (stderr, "server %s is unknown (i.e., not found in hosttable)\n", servername);
+      exit (0);
+   }
+   bzero ((char *) &servaddr, sizeof(servaddr));
+   servaddr.sin_family = AF_INET;
+   servaddr.sin_addr.s_addr = *((uint *) ip_addr);
+   servaddr.sin_port = htons (portno);
+
+   reqlen = snprintf (req, sizeof(req), "GET %s HTTP/1.%d\r\nHost: %s\r\n\r\n", docname, keepalive, servername);
+   if (reqlen >= sizeof(req)) {
+      printf ("document name too long: %s\n", docname);
+      exit (0);
    }
 
-                        /* must use this newline for Harvest */
-   req = "GET / HTTP/1.0\r\n\r\n";
-   line[0] = 'G';
-   line[1] = 'E';
-   line[2] = 'T';
-   line[3] = ' ';
-   line[4] = '/';
-
-/*
-printf ("going to loop\n");
-*/
-
-/*
-   gettimeofday (&time1, &crap);
-   lasttime1 = time1;
-*/
-   time1 = time(NULL); //ae_gettick();
-   while (fgets (&line[5], 250, urlfile)) {
-/*
-printf ("%s\n", line);
-*/
-
-      if ((fd = socket (AF_INET, SOCK_STREAM, IPPROTO_TCP)) == -1) {
-         fprintf (stderr, "Unable to create the main server TCP socket\n");
-         exit(0);
-      }
-
-      bzero ((char *) &connaddr, sizeof(connaddr));
-      connaddr.sin_family = AF_INET;
-      connaddr.sin_addr.s_addr = *((uint *) ip_addr);
-      connaddr.sin_port = htons (portno);
+   for (i=0; i<numconns; i++) {
+      conns[i].fd = -1;
+      conns[i].outstanding = 0;
+   }
 
-      if (connect (fd, (struct sockaddr *) &connaddr, sizeof(connaddr)) == -1) {
-         perror ("cannot establish connection to server\n");
-         exit(0);
-      }
-      ret = strlen (line);
-      assert (ret < 240);
-                        /* must use this newline for Harvest */
-      bcopy (" HTTP/1.0\r\n\r\n\0", &line[(ret-1)], 14);
-      ret = write (fd, line, (ret+12));
-/*
-printf ("next HTML request:\n%s",line);
-      printf ("\nret %d\n", ret);
-*/
-      /* set up base pathname */
-      ret = strlen(line) - 11;
-      line[ret] = (char) 0;
-      while (line[ret] != '/') {
-         line[ret] = (char) 0;
-         ret--;
-         assert (ret > 0);
-      }
+   gettimeofday (&start, NULL);
 
-      pagebytes = 0;
-      while ((ret = read (fd, &pagebuf[pagebytes], 8192)) > 0) {
-         filesize += ret;
-         bytes += ret;
-         pagebytes += ret;
-         if (pagebytes > (32768 - 8192)) {
-            printf ("Page might exceed maximum length\n");
-            exit (0);
+   while (completed < totalreqs) {
+      FD_ZERO (&readset);
+      maxfd = -1;
+      for (i=0; i<numconns; i++) {
+         blast_issue (&conns[i]);
+         if (conns[i].fd != -1) {
+            FD_SET (conns[i].fd, &readset);
+            maxfd = (conns[i].fd > maxfd) ? conns[i].fd : maxfd;
          }
       }
-      close (fd);
-      urllist = scan_for_urls (pagebuf, pagebytes, &line[4]);
-/*
-if (pagebytes < 500) {
-printf ("pagebytes %d, urllist %x\n", pagebytes, (unsigned) urllist);
-pagebuf[pagebytes] = (char) 0;
-printf ("%s\n", pagebuf);
-}
-*/
-      while ((urllist != NULL) && (numconns < MaxConns)) {
-         urlptr_t *tmp = urllist;
-         urllist = tmp->next;
-         if (tmp->len > 0) {
-            request_url (tmp);
-         }
-         free_urlptr (tmp);
+      assert (maxfd != -1);
+      if (select ((maxfd+1), &readset, NULL, NULL, NULL) < 0) {
+         perror ("select failed");
+         exit (0);
       }
-      while (numconns != 0) {
-         for (i=0; i<MaxConns; i++) {
-            if (connfds[i] != -1) {
-               while (read (connfds[i], buf, 8192) > 0) {
-               }
-               close (connfds[i]);
-               connfds[i] = -1;
-               numconns--;
-               if (urllist) {
-                  urlptr_t *tmp = urllist;
-                  urllist = tmp->next;
-                  if (tmp->len > 0) {
-                     request_url (tmp);
-                  }
-                  free_urlptr (tmp);
-               }
-/* don't know when it is closed ??
-               if (fstat (connfds[i], &statbuf) != 0) {
-                  perror ("unable to stat socket descriptor");
-                  exit (0);
-               }
-               while (statbuf.st_size > 0) {
-                  if ((ret = read (fd, buf, min (8192, statbuf.st_size))) != min (8192, statbuf.st_size)) {
-                     printf ("input size not equal to expected: %d != %d\n", ret, min (statbuf.st_size, 8192));
-                     exit (0);
-                  }
-                  statbuf.st_size -= min (8192, statbuf.st_size);
-               }
-*/
-            }
+      for (i=0; i<numconns; i++) {
+         if ((conns[i].fd != -1) && (FD_ISSET (conns[i].fd, &readset))) {
+            blast_readable (&conns[i]);
          }
       }
-      
-      webpages++;
-/*
-      if (webpages > 0) {
-         struct timeval tmp;
-         gettimeofday (&tmp, &crap);
-         usecs = (tmp.tv_sec * 1000000) + tmp.tv_usec - (lasttime1.tv_sec * 1000000) - lasttime1.tv_usec;
-         bpms = (bytes / (usecs / 1000)) * 1000;
-         printf ("after pageno %d -- bytes: %7d, bytes/sec: %6d\n", webpages, bytes, bpms);
-         lasttime1 = tmp;
-         bytes = 0;
-      }
-*/
    }
 
-   ticks = time(NULL) - time1; //ae_gettick() - time1;
-   bpms = (filesize / (ticks * rate / 1000)) * 1000;
-   totaltime += (double) ticks * (double) rate / 1000000.0;
-   printf ("bytes: %7d, usecs %8d, bytes/sec: %6d, pages/sec %f\n", filesize, (ticks * rate / 1000), bpms, ((double)webpages/totaltime));
+   gettimeofday (&end, NULL);
 
-   repeatcount++;
-   if (repeatcount < repeatmax) {
-      goto repeat;
+   for (i=0; i<numconns; i++) {
+      if (conns[i].fd != -1) {
+         blast_close (&conns[i]);
+      }
    }
 
-   printf ("done: ret %d (webpages %d)\n", ret, webpages);
-/*
-tcp_statistics();
-*/
-   return (1);
-}
+   secs = (double) (end.tv_sec - start.tv_sec) + ((double) (end.tv_usec - start.tv_usec) / 1000000.0);
+   printf ("%d requests over %d connections (%s, depth %d) in %d.%03d secs\n", completed, connects, ((keepalive) ? "persistent" : "one per request"), depth, (int) secs, ((int) (secs * 1000.0)) % 1000);
+   if (secs > 0.0) {
+      printf ("%d requests/sec, %d KB/sec\n", (int) ((double) completed / secs), (int) ((double) bytes / 1024.0 / secs));
+   }
 
+   return (0);
+}
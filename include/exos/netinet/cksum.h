@@ -107,6 +107,15 @@ static inline uint16 fold_32bit_checksum (uint32 sum)
    return (sum);
 }
 
+/* Fold a partial sum to 16 bits and swap its bytes, for adding the sum */
+/* of a piece that starts at an odd offset into the sum of the whole.   */
+static inline uint inet_sum_swab (uint sum)
+{
+   sum = (sum & 0xffff) + (sum >> 16);
+   sum = (sum & 0xffff) + (sum >> 16);
+   return (((sum & 0xff) << 8) | (sum >> 8));
+}
+
 struct ae_recv;
 uint16 inet_cksum_recv(struct ae_recv *a, uint16 count, long start);
 unsigned short inet_cksum_recv_cheat(struct ae_recv *a, unsigned long count, unsigned long start);
@@ -115,6 +124,13 @@ int otto_in_cksum(struct ae_recv *a, register int len, unsigned long input);
 long inet_sum(uint16 *addr, uint16 count, long start);
 uint16 inet_cksum(uint16 *addr, uint16 count, long start);
 uint inet_checksum(unsigned short *addr, int count, uint start, int last);
+uint inet_checksum_copy(unsigned short *src, unsigned short *dst, int count, uint start, int last);
+
+/* The sum and copy+sum loops are chosen by CPU type on first use; this */
+/* selects them by name instead (NULL for the default).  Returns -1 for */
+/* an unknown name.  inet_cksum_impl names the loops in use.            */
+int inet_cksum_select(char *name);
+extern char *inet_cksum_impl;
 int netbsd_in_cksum(register char *p, register int len, unsigned long input);
 
 #endif
@@ -95,16 +95,20 @@
 #define NPTY_SHARED_REGION_SZ	21*PAGESIZ
 
 #define FILP_SHARED_REGION (NPTY_SHARED_REGION + NPTY_SHARED_REGION_SZ)
-#define FILP_SHARED_REGION_SZ 5*PAGESIZ
+#define FILP_SHARED_REGION_SZ 2*PAGESIZ
 
-#define MOUNT_SHARED_REGION (FILP_SHARED_REGION + FILP_SHARED_REGION_SZ)
+/* file entries, mapped a chunk at a time (see fd/proc.h) */
+#define FILP_ENTRY_REGION (FILP_SHARED_REGION + FILP_SHARED_REGION_SZ)
+#define FILP_ENTRY_REGION_SZ 1024*PAGESIZ
+
+#define MOUNT_SHARED_REGION (FILP_ENTRY_REGION + FILP_ENTRY_REGION_SZ)
 #define MOUNT_SHARED_REGION_SZ PAGESIZ
 
 #define CFFS_SHARED_REGION (MOUNT_SHARED_REGION + MOUNT_SHARED_REGION_SZ)
 #define CFFS_SHARED_REGION_SZ 3*PAGESIZ
 
 #define PIPE_SHARED_REGION (CFFS_SHARED_REGION + CFFS_SHARED_REGION_SZ) 
-#define PIPE_SHARED_REGION_SZ 402*PAGESIZ
+#define PIPE_SHARED_REGION_SZ 660*PAGESIZ
 
 /* arp_shared_region */
 #define ARP_SHM_OFFSET          234235
@@ -132,7 +136,7 @@
 /* process management table */
 #define PROC_TABLE_SHM_OFFSET      (NEWPTY_SHM_OFFSET + 1)    
 #define PROC_TABLE_SHARED_REGION   (NEWPTY_SHARED_REGION + NEWPTY_SHARED_REGION_SZ)
-#define PROC_TABLE_SHARED_REGION_SZ 17*PAGESIZ
+#define PROC_TABLE_SHARED_REGION_SZ 19*PAGESIZ
     
 /* Exos locks in shared memory */
 #define EXOS_LOCKS_SHM_OFFSET	  (PROC_TABLE_SHM_OFFSET + 1)
@@ -154,7 +158,11 @@
 #define TEMP_PROC_STRUCT    (PROC_STRUCT + PROC_STRUCT_SZ)
 #define TEMP_PROC_STRUCT_SZ PROC_STRUCT_SZ
 
-#define USER_TEMP_PGS	(TEMP_PROC_STRUCT + TEMP_PROC_STRUCT_SZ)
+/* the fd and close-on-exec tables of the proc_struct, grown on demand */
+#define FD_TABLE_REGION	(TEMP_PROC_STRUCT + TEMP_PROC_STRUCT_SZ)
+#define FD_TABLE_REGION_SZ	40*PAGESIZ
+
+#define USER_TEMP_PGS	(FD_TABLE_REGION + FD_TABLE_REGION_SZ)
 #define USER_TEMP_PGS_SZ	32*PAGESIZ
 
 #define FORK_TEMP_PG (USER_TEMP_PGS + USER_TEMP_PGS_SZ)
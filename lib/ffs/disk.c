@@ -1,5 +1,8 @@
 #include <xuser.h>
 #include <stdlib.h>
+#include <string.h>
+#include <machine/param.h>
+#include <sys/queue.h>
 #include <xok/disk.h>
 #include <sys/types.h>
 #include <xok/sysinfo.h>
@@ -11,72 +14,323 @@
 int disk = -1;
 u_int e, j, k, disksize, bshift;
 
-int openDisk(u_int ndisk, u_int ne, u_int nj, u_int nk)
+/*
+ * Block cache.
+ *
+ * All disk traffic goes through a cache of NCBUF page-sized buffers,
+ * named by their page number on the disk (the same granularity the
+ * kernel buffer cache uses).  Reads copy out of the cache, filling
+ * any missing pages of a request with a single scatter/gather read.
+ * Writes are delayed: they only dirty the cached pages, which go out
+ * when they are evicted or on syncDisk().  A dirty page is written
+ * together with any dirty pages physically adjacent to it (up to
+ * CBUF_CLUSTER pages in one request), so blocks that ffs_alloc laid
+ * out contiguously are written back as one transfer.
+ */
+
+#define NCBUF		128
+#define CBUF_HASH	64
+#define CBUF_CLUSTER	16
+
+struct cbuf
 {
-  if (ndisk >= __sysinfo.si_ndisks)
-    return 0;
-  disk = ndisk;
-  e = ne;
-  j = nj;
-  k = nk;
-  disksize = __sysinfo.si_disks[disk].d_size;
-  bshift = __sysinfo.si_disks[disk].d_bshift;
-  return disksize;
+  struct buf cb_buf;		/* request header for this page */
+  u_int cb_pgno;		/* page number on disk */
+  int cb_valid, cb_dirty;
+  char *cb_data;
+  LIST_ENTRY(cbuf) cb_hash;
+  TAILQ_ENTRY(cbuf) cb_lru;
+};
+
+static struct cbuf *cbufs;
+static char *cbdata;
+static LIST_HEAD(, cbuf) cbhash[CBUF_HASH];
+static TAILQ_HEAD(, cbuf) cblru;
+static u_int pgsects;		/* sectors per cache page */
+
+#define cbuf_hashq(pgno)	(&cbhash[(pgno) & (CBUF_HASH - 1)])
+
+/* sectors of page pgno that lie on the disk */
+static inline u_int
+cbuf_sects (u_int pgno)
+{
+  u_int blk = pgno * pgsects;
+
+  return (blk + pgsects <= disksize ? pgsects : disksize - blk);
 }
 
-int readBlock(u_int offset, u_int len, void *block)
+/* issue the request chain starting at bp and wait for it to complete */
+static int
+disk_io (struct buf *bp, struct buf *last)
 {
-  struct buf b;
+  int resid = 0;
 
-  if (disk == -1)
-    return -1;
-  if (offset+(len>>bshift) >= disksize)
+  last->b_resptr = &resid;
+  if (sys_disk_request(e, j, k, bp))
     return -1;
+  /* GROK - hack'd way to force waiting for completion */
+  while ((resid == 0) && (ffs_fstat(-1) == 0));
+  return 0;
+}
+
+/* Read or write the n cache pages in cbv, which must be consecutive */
+/* on disk, as one scatter/gather request.                            */
+static int
+cbuf_io (struct cbuf **cbv, int n, int flags)
+{
+  struct buf *bp;
+  u_int total = 0;
+  int i;
 
-  b.b_flags = B_READ;
-  b.b_dev = disk;
-  b.b_blkno = offset;
-  b.b_bcount = len;
-  b.b_memaddr = block;
-  b.b_resid = 0;
-  b.b_resptr = &b.b_resid;
-  if (sys_disk_request(e, j, k, &b)) {
+  for (i = 0; i < n; i++)
+  {
+    bp = &cbv[i]->cb_buf;
+    bp->b_flags = flags | (i < n - 1 ? B_SCATGATH : 0);
+    bp->b_dev = disk;
+    bp->b_blkno = cbv[i]->cb_pgno * pgsects;
+    bp->b_bcount = cbuf_sects(cbv[i]->cb_pgno) << bshift;
+    bp->b_memaddr = cbv[i]->cb_data;
+    bp->b_sgnext = (i < n - 1) ? &cbv[i+1]->cb_buf : NULL;
+    bp->b_resptr = NULL;
+    bp->b_resid = 0;
+    total += bp->b_bcount;
+  }
+  cbv[0]->cb_buf.b_sgtot = (n > 1) ? total : 0;
+  return disk_io(&cbv[0]->cb_buf, &cbv[n-1]->cb_buf);
+}
+
+static struct cbuf *
+cbuf_lookup (u_int pgno)
+{
+  struct cbuf *cb;
+
+  for (cb = cbuf_hashq(pgno)->lh_first; cb; cb = cb->cb_hash.le_next)
+    if (cb->cb_pgno == pgno)
+      return cb;
+  return NULL;
+}
+
+/* write cb out along with the dirty pages physically adjacent to it */
+static int
+cbuf_flush (struct cbuf *cb)
+{
+  struct cbuf *cbv[CBUF_CLUSTER], *n;
+  u_int first = cb->cb_pgno;
+  int i, cnt;
+
+  while (first > 0 && cb->cb_pgno - first < CBUF_CLUSTER - 1 &&
+	 (n = cbuf_lookup(first - 1)) && n->cb_dirty)
+    first--;
+  for (cnt = 0; cnt < CBUF_CLUSTER; cnt++)
+  {
+    n = cbuf_lookup(first + cnt);
+    if (!n || !n->cb_dirty)
+      break;
+    cbv[cnt] = n;
+  }
+  if (cbuf_io(cbv, cnt, B_WRITE))
     return -1;
+  for (i = 0; i < cnt; i++)
+    cbv[i]->cb_dirty = 0;
+  return 0;
+}
+
+/* take the least recently used page and rename it pgno (not yet valid) */
+static struct cbuf *
+cbuf_alloc (u_int pgno)
+{
+  struct cbuf *cb = cblru.tqh_first;
+
+  if (cb->cb_dirty && cbuf_flush(cb))
+    return NULL;
+  if (cb->cb_pgno != -1)
+    LIST_REMOVE(cb, cb_hash);
+  cb->cb_pgno = pgno;
+  cb->cb_valid = 0;
+  LIST_INSERT_HEAD(cbuf_hashq(pgno), cb, cb_hash);
+  TAILQ_REMOVE(&cblru, cb, cb_lru);
+  TAILQ_INSERT_TAIL(&cblru, cb, cb_lru);
+  return cb;
+}
+
+/* Make the pages covering bytes start..end of the disk resident,      */
+/* reading the missing ones in runs.  When writing, pages that are     */
+/* about to be overwritten entirely are not read first; they stay      */
+/* invalid until writeBytes has filled them.                           */
+static int
+cbuf_fill (u_int start, u_int end, int writing)
+{
+  struct cbuf *cbv[CBUF_CLUSTER], *cb;
+  u_int pgno, last = (end - 1) / NBPG;
+  int n = 0;
+
+  for (pgno = start / NBPG; pgno <= last; pgno++)
+  {
+    if ((cb = cbuf_lookup(pgno)))
+    {
+      TAILQ_REMOVE(&cblru, cb, cb_lru);
+      TAILQ_INSERT_TAIL(&cblru, cb, cb_lru);
+    }
+    else if (!(cb = cbuf_alloc(pgno)))
+      return -1;
+    if (!cb->cb_valid &&
+	!(writing && pgno * NBPG >= start &&
+	  pgno * NBPG + (cbuf_sects(pgno) << bshift) <= end))
+    {
+      cbv[n++] = cb;
+      if (n < CBUF_CLUSTER && pgno != last)
+	continue;
+    }
+    if (n)
+    {
+      if (cbuf_io(cbv, n, B_READ))
+      {
+	while (n--)
+	{
+	  LIST_REMOVE(cbv[n], cb_hash);
+	  cbv[n]->cb_pgno = -1;
+	}
+	return -1;
+      }
+      while (n--)
+	cbv[n]->cb_valid = 1;
+      n = 0;
+    }
   }
-  /* GROK - hack'd way to force waiting for completion */
-  while ((b.b_resid == 0) && (ffs_fstat(-1) == 0));
   return 0;
 }
 
-int writeBlock(u_int offset, u_int len, void *block)
+static int
+cache_check (u_int offset, u_int skip, u_int len)
 {
-  struct buf b;
+  if (disk == -1 || !cbufs)
+    return -1;
+  if (offset + ((skip + len) >> bshift) >= disksize)
+    return -1;
+  return 0;
+}
+
+/* Copy len bytes starting skip bytes into sector offset out of the cache. */
+int readBytes(u_int offset, u_int skip, u_int len, void *buf)
+{
+  u_int start, pgno, off, n;
+  char *p = buf;
 
-  if (disk == -1)
+  if (cache_check(offset, skip, len))
     return -1;
-  if (offset+(len>>bshift) >= disksize)
+  if (len == 0)
+    return 0;
+  start = (offset << bshift) + skip;
+  if (cbuf_fill(start, start + len, 0))
     return -1;
+  for (pgno = start / NBPG, off = start % NBPG; len; pgno++, off = 0)
+  {
+    n = NBPG - off < len ? NBPG - off : len;
+    memcpy(p, cbuf_lookup(pgno)->cb_data + off, n);
+    p += n;
+    len -= n;
+  }
+  return 0;
+}
+
+/* Copy len bytes into the cache starting skip bytes into sector offset. */
+/* The pages are only marked dirty; see syncDisk.                         */
+int writeBytes(u_int offset, u_int skip, u_int len, void *buf)
+{
+  u_int start, end, pgno, off, n;
+  struct cbuf *cb;
+  char *p = buf;
 
-  b.b_flags = B_WRITE;
-  b.b_dev = disk;
-  b.b_blkno = offset;
-  b.b_bcount = len;
-  b.b_memaddr = block;
-  b.b_resid = 0;
-  b.b_resptr = &b.b_resid;
-  if (sys_disk_request(e, j, k, &b)) {
+  if (cache_check(offset, skip, len))
     return -1;
+  if (len == 0)
+    return 0;
+  start = (offset << bshift) + skip;
+  end = start + len;
+  if (cbuf_fill(start, end, 1))
+    return -1;
+  for (pgno = start / NBPG, off = start % NBPG; len; pgno++, off = 0)
+  {
+    n = NBPG - off < len ? NBPG - off : len;
+    cb = cbuf_lookup(pgno);
+    memcpy(cb->cb_data + off, p, n);
+    cb->cb_valid = cb->cb_dirty = 1;
+    p += n;
+    len -= n;
   }
-  /* GROK - hack'd way to force waiting for completion */
-  while ((b.b_resid == 0) && (ffs_fstat(-1) == 0));
   return 0;
 }
 
+/* write back every dirty page in the cache */
+int syncDisk(void)
+{
+  int i, error = 0;
+
+  if (!cbufs)
+    return 0;
+  for (i = 0; i < NCBUF; i++)
+    if (cbufs[i].cb_dirty && cbuf_flush(&cbufs[i]))
+      error = -1;
+  return error;
+}
+
+int openDisk(u_int ndisk, u_int ne, u_int nj, u_int nk)
+{
+  int i;
+
+  if (ndisk >= __sysinfo.si_ndisks)
+    return 0;
+  if (!cbufs)
+  {
+    if (!(cbufs = malloc(NCBUF * sizeof (struct cbuf))))
+      return 0;
+    if (!(cbdata = malloc(NCBUF * NBPG + NBPG)))
+    {
+      free(cbufs);
+      cbufs = 0;
+      return 0;
+    }
+  }
+  disk = ndisk;
+  e = ne;
+  j = nj;
+  k = nk;
+  disksize = __sysinfo.si_disks[disk].d_size;
+  bshift = __sysinfo.si_disks[disk].d_bshift;
+  pgsects = NBPG >> bshift;
+
+  for (i = 0; i < CBUF_HASH; i++)
+    LIST_INIT(&cbhash[i]);
+  TAILQ_INIT(&cblru);
+  for (i = 0; i < NCBUF; i++)
+  {
+    /* page align the buffers so a transfer never straddles pages */
+    cbufs[i].cb_data = (char *)(((u_int)cbdata + NBPG - 1) & ~(NBPG - 1))
+      + i * NBPG;
+    cbufs[i].cb_pgno = -1;
+    cbufs[i].cb_valid = cbufs[i].cb_dirty = 0;
+    TAILQ_INSERT_TAIL(&cblru, &cbufs[i], cb_lru);
+  }
+  return disksize;
+}
+
+int readBlock(u_int offset, u_int len, void *block)
+{
+  return readBytes(offset, 0, len, block);
+}
+
+int writeBlock(u_int offset, u_int len, void *block)
+{
+  return writeBytes(offset, 0, len, block);
+}
+
+/* The bread/bdwrite interface used by the BSD-derived allocation code. */
+/* Buffers are private copies; bdwrite hands the contents back to the   */
+/* cache as a delayed write.                                            */
+
 int bread(u_int dev, u_int blk, u_int len, struct buf **bp)
 {
-  if (disk == -1)
-    return -1;
-  if (blk+(len>>bshift) >= disksize)
+  if (cache_check(blk, 0, len))
     return -1;
 
   if (!(*bp = malloc(sizeof (struct buf))))
@@ -91,17 +345,13 @@ int bread(u_int dev, u_int blk, u_int len, struct buf **bp)
   (*bp)->b_dev = disk;
   (*bp)->b_blkno = blk;
   (*bp)->b_bcount = len;
-  (*bp)->b_resid = 0;
-  (*bp)->b_resptr = &(*bp)->b_resid;
-  if (sys_disk_request(e, j, k, *bp))
+  if (readBytes(blk, 0, len, (*bp)->b_memaddr))
   {
     free((*bp)->b_memaddr);
     free(*bp);
     *bp = 0;
     return -1;
   }
-  /* GROK - hack'd way to force waiting for completion */
-  while (((*bp)->b_resid == 0) && (ffs_fstat(-1) == 0));
   return 0;
 }
 
@@ -110,12 +360,7 @@ void bdwrite(struct buf *bp)
   if (disk == -1 || !bp)
     return;
 
-  bp->b_flags = B_WRITE;
-  bp->b_resid = 0;
-  bp->b_resptr = &bp->b_resid;
-  sys_disk_request(e, j, k, bp);
-  /* GROK - hack'd way to force waiting for completion */
-  while ((bp->b_resid == 0) && (ffs_fstat(-1) == 0));
+  writeBytes(bp->b_blkno, 0, bp->b_bcount, bp->b_memaddr);
   brelse(bp);
 }
 
@@ -130,5 +375,10 @@ void brelse(struct buf *bp)
 
 void closeDisk(void)
 {
+  syncDisk();
   disk = -1;
+  free(cbdata);
+  free(cbufs);
+  cbdata = 0;
+  cbufs = 0;
 }
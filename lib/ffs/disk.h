@@ -1,6 +1,9 @@
 int openDisk(u_int disk, u_int a, u_int b, u_int c);
 int readBlock(u_int offset, u_int len, void *block);
 int writeBlock(u_int offset, u_int len, void *block);
+int readBytes(u_int offset, u_int skip, u_int len, void *buf);
+int writeBytes(u_int offset, u_int skip, u_int len, void *buf);
+int syncDisk(void);
 void closeDisk(void);
 
 struct buf;
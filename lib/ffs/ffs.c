@@ -50,7 +50,8 @@ ffs_init (u_int disk, u_int e, u_int j, u_int k, int rdonly)
   {
     fs->fs_ronly = 0;
     fs->fs_clean = 0;
-    if (writeBlock(SBOFF >> 9, SBSIZE, fs))
+    /* the unclean mark has to reach the disk before anything else does */
+    if (writeBlock(SBOFF >> 9, SBSIZE, fs) || syncDisk())
     {
       free(fs);
       return -8;
@@ -109,27 +110,47 @@ ffs_cgupdate (void)
   return (allerror);
 }
 
+/* Write back modified inodes of open files, the cylinder group */
+/* summaries and every delayed block write.                     */
 int
-ffs_shutdown (void)
+ffs_sync (void)
 {
-  int i;
+  int i, error = 0;
 
+  if (fs->fs_ronly)
+    return 0;
   for (i = 0; i < MAX_FDS; i++)
   {
-    if (fds[i].used)
+    if (fds[i].used && fds[i].in.i_flag & IN_MODIFIED)
     {
-      if (!fs->fs_ronly && fds[i].in.i_flag & IN_MODIFIED)
-	ffs_writeinode(&fds[i].in);
-      fds[i].used = 0;
+      if (ffs_writeinode(&fds[i].in))
+	error = -1;
+      else
+	fds[i].in.i_flag &= ~IN_MODIFIED;
     }
   }
-  if (!fs->fs_ronly && ffs_cgupdate() == 0)
+  if (ffs_cgupdate())
+    error = -1;
+  if (syncDisk())
+    error = -1;
+  return error;
+}
+
+int
+ffs_shutdown (void)
+{
+  int i;
+
+  /* the superblock may only be marked clean once everything else is out */
+  if (!fs->fs_ronly && ffs_sync() == 0)
   {
     fs->fs_clean = FS_ISCLEAN;
     fs->fs_fmod = 0;
     memcpy(ffs_space, fs, fs->fs_sbsize);
     writeBlock(SBOFF >> 9, fs->fs_sbsize, ffs_space);
   }
+  for (i = 0; i < MAX_FDS; i++)
+    fds[i].used = 0;
   closeDisk();
   free(ffs_space);
   ffs_space = 0;
@@ -13,6 +13,7 @@ struct dir;
 /* Arguments: disk, extent group, extent w/in group, capability, rdonly */
 int ffs_init (u_int, u_int, u_int, u_int, int);
 int ffs_shutdown (void);
+int ffs_sync (void);
 
 int            ffs_open (const char *, int, int mode);
 int            ffs_close (int);
@@ -180,12 +180,11 @@ ffs_read (int fd, void *buffer, u_int nbytes)
       memset(buffer, 0, len);
     else
     {
-      if (readBlock(num, fs->fs_bsize, ffs_space))
+      if (readBytes(num, off, len, buffer))
       {
 	error = EIO;
 	break;
       }
-      memcpy(buffer, ffs_space + off, len);
     }
     nbytes -= len;
     bytesdone += len;
@@ -22,13 +22,17 @@ u_long nextgennumber;
  *
  ******/
 
+/* Inodes are read and written one at a time through the block cache, */
+/* so the inode blocks themselves act as the in-core inode table.      */
+
 int
 ffs_getdinode (ino_t inum, struct dinode *dip)
 {
   /*printf(" << getinode(%d)\n", inum);*/
-  if (readBlock(fsbtodb(fs,ino_to_fsba(fs, inum)), fs->fs_bsize, ffs_space))
+  if (readBytes(fsbtodb(fs,ino_to_fsba(fs, inum)),
+		ino_to_fsbo(fs, inum) * sizeof(struct dinode),
+		sizeof(struct dinode), dip))
     return 1;
-  *dip = (struct dinode)*((struct dinode*)ffs_space + ino_to_fsbo(fs,inum));
   return 0;
 }
 
@@ -36,10 +40,8 @@ int
 ffs_getinode (ino_t inum, struct inode *ip)
 {
   /*printf(" << getinode(%d)\n", inum);*/
-  if (readBlock(fsbtodb(fs,ino_to_fsba(fs, inum)), fs->fs_bsize, ffs_space))
+  if (ffs_getdinode(inum, &ip->i_din))
     return EIO;
-  ip->i_din = (struct dinode)*((struct dinode*)ffs_space
-			       + ino_to_fsbo(fs,inum));
   ip->i_flag = 0;
   ip->i_number = inum;
   ip->i_fs = fs;
@@ -50,13 +52,9 @@ int
 ffs_writeinode (struct inode *ip)
 {
   /*printf(" << writeinode(%d)\n", ip->i_number);*/
-  if (readBlock(fsbtodb(fs,ino_to_fsba(fs, ip->i_number)),
-		fs->fs_bsize, ffs_space))
-    return EIO;
-  (struct dinode)*((struct dinode*)ffs_space + ino_to_fsbo(fs,ip->i_number))
-    = ip->i_din;
-  if (writeBlock(fsbtodb(fs,ino_to_fsba(fs, ip->i_number)),
-		 fs->fs_bsize, ffs_space))
+  if (writeBytes(fsbtodb(fs,ino_to_fsba(fs, ip->i_number)),
+		 ino_to_fsbo(fs, ip->i_number) * sizeof(struct dinode),
+		 sizeof(struct dinode), &ip->i_din))
     return EIO;
   return 0;
 }
@@ -91,7 +91,7 @@ sysconf(name)
 	  kprintf ("how come I can't have _SC_NGROUPS_MAX?\n");
           assert(0);
 	case _SC_OPEN_MAX:
-	  return (NR_OPEN);
+	  return (NR_OPEN_MAX);
 	case _SC_STREAM_MAX:
 	case _SC_TZNAME_MAX:
 	case _SC_SAVED_IDS:
@@ -31,6 +31,23 @@ static char rcsid[] = "$OpenBSD: malloc.c,v 1.32 1998/08/06 16:26:32 millert Exp
 #undef MALLOC_STATS
 #endif
 
+/*
+ * Chunks of up to malloc_maxsize bytes are handed out from per-process
+ * size-class caches in front of the page bitmaps: free() pushes a chunk
+ * onto the cache for its class and malloc() pops it back off, so the
+ * common malloc/free cycle never scans the free bitmap (each page also
+ * has a cached bitmap, so freeing a chunk that is sitting in a cache is
+ * still reported as a double free).  An empty
+ * cache is refilled MALLOC_BATCH chunks at a time; a cache holding more
+ * than malloc_ccache pages worth of chunks gives half of them back to
+ * the bitmaps, so that pages which empty out are reused by other classes
+ * or returned to the OS.  The 'c' option turns the caches off.
+ *
+ * Pages are taken from the OS at least malloc_grow at a time ('g' makes
+ * it one page at a time).
+ */
+#define MALLOC_BATCH	16
+
 /*
  * What to use for Junk.  This is the byte value we use to fill with
  * when the 'J' option is enabled.
@@ -111,6 +128,7 @@ struct pginfo {
     u_short		shift;	/* How far to shift for this size chunks */
     u_short		free;	/* How many free chunks */
     u_short		total;	/* How many chunk */
+    u_long		*cached; /* Which allocated chunks sit in a cache */
     u_long		bits[1]; /* Which chunks are free */
 };
 
@@ -189,6 +207,30 @@ static unsigned malloc_started;
 /* Number of free pages we cache */
 static unsigned malloc_cache = 16;
 
+/* Minimum number of pages to get from the OS at once */
+static unsigned malloc_grow = 16;
+
+/* Size of each chunk cache, in pages worth of chunks (0: no caches) */
+static unsigned malloc_ccache = 4;
+
+/* Per size-class caches of free chunks, indexed by bucket */
+struct chunkcache {
+    void		*head;	/* chunks, linked through their first word */
+    u_int		count;	/* how many are on the list */
+    u_int		max;	/* trim the list when it gets longer than this */
+};
+static struct chunkcache chunk_cache[malloc_pageshift];
+
+/* Bucket for each request size, in units of malloc_minsize */
+static u_char size2bucket[malloc_maxsize / malloc_minsize + 1];
+#define malloc_bucket(size) \
+	(size2bucket[((size) + malloc_minsize - 1) / malloc_minsize])
+
+#ifdef MALLOC_STATS
+static u_long stat_chits, stat_cmisses, stat_crefills, stat_ctrims;
+static u_long stat_grows, stat_grown;
+#endif /* MALLOC_STATS */
+
 /* The offset from pagenumber to index into the page directory */
 static u_long malloc_origo;
 
@@ -275,6 +317,8 @@ static void *imalloc(size_t size);
 static void ifree(void *ptr);
 static void *irealloc(void *ptr, size_t size);
 static void *malloc_bytes(size_t size);
+static void free_bytes(void *ptr, int index, struct pginfo *info);
+static void free_pages(void *ptr, int index, struct pginfo *info);
 
 #ifdef MALLOC_STATS
 void
@@ -332,6 +376,16 @@ malloc_dump(fd)
     fprintf(fd, "LastPage\t%ld %lx\n", last_index+malloc_pageshift,
 	(last_index + malloc_pageshift) << malloc_pageshift);
     fprintf(fd, "Break\t%ld\n", (u_long)sbrk(0) >> malloc_pageshift);
+
+    for(j=0;j<malloc_pageshift;j++)
+	if (chunk_cache[j].count)
+	    fprintf(fd, "Cache\t%d\t%u (max %u)\n", 1 << j,
+		chunk_cache[j].count, chunk_cache[j].max);
+    fprintf(fd, "CacheHits\t%lu\n", stat_chits);
+    fprintf(fd, "CacheMisses\t%lu\n", stat_cmisses);
+    fprintf(fd, "CacheRefills\t%lu\n", stat_crefills);
+    fprintf(fd, "CacheTrims\t%lu\n", stat_ctrims);
+    fprintf(fd, "Grows\t%lu (%lu pages)\n", stat_grows, stat_grown);
 }
 #endif /* MALLOC_STATS */
 
@@ -406,6 +460,11 @@ map_pages(pages)
     last_index = ptr2index(tail) - 1;
     malloc_brk = tail;
 
+#ifdef MALLOC_STATS
+    stat_grows++;
+    stat_grown += pages;
+#endif /* MALLOC_STATS */
+
     if ((last_index+1) >= malloc_ninfo && !extend_pgdir(last_index))
 	return 0;
 
@@ -505,6 +564,10 @@ malloc_init ()
 		case '<': malloc_cache   >>= 1; break;
 		case 'a': malloc_abort   = 0; break;
 		case 'A': malloc_abort   = 1; break;
+		case 'c': malloc_ccache  = 0; break;
+		case 'C': malloc_ccache  = 4; break;
+		case 'g': malloc_grow    = 1; break;
+		case 'G': malloc_grow    = 16; break;
 #ifdef MALLOC_STATS
 		case 'd': malloc_stats   = 0; break;
 		case 'D': malloc_stats   = 1; break;
@@ -576,6 +639,15 @@ malloc_init ()
 
     malloc_cache <<= malloc_pageshift;
 
+    /* Set up the size classes and their caches */
+    for (i = 0, j = 0; i <= malloc_maxsize / malloc_minsize; i++) {
+	while ((1UL << j) < i * malloc_minsize || (1UL << j) < malloc_minsize)
+	    j++;
+	size2bucket[i] = j;
+    }
+    for (j = 0; j < malloc_pageshift; j++)
+	chunk_cache[j].max = (malloc_ccache << malloc_pageshift) >> j;
+
     /*
      * This is a nice hack from Kaleb Keithly (kaleb@x.org).
      * We can sbrk(2) further back when we keep this on a low address.
@@ -644,8 +716,18 @@ malloc_pages(size)
 
     size >>= malloc_pageshift;
 
-    /* Map new pages */
-    if (!p)
+    /* Map new pages, at least malloc_grow of them; the rest go on the free list */
+    if (!p && size < malloc_grow) {
+	p = map_pages(malloc_grow);
+	if (p) {
+	    index = ptr2index(p) + size;
+	    page_dir[index] = MALLOC_FIRST;
+	    for (i = 1; i < malloc_grow - size; i++)
+		page_dir[index+i] = MALLOC_FOLLOW;
+	    free_pages((char *)p + (size << malloc_pageshift), index,
+		MALLOC_FIRST);
+	}
+    } else if (!p)
 	p = map_pages(size);
 
     if (p) {
@@ -679,17 +761,17 @@ malloc_make_chunks(bits)
 {
     struct  pginfo *bp;
     void *pp;
-    int i, k, l;
+    int i, k, l, n;
 
     /* Allocate a new bucket */
     pp = malloc_pages((size_t)malloc_pagesize);
     if (!pp)
 	return 0;
 
-    /* Find length of admin structure */
+    /* Find length of admin structure: the free and the cached bitmaps */
+    n = ((malloc_pagesize >> bits)+MALLOC_BITS-1) / MALLOC_BITS;
     l = sizeof *bp - sizeof(u_long);
-    l += sizeof(u_long) *
-	(((malloc_pagesize >> bits)+MALLOC_BITS-1) / MALLOC_BITS);
+    l += 2 * sizeof(u_long) * n;
 
     /* Don't waste more than two chunks on this */
     if ((1UL<<(bits)) <= l+l) {
@@ -706,6 +788,8 @@ malloc_make_chunks(bits)
     bp->shift = bits;
     bp->total = bp->free = malloc_pagesize >> bits;
     bp->page = pp;
+    bp->cached = bp->bits + n;
+    memset(bp->cached, 0, n * sizeof(u_long));
 
     /* set all valid bits in the bitmap */
     k = bp->total;
@@ -741,28 +825,17 @@ malloc_make_chunks(bits)
 }
 
 /*
- * Allocate a fragment
+ * Take a free chunk of bucket j off the page bitmaps
  */
-static void *
-malloc_bytes(size)
-    size_t size;
+static __inline__ void *
+malloc_chunk(j)
+    int j;
 {
-    int i,j;
     u_long u;
     struct  pginfo *bp;
     int k;
     u_long *lp;
 
-    /* Don't bother with anything less than this */
-    if (size < malloc_minsize)
-	size = malloc_minsize;
-
-    /* Find the right bucket */
-    j = 1;
-    i = size-1;
-    while (i >>= 1)
-	j++;
-
     /* If it's empty, make a page more of that size chunks */
     if (!page_dir[j] && !malloc_make_chunks(j))
 	return 0;
@@ -792,10 +865,123 @@ malloc_bytes(size)
     k += (lp-bp->bits)*MALLOC_BITS;
     k <<= bp->shift;
 
+    return (u_char *)bp->page + k;
+}
+
+/*
+ * Note chunk p going into (on) or coming out of its size-class cache,
+ * so that freeing it again while it is cached is caught.
+ */
+static __inline__ void
+chunk_setcached(p, on)
+    void *p;
+    int on;
+{
+    struct pginfo *info = page_dir[ptr2index(p)];
+    int i = ((u_long)p & malloc_pagemask) >> info->shift;
+
+    if (on)
+	info->cached[i/MALLOC_BITS] |= 1UL<<(i%MALLOC_BITS);
+    else
+	info->cached[i/MALLOC_BITS] &= ~(1UL<<(i%MALLOC_BITS));
+}
+
+/*
+ * Refill the cache for bucket j with up to MALLOC_BATCH chunks
+ */
+static int
+chunk_refill(j)
+    int j;
+{
+    struct chunkcache *cc = &chunk_cache[j];
+    void *p, **tail = &cc->head;
+    int n;
+
+    /* Keep them in address order, lowest first out */
+    for (n = 0; n < MALLOC_BATCH && n < cc->max; n++) {
+	if (!(p = malloc_chunk(j)))
+	    break;
+	chunk_setcached(p, 1);
+	*tail = p;
+	tail = (void **)p;
+    }
+    *tail = 0;
+    cc->count = n;
+#ifdef MALLOC_STATS
+    stat_crefills++;
+#endif /* MALLOC_STATS */
+    return n;
+}
+
+/*
+ * Give the older half of the cache for bucket j back to the bitmaps
+ */
+static void
+chunk_trim(j)
+    int j;
+{
+    struct chunkcache *cc = &chunk_cache[j];
+    void *p, *list;
+    u_int keep = cc->max / 2;
+    int index;
+
+    /* Detach the list first; free_bytes may come back in through ifree */
+    for (p = cc->head; --keep; p = *(void **)p)
+	;
+    list = *(void **)p;
+    *(void **)p = 0;
+    cc->count = cc->max / 2;
+
+    while ((p = list)) {
+	list = *(void **)p;
+	chunk_setcached(p, 0);
+	index = ptr2index(p);
+	free_bytes(p, index, page_dir[index]);
+    }
+#ifdef MALLOC_STATS
+    stat_ctrims++;
+#endif /* MALLOC_STATS */
+}
+
+/*
+ * Allocate a fragment
+ */
+static void *
+malloc_bytes(size)
+    size_t size;
+{
+    struct chunkcache *cc;
+    void *p;
+    int j;
+
+    /* Don't bother with anything less than this */
+    if (size < malloc_minsize)
+	size = malloc_minsize;
+
+    /* Find the right bucket */
+    j = malloc_bucket(size);
+    cc = &chunk_cache[j];
+
+    if (cc->head || (cc->max && chunk_refill(j))) {
+	p = cc->head;
+	cc->head = *(void **)p;
+	cc->count--;
+	chunk_setcached(p, 0);
+#ifdef MALLOC_STATS
+	stat_chits++;
+#endif /* MALLOC_STATS */
+    } else {
+	if (!(p = malloc_chunk(j)))
+	    return 0;
+#ifdef MALLOC_STATS
+	stat_cmisses++;
+#endif /* MALLOC_STATS */
+    }
+
     if (malloc_junk)
-	memset((char *)bp->page + k, SOME_JUNK, bp->size);
+	memset(p, SOME_JUNK, 1UL << j);
 
-    return (u_char *)bp->page + k;
+    return p;
 }
 
 /*
@@ -894,7 +1080,8 @@ irealloc(ptr, size)
 	i = ((u_long)ptr & malloc_pagemask) >> (*mp)->shift;
 
 	/* Verify that it isn't a free chunk already */
-        if ((*mp)->bits[i/MALLOC_BITS] & (1UL<<(i%MALLOC_BITS))) {
+        if (((*mp)->bits[i/MALLOC_BITS] | (*mp)->cached[i/MALLOC_BITS]) &
+	    (1UL<<(i%MALLOC_BITS))) {
 	    wrtwarning("chunk is already free.\n");
 	    return 0;
 	}
@@ -1131,6 +1318,39 @@ free_bytes(ptr, index, info)
     ifree(vp);
 }
 
+/*
+ * Free a chunk into the cache for its size class.
+ */
+static __inline__ void
+free_chunk(ptr, info)
+    void *ptr;
+    struct pginfo *info;
+{
+    struct chunkcache *cc = &chunk_cache[info->shift];
+    int i;
+
+    if (((u_long)ptr & (info->size-1))) {
+	wrtwarning("modified (chunk-) pointer.\n");
+	return;
+    }
+
+    i = ((u_long)ptr & malloc_pagemask) >> info->shift;
+    if ((info->bits[i/MALLOC_BITS] | info->cached[i/MALLOC_BITS]) &
+	(1UL<<(i%MALLOC_BITS))) {
+	wrtwarning("chunk is already free.\n");
+	return;
+    }
+
+    if (malloc_junk)
+	memset(ptr, SOME_JUNK, info->size);
+
+    info->cached[i/MALLOC_BITS] |= 1UL<<(i%MALLOC_BITS);
+    *(void **)ptr = cc->head;
+    cc->head = ptr;
+    if (++cc->count > cc->max)
+	chunk_trim(info->shift);
+}
+
 static void
 ifree(ptr)
     void *ptr;
@@ -1167,6 +1387,8 @@ ifree(ptr)
 
     if (info < MALLOC_MAGIC)
         free_pages(ptr, index, info);
+    else if (chunk_cache[info->shift].max)
+	free_chunk(ptr, info);
     else
 	free_bytes(ptr, index, info);
     return;
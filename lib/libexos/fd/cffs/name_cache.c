@@ -79,11 +79,18 @@ static nc_entry_t * name_cache_getFreeEntry (nc_t *, int, char *, int);
 
 nc_t * name_cache_init (int size, int buckets)
 {
-   nc_t *namecache;
+   return (name_cache_initspace ((nc_t *) __malloc (size), size, buckets));
+}
+
+
+        /* same as name_cache_init, but the caller supplies the space (e.g., */
+        /* a shared mapping, so that several processes can use one cache)   */
+
+nc_t * name_cache_initspace (nc_t *namecache, int size, int buckets)
+{
    int entries;
    int i;
 
-   namecache = (nc_t *) __malloc (size);
    entries = name_cache_entries(size);
 
 //   printf("name_cache_init: size %d, buckets %d, entries %d\n",  size, buckets, entries);
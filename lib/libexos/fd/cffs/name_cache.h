@@ -95,6 +95,7 @@ typedef struct nc nc_t;
 /* name_cache.c prototypes */
 
 nc_t * name_cache_init (int size, int buckets);
+nc_t * name_cache_initspace (nc_t *namecache, int size, int buckets);
 void name_cache_addEntry (nc_t *namecache, int id, char *name, int namelen, int value);
 int name_cache_findEntry (nc_t *namecache, int id, char *name, int namelen, int *valueP);
 void name_cache_removeEntry (nc_t *namecache, int id, char *name, int namelen);
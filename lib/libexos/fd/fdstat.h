@@ -131,6 +131,7 @@ macro(module,alloc);				\
 macro(module,dealloc);				\
 macro(module,insert);				\
 macro(module,flush);				\
+macro(module,readahead);			\
 macro(module,step0);				\
 macro(module,step1);				\
 macro(module,step2);				\
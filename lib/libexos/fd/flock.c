@@ -178,9 +178,10 @@ static int check_invariant1_helper(int dev, ino_t ino)
   int num_shared_locks = 0;
   int i;
 
-  for (i=0; i < NR_FTABLE; i++) {
-    if (FD_ISSET(i,&global_ftable->inuse)) {
-      struct file *filp = &global_ftable->fentries[i];
+  ftable_attach();
+  for (i=0; i < NR_FTABLE_CREATED; i++) {
+    if (FILP_ISINUSE(FILP_ENTRY(i))) {
+      struct file *filp = FILP_ENTRY(i);
       if ((filp->f_dev == dev) && (filp->f_ino == ino)) {
 	if (filp->flock_state == FLOCK_STATE_SHARED)
 	  num_shared_locks++;
@@ -216,9 +217,10 @@ static int check_invariant1(void)
    * pair).  
    */
 
-  for (i=0; i < NR_FTABLE; i++) {
-    if (FD_ISSET(i,&global_ftable->inuse)) {
-      struct file *filp = &global_ftable->fentries[i];	  
+  ftable_attach();
+  for (i=0; i < NR_FTABLE_CREATED; i++) {
+    if (FILP_ISINUSE(FILP_ENTRY(i))) {
+      struct file *filp = FILP_ENTRY(i);	  
       ret = check_invariant1_helper(filp->f_dev, filp->f_ino);
       if (ret != SUCCESS)
 	return FAILURE;
@@ -252,7 +254,7 @@ static int release(int fd)
 
   CHECK_INVARIANTS();
 
-  if (fd < 0 || fd > NR_OPEN || __current->fd[fd] == NULL) {
+  if (fd < 0 || fd >= __current->nr_open || __current->fd[fd] == NULL) {
     DEBUG(("flock.release received a bogus fd %d", fd));
     errno = EBADF;
     unlock_ftable_flock();
@@ -295,7 +297,7 @@ static int acquire (int fd, int blocking)
  
   CHECK_INVARIANTS();
 
-  if (fd < 0 || fd > NR_OPEN || __current->fd[fd] == NULL) {
+  if (fd < 0 || fd >= __current->nr_open || __current->fd[fd] == NULL) {
     DEBUG(("flock.acquire received a bogus fd %d", fd));
     errno = EBADF;
     unlock_ftable_flock();
@@ -306,9 +308,10 @@ static int acquire (int fd, int blocking)
 
   DEBUG(("flock.acquire prog: %s envid: %d fd: %d --> dev: %d ino: %d\n", __progname, __envid, fd, filp->f_dev, filp->f_ino)); 
 
-  for (i=0; i < NR_FTABLE; i++) {
-    if (FD_ISSET(i,&global_ftable->inuse)) {
-	struct file *tmpfilp = &global_ftable->fentries[i];
+  ftable_attach();
+  for (i=0; i < NR_FTABLE_CREATED; i++) {
+    if (FILP_ISINUSE(FILP_ENTRY(i))) {
+	struct file *tmpfilp = FILP_ENTRY(i);
 	if ((tmpfilp->f_dev == filp->f_dev) && (tmpfilp->f_ino == filp->f_ino)) {
 	    offending_filp = tmpfilp;
 	    state = UNFLOCKED_AND_IN_FTABLE;
@@ -65,6 +65,8 @@ extern int close(int);
 #include <exos/debug.h>
 
 #include <exos/regions.h>
+#include <exos/vm.h>
+#include <exos/cap.h>
 
 #if 0
 #define PR fprintf(stderr,"%s: %d\n",__FILE__,__LINE__);
@@ -75,6 +77,21 @@ extern int close(int);
 struct global_ftable *global_ftable;
 static int fd_setup_dumb(void);
 
+/* number of file entry chunks mapped into this process */
+static int chunks_attached = 0;
+
+/* File entries this process took off the global free list, or freed
+ * itself, and has not handed out yet.  The cache belongs to envid: a
+ * forked child starts out with a copy of its parent's cache, which it
+ * must not touch. */
+static struct {
+  u_int envid;
+  int n;
+  int idx[2 * FILP_CACHE_BATCH];
+} filp_cache;
+
+static int ftable_exec(u_int k, int envid, int execonly);
+
 /* clear_ftable_lock - initializes the ftable lock, should only be used
  once, implemented naively for now */
 void
@@ -144,23 +161,17 @@ ftable_init(void)
     if (status) {
       /* printf("Initializing Filp Table shared data structture\n");*/
 
-      /* Setup the dma regions, the first NR_FTABLE regions starting at
-	 regid_filetable belong to file entries, the last region
-	 belongs to the other data in the global ftable.
+      /* Setup the dma region for the global ftable.  The file entries
+	 themselves are created later, a chunk at a time, and do not
+	 get regions of their own.
        */
       dma_ctrlblk_t c;
-      dma_region_t r[NR_FTABLE + 1];
-      int i;
+      dma_region_t r[1];
 #define FTABLE_KEY 20
-      for (i = 0; i < NR_FTABLE; i++) {
-	r[i].key = FTABLE_KEY; r[i].reg_addr = &global_ftable->fentries[i];
-	r[i].reg_size = sizeof(struct file);
-      }
-      r[NR_FTABLE].reg_addr = &global_ftable->fentries[NR_FTABLE];
-      r[NR_FTABLE].reg_size = 
-	sizeof(struct global_ftable) - (sizeof(struct file)* NR_FTABLE);
-      r[NR_FTABLE].key = FTABLE_KEY;
-      c.nregions = NR_FTABLE + 1;
+      r[0].reg_addr = global_ftable;
+      r[0].reg_size = sizeof(struct global_ftable);
+      r[0].key = FTABLE_KEY;
+      c.nregions = 1;
       c.dma_regions = &r[0];
       status = dma_setup_append(&c);
       assert(status >= 0);
@@ -168,7 +179,9 @@ ftable_init(void)
 
       clear_ftable_lock();
       exos_lock_init (&global_ftable->cffs_lock); /* XXX temp temp temp */
-      FD_ZERO(&global_ftable->inuse);
+      global_ftable->nchunks = 0;
+      global_ftable->free_head = -1;
+      global_ftable->nfree = 0;
       error = dumb_terminal_init();
       demand(!error, dumb_terminal_init failed);
       fd_setup_dumb();
@@ -189,9 +202,12 @@ ftable_init(void)
       }
     } else {
       /* printf("This is not first process, just attaching memory\n");*/ 
+      error = ftable_attach();
+      demand(!error, could not attach file entries);
       error = dumb_terminal_init();
       demand(!error, dumb_terminal_init failed);
     }
+    OnExec(ftable_exec);
     /* we must initialize pty first otherwise if we use
      * ptys before (say in a printf) we would seg fault 
      */
@@ -209,53 +225,142 @@ ftable_init(void)
 }
 
 
+/* ftable_attach - maps into this process any file entry chunks other
+   processes created since we last looked.  Must be called before
+   walking the whole table. */
+int
+ftable_attach(void)
+{
+    u_int num_completed;
+    int n = global_ftable->nchunks;
+
+    for (; chunks_attached < n; chunks_attached++) {
+      num_completed = 0;
+      if (_exos_self_insert_pte_range(CAP_WORLD,
+				      global_ftable->chunk_ptes[chunks_attached],
+				      FILP_CHUNK_PAGES,
+				      (u_int)FILP_ENTRY(chunks_attached *
+							NR_FILP_CHUNK),
+				      &num_completed, 0, NULL) < 0)
+	return -1;
+    }
+    return 0;
+}
+
+/* ftable_newchunk - allocates another chunk of file entries and puts
+   them all on the free list.  Called with the ftable locked. */
+static int
+ftable_newchunk(void)
+{
+    int c = global_ftable->nchunks;
+    int i, first = c * NR_FILP_CHUNK;
+    u_int va = (u_int)FILP_ENTRY(first);
+
+    StaticAssert(sizeof(struct global_ftable) <= FILP_SHARED_REGION_SZ);
+    if (c >= NR_FTABLE_CHUNKS || ftable_attach() < 0) return -1;
+    if (__vm_alloc_region(va, FILP_CHUNK_PAGES * NBPG, CAP_WORLD,
+			  PG_U | PG_W | PG_P | PG_SHARED) < 0)
+      return -1;
+    for (i = 0; i < FILP_CHUNK_PAGES; i++)
+      global_ftable->chunk_ptes[c][i] = vpt[PGNO(va) + i];
+
+    for (i = first + NR_FILP_CHUNK - 1; i >= first; i--) {
+      FILP_ENTRY(i)->ff_next = global_ftable->free_head;
+      global_ftable->free_head = i;
+    }
+    global_ftable->nfree += NR_FILP_CHUNK;
+    global_ftable->nchunks = c + 1;
+    chunks_attached = c + 1;
+    return 0;
+}
+
+static inline void
+filp_cache_check(void)
+{
+    if (filp_cache.envid != __envid) {
+      filp_cache.envid = __envid;
+      filp_cache.n = 0;
+    }
+}
+
+/* filp_cache_fill - moves up to FILP_CACHE_BATCH entries from the
+   global free list into our cache, creating a chunk if the list is
+   empty.  The last NR_RSVRD_FTABLE entries of the table are reserved
+   for root processes. */
+static int
+filp_cache_fill(void)
+{
+    int i;
+    int reserve = (getuid() != 0) ? NR_RSVRD_FTABLE : 0;
+
+    lock_ftable();
+    if (ftable_attach() < 0) {
+      unlock_ftable();
+      return -1;
+    }
+    while (filp_cache.n < FILP_CACHE_BATCH) {
+      if (global_ftable->nfree + (NR_FTABLE_CHUNKS - global_ftable->nchunks) *
+	  NR_FILP_CHUNK <= reserve)
+	break;
+      if (global_ftable->nfree == 0 && ftable_newchunk() < 0)
+	break;
+      i = global_ftable->free_head;
+      global_ftable->free_head = FILP_ENTRY(i)->ff_next;
+      global_ftable->nfree--;
+      FILP_ENTRY(i)->ff_next = FILP_CACHED;
+      filp_cache.idx[filp_cache.n++] = i;
+    }
+    unlock_ftable();
+    return (filp_cache.n > 0) ? 0 : -1;
+}
+
+/* filp_cache_drain - returns all but the first keep cached entries to
+   the global free list */
+static void
+filp_cache_drain(int keep)
+{
+    int i;
+
+    if (filp_cache.n <= keep) return;
+    lock_ftable();
+    while (filp_cache.n > keep) {
+      i = filp_cache.idx[--filp_cache.n];
+      FILP_ENTRY(i)->ff_next = global_ftable->free_head;
+      global_ftable->free_head = i;
+      global_ftable->nfree++;
+    }
+    unlock_ftable();
+}
+
 /* getfilp - allocates a global file pointer from global_ftable */
 struct file *
 getfilp(void)
 {
-    int i;
-    int upper;
+    struct file *filp;
     START(ftable,getfilp);
 #if 0
     DPRINTF(SYSHELP_LEVEL,("getfilp:\n"));
 	    DPRINTF(SYS_LEVEL,("before pr_ftable: %d\n",pr_ftable()));
 #endif
 
-
     StaticAssert(NR_FTABLE >= NR_RSVRD_FTABLE);
-    upper = NR_FTABLE;
-
-    if (getuid() != 0) 
-      /* The upper NR_RSVRD_FTABLE entries are reserved for root processes.
-       * Note, that by reserving the upper entries of the ftable
-       * we ensure that they will be used only if the ftable is otherwise 
-       * full.
-       */
-      upper -= NR_RSVRD_FTABLE;
+    filp_cache_check();
+    if (filp_cache.n == 0 && filp_cache_fill() < 0) {
+      DPRINTF(SYSHELP_LEVEL,("getfilp out of global file pointer!\n"));
+      fprintf(stderr,"warning getfilp out of global file pointer pid: %d\n",getpid());
+      STOP(ftable,getfilp);
+      return (struct file *) 0;
+    }
 
-    lock_ftable();
-    for (i = 0; i < upper; i++)
-	if (!(FD_ISSET(i,&global_ftable->inuse)))
-	{
-	    DPRINTF(SYSHELP_LEVEL,
-		    ("found a filp, fentry[%d]\n",i));
-	    FD_SET(i,&global_ftable->inuse);
-	    clear_filp_lock(&global_ftable->fentries[i]);
-	    global_ftable->fentries[i].ff_count = 11711;  /* XXX what does this number mean? --josh */
-	    global_ftable->fentries[i].flock_state = FLOCK_STATE_UNLOCKED;
-	    unlock_ftable();
-#if 0
-	    DPRINTF(SYS_LEVEL,("after pr_ftable: %d\n",pr_ftable()));
-	    DPRINTF(SYS_LEVEL,("getfilp returning: %08x\n",(int)&global_ftable->fentries[i]));
-#endif
-	    STOP(ftable,getfilp);
-	    return(&global_ftable->fentries[i]);
-	}
-    unlock_ftable();
-    DPRINTF(SYSHELP_LEVEL,("getfilp out of global file pointer!\n"));
-    fprintf(stderr,"warning getfilp out of global file pointer pid: %d\n",getpid());
+    filp = FILP_ENTRY(filp_cache.idx[--filp_cache.n]);
+    DPRINTF(SYSHELP_LEVEL,
+	    ("found a filp, fentry[%d]\n",FILP_INDEX(filp)));
+    filp->ff_next = FILP_INUSE;
+    clear_filp_lock(filp);
+    filp->ff_count = 11711;  /* XXX what does this number mean? --josh */
+    filp->flock_state = FLOCK_STATE_UNLOCKED;
     STOP(ftable,getfilp);
-    return (struct file *) 0;
+    return filp;
 }
 
 
@@ -265,28 +370,39 @@ getfilp(void)
 void
 putfilp(struct file * filp)
 {
-    int i;
     START(ftable,putfilp);
     DPRINTF(SYSHELP_LEVEL,("putfilp: %08x\n",(int)filp));
     demand(filp, bogus filp);
-    if (filp < &global_ftable->fentries[0]) return;
-    lock_ftable();
-    for (i = 0; i < NR_FTABLE ; i++)
-	if (FD_ISSET(i,&global_ftable->inuse))
-	{
-	    if (&global_ftable->fentries[i] == filp)
-	    {
-		FD_CLR(i,&global_ftable->inuse);
-		unlock_ftable();
-		STOP(ftable,putfilp);
-		return;
-	    }
-	}
-    unlock_ftable();
-    DPRINTF(SYSHELP_LEVEL,("warning, putfilp was given a non-inuse filp\n"));
+    if (filp < FILP_ENTRY(0) || filp >= FILP_ENTRY(NR_FTABLE)) return;
+    if (filp->ff_next != FILP_INUSE) {
+      DPRINTF(SYSHELP_LEVEL,("warning, putfilp was given a non-inuse filp\n"));
+      STOP(ftable,putfilp);
+      return;
+    }
+    filp_cache_check();
+    filp->ff_next = FILP_CACHED;
+    if (filp_cache.n == 2 * FILP_CACHE_BATCH)
+      filp_cache_drain(FILP_CACHE_BATCH);
+    filp_cache.idx[filp_cache.n++] = FILP_INDEX(filp);
     STOP(ftable,putfilp);
 }
 
+/* putfilp_flush - gives all cached file entries back, when exiting */
+void
+putfilp_flush(void)
+{
+    filp_cache_check();
+    filp_cache_drain(0);
+}
+
+/* the cache stays behind in the old environment on exec */
+static int
+ftable_exec(u_int k, int envid, int execonly)
+{
+    if (execonly) putfilp_flush();
+    return 0;
+}
+
 
 static int
 fd_setup_dumb(void) {
@@ -427,38 +543,41 @@ pr_ftable(void) {
     printf("counter2: %d\n",global_ftable->counter2);
     printf("remotedev: %d\n",global_ftable->remotedev);
 
+    printf("chunks: %d free: %d\n",global_ftable->nchunks,
+	   global_ftable->nfree);
+
+    ftable_attach();
 #if 0
-   for (i = 0; i < NR_FTABLE ; i++) {
-	using = ((int)FD_ISSET(i,&global_ftable->inuse)) ? 1 : 0;
+   for (i = 0; i < NR_FTABLE_CREATED ; i++) {
+	using = FILP_ISINUSE(FILP_ENTRY(i)) ? 1 : 0;
 	printf("[%02d]:%d pt %08x ",i,
-	       using,(int)&global_ftable->fentries[i]);
+	       using,(int)FILP_ENTRY(i));
 	    if (i % 4 == 3) printf("\n");
-	    if (FD_ISSET(i,&global_ftable->inuse)) c++;
+	    if (using) c++;
 	}
 #endif
-    for (i = 0; i < NR_FTABLE ; i++) {
-	using = ((int)FD_ISSET(i,&global_ftable->inuse)) ? 1 : 0;
+    for (i = 0; i < NR_FTABLE_CREATED ; i++) {
+	using = FILP_ISINUSE(FILP_ENTRY(i)) ? 1 : 0;
 	if (using) {
-	  if (global_ftable->fentries[i].op_type == NFS_TYPE) {
-//	     || global_ftable->fentries[i].op_type == UDP_SOCKET_TYPE) {
+	  if (FILP_ENTRY(i)->op_type == NFS_TYPE) {
+//	     || FILP_ENTRY(i)->op_type == UDP_SOCKET_TYPE) {
 	    printf("\n#ftable entry: %2d\n",i);
-	    pr_filp(&global_ftable->fentries[i]," ");
+	    pr_filp(FILP_ENTRY(i)," ");
 	  }
 	}
     }
     printf("root: %p (%d)\ncwd: %p (%d)\n",
 	   __current->root,
-	   __current->root - global_ftable->fentries ,
+	   FILP_INDEX(__current->root),
 	   __current->cwd,
-	   __current->cwd - global_ftable->fentries);
+	   FILP_INDEX(__current->cwd));
     if (__current->root) pr_filp(__current->root,"ROOT");
     if (__current->cwd) pr_filp(__current->cwd,"CWD");
     printf("fds in use:\n");
-    for (i = 0; i < NR_OPEN; i++) {
+    for (i = 0; i < __current->nr_open; i++) {
 	if (__current->fd[i]) {
 	    printf("%02d (%4d):%d ",i,
-		   ((int)__current->fd[i] - (int)&global_ftable->fentries[0])/
-		   sizeof(struct file),
+		   FILP_INDEX(__current->fd[i]),
 		   (int)__current->cloexec_flag[i]);
 	    if (d % 4 == 3) printf("\n");
 	    d++;
@@ -475,12 +594,13 @@ isbusy_fs(dev_t dev, int fs) {
   //  printf("FTABLE: lock %d\n",global_ftable->lock);
   //  printf("remotedev: %d\n",global_ftable->remotedev);
   
-  for (i = 0; i < NR_FTABLE ; i++) {
-    using = ((int)FD_ISSET(i,&global_ftable->inuse)) ? 1 : 0;
+  ftable_attach();
+  for (i = 0; i < NR_FTABLE_CREATED ; i++) {
+    using = FILP_ISINUSE(FILP_ENTRY(i)) ? 1 : 0;
     if (using && 
-	global_ftable->fentries[i].f_dev == dev && 
-	global_ftable->fentries[i].op_type == fs) {
-      // pr_filp(&global_ftable->fentries[i],"using dev ");
+	FILP_ENTRY(i)->f_dev == dev && 
+	FILP_ENTRY(i)->op_type == fs) {
+      // pr_filp(FILP_ENTRY(i),"using dev ");
       count++;
     }
   }
@@ -96,6 +96,7 @@ nfsc_cleare(nfsc_p p) {
   p->dev = 0;
   p->inbuffercache = 0;
   p->writestart = p->writeend = p->n_dirsize = 0;
+  p->ra_next = p->ra_pages = 0;
   nfsc_ts_zero(p);		/* zero timestamp */
   p->sb.st_ino = 0;
 }
@@ -72,15 +72,38 @@
 
 extern char *__progname;
 
+/* send (or resend) one request of a parallel rpc */
+static int
+p_rpc_send(struct generic_server *server, struct p_rpc_rec *rw)
+{
+  struct ae_recv m = {.n = 1};
+  int j;
+
+  m.r[0].data = (char *)rw->ptr;
+  m.r[0].sz = ((char *) rw->end) - ((char *) rw->ptr);
+  for (j = 0 ; j < rw->r.n ; j++)
+    m.r[j+1] = rw->r.r[j];
+  m.n += rw->r.n;
+
+  return server_sendv(server, &m);
+}
+
+/* p_generic_rpc_call
+
+ issues the prpc->n requests in prpc, keeping at most server->window of
+ them outstanding at a time, and waits for all of the replies.  The
+ window is kept per server: it opens by one request for every window's
+ worth of replies and is halved whenever a request times out.
+
+ returns: 1 on success, on error it returns -1 and sets errno.
+ */
+
 int 
 p_generic_rpc_call(struct generic_server *server, struct p_rpc *prpc)
 {
   int result;
-  int n,i,j;
-  int len;
+  int n,i;
   int xid;
-  int *start;
-  int *end;
   int found_total = 0;
   int retval;
   unsigned int timeout, init_timeout, max_timeout;
@@ -89,18 +112,25 @@ p_generic_rpc_call(struct generic_server *server, struct p_rpc *prpc)
   /*  int retrans      = server->retrans;*/
 
   int number;
+  int next;			/* next request never sent */
+  int inflight;			/* sent and not yet answered */
   struct p_rpc_rec *rw;
-  /*  int retrans      = server->retrans;*/
 
   timeout = init_timeout = 100000  ; //server->timeo      *1000;
   max_timeout = init_timeout << 7; //NFS_MAX_RPC_TIMEOUT*10000;
 
   number = prpc->n;
+  assert(number <= MAX_P_RPC);
+  for (i = 0; i < number; i++)
+    prpc->rw[i].sent = 0;
+  next = inflight = 0;
   signals_off();
 
   assert(timeout < max_timeout);
   assert(init_timeout < max_timeout);
 
+  if (server->window < 1 || server->window > NFS_RPC_MAXWINDOW)
+    server->window = NFS_RPC_INITWINDOW;
 
   for (timeout = init_timeout, n = 0 ; ; n++, timeout <<= 1) 
     {
@@ -117,35 +147,32 @@ p_generic_rpc_call(struct generic_server *server, struct p_rpc *prpc)
       }
 
       exos_lock_get_nb(&(server->lock));
-      for (i = 0; i < number; i++) {
-	rw = &prpc->rw[i];
-	if (rw->done == 0) {
-	  struct ae_recv m = {.n = 1};
-	  start = rw->ptr; 
-	  end = rw->end;
-	  len = ((char *) end) - ((char *) start);
-	  /* 	      if (timeout != 1) printf("."); */
-	  m.r[0].data = (char *)start;
-	  m.r[0].sz = len;
-	  for (j = 0 ; j < rw->r.n ; j++)
-	    m.r[j+1] = rw->r.r[j];
-	  m.n += rw->r.n;
-
-	  result = server_sendv(server, &m);
-
-	  if (result < 0) {
-	    printf("generic_rpc_call: send error = %d errno: %d\n", 
-		   result,errno);
-	    retval = -1;
-	    exos_lock_release(&(server->lock));
-	    goto done;
+      if (n > 0) {
+	/* timed out: back off and resend what is still outstanding */
+	server->window = (server->window > 1) ? server->window / 2 : 1;
+	server->wincredit = 0;
+	server->nrtimeouts++;
+	for (i = 0; i < next; i++) {
+	  rw = &prpc->rw[i];
+	  if (rw->done == 0) {
+	    if ((result = p_rpc_send(server, rw)) < 0) goto senderr;
+	    DPRINTF(CLUHELP_LEVEL,
+		    ("resending for %d, xid: %08x\n",i,rw->xid));
 	  }
-	  DPRINTF(CLUHELP_LEVEL,
-		  ("sending for %d, xid: %08x\n",i,rw->xid));
-	  
 	}
       }
 
+    fill:
+      /* open up to the window */
+      while (next < number && inflight < server->window) {
+	rw = &prpc->rw[next];
+	if ((result = p_rpc_send(server, rw)) < 0) goto senderr;
+	DPRINTF(CLUHELP_LEVEL,
+		("sending for %d, xid: %08x\n",next,rw->xid));
+	rw->sent = 1;
+	inflight++;
+	next++;
+      }
       
       usecs = timeout;
       if (usecs > 1000000) {
@@ -166,7 +193,7 @@ p_generic_rpc_call(struct generic_server *server, struct p_rpc *prpc)
       result = server_recvfrom(server,&xid,4,MSG_PEEK);
 
       demand(result == 4, hmm result not eq 4);
-      for (i = 0; i < number; i++) {
+      for (i = 0; i < next; i++) {
 	rw = &prpc->rw[i];
 	if (rw->done == 0 && rw->xid == xid) {
 	  result = server_recvfrom(server,(void *)rw->ptr, rw->size, 0);
@@ -179,6 +206,12 @@ p_generic_rpc_call(struct generic_server *server, struct p_rpc *prpc)
 	  rw->read = result;
 	  rw->done = 1;
 	  found_total++;
+	  inflight--;
+	  if (server->window < NFS_RPC_MAXWINDOW &&
+	      ++server->wincredit >= server->window) {
+	    server->window++;
+	    server->wincredit = 0;
+	  }
 	  goto check;
 	}
       }
@@ -189,14 +222,24 @@ p_generic_rpc_call(struct generic_server *server, struct p_rpc *prpc)
 #endif
 	
       demand(result == 4, hmm result not eq 4);
+      goto retry;
     check:
       if (found_total == number) {
 	retval = 1;
 	exos_lock_release(&(server->lock));
 	goto done;
       }
-      goto retry;
-      
+      /* a reply means the server is keeping up: restart the timer */
+      timeout = init_timeout;
+      n = 0;
+      goto fill;
+
+    senderr:
+      printf("generic_rpc_call: send error = %d errno: %d\n", 
+	     result,errno);
+      retval = -1;
+      exos_lock_release(&(server->lock));
+      goto done;
     }
   printf("*** WARNING FALLING OFF P_RPC LOOP\n");
 done:
@@ -109,8 +109,13 @@ int *generic_rpc_header(int *p,
 			int ruid);
 
 /* For parallel requests, for example :
-   reading a page with fout 1K requests  */
-#define MAX_P_RPC 4
+   reading a page with fout 1K requests, or several pages at once for
+   read-ahead and write-back.  At most a window of them are outstanding
+   at a time; the window must stay below the number of udp receive
+   buffers (see make_server). */
+#define MAX_P_RPC 32
+#define NFS_RPC_INITWINDOW 4
+#define NFS_RPC_MAXWINDOW 12
 
 typedef struct p_rpc_rec {
   int xid;		/* transaction id */
@@ -118,6 +123,7 @@ typedef struct p_rpc_rec {
   int size;		/* size of ptr buffer */
   int count;		/* how many we expect to read */
   int read;		/* how many bytes we read */
+  int sent;		/* sent at least once */
   int *ptr;		/* not to be touched */
   int *start;			/* start of rpc header */
   int *end;			/* end of rpc header */
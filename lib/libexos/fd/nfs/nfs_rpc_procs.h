@@ -251,6 +251,13 @@ extern int nfs_proc_read_p(struct nfs_fh *fhandle,
 			 int offset, int count, char *data,
 			 struct nfs_fattr *fattr);
 
+extern int nfs_proc_null(struct nfs_fh *fhandle);
+
+/* parallizing, into separate pages (read-ahead) */
+extern int nfs_proc_readpages(struct nfs_fh *fhandle,
+			 int offset, int npages, char **pages,
+			 struct nfs_fattr *fattr);
+
 extern int nfs_proc_write(struct nfs_fh *fhandle,
 			  int offset, int count, char *data,
 			  struct nfs_fattr *fattr);
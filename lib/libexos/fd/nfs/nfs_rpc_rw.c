@@ -102,6 +102,7 @@ p_overhead_rpc_alloc(int size,int count) {
 #endif /* PREALLOC */
     number = (count / size) + ((count % size) ? 1 : 0);
     DPRINTF(CLUHELP_LEVEL,("number: %d size: %d count: %d\n",number,size,count));
+    assert(number <= MAX_P_RPC);
     overhead_p_rpc.n = number;
     size+=NFS_SLACK_SPACE;		
     for (i = 0 ; i < number; i++) {
@@ -219,6 +220,79 @@ nfs_proc_read_p(struct nfs_fh *fhandle, int offset, int count,
     return (status == NFS_OK) ? total_length : nfs_stat_to_errno(status);
 }
 
+/* reads npages consecutive pages starting at offset into the page
+ * buffers in pages, all as one parallel rpc, so that read-ahead keeps
+ * several pages worth of requests in flight.  Returns the number of
+ * bytes read, which is short at the end of the file, or -errno if any
+ * reply before the end failed. */
+int 
+nfs_proc_readpages(struct nfs_fh *fhandle, int offset, int npages, 
+		   char **pages, struct nfs_fattr *fattr) {
+    int *p;
+    int len = 0;
+    int status = NFS_OK;
+    int ruid = 0;
+    struct generic_server *server = fhandle->server;
+    struct p_rpc *prpc;
+    struct p_rpc_rec *rw;
+    int i;
+    int chunk, per;
+    int total_length = 0;
+    
+    DPRINTF(CLUHELP_LEVEL,("NFS call  readpages %d @ %d\n", npages, offset));
+    chunk = (server->rsize < NFSPGSZ) ? server->rsize : NFSPGSZ;
+    assert((NFSPGSZ % chunk) == 0);
+    per = NFSPGSZ / chunk;
+    assert(npages * per <= MAX_P_RPC);
+
+    if (!(prpc = p_overhead_rpc_alloc(chunk, npages * NFSPGSZ)))
+	return -EIO;
+
+    for (i = 0; i < prpc->n ; i++) {
+	rw = &prpc->rw[i];
+	rw->start = nfs_rpc_header(rw->ptr, NFSPROC_READ, ruid);
+	rw->start = xdr_encode_fhandle(rw->start, fhandle);
+	*rw->start++ = htonl(offset + i*chunk);	/* offset */
+	*rw->start++ = htonl(chunk);		/* count */
+	rw->count = chunk;
+	*rw->start++ = htonl(chunk); /* traditional, could be any value */
+
+	rw->end = rw->start;
+	rw->r.n = 0;
+
+	rw->xid = rw->ptr[0];
+	rw->done = 0;
+    }
+
+    if ((status = p_generic_rpc_call(server,prpc)) < 0) {
+	p_overhead_rpc_free(prpc);
+	return status;
+    }
+    status = NFS_OK;
+    for (i = 0; i < prpc->n ; i++) {
+	rw = &prpc->rw[i];
+
+	if (!(p = generic_rpc_verify(rw->ptr))) {
+	    status = NFSERR_IO;
+	    break;
+	} else if ((status = ntohl(*p++)) != NFS_OK) {
+	    break;
+	}
+	p = xdr_decode_fattr(p, fattr);
+	if (!(p = xdr_decode_data(p, pages[i / per] + (i % per) * chunk,
+				  &len, rw->count))) {
+	    DPRINTF(CLUHELP_LEVEL,("nfs_proc_readpages: giant data size\n")); 
+	    status = NFSERR_IO;
+	    break;
+	}
+	total_length += len;
+	if (len < rw->count) break; /* end of file */
+    }
+
+    p_overhead_rpc_free(prpc);
+    return (status == NFS_OK) ? total_length : -nfs_stat_to_errno(status);
+}
+
 /* not parallel */
 int 
 nfs_proc_read_np(struct nfs_fh *fhandle, int offset, int count, 
@@ -275,6 +349,30 @@ nfs_proc_write(struct nfs_fh *fhandle, int offset, int count,
   return nfs_proc_writev(fhandle,offset,count,&r,fattr);
 }
 
+/* sets dst to the len bytes of src starting at off */
+static void
+ae_recv_slice(struct ae_recv *dst, struct ae_recv *src, int off, int len) {
+    int i, sz;
+
+    dst->n = 0;
+    for (i = 0; i < src->n && len > 0; i++) {
+	if (off >= src->r[i].sz) {
+	    off -= src->r[i].sz;
+	    continue;
+	}
+	sz = src->r[i].sz - off;
+	if (sz > len) sz = len;
+	assert(dst->n < AE_RECV_MAXSCATTER - 2);
+	dst->r[dst->n].data = src->r[i].data + off;
+	dst->r[dst->n].sz = sz;
+	dst->n++;
+	len -= sz;
+	off = 0;
+    }
+    assert(len == 0);
+}
+
+/* writes count bytes as wsize sized rpcs, all sent as one parallel rpc */
 int 
 nfs_proc_writev(struct nfs_fh *fhandle, int offset, int count, 
 	       struct ae_recv *r, struct nfs_fattr *fattr) {
@@ -296,8 +394,6 @@ nfs_proc_writev(struct nfs_fh *fhandle, int offset, int count,
     if (!(prpc = p_overhead_rpc_alloc(wsize, count)))
 	return -EIO;
 
-    demand(count <= wsize, we only handle up to 8K for now);
-
     tmp_data = NULL; // data;
     for (i = 0; i < prpc->n ; i++) {
       static char overflow[4];
@@ -310,12 +406,11 @@ nfs_proc_writev(struct nfs_fh *fhandle, int offset, int count,
 	*rw->start++ = htonl(rw->count); /* count */
 	*rw->start++ = htonl(rw->count); /* data len */
 	rw->end = rw->start;
-	rw->r.n = 1;
-	rw->r = *r;
+	ae_recv_slice(&rw->r, r, i*wsize, rw->count);
 
 	if ((rw->count % 4) != 0) {
-	  rw->r.r[r->n].data = overflow;
-	  rw->r.r[r->n].sz = 4 - (rw->count % 4);
+	  rw->r.r[rw->r.n].data = overflow;
+	  rw->r.r[rw->r.n].sz = 4 - (rw->count % 4);
 	  rw->r.n++;
 	}
 	pr_ae_recv(&rw->r);
@@ -346,7 +441,8 @@ nfs_proc_writev(struct nfs_fh *fhandle, int offset, int count,
 	    p = xdr_decode_fattr(p, fattr);
 	    DPRINTF(CLUHELP_LEVEL,("NFS reply write xid: %d, count %d\n", 
 		   rw->xid,rw->count));
-	}
+	} else 
+	    break;
     }
     
     DPRINTF(CLUHELP_LEVEL,("status: %d\n",status));
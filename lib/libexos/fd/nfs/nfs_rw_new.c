@@ -364,6 +364,81 @@ nfs_get_page(nfsc_p e, short pageno, short flags) {
   return vaddr;
 }
 
+/* nfs_fetch_pages:
+   brings the pages of [pageno, pageno + need + ahead) that are not yet in
+   the buffer cache into it, fetching each run of missing pages with one
+   parallel rpc.  The first need pages are wanted now; the rest are read
+   ahead, and are only fetched once at least half of them are missing so
+   that the requests go out in batches.  Pages are left unmapped.
+   */
+static void
+nfs_fetch_pages(nfsc_p e, int pageno, int need, int ahead) {
+  int dev, ino, status;
+  int first, end, npages, maxbatch, i, count;
+  char *pages[MAX_P_RPC];
+  struct nfs_fattr fattr;
+  struct generic_server *server;
+
+  dev = GETNFSCEDEV(e);
+  ino = GETNFSCEINO(e);
+  server = nfsc_get_fhandle(e)->server;
+
+  end = pageno + need + ahead;
+  npages = (nfsc_get_size(e) + NFSPGSZ - 1) / NFSPGSZ;
+  if (end > npages) end = npages;
+  if (end > NFSMAXOFFSET / NFSPGSZ) end = NFSMAXOFFSET / NFSPGSZ;
+
+  maxbatch = MAX_P_RPC / ((server->rsize < NFSPGSZ) ? 
+			  (NFSPGSZ / server->rsize) : 1);
+  if (maxbatch > NFS_RA_MAXPAGES) maxbatch = NFS_RA_MAXPAGES;
+
+  for (first = pageno; first < end; first++)
+    if (__bc_lookup64 ((u32)dev, NFSBCBLOCK(ino,first)) == NULL) break;
+  if (first >= end) return;
+  if (first >= pageno + need && (end - first) < (ahead + 1) / 2) return;
+
+  START(nfsc,readahead);
+  while (first < end) {
+    for (npages = 0; 
+	 npages < maxbatch && first + npages < end &&
+	   __bc_lookup64 ((u32)dev, NFSBCBLOCK(ino,first + npages)) == NULL;
+	 npages++)
+      pages[npages] = ALLOCATE_BC_PAGE();
+
+    if ((status = nfs_get_nfscd_envid()) && status != __envid) {
+      status = sipcout(status,IPC_NFS_READ,(u_int)e,
+		       first * NFSPGSZ,npages * NFSPGSZ);
+    }
+
+    count = nfs_proc_readpages(nfsc_get_fhandle(e),
+			       first * NFSPGSZ,
+			       npages,
+			       pages,
+			       &fattr);
+    if (count >= 0) {
+      if (nfsc_neq_mtime(e,&fattr) || nfsc_ts_iszero(e)) {
+	nfs_flush_nfsce(e);
+      }
+      nfsc_settimestamp(e);
+      nfs_fill_stat(&fattr,e);
+    }
+
+    for (i = 0; i < npages; i++) {
+      /* pages past what the server returned stay out of the cache;
+	 nfs_get_page will report any error when they are wanted */
+      if (count >= 0 && i * NFSPGSZ < count) {
+	nfs_new_bc_insert(pages[i],dev,NFSBCBLOCK(ino,first + i));
+      }
+      DEALLOCATE_MEMORY_BLOCK(pages[i], NBPG);
+    }
+    if (count < npages * NFSPGSZ) break;
+
+    for (first += npages; first < end; first++)
+      if (__bc_lookup64 ((u32)dev, NFSBCBLOCK(ino,first)) == NULL) break;
+  }
+  STOP(nfsc,readahead);
+}
+
 /* we don't unmap a page if is dirty */
 static inline int
 nfs_put_page(nfsc_p e, int pageno, void *vaddr) {
@@ -629,7 +704,7 @@ nfs_read_new(struct file *filp, char *buffer, int length, int blocking) {
   int amountToCopy;
   int blockOffset;
   int totlength;
-  int size,offset,pageno;
+  int size,offset,pageno,lastpage;
   
   demand(filp, bogus filp);
 
@@ -646,7 +721,7 @@ nfs_read_new(struct file *filp, char *buffer, int length, int blocking) {
 	  (int)filp, size, offset, length);
 #endif
   /* HBXX ASSUME SIZE IS UP TO DATE FIX ME LATER */
-  if (offset >= size) return(0); /* reading EOF */
+  if (offset >= size || length <= 0) return(0); /* reading EOF */
 
   if (offset+length > size) {
     length = size - offset;
@@ -658,6 +733,18 @@ nfs_read_new(struct file *filp, char *buffer, int length, int blocking) {
   blockOffset = offset % NFSPGSZ; /*don't do each time*/
   totlength = 0;
   pageno = offset / NFSPGSZ;
+  lastpage = (offset + length - 1) / NFSPGSZ;
+
+  /* reads that carry on where the last one stopped open the read-ahead
+     window, others close it */
+  if (pageno == e->ra_next) {
+    e->ra_pages = (e->ra_pages == 0) ? NFS_RA_MINPAGES : 
+      MIN(2 * e->ra_pages, NFS_RA_MAXPAGES);
+  } else if (pageno + 1 != e->ra_next) {
+    e->ra_pages = 0;
+  }
+  e->ra_next = lastpage + 1;
+  nfs_fetch_pages(e, pageno, lastpage - pageno + 1, e->ra_pages);
 
   while(length) {
     amountToCopy = min (length, NFSPGSZ - blockOffset);
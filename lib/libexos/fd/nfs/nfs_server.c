@@ -246,6 +246,7 @@ make_server(char *host, unsigned int port) {
     extern void pr_filp(struct file *,char *);
     extern int udp_set_nr_buffers(int);
     assert(MAX_P_RPC >= 4);
+    assert(NFS_RPC_MAXWINDOW < 15);
 
     udp_set_nr_buffers(15);	/* this has to be done before each bind */
 
@@ -290,6 +291,9 @@ make_server(char *host, unsigned int port) {
 
   server->nrwrites = 0;
   server->nrbcwrites = 0;
+  server->window = NFS_RPC_INITWINDOW;
+  server->wincredit = 0;
+  server->nrtimeouts = 0;
   /* pass the filter references to init process. */
   nfs_pass_server_ref(NFS_CAP,__envs[0].env_id,server);
   return(server);
@@ -326,6 +330,8 @@ pr_server(struct generic_server *serverp) {
 	 ntohl(serverp->addr->sin_addr.s_addr));
   printf("number of writes: %d, number of bc aligned writes: %d\n",
 	 serverp->nrwrites,serverp->nrbcwrites);
+  printf("rpc window: %d, rpc timeouts: %d\n",
+	 serverp->window,serverp->nrtimeouts);
 
 }
 
@@ -64,6 +64,9 @@ typedef struct generic_server {
   dev_t  fakedevice;
   int nrwrites;
   int nrbcwrites;
+  int window;		/* rpcs allowed in flight (p_generic_rpc_call) */
+  int wincredit;	/* replies since the window last opened */
+  int nrtimeouts;	/* rpc timeouts, each of which halved the window */
   
 } generic_server_t, *generic_server_p;
 
@@ -70,6 +70,8 @@ struct nfsc {
   int writestart;
   int n_dirsize;		/* for cached dirents */
   int writeend;
+  int ra_next;			/* page after the last one read */
+  int ra_pages;			/* read-ahead window, in pages */
   int fence2;
 };
 typedef struct nfsc nfsc_t;
@@ -135,6 +137,11 @@ typedef struct nfsc *nfsc_p;
 
 /* nfs block top 32 bits for inode, and bottom 32 bits for pageno */
 #define NFSPGSZ 4096
+
+/* sequential reads open the read-ahead window from NFS_RA_MINPAGES,
+   doubling up to NFS_RA_MAXPAGES (also bounded by MAX_P_RPC rpcs) */
+#define NFS_RA_MINPAGES 2
+#define NFS_RA_MAXPAGES 8
 static inline u_quad_t NFSBCBLOCK(int i,int o) {
      return (INT2QUAD (i, o));
    }
@@ -61,6 +61,8 @@
 #include <unistd.h>
 
 #include <exos/signal.h>
+#include <exos/vm.h>
+#include <xok/kerrno.h>
 #if 0
 #include <stdio.h>
 #define PR fprintf(stderr,"%s: %d\n",__FILE__,__LINE__);
@@ -73,11 +75,23 @@
 #define WPROTECT
 /* #define RPROTECT                /* read protect */
 #define DIRECT            /* Copy direct from writer to reader */
+#define LOAN              /* Loan whole pages to the reader instead of copying */
 
 #define PIPE_KEY PIPE_TYPE
 #define PIPE_BUFFER_SIZE (2*4096)
 #define NR_PIPE 200
 
+/* A pipe that sees writes larger than its ring swaps the ring for one of
+ * a small pool of big ones.  The big ring goes back to the pool when the
+ * pipe is closed. */
+#define PIPE_BIG_BUFFER_SIZE (16*4096)
+#define NR_PIPE_BIG 16
+
+#ifdef LOAN
+#define PIPE_LOAN_MIN (2*NBPG)	/* smaller direct writes are just copied */
+#define PIPE_LOAN_CHUNK 16	/* pages loaned per syscall */
+#endif
+
 #ifdef HANDLESIGNALS
 #include <exos/synch.h>
 #endif
@@ -98,21 +112,35 @@ static struct pipe_shared_data {
 	volatile int n;
         volatile int written;		/* number of bytes directly written */
 	volatile char *buf;
+#ifdef LOAN
+	volatile u_int loanva;	/* pages [loanva, loanend) of the reader */
+	volatile u_int loanend;	/* were loaned by the last direct write */
 #endif
+#endif
+	volatile int size;	/* size of the ring in use */
+	volatile int big;	/* index of big ring, or -1 to use buffer */
     } pipe[NR_PIPE];
+    volatile int bigowner[NR_PIPE_BIG];	/* pipe holding each big ring */
+    char bigbuffer[NR_PIPE_BIG][PIPE_BIG_BUFFER_SIZE];
 } *pipe_shared_data;
 
 static int piperegid = -99;
 
-#define GETREGION(p) (((p) - &pipe_shared_data->pipe[0]) + piperegid)
+#define PIPENUM(p) ((p) - &pipe_shared_data->pipe[0])
+#define GETREGION(p) (PIPENUM(p) + piperegid)
+/* the big rings have their own regions after the NR_PIPE pipe regions */
+#define GETRINGREGION(p) ((p)->big < 0 ? GETREGION(p) : \
+			  piperegid + NR_PIPE + (p)->big)
+#define PIPE_RING(p)    ((p)->big < 0 ? (p)->buffer : \
+			 pipe_shared_data->bigbuffer[(p)->big])
+#define PIPE_SIZE(p)    ((p)->size)
 
-#define PIPE_INC(i)     ((i + 1) % PIPE_BUFFER_SIZE)
-#define PIPE_INCN(i, n) ((i + (n)) % PIPE_BUFFER_SIZE)
+#define PIPE_INCN(p, i, n) ((i + (n)) % PIPE_SIZE(p))
 #define PIPE_FULL(p)    (((p)->head == (p)->tail) && ((p)->full))
 #define PIPE_EMPTY(p)   (((p)->head == (p)->tail) && ((p)->full == 0))
-#define PIPE_NBYTES(p)  (PIPE_FULL(p) ? PIPE_BUFFER_SIZE :		   \
+#define PIPE_NBYTES(p)  (PIPE_FULL(p) ? PIPE_SIZE(p) :		   \
 			 ((p)->head >= (p)->tail ? (p)->head - (p)->tail : \
-			  (p)->head - (p)->tail + PIPE_BUFFER_SIZE))
+			  (p)->head - (p)->tail + PIPE_SIZE(p)))
 
 static inline void
 SET_HEAD(struct pipe *pipep, int val) {
@@ -237,19 +265,48 @@ SET_REID(struct pipe *pipep, int val) {
 }
 
 
+/* switch pipep to big ring big (-1 for its own buffer).  Only done while
+   the ring is empty, so there is nothing to move over. */
+static inline void
+SET_RING(struct pipe *pipep, int big) {
+    struct {
+	int size;
+	int big;
+    } ring;
+
+    ring.size = big < 0 ? PIPE_BUFFER_SIZE : PIPE_BIG_BUFFER_SIZE;
+    ring.big = big;
+#ifdef WPROTECT
+    {
+      int t;
+
+      if ((pipep->size != ring.size || pipep->big != ring.big) &&
+	  (t = dma_to(0, &ring, sizeof(ring), __envid, (void *) &pipep->size,
+		      PIPE_KEY, GETREGION(pipep))) != 0) {
+	printf("set_ring: dma_to: failed %d\n", t);
+	assert(0);
+      }
+    }
+#else
+    pipep->size = ring.size;
+    pipep->big = ring.big;
+#endif
+}
+
+
 static inline void
 WRITE_BUFFER(struct pipe *pipep, int i, char *buf, int n) {
 #ifdef WPROTECT
     int t;  
 
     if (n > 0 &&
-	(t = dma_to(0, buf, n, __envid, (void *) &(pipep->buffer[i]), 
-		    PIPE_KEY, GETREGION(pipep))) != 0) {
+	(t = dma_to(0, buf, n, __envid, (void *) &(PIPE_RING(pipep)[i]), 
+		    PIPE_KEY, GETRINGREGION(pipep))) != 0) {
 	printf("write_buffer: dma_to: failed %d\n", t);
 	assert(0);
     }
 #else
-    memcpy(&pipep->buffer[i], buf, n);
+    memcpy(&PIPE_RING(pipep)[i], buf, n);
 #endif
 }
 
@@ -259,13 +316,13 @@ READ_BUFFER(struct pipe *pipep, int i, char *buf, int n) {
 #ifdef RPROTECT
     int t;
 
-    if ((t = dma_from(__envid, (void *) (&pipep->buffer[i]), n,
-	     0, (void *) buf, PIPE_KEY, GETREGION(pipep))) != 0) {
+    if ((t = dma_from(__envid, (void *) (&PIPE_RING(pipep)[i]), n,
+	     0, (void *) buf, PIPE_KEY, GETRINGREGION(pipep))) != 0) {
 	printf("read_buffer: dma_from: failed %d\n", t);
 	assert(0);
     }
 #else
-    memcpy(buf, &pipep->buffer[i], n);
+    memcpy(buf, &PIPE_RING(pipep)[i], n);
 #endif
 }
 
@@ -361,6 +418,10 @@ PIPE_INIT(struct pipe *pipe) {
     pipe->n = 0;
 #endif
 #endif
+#ifdef LOAN
+    pipe->loanva = pipe->loanend = 0;
+#endif
+    SET_RING(pipe, -1);
 }
 
 #define GETPIPEP(filp, p)  memcpy(&p, (filp)->data, sizeof(p))
@@ -469,8 +530,9 @@ pr_pipep(struct pipe *pipep) {
     fprintf(stderr,"%p: lck:%d ", pipep, pipep->lock.lock);
     fprintf(stderr,"inuse reader: %d writer: %d ",
 	    pipep->inuse[0],pipep->inuse[1]);
-    fprintf(stderr,"pipe[s]-%d  %3d:%-3d(full=%d) ",
-	    pipep->lock.lock,pipep->head, pipep->tail, pipep->full);
+    fprintf(stderr,"pipe[s]-%d  %3d:%-3d(full=%d) ring:%d/%d ",
+	    pipep->lock.lock,pipep->head, pipep->tail, pipep->full,
+	    pipep->big, pipep->size);
 #ifdef DIRECT
     fprintf(stderr,"Dbuf: %p Dn: %d, Dd: %d",
 	    pipep->buf, pipep->n, pipep->done);
@@ -507,6 +569,7 @@ pipe_init(void) {
 			  (char *)PIPE_SHARED_REGION);
 
     pipe_shared_data = (struct pipe_shared_data *) PIPE_SHARED_REGION;
+    StaticAssert(sizeof(struct pipe_shared_data) <= PIPE_SHARED_REGION_SZ);
 
     if (status == -1) {
 	demand(0, problems attaching shm);
@@ -522,14 +585,19 @@ pipe_init(void) {
 
         {
           dma_ctrlblk_t c;
-          dma_region_t r[NR_PIPE];
+          dma_region_t r[NR_PIPE + NR_PIPE_BIG];
           int i;
           for (i = 0; i < NR_PIPE; i++) {
             r[i].key = PIPE_KEY; 
             r[i].reg_addr = &pipe_shared_data->pipe[i];
             r[i].reg_size = sizeof(struct pipe);
           }
-          c.nregions = NR_PIPE;
+          for (i = 0; i < NR_PIPE_BIG; i++) {
+            r[NR_PIPE + i].key = PIPE_KEY; 
+            r[NR_PIPE + i].reg_addr = pipe_shared_data->bigbuffer[i];
+            r[NR_PIPE + i].reg_size = PIPE_BIG_BUFFER_SIZE;
+          }
+          c.nregions = NR_PIPE + NR_PIPE_BIG;
           c.dma_regions = &r[0];
           status = dma_setup_append(&c);
           assert(status >= 0);
@@ -544,7 +612,10 @@ pipe_init(void) {
 	    init_lock_pipe(pipep);
 	    CLR_PIPE_INUSE(0,pipep);
 	    CLR_PIPE_INUSE(1,pipep);
+	    SET_RING(pipep, -1);
 	}
+	for (i = 0; i < NR_PIPE_BIG; i++)
+	    pipe_shared_data->bigowner[i] = -1;
 	//kprintf("Maximum number of pipes: %d\n", NR_PIPE);
     }
 
@@ -555,6 +626,100 @@ pipe_init(void) {
     return 0;
 }
 
+/* Give pipep a big ring if one is free.  A big ring is free if its
+   owner has since given it back or closed both ends without doing so. */
+static void
+pipe_grow(struct pipe *pipep) {
+    struct pipe *ownerp;
+    int i, o;
+
+    lock_pipe_shared_data();
+    for (i = 0; i < NR_PIPE_BIG; i++) {
+	o = pipe_shared_data->bigowner[i];
+	if (o >= 0) {
+	    ownerp = MAKEPIPEP(o);
+	    if (ownerp->big == i &&
+		(PIPE_BUSY(0, ownerp) || PIPE_BUSY(1, ownerp))) continue;
+	}
+	pipe_shared_data->bigowner[i] = PIPENUM(pipep);
+	SET_RING(pipep, i);
+	break;
+    }
+    unlock_pipe_shared_data();
+}
+
+#ifdef LOAN
+/* Can the reader's page at va take a loan?  Like sys_vcopyout we want
+ * a present user page we could write to, except that a page an earlier
+ * loan left copy-on-write will do too (see pipe_read).  Shared pages
+ * have to stay shared. */
+static inline int
+pipe_loan_dest_ok(int envid, u_int va) {
+    int err = 0;
+    Pte pte = sys_read_pte(va, 0, envid, &err);
+
+    return err == 0 && (pte & (PG_P|PG_U|PG_SHARED)) == (PG_P|PG_U) &&
+	(pte & (PG_W|PG_COW));
+}
+
+/* Move len bytes at buffer into the reader's buffer.  When both sides
+ * sit at the same page offset the whole pages in the middle are not
+ * copied: they are mapped into the reader and both mappings are made
+ * copy-on-write, so whoever writes to one first takes the copy (see
+ * do_cow_fault).  Pages that can't be loaned are copied.  Returns what
+ * sys_vcopyout returns. */
+static int
+pipe_loan(struct pipe *pipep, char *buffer, int len) {
+    Pte ptes[PIPE_LOAN_CHUNK];
+    Pte pte;
+    int envid = pipep->reid;
+    u_int va = (u_int)pipep->buf;
+    u_int start = (u_int)buffer;
+    u_int pg = PGROUNDUP(start);
+    u_int end = PGROUNDDOWN(start + len);
+    u_int npages, done, i;
+    int r;
+
+    pipep->loanva = pipep->loanend = 0;
+    if (len < PIPE_LOAN_MIN || ((start ^ va) & PGMASK) || pg >= end)
+	return sys_vcopyout(buffer, envid, va, len);
+
+    if ((r = sys_vcopyout(buffer, envid, va, pg - start)) != 0)
+	return r;
+    va += pg - start;
+
+    while (pg < end) {
+	npages = MIN(PGNO(end - pg), PIPE_LOAN_CHUNK);
+	for (i = 0; i < npages; i++) {
+	    pte = vpt[PGNO(pg) + i];
+	    /* shared pages have to stay shared, and other people's pages
+	       have to stay theirs */
+	    if ((pte & (PG_P|PG_U|PG_SHARED)) != (PG_P|PG_U) ||
+		!(pte & (PG_W|PG_COW)) || !pipe_loan_dest_ok(envid, va + i*NBPG))
+		break;
+	    ptes[i] = (pte & ~(PG_W|PG_RO|PG_A|PG_D)) | PG_COW;
+	}
+	done = 0;
+	if (i > 0 && sys_self_mod_pte_range(0, PG_COW, PG_W, pg, i) >= 0)
+	    _exos_insert_pte_range(0, ptes, i, va, &done, 0, envid, 0, NULL);
+	if (done > 0) {
+	    if (pipep->loanend == 0)
+		pipep->loanva = va;
+	    pipep->loanend = va + done * NBPG;
+	} else {
+	    /* copy the page we couldn't loan and try again after it */
+	    done = 1;
+	    if ((r = sys_vcopyout((char *)pg, envid, va, NBPG)) != 0)
+		return r;
+	}
+	pg += done * NBPG;
+	va += done * NBPG;
+    }
+
+    return sys_vcopyout((char *)end, envid, va, start + len - end);
+}
+#endif
+
 static int 
 pipewrite(struct pipe *pipep, char *buffer, int nbyte) {
     int to_write, to_write1;
@@ -562,6 +727,7 @@ pipewrite(struct pipe *pipep, char *buffer, int nbyte) {
     int n = PIPE_NBYTES(pipep);
     int h = GET_HEAD(pipep);
     int m = 0;
+    int size;
 
 #ifdef DIRECT
     /* Copy as much as possible directly into the reader's buffer.  Copy
@@ -569,29 +735,45 @@ pipewrite(struct pipe *pipep, char *buffer, int nbyte) {
     if (pipep->n > 0) {
         int r;
 	m = MIN(nbyte, pipep->n);
-	if ((r = sys_vcopyout(buffer, pipep->reid, (u_long) pipep->buf, 
-			      m)) != 0) {
+#ifdef LOAN
+	r = pipe_loan(pipep, buffer, m);
+#else
+	r = sys_vcopyout(buffer, pipep->reid, (u_long) pipep->buf, m);
+#endif
+	if (r == -E_RVMI) {
+	  /* the reader left loaned pages in its buffer read-only (see
+	     pipe_read).  Let it copy out of the ring instead. */
+	  pipep->n = 0;
+	  m = 0;
+	} else if (r != 0) {
 	  ExitCritical();
 	  sys_cputs("vcopyout failed: ");
 	  kprintf("%d\n", r);
 	  printf("vcopyout failed: %d\n", r);
 	  assert(0);
-	}
-	pipep->n = 0;
-	pipep->done = 1;
-	pipep->written = m;
-	pipep->buf = 0;
+	} else {
+	  pipep->n = 0;
+	  pipep->done = 1;
+	  pipep->written = m;
+	  pipep->buf = 0;
 	
-	if (m == nbyte)
-	  return nbyte;
-	nbyte -= m;
-	buffer += m;
+	  if (m == nbyte)
+	    return nbyte;
+	  nbyte -= m;
+	  buffer += m;
+	}
     }
 #endif
-    to_write = total = MIN(nbyte, PIPE_BUFFER_SIZE - n);
-    if ((h + to_write) > PIPE_BUFFER_SIZE) {
+    /* a write bigger than the ring would have to wait for the reader
+       several times over; move to a bigger ring while this one is empty */
+    if (n == 0 && pipep->big < 0 && nbyte > PIPE_SIZE(pipep))
+	pipe_grow(pipep);
+
+    size = PIPE_SIZE(pipep);
+    to_write = total = MIN(nbyte, size - n);
+    if ((h + to_write) > size) {
 	/* copy in two steps */
-	to_write1 = PIPE_BUFFER_SIZE - h;
+	to_write1 = size - h;
 	to_write -= to_write1;
 	WRITE_BUFFER(pipep, h, buffer, to_write1);
 	buffer += to_write1;
@@ -599,7 +781,7 @@ pipewrite(struct pipe *pipep, char *buffer, int nbyte) {
     }
     /* copy in one step */
     WRITE_BUFFER(pipep, h, buffer, to_write);
-    SET_HEAD(pipep, PIPE_INCN(h, to_write));
+    SET_HEAD(pipep, PIPE_INCN(pipep, h, to_write));
     return total + m;
 }
 
@@ -610,11 +792,12 @@ piperead(struct pipe *pipep, char *buffer, int nbyte) {
     int total;
     int n = PIPE_NBYTES(pipep);
     int t = GET_TAIL(pipep);
+    int size = PIPE_SIZE(pipep);
     
     to_read = total = MIN(nbyte, n);
-    if ((t + to_read) > PIPE_BUFFER_SIZE) {
+    if ((t + to_read) > size) {
 	/* copy in two steps because it wraps around */
-	to_read1 = PIPE_BUFFER_SIZE - t;
+	to_read1 = size - t;
 	to_read -= to_read1;
 
 	READ_BUFFER(pipep, t, buffer, to_read1);
@@ -623,7 +806,7 @@ piperead(struct pipe *pipep, char *buffer, int nbyte) {
     }
      
     READ_BUFFER(pipep, t, buffer, to_read);
-    SET_TAIL(pipep, PIPE_INCN(t, to_read));
+    SET_TAIL(pipep, PIPE_INCN(pipep, t, to_read));
     return (to_read + to_read1);
 }
 
@@ -774,6 +957,16 @@ pipe_read(struct file *filp, char *buffer, int nbyte, int blocking) {
       for (va = PGROUNDDOWN((u_int)buffer);
 	   va < (u_int)buffer + nbyte;
 	   va += NBPG)
+#ifdef LOAN
+	/* pages loaned by the last read will most likely just be replaced
+	   by the next loan, so don't copy them.  If the writer has to
+	   copy instead it falls back to the ring.  Other copy-on-write
+	   pages, from fork say, still get their copy here. */
+	if (nbyte < PIPE_LOAN_MIN || pipep->reid != __envid ||
+	    va < pipep->loanva || va >= pipep->loanend ||
+	    (vpd[PDENO(va)] & PG_P) == 0 ||
+	    (vpt[PGNO(va)] & (PG_P|PG_COW)) != (PG_P|PG_COW))
+#endif
 	asm volatile ("movl %2, %0\n"
 		      "\tmovl %3, %1" :
 		      "=r" (temp), "=m" (*(u_int*)va) :
@@ -844,8 +1037,8 @@ pipe_read(struct file *filp, char *buffer, int nbyte, int blocking) {
 #endif
 	    lock_filp (filp);
 #ifdef DIRECT
-	    /* HBXX - this assert will fail if multiple readers on the pipe */
-	    assert (pipep->done || PIPE_EMPTY(pipep));
+	    /* the writer may also have put the data in the ring instead,
+	       if it couldn't write into our buffer (see pipewrite) */
 	    if (pipep->done) {	/* did the writer do a direct copy? */
 	      final += pipep->written;
 	      goto done;
@@ -987,6 +1180,14 @@ pipe_close(struct file * filp) {
     writer = filp->f_pos;
     assert(writer == 0 || writer == 1);
     CLR_PIPE_INUSE(writer,pipep);
+    /* last one out gives the big ring back */
+    if (!PIPE_BUSY(0, pipep) && !PIPE_BUSY(1, pipep) && pipep->big >= 0) {
+	lock_pipe_shared_data();
+	if (pipe_shared_data->bigowner[pipep->big] == PIPENUM(pipep))
+	    pipe_shared_data->bigowner[pipep->big] = -1;
+	SET_RING(pipep, -1);
+	unlock_pipe_shared_data();
+    }
 
     return 0;
 }
@@ -1075,7 +1276,7 @@ pipe_stat(struct file *filp, struct stat *buf) {
     buf->st_atime   = 0;
     buf->st_mtime   = 0;
     buf->st_ctime   = 0;
-    buf->st_blksize = PIPE_BUFFER_SIZE;
+    buf->st_blksize = PIPE_BIG_BUFFER_SIZE;
     buf->st_blocks  = 0;
     return(0);
 }
@@ -203,7 +203,7 @@ pr_fds(void) {
     int i, d = 0;
 
     fprintf(stderr,"PID: %d fds in use:\n",getpid());
-    for (i = 0; i < NR_OPEN; i++) {
+    for (i = 0; i < __current->nr_open; i++) {
 	if (__current->fd[i]) {
 	  char buffer[16];
 	  fprintf(stderr,"FD: %2d filp %p cloexec: %d\n",i,__current->fd[i],
@@ -249,7 +249,7 @@ print_fds(FILE *out) {
     else
       kprintf("PID %d ENVID %d PROG %s. fds in use:\n",getpid(), __envid, __progname);
 
-    for (i = 0; i < NR_OPEN; i++) {
+    for (i = 0; i < __current->nr_open; i++) {
 	if (__current->fd[i]) {
 	  if (out)
 	    fprintf(out, "FD: %2d filp %s cloexec: %d\n",i,
@@ -278,10 +278,11 @@ print_ftable(FILE *out) {
   else
     kprintf("--FTABLE--\n");
 
-  for (i=0; i < NR_FTABLE; i++) {
-    if (FD_ISSET(i,&global_ftable->inuse))
+  ftable_attach();
+  for (i=0; i < NR_FTABLE_CREATED; i++) {
+    if (FILP_ISINUSE(FILP_ENTRY(i)))
       {
-	struct file *filp = &global_ftable->fentries[i];
+	struct file *filp = FILP_ENTRY(i);
 	if (out)
 	  fprintf (out, "%s\n", filp_to_string(filp, buf, BUFSIZE));
 	else
@@ -311,7 +312,9 @@ getfd(void)
     int fd;
     START(ftable,getfd);
     DPRINTF(SYSHELP_LEVEL,("getfd entering\n"));
-    for(fd = 0; fd < NR_OPEN ; fd++)
+    for(fd = __current->fd_hint; ; fd++) {
+	if (fd == __current->nr_open && fd_table_grow(fd + 1) < 0)
+	    break;
 	if (__current->fd[fd] == NULL) 
 	    {
 		__current->fd[fd] = getfilp();
@@ -329,10 +332,12 @@ getfd(void)
 #endif
 		    filp_refcount_init(__current->fd[fd]);
 		    __current->cloexec_flag[fd] = 0;
+		    __current->fd_hint = fd + 1;
 		    STOP(ftable,getfd);
 		    return fd;
 		}
 	    }
+    }
     DPRINTF(SYSHELP_LEVEL,("getfd out of fds!\n"));
     fprintf(stderr,"getfd out of fds!\n");
     STOP(ftable,getfd);
@@ -345,10 +350,10 @@ putfd(int fd)
 {
   START(ftable,putfd);
     DPRINTF(SYSHELP_LEVEL,("putfd entering fd: %d\n",fd));
-    if (!((fd >= 0 && fd < NR_OPEN))) {
+    if (!((fd >= 0 && fd < __current->nr_open))) {
 	printf("BAD FD: %d\n",fd);
     }
-    demand (fd >= 0 && fd < NR_OPEN, putfd: fd out of bounds);
+    demand (fd >= 0 && fd < __current->nr_open, putfd: fd out of bounds);
     if (__current->fd[fd] == NULL) {
       fprintf(stderr,"warning, putfd was given a non-inuse fd\n");
       return;
@@ -356,6 +361,7 @@ putfd(int fd)
 	if (filp_refcount_get(__current->fd[fd]) == 0) putfilp(__current->fd[fd]);
 	__current->fd[fd] = (struct file *) NULL;
 	__current->cloexec_flag[fd] = 0;
+	if (fd < __current->fd_hint) __current->fd_hint = fd;
     }
     STOP(ftable,putfd);
 }
@@ -375,11 +381,16 @@ dup2(int fd1, int fd2) {
     DPRINTF(SYS_LEVEL,("dup2 %d %d: entering\n",fd1,fd2));
     CHECKFD(fd1, OSCALL_dup2);
     
-    if (fd2 < 0 || fd2 > NR_OPEN) {
+    if (fd2 < 0 || fd2 >= NR_OPEN_MAX) {
       errno = EBADF;
       OSCALLEXIT(OSCALL_dup2);
       return -1;
     }
+    if (fd_table_grow(fd2 + 1) < 0) {
+      errno = EMFILE;
+      OSCALLEXIT(OSCALL_dup2);
+      return -1;
+    }
 
     /* handle the case they are the same */
     if (fd1 == fd2) {
@@ -408,10 +419,13 @@ dup3(int fd1, int fd2) {
     DPRINTF(SYS_LEVEL,("dup3 %d %d: entering\n",fd1,fd2));
     CHECKFD(fd1, -1);
     
-    if (fd2 < 0 || fd2 > NR_OPEN) { errno = EINVAL;return -1;}
+    if (fd2 < 0 || fd2 >= NR_OPEN_MAX) { errno = EINVAL;return -1;}
 
     filp = __current->fd[fd1];
-    for ( ; fd2 < NR_OPEN ; fd2++) {
+    if (fd2 < __current->fd_hint) fd2 = __current->fd_hint;
+    for ( ; fd2 < NR_OPEN_MAX ; fd2++) {
+      if (fd2 >= __current->nr_open && fd_table_grow(fd2 + 1) < 0)
+	break;
       if (__current->fd[fd2] == NULL) {
 	filp_refcount_inc(filp);
 	__current->fd[fd2] = filp;
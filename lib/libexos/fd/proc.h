@@ -50,6 +50,7 @@
 #include <exos/locks.h>
 #include <xok/wk.h>
 #include <xok/disk.h>
+#include <exos/vm-layout.h>
 #include "fdstat.h"
 
 /* debugging levels:
@@ -63,12 +64,30 @@
  */
 
 
-#define NR_OPEN 128		/* # of max fd's */
-#define NR_FTABLE 256		/* # of files open among all processes */
+/* The per-process fd table lives at FD_TABLE_REGION and starts out
+ * one page of pointers big; getfd, dup2 and F_DUPFD grow it a page at
+ * a time (fd_table_grow) up to NR_OPEN_MAX.  __current->nr_open is its
+ * current size.  select copes with any width, so programs that use
+ * more than FD_SETSIZE fds just need to define a bigger FD_SETSIZE.
+ */
+#define NR_OPEN_MAX 32768	/* # of max fd's */
+#define NR_OPEN_GROW (NBPG / sizeof(struct file *)) /* fd's per table page */
+#define FD_TABLE_FDS FD_TABLE_REGION
+#define FD_TABLE_CLOEXEC (FD_TABLE_REGION + NR_OPEN_MAX * sizeof(struct file *))
+
+/* File entries are kept in chunks of FILP_CHUNK_PAGES shared pages at
+ * FILP_ENTRY_REGION, created as needed and mapped into each process
+ * when it first needs them.  Each process takes entries from the
+ * global free list FILP_CACHE_BATCH at a time and keeps the ones it
+ * frees in a private cache, so the ftable lock is only taken once
+ * every few opens and closes.
+ */
+#define FILP_CHUNK_PAGES 4
+#define NR_FTABLE_CHUNKS (FILP_ENTRY_REGION_SZ / (FILP_CHUNK_PAGES * NBPG))
+#define NR_FILP_CHUNK (FILP_CHUNK_PAGES * NBPG / sizeof(struct file))
+#define NR_FTABLE (NR_FTABLE_CHUNKS * NR_FILP_CHUNK) /* # of files open among all processes */
 #define NR_RSVRD_FTABLE 60      /* # of files in ftable reserved for root processes */
-
-#undef FD_SETSIZE
-#define FD_SETSIZE NR_FTABLE	/* for fd_set type */
+#define FILP_CACHE_BATCH 16
 
 #define NR_SOCKTYPES 4		/* # of socket types, just udp,udp,tcp,tcp */
 #define GROUP_END -1
@@ -139,9 +158,13 @@ struct file {
   u_int flock_envid;
   u_int flock_state;
   exos_lock_t lock;
+  int ff_next;			/* next free entry, or FILP_INUSE/CACHED */
   unsigned char data[FILE_DATA_SIZE]; /* partial-private data for file */
 };
 
+#define FILP_INUSE  -2		/* ff_next of an allocated file entry */
+#define FILP_CACHED -3		/* ff_next of an entry in a process' cache */
+
 static inline void
 filp_refcount_init(struct file *filp)
 {
@@ -256,8 +279,10 @@ struct proc_struct {
   struct file * cwd;
   int cwd_isfd;
   int count;
-  struct file * fd[NR_OPEN];
-  char cloexec_flag[NR_OPEN];
+  int nr_open;			/* size of the fd and cloexec_flag tables */
+  int fd_hint;			/* all fds below this one are in use */
+  struct file ** fd;		/* both tables live in FD_TABLE_REGION */
+  char * cloexec_flag;
   struct file_ops *fops[SUPPORTED_OPS];
 
   int regids[SUPPORTED_OPS];	/* contains the first region id of
@@ -294,12 +319,14 @@ typedef struct mounttable mounttable_t;
 
 #define FILPEQ(x,y) ((x)->f_ino == (y)->f_ino && (x)->f_dev == (y)->f_dev)
 struct global_ftable {
-  struct file fentries[NR_FTABLE]; /* file entries */
   exos_lock_t lock;
   exos_lock_t flock_lock;
   exos_lock_t cffs_lock;	/* global lock for all of cffs */
   dev_t remotedev;		/* remote devices for nfs dev */
-  fd_set inuse;			/* if file entry is inuse */
+  int nchunks;			/* file entry chunks created so far */
+  int free_head;		/* first entry of the free list or -1 */
+  int nfree;			/* entries on the free list */
+  Pte chunk_ptes[NR_FTABLE_CHUNKS][FILP_CHUNK_PAGES]; /* to map chunks */
 
   u_int inited_disks[MAX_DISKS];
   u_int mounted_disks[MAX_DISKS];
@@ -311,6 +338,14 @@ struct global_ftable {
 };
 extern struct global_ftable *global_ftable;
 
+/* file entry i; only valid once its chunk is attached (ftable_attach) */
+#define FILP_ENTRY(i) (((struct file *)FILP_ENTRY_REGION) + (i))
+#define FILP_INDEX(filp) ((filp) - (struct file *)FILP_ENTRY_REGION)
+#define FILP_ISINUSE(filp) ((filp)->ff_next == FILP_INUSE)
+/* entries created so far, to walk the table */
+#define NR_FTABLE_CREATED (global_ftable->nchunks * NR_FILP_CHUNK)
+int ftable_attach(void);
+
 #define EQDOT(next) \
      ((next)[0] == '.' && (next)[1] == (char)NULL)
 #define EQDOTDOT(next) \
@@ -373,6 +408,7 @@ void dump_file_structures(FILE *);
 
 extern void putfd(int fd);
 extern int getfd(void);
+extern int fd_table_grow(int nfds);
 
 extern struct file *
 getfilp(void);
@@ -380,12 +416,15 @@ getfilp(void);
 extern void
 putfilp(struct file * filp);
 
+extern void
+putfilp_flush(void);
+
 extern int
 fd_shm_alloc(key_t seg, int size, char *location);
 
 /* CHECKFD - verifies the validity of a FD, if bad sets the right error */
 #define CHECKFD(x, y) {						\
-  if ((x) < 0 || (x) > NR_OPEN || __current->fd[(x)] == NULL) {	\
+  if ((x) < 0 || (x) >= __current->nr_open || __current->fd[(x)] == NULL) { \
     errno = EBADF;						\
     if (y >= 0) OSCALLEXIT(y);					\
     return -1;							\
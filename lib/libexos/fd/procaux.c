@@ -66,28 +66,35 @@ struct proc_struct *__current = (struct proc_struct *)0;
  * process, and every other process thereafter.
  * This procedures copies its current structure to its child to be.
  */
-/* shares current into the child process as COW */
+/* shares npages pages at va into newenvid as COW */
+static int
+ShareCOW(u_int k, int newenvid, u_int va, u_int npages) {
+  u_int num_completed = 0;
+
+  if (_exos_insert_pte_range(k, &vpt[PGNO(va)], npages, va, &num_completed,
+			     k, newenvid, 0, NULL) < 0 ||
+      sys_mod_pte_range(k, PG_COW, PG_W | PG_RO, va, npages, k,
+			newenvid) < 0 ||
+      sys_self_mod_pte_range(k, PG_COW, PG_W | PG_RO, va, npages) < 0)
+    return -1;
+  return 0;
+}
+
+/* shares current and its fd tables into the child process as COW */
 int 
 ExecProcInit(u_int k, int newenvid, int execonly) {
-  u_int num_completed = 0;
   /* kprintf("ExecProcInit\n"); */
   assert(__current);
   StaticAssert(sizeof(struct proc_struct) <= PROC_STRUCT_SZ);
-
-  if (_exos_insert_pte_range(k, &vpt[PGNO(__current)],
-			     PGNO(PGROUNDUP((u_int)__current +
-					    sizeof(struct proc_struct))) -
-			     PGNO(__current), PROC_STRUCT, &num_completed, k,
-			     newenvid, 0, NULL) < 0 ||
-      sys_mod_pte_range(k, PG_COW, PG_W | PG_RO, PGROUNDDOWN((u_int)__current),
-			PGNO(PGROUNDUP((u_int)__current +
-				       sizeof(struct proc_struct))) -
-			PGNO((u_int)__current), k, newenvid) < 0 ||
-      sys_self_mod_pte_range(k, PG_COW, PG_W | PG_RO,
-			     PGROUNDDOWN((u_int)__current),
-			     PGNO(PGROUNDUP((u_int)__current +
-					    sizeof(struct proc_struct))) -
-			     PGNO((u_int)__current)) < 0 ||
+  assert((u_int)__current == PROC_STRUCT);
+
+  if (ShareCOW(k, newenvid, PROC_STRUCT,
+	       PGNO(PGROUNDUP(sizeof(struct proc_struct)))) < 0 ||
+      ShareCOW(k, newenvid, (u_int)__current->fd,
+	       PGNO(PGROUNDUP(__current->nr_open *
+			      sizeof(struct file *)))) < 0 ||
+      ShareCOW(k, newenvid, (u_int)__current->cloexec_flag,
+	       PGNO(PGROUNDUP(__current->nr_open))) < 0 ||
       _exos_insert_pte(k, vpt[PGNO(MOUNT_SHARED_REGION)], MOUNT_SHARED_REGION,
 		       k, newenvid, 0, NULL) < 0) {
     kprintf ("ExecProcInit failed!\n");
@@ -156,15 +163,71 @@ FDFreshProcInit(void) {
     for(i = 0; i < SUPPORTED_OPS; i++)
 	__current->fops[i] = (struct file_ops *) 0;
 
-    for(i = 0; i < NR_OPEN; i++) {
-	__current->fd[i] = (struct file *) 0;
-	__current->cloexec_flag[i] = 0;
+    __current->fd = (struct file **) FD_TABLE_FDS;
+    __current->cloexec_flag = (char *) FD_TABLE_CLOEXEC;
+    __current->nr_open = 0;
+    __current->fd_hint = 0;
+    if (fd_table_grow(NR_OPEN_GROW) < 0) {
+      kprintf("FDFreshProcInit: could not allocate fd table\n");
+      return -1;
     }
 
     return 0;
     /* move stuff from proc_init */
 }
 
+static void
+fd_table_unmap(u_int va, u_int end) {
+  for (; va < end; va += NBPG)
+    _exos_self_unmap_page(0, va);
+}
+
+/* maps zeroed pages at [va, end), or none of them */
+static int
+fd_table_map(u_int va, u_int end) {
+  u_int p;
+
+  for (p = va; p < end; p += NBPG) {
+    if (_exos_self_insert_pte(0, PG_U|PG_W|PG_P, p, 0, NULL) < 0) {
+      fd_table_unmap(va, p);
+      return -1;
+    }
+    bzero((void *)p, NBPG);
+  }
+  return 0;
+}
+
+/* fd_table_grow - makes the fd table big enough for nfds descriptors,
+ * mapping (zeroed) pages for both tables a page of fds at a time.
+ * Returns 0, or -1 if nfds is more than NR_OPEN_MAX or there is no
+ * memory.
+ */
+int
+fd_table_grow(int nfds) {
+  u_int fdva, fdend, cova, coend;
+  int n;
+
+  if (nfds <= __current->nr_open) return 0;
+  if (nfds > NR_OPEN_MAX) return -1;
+  n = (nfds + NR_OPEN_GROW - 1) / NR_OPEN_GROW * NR_OPEN_GROW;
+
+  /* pointer pages, then the close-on-exec flags they need; if we run
+     out of memory the table stays as it was */
+  fdva = PGROUNDUP((u_int)&__current->fd[__current->nr_open]);
+  fdend = PGROUNDUP((u_int)&__current->fd[n]);
+  cova = PGROUNDUP((u_int)&__current->cloexec_flag[__current->nr_open]);
+  coend = PGROUNDUP((u_int)&__current->cloexec_flag[n]);
+  if (fd_table_map(fdva, fdend) < 0)
+    return -1;
+  if (fd_table_map(cova, coend) < 0) {
+    fd_table_unmap(fdva, fdend);
+    return -1;
+  }
+
+  __current->nr_open = n;
+  return 0;
+}
+
 /* Updates the ref count of the objects pointed by the fd vector of
  * the current process.  This is called by the parent before creating 
  * (via exec or fork) a new process, therefore there are no race conditions.
@@ -175,7 +238,7 @@ UpdateRefCount(void) {
     int fd;
 
     /* kprintf("Update Ref Count PID: %d\n",getpid()); */
-    for (fd = 0 ; fd < NR_OPEN ; fd++) {
+    for (fd = 0 ; fd < __current->nr_open ; fd++) {
 	if (__current->fd[fd] != NULL) {
 /*	  kprintf("fd: %d is good, filp: %08x\n",fd,(int)__current->fd[fd]);*/
 	  lock_filp(__current->fd[fd]);
@@ -219,7 +282,7 @@ int
 CloseOnExecFD(void) {
     int fd;
 
-    for (fd = 0 ; fd < NR_OPEN ; fd++) {
+    for (fd = 0 ; fd < __current->nr_open ; fd++) {
 	if (__current->fd[fd] != NULL && 
 	    __current->cloexec_flag[fd] == 1) {
 	    /* 	    (__current->fd[fd]->f_flags & FD_CLOEXEC)) { */
@@ -301,7 +364,7 @@ FDEndProcess(void) {
 
     STOPP(misc,step7);
     ISTART(misc,step8);
-    for (fd = 3 ; fd < NR_OPEN ; fd++) {
+    for (fd = 3 ; fd < __current->nr_open ; fd++) {
 	if (__current->fd[fd] != NULL) {
 /*	    kprintf("closing fd: %d (%08x)...",fd,(int)__current->fd[fd]);*/
 	    close(fd);
@@ -329,6 +392,9 @@ FDEndProcess(void) {
     }
     STOPP(misc,step9);
 
+    /* give back the file entries we had cached */
+    putfilp_flush();
+
     return 0;
 }
 
@@ -40,6 +40,8 @@
 #include <sys/types.h>
 #include <sys/time.h>
 #include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <assert.h>
 
@@ -54,9 +56,17 @@
 
 #define SELECT_EXCEPT_CONDITIONS 1
 
+/* Past this many fds we do not build a wakeup predicate (it would not
+   fit) and poll the fds every tick instead. */
+#define SELECT_PRED_FDS 64
+
+/* fd sets are only as big as the width passed in, which may be larger
+   or smaller than our FD_SETSIZE */
+#define FDSET_BYTES(width) (howmany((width), NFDBITS) * sizeof(fd_mask))
+
 static inline void
 copyfds(fd_set *a,fd_set *b, int width) {
-  memcpy((void*)a,(void*)b,width);
+  memcpy((void*)a,(void*)b,FDSET_BYTES(width));
 }
 
 int
@@ -69,15 +79,23 @@ select(int width, fd_set *readfds, fd_set *writefds, fd_set *exceptfds,
   struct wk_term t[WK_SELECT_SZ];  
   int next;
   int total = 0;
-  fd_set newreadfds, newwritefds, newexceptfds;
+  int nfds = 0;
+  u_quad_t wait_until = 0;
+  fd_set *newreadfds, *newwritefds, *newexceptfds;
 #define DID_FDREADY 1		
 #define DID_TIMEOUT 2
 #define DID_SIGNAL 3
+#define DID_POLL 4
   struct file *filp;
   int had_prev_term;
 
   OSCALLENTER(OSCALL_select);
-  width = MIN (width+1, NR_OPEN);
+  if (width < 0) {
+    errno = EINVAL;
+    OSCALLEXIT(OSCALL_select);
+    return -1;
+  }
+  width = MIN (width, __current->nr_open);
 
   /* make sure that all fd's set to be polled are valid fd's */
 
@@ -88,12 +106,16 @@ select(int width, fd_set *readfds, fd_set *writefds, fd_set *exceptfds,
       CHECKFD(fd, OSCALL_select);
       assert (CHECKOP (__current->fd[fd], select));
       assert (CHECKOP (__current->fd[fd], select_pred));
+      nfds++;
     }
   }
 
-  FD_ZERO(&newreadfds);
-  FD_ZERO(&newwritefds);
-  FD_ZERO(&newexceptfds);
+  newreadfds = alloca(FDSET_BYTES(width));
+  newwritefds = alloca(FDSET_BYTES(width));
+  newexceptfds = alloca(FDSET_BYTES(width));
+  bzero(newreadfds, FDSET_BYTES(width));
+  bzero(newwritefds, FDSET_BYTES(width));
+  bzero(newexceptfds, FDSET_BYTES(width));
 
   /* Our basic algorithm is poll the fd's once. If any fd's are found
      ready return. Otherwise sleep until one of them might be ready
@@ -121,17 +143,17 @@ select(int width, fd_set *readfds, fd_set *writefds, fd_set *exceptfds,
       if (readfds && FD_ISSET (fd, readfds))
 	if (DOOP (__current->fd[fd], select, (__current->fd[fd], SELECT_READ))) {
 	  total++;
-	  FD_SET (fd, &newreadfds);
+	  FD_SET (fd, newreadfds);
 	}
       if (writefds && FD_ISSET (fd, writefds))
 	if (DOOP (__current->fd[fd], select, (__current->fd[fd], SELECT_WRITE))) {
 	  total++;
-	  FD_SET (fd, &newwritefds);
+	  FD_SET (fd, newwritefds);
 	}	
       if (SELECT_EXCEPT_CONDITIONS && exceptfds && FD_ISSET (fd, exceptfds))
 	if (DOOP (__current->fd[fd], select, (__current->fd[fd], SELECT_EXCEPT))) {
 	  total++;
-	  FD_SET (fd, &newexceptfds);
+	  FD_SET (fd, newexceptfds);
 	}	
     }
 
@@ -141,11 +163,11 @@ select(int width, fd_set *readfds, fd_set *writefds, fd_set *exceptfds,
 
     if (total) {
       if (readfds)
-	copyfds (readfds, &newreadfds, width);
+	copyfds (readfds, newreadfds, width);
       if (writefds)
-	copyfds (writefds, &newwritefds, width);
+	copyfds (writefds, newwritefds, width);
       if (exceptfds)
-	copyfds (exceptfds, &newexceptfds, width);
+	copyfds (exceptfds, newexceptfds, width);
       /* XXX */
       OSCALLEXIT(OSCALL_select);
       return total;
@@ -159,12 +181,15 @@ select(int width, fd_set *readfds, fd_set *writefds, fd_set *exceptfds,
 	(timeout->tv_usec + RATE - 1)/RATE;
       if (!wait_ticks)
 	{
-	  if (readfds) FD_ZERO(readfds);
-	  if (writefds) FD_ZERO(writefds);
-	  if (exceptfds) FD_ZERO(exceptfds);
+	  if (readfds) bzero(readfds, FDSET_BYTES(width));
+	  if (writefds) bzero(writefds, FDSET_BYTES(width));
+	  if (exceptfds) bzero(exceptfds, FDSET_BYTES(width));
 	  OSCALLEXIT(OSCALL_select);
 	  return 0;
 	}
+      /* measured from the first pass, as we may go round many times */
+      if (!wait_until)
+	wait_until = wait_ticks + __sysinfo.si_system_ticks;
     }
 
     /* now construct a wakeup-predicate that will wake us when something
@@ -174,8 +199,14 @@ select(int width, fd_set *readfds, fd_set *writefds, fd_set *exceptfds,
 
     next = 0;
     had_prev_term = 0;
-    next = wk_mktag (next, t, DID_FDREADY);
-    for (fd = 0; fd < width; fd++) {
+    if (nfds > SELECT_PRED_FDS) {
+      /* too many to sleep on: look at them all again next tick */
+      next = wk_mktag (next, t, DID_POLL);
+      next += wk_mksleep_pred (&t[next], __sysinfo.si_system_ticks + 1);
+      had_prev_term = 1;
+    } else
+      next = wk_mktag (next, t, DID_FDREADY);
+    for (fd = 0; nfds <= SELECT_PRED_FDS && fd < width; fd++) {
       filp = __current->fd[fd];
       if (readfds && FD_ISSET (fd, readfds)) {
 	if (had_prev_term)
@@ -205,7 +236,7 @@ select(int width, fd_set *readfds, fd_set *writefds, fd_set *exceptfds,
       if (had_prev_term)
 	next = wk_mkop (next, t, WK_OR);
       next = wk_mktag (next, t, DID_TIMEOUT);
-      next += wk_mksleep_pred (&t[next], wait_ticks + __sysinfo.si_system_ticks);
+      next += wk_mksleep_pred (&t[next], wait_until);
       had_prev_term = 1;
     }
 
@@ -224,9 +255,9 @@ select(int width, fd_set *readfds, fd_set *writefds, fd_set *exceptfds,
        us to wake up */
 
     if (UAREA.u_pred_tag == DID_TIMEOUT) {
-      if (readfds) FD_ZERO(readfds);
-      if (writefds) FD_ZERO(writefds);
-      if (exceptfds) FD_ZERO(exceptfds);
+      if (readfds) bzero(readfds, FDSET_BYTES(width));
+      if (writefds) bzero(writefds, FDSET_BYTES(width));
+      if (exceptfds) bzero(exceptfds, FDSET_BYTES(width));
       OSCALLEXIT(OSCALL_select);
       return 0;
     }
@@ -367,7 +398,7 @@ old_select(int width, fd_set *readfds, fd_set *writefds, fd_set *exceptfds,
   FD_ZERO(&newexceptfds);
 
   t = TICKS;
-  width = MIN(width,NR_OPEN);
+  width = MIN(width,__current->nr_open);
   do {
     DPRINTF(SYS_LEVEL,("polling: %d ticks\n",wait_ticks));
     for (fd = 0; fd <= width; fd++) {
@@ -75,7 +75,7 @@ static int
 udp_pass_all_ref(u_int k, int envid, int ExecOnlyOrNewpid) {
   struct file *filp;
   int i;
-  for (i = 0; i < NR_OPEN; i++)
+  for (i = 0; i < __current->nr_open; i++)
     if (__current->fd[i]) {
       filp = __current->fd[i];
       if (filp->op_type == UDP_SOCKET_TYPE) 
@@ -134,8 +134,8 @@ udp_socket_init(void) {
     OnFork(udp_pass_all_ref);
     OnExec(udp_pass_all_ref);
 
-    /* wasteful situation when NR_SOCKETS > NR_OPEN  */
-    StaticAssert(NR_SOCKETS < NR_OPEN);
+    /* wasteful situation when NR_SOCKETS > NR_OPEN_GROW  */
+    StaticAssert(NR_SOCKETS < NR_OPEN_GROW);
 
     if (status) {
       /* printf("Initializing udp shared data structture\n"); */
@@ -43,6 +43,7 @@
 #include <exos/osdecl.h>		/* for ADD_UVA */
 #include <xok/env.h>
 #include <exos/uwk.h>
+#include <exos/netinet/cksum.h>
 
 #include "udp_socket.h"
 #include "errno.h"
@@ -63,11 +64,6 @@ fd_udp_read(struct file *filp, char *buffer, int length, int nonblocking) {
   DPRINTF(CLU_LEVEL,("fd_udp_read\n"));
   demand(filp, bogus filp);
   
-  if (length > 1472) {
-    kprintf("Warning trying to read upd packet larger than 1472: %d,\nreassembly not supported yet\n",length);
-    errno = EMSGSIZE;
-    return -1;
-  }
   sock = GETSOCKDATA(filp);
   
   if (sock->tosockaddr.sin_port == 0) {
@@ -77,176 +73,121 @@ fd_udp_read(struct file *filp, char *buffer, int length, int nonblocking) {
   return fd_udp_recvfrom(filp,buffer,length,nonblocking,0,0,0);
 }
 
+/* A datagram the kernel had to reassemble from IP fragments may not */
+/* fit in one ring entry, in which case it carries on in the entries  */
+/* after it (each entry's poll holding the bytes put there).  Returns */
+/* the number of entries the datagram starting at r takes up.         */
+static int
+udp_entries(ringbuf_p r) {
+    struct eiu *eiu = (struct eiu *)r->data;
+    int left = sizeof(struct eth) + ntohs(eiu->ip.totallength) - r->poll;
+    int n = 1;
+
+    while (left > 0) {
+	r = r->next;
+	left -= r->poll;
+	n++;
+    }
+    return n;
+}
+
+/* copy len bytes of the payload of the datagram starting at ring entry */
+/* r to buffer.  If sum is non-null, the bytes copied are added to it;  */
+/* entries are MTU sized, so every piece but the last has even length.  */
+static void
+udp_copy(ringbuf_p r, char *buffer, int len, uint *sum) {
+    char *src = (char *)&((struct eiu *)r->data)->data[0];
+    int n = r->poll - sizeof(struct eiu);
+
+    for (;;) {
+	n = MIN(n, len);
+	if (sum)
+	    *sum = inet_checksum_copy((uint16 *)src, (uint16 *)buffer, n,
+				      *sum, 0);
+	else
+	    memcpy(buffer, src, n);
+	buffer += n;
+	len -= n;
+	if (len <= 0)
+	    break;
+	r = r->next;
+	src = r->data;
+	n = r->poll;
+    }
+}
+
+/* copy the payload of the datagram at r to buffer and verify the UDP */
+/* checksum in the same pass.  returns 0 if the checksum is good.     */
+static int
+udp_copy_verify(ringbuf_p r, char *buffer, int len) {
+    struct eiu *eiu = (struct eiu *)r->data;
+    uint sum = 0;
+    uint16 proto = htons(IP_PROTO_UDP);
+
+    udp_copy(r, buffer, len, &sum);
+    /* pseudo header: addresses, protocol and udp length */
+    sum = inet_checksum(&eiu->ip.source[0], 8, sum, 0);
+    sum = inet_checksum(&proto, 2, sum, 0);
+    sum = inet_checksum(&eiu->udp.length, 2, sum, 0);
+    /* the header, whose checksum field brings the sum to 0xffff; the */
+    /* complement of that comes back as 0xffff too, not 0.            */
+    sum = inet_checksum((uint16 *)&eiu->udp, sizeof(struct udp), sum, 1);
+    return (sum != 0xffff);
+}
+
+/* give the n ring entries starting at r back to the kernel */
+static void
+udp_release(socket_data_p sock, ringbuf_p r, int n) {
+    while (n-- > 0) {
+	r->poll = 0;
+	r = r->next;
+    }
+    sock->recvfrom.r = r;
+}
+
 int
 fd_udp_recvfrom(struct file *filp, void *buffer, int length, int nonblocking,
 	     unsigned flags, struct sockaddr *reg_rfrom, int *rfromlen) {
     struct eiu *eiu;
-    ringbuf_p r, start;
+    ringbuf_p r;
     socket_data_p sock;
     struct sockaddr_in *rfrom;
-    int return_length;
-    int badfrag = 0;
-    ringbuf_p cur, start2;
-    int frags_i = 0, i, j, lowest, lowest_i, offset, begin_o, end_o, copied, sz;
-    char *src, *dst;
-    ringbuf_p frags[8]; //8192
+    int return_length, udplen;
 
     rfrom = (struct sockaddr_in *)reg_rfrom;
 
-//    kprintf("(R%d",__envid);
-
     DPRINTF(CLU_LEVEL,("fd_udp_recvfrom\n"));
     demand(filp, bogus filp);
 
     sock = GETSOCKDATA(filp);
-    /* remove this */
+again:
     r = sock->recvfrom.r;
-	
-    start = sock->recvfrom.r;
-
-    do {
-	eiu = (struct eiu *)r->data;
-	if (!eiu) {
-	    kprintf("recvfrom.data is corrupted, filp: %08x\n",
-		   (int)filp);
-	    assert(0);
-	}
-
-	if (r->poll == 0 && CHECKNB(filp)) {
-	    errno = EWOULDBLOCK;
-	    return -1;
-	}
-	wk_waitfor_value_neq ((unsigned int *)&r->poll, 0, UDP_CAP);
-
-	if((ntohs(eiu->ip.fragoffset) & IP_FRG_MF) != 0) {
-	    /* do frag stuff */
-
-	    struct eiu *eiu2;
-	    int id; /* get ipid, assume other identifying things are same for one socket */
-
-	    frags_i = 0;
-kprintf("got frag %08x\n", (int)eiu);
-
-	    eiu2 = (struct eiu *)r->data;
-	    if (!eiu2) {
-		kprintf("2recvfrom.data is corrupted, filp: %08x\n",
-			(int)filp);
-		assert(0);
-	    }
-	    id = eiu2->ip.identification;
-
-kprintf("finding parts for frag %d in ring %d length %d\n", id, sock->recvfrom.ring_id, length);
-	    /* find correct frags */
-	    start2 = cur = sock->recvfrom.r;
-	    do {
-eiu2 = (struct eiu *)cur->data;
-		if(cur->poll != 0) {
-kprintf("entry 0x%08x id %d poll %d offset %d length %d\n", (int)cur, id, cur->poll, (ntohs(eiu2->ip.fragoffset) & IP_FRAGOFF) * 8, ntohs(eiu2->ip.totallength));
-		    eiu2 = (struct eiu *)cur->data;
-		    if (!eiu2) {
-			kprintf("3recvfrom.data is corrupted, filp: %08x\n",
-				(int)filp);
-			assert(0);
-		    }
-		    if(eiu2->ip.identification == id) {
-//kprintf("add 0x%08x id %d offset %d length %d\n", (int)cur, id, (ntohs(eiu2->ip.fragoffset) & IP_FRAGOFF) * 8, ntohs(eiu2->ip.totallength));
-			frags[frags_i++] = cur;
-		    }
-		} //else
-//		    if(eiu2->ip.identification == id)
-//kprintf("match, but not there? 0x%08x id %d offset %d length %d\n", (int)cur, id, (ntohs(eiu2->ip.fragoffset) & IP_FRAGOFF) * 8, ntohs(eiu2->ip.totallength));
-		cur = cur->next;
-	    } while (cur != start2);
-
-	    /* sort frags */
-	    for(i = 0; i < frags_i; i++) {
-		lowest = 8192;
-		lowest_i = -1;
-		for(j = i; j < frags_i; j++) {
-		    eiu2 = (struct eiu *)frags[j]->data;
-		    offset = ntohs(eiu2->ip.fragoffset) & IP_FRAGOFF;
-		    if(offset < lowest) {
-			lowest = offset;
-			lowest_i = j;
-			cur = frags[j];
-		    }
-		}
-		if(lowest_i < 0) break; /* no more frags */
-		frags[lowest_i] = frags[i];
-		frags[i] = cur;
-	    }
-kprintf("eh? lowest=%d\n", 8*ntohs(((struct eiu *)frags[0]->data)->ip.fragoffset) & IP_FRAGOFF);
-	    /* look to see if we have all */
-	    for(i = 0; i < (frags_i-1); i++) {
-		eiu2 = (struct eiu *)frags[i]->data;
-		offset = (ntohs(eiu2->ip.fragoffset) & IP_FRAGOFF) * 8;
-		end_o = offset + ntohs(eiu2->ip.totallength) - sizeof(struct ip);
-		eiu2 = (struct eiu *)frags[i+1]->data;
-		begin_o = (ntohs(eiu2->ip.fragoffset) & IP_FRAGOFF) * 8;
-kprintf("end_o %d begin_o %d\n", end_o, begin_o);
-		if(end_o != begin_o) // || !(ntohs(eiu2->ip.fragoffset) & IP_FRG_MF))
-		    break;
-	    }
-
-	    eiu2 = (struct eiu *)frags[i]->data;
-	    offset = (ntohs(eiu2->ip.fragoffset) & IP_FRAGOFF) * 8;
-	    end_o = offset + ntohs(eiu2->ip.totallength) - sizeof(struct ip);
-	    eiu2 = (struct eiu *)frags[0]->data;
-//    return_length = MIN(length, ntohs(eiu2->udp.length) - sizeof(struct udp));
-	    if(end_o != ntohs(eiu2->udp.length)) { 
-		/* if not, move frags to end and bail
-		sock->recvfrom.r = sock->recvfrom.r->next;
-		r = sock->recvfrom.r;
-		badfrag = 1; */
-	for(i=0; i<frags_i; i++) {
-		frags[i]->poll = 0;
-		if(frags[i] == sock->recvfrom.r)
-			sock->recvfrom.r = sock->recvfrom.r->next;
-	}
-kprintf("missing. got %d of %d in %d . eiu = 0x%08x. udp source=0x%08x dest=0x%08x chksum 0x%08x\n", end_o, ntohs(eiu2->udp.length), frags_i, (int)eiu2, ntohs(eiu2->udp.src_port), ntohs(eiu2->udp.dst_port), ntohs(eiu2->udp.cksum));
-		r = sock->recvfrom.r;
-	if (r->poll == 0 && CHECKNB(filp)) {
-	    errno = EWOULDBLOCK;
-	    return -1;
-	}
-	wk_waitfor_value_neq ((unsigned int *)&r->poll, 0, UDP_CAP);
-		badfrag = 1;
-	    }
+    eiu = (struct eiu *)r->data;
+    if (!eiu) {
+	kprintf("recvfrom.data is corrupted, filp: %08x\n",
+		(int)filp);
+	assert(0);
+    }
 
-kprintf("memcpying badfrag=%d\n", badfrag);
-	    if(badfrag != 1) {
-		eiu2 = (struct eiu *)frags[0]->data;
-		/* copy frags into buffer, return */
-		copied = 0;
-		for(i = 0; i < frags_i && length - copied > 0; i++) {
-		  eiu2 = (struct eiu *)frags[i]->data;
-		  offset = (ntohs(eiu2->ip.fragoffset) & IP_FRAGOFF) * 8;
-		  src = &eiu2->data[0];
-		  dst = (char *)buffer+offset;
-		  sz = ntohs(eiu2->ip.totallength) - sizeof(struct ip) - sizeof(struct udp);
-		  if(i!=0) {
-			dst -= sizeof(struct udp);
-			src -= sizeof(struct udp);
-			sz += sizeof(struct udp);
-		  }
-		  if(sz > length - copied)
-			sz = length - copied;
-		  memcpy(dst, src, sz);
-		  copied += sz;
-kprintf("copied %d at offset %d to %08x\n", ntohs(eiu2->ip.totallength) - sizeof(struct ip), offset, (int)buffer);
-		}
-    return_length = MIN(length, ntohs(eiu->udp.length) - sizeof(struct udp));
-kprintf("length %d udp %d\n", length, ntohs(eiu->udp.length)-sizeof(struct udp));
-kprintf("totallength %d udplength %d\n", return_length, ntohs(eiu->udp.length));
-		sys_self_dpf_free_state(UDP_CAP, sock->demux_id, id);
-	    }
-	} else {
-	    /*  pull the message out */
-	    memcpy((char *)buffer, &eiu->data[0],
-		   MIN(length, ntohs(eiu->udp.length) - sizeof(struct udp)));
+    if (r->poll == 0 && CHECKNB(filp)) {
+	errno = EWOULDBLOCK;
+	return -1;
+    }
+    wk_waitfor_value_neq ((unsigned int *)&r->poll, 0, UDP_CAP);
+
+    udplen = ntohs(eiu->udp.length) - sizeof(struct udp);
+    return_length = MIN(length, udplen);
+    if (eiu->udp.cksum != 0 && !(flags & MSG_PEEK) && length >= udplen) {
+	/*  pull the whole message out, checking it on the way; a
+	 *  corrupted datagram is dropped and we go for the next one */
+	if (udp_copy_verify(r, (char *)buffer, udplen)) {
+	    udp_release(sock, r, udp_entries(r));
+	    goto again;
 	}
-    } while(badfrag && (r != start));
-    return_length = MIN(length, ntohs(eiu->udp.length) - sizeof(struct udp));
+    } else {
+	/*  pull the message out */
+	udp_copy(r, (char *)buffer, return_length, NULL);
+    }
 
     if (rfrom != (struct sockaddr_in *)0)
     {
@@ -257,16 +198,7 @@ kprintf("totallength %d udplength %d\n", return_length, ntohs(eiu->udp.length));
 	       sizeof eiu->ip.destination);
 	rfrom->sin_port = eiu->udp.src_port;
     }
-//    kprintf(")");
-    if (!(flags & MSG_PEEK)) { /* we don't add new structure */
-	r->poll = 0;
-	sock->recvfrom.r = r->next;
-	for(i=0; i<frags_i; i++) {
-		frags[i]->poll = 0;
-		if(frags[i] == sock->recvfrom.r)
-			sock->recvfrom.r = sock->recvfrom.r->next;
-	}
-    }
+    if (!(flags & MSG_PEEK)) /* we don't add new structure */
+	udp_release(sock, r, udp_entries(r));
     return return_length;
 }
-
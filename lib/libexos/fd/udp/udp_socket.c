@@ -83,10 +83,6 @@ bind_udp_port(unsigned short src_port, unsigned char *ip_src, unsigned short dst
 {
   struct dpf_ir filter1;
   int fid;
-#ifdef UDP_FRAG 
-  int fid2;
-  struct dpf_ir filter2, filter3;
-#endif
   DPRINTF(CLUHELP_LEVEL,("bind_udp_port, port %d (dec)\n",htons(src_port)));
 
   assert(ring_id != 0);
@@ -102,31 +98,8 @@ bind_udp_port(unsigned short src_port, unsigned char *ip_src, unsigned short dst
     fid = sys_self_dpf_insert(CAP_ROOT, UDP_CAP, &filter1, ring_id);
     fidset[0] = fid;
 
-#ifdef UDP_FRAG
-    dpf_begin(&filter2);  /* must be done before use */
-    dpf_eq16(&filter2, 12, 0x8);
-    dpf_eq8(&filter2, 14, 0x45);
-    dpf_meq8(&filter2, 20, 0x20, 0x20);
-    dpf_eq8(&filter2, 23, 0x11);
-    dpf_eq16(&filter2, 36, src_port);
-    dpf_actioneq16(&filter2, 38);
-
-    dpf_begin(&filter3);  /* must be done before use */
-    dpf_eq16(&filter3, 12, 0x8);
-    dpf_eq8(&filter3, 14, 0x45);
-    dpf_stateeq16(&filter3, 18, 0);
-    dpf_eq8(&filter3, 23, 0x11);
-
-   
-    fid2 = sys_self_dpf_insert(CAP_ROOT, UDP_CAP, &filter2, ring_id);
-    fidset[1] = fid2;
-   
-    fid2 = sys_self_dpf_insert(CAP_ROOT, UDP_CAP, &filter3, ring_id);
-    fidset[2] = fid2;
-#else
     fidset[1] = -1;
     fidset[2] = -1;
-#endif
     fidset[3] = -1;
   } 
   
@@ -143,30 +116,6 @@ bind_udp_port(unsigned short src_port, unsigned char *ip_src, unsigned short dst
     dpf_eq8(&filter1, 33, ip_src[3]);
     dpf_eq16(&filter1, 36, src_port);
 
-#ifdef UDP_FRAG
-    dpf_begin(&filter2);
-    dpf_eq16(&filter2, 12, 0x8);
-    dpf_eq8(&filter2, 14, 0x45);
-    dpf_meq16(&filter2, 20, 0x2000, 0x2000);
-    dpf_eq8(&filter2, 23, 0x11);
-    dpf_eq8(&filter2, 30, ip_src[0]);
-    dpf_eq8(&filter2, 31, ip_src[1]);
-    dpf_eq8(&filter2, 32, ip_src[2]);
-    dpf_eq8(&filter2, 33, ip_src[3]);
-    dpf_eq16(&filter2, 36, src_port);
-    dpf_actioneq16(&filter2, 38);
-
-    dpf_begin(&filter3);
-    dpf_eq16(&filter3, 12, 0x8);
-    dpf_eq8(&filter3, 14, 0x45);
-    dpf_stateeq16(&filter3, 20, 0);
-    dpf_eq8(&filter3, 23, 0x11);
-    dpf_eq8(&filter3, 30, ip_src[0]);
-    dpf_eq8(&filter3, 31, ip_src[1]);
-    dpf_eq8(&filter3, 32, ip_src[2]);
-    dpf_eq8(&filter3, 33, ip_src[3]);
-#endif
-
     if (ip_dst != 0L) /* also has addr of sender */
     {
       dpf_eq8(&filter1, 26, ip_dst[0]);
@@ -174,34 +123,13 @@ bind_udp_port(unsigned short src_port, unsigned char *ip_src, unsigned short dst
       dpf_eq8(&filter1, 28, ip_dst[2]);
       dpf_eq8(&filter1, 29, ip_dst[3]);
       dpf_eq16(&filter1, 34, dst_port);
-
-#ifdef UDP_FRAG
-      dpf_eq8(&filter2, 26, ip_dst[0]);
-      dpf_eq8(&filter2, 27, ip_dst[1]);
-      dpf_eq8(&filter2, 28, ip_dst[2]);
-      dpf_eq8(&filter2, 29, ip_dst[3]);
-      dpf_eq16(&filter2, 34, dst_port);
-      
-      dpf_eq8(&filter3, 26, ip_dst[0]);
-      dpf_eq8(&filter3, 27, ip_dst[1]);
-      dpf_eq8(&filter3, 28, ip_dst[2]);
-      dpf_eq8(&filter3, 29, ip_dst[3]);
-#endif
     }
 
     fid = sys_self_dpf_insert(CAP_ROOT, UDP_CAP, &filter1, ring_id);
     fidset[0] = fid; 
 
-#ifdef UDP_FRAG
-    fid2 = sys_self_dpf_insert(CAP_ROOT, UDP_CAP, &filter2, ring_id);
-    fidset[1] = fid2;
-    
-    fid2 = sys_self_dpf_insert(CAP_ROOT, UDP_CAP, &filter3, ring_id);
-    fidset[2] = fid2;
-#else
     fidset[1] = -1;
     fidset[2] = -1;
-#endif
     fidset[3] = -1;
   }
 
@@ -579,6 +507,10 @@ fd_udp_bind(struct file *filp, struct sockaddr *reg_name, int namelen)
       assert (0);
   }
   kprintf("got ring_id : %d (ring size: %d)\n",ring_id,nrudpbufs);
+  /* reassembled datagrams bigger than one buffer come in several
+     entries, which udp_recvfrom puts back together */
+  status = sys_pktring_setflags (UDP_CAP, ring_id, PKTRING_FL_CHAIN);
+  CHECK(status);
 
   src_port = fd_bind_getport(ntohs(name->sin_port),
 			     ip_src,&sock->demux_id, &sock->aux_fids[0], ring_id);
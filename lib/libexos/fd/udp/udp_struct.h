@@ -57,7 +57,7 @@
 #define DEFAULT_NRUDPBUFS 3
 
 #define NR_RINGBUFS 64
-/* should be less than NR_OPEN  */
+/* should be less than NR_OPEN_GROW  */
 #define NR_SOCKETS 32	/* # of sockets open at a time, total */
 
 
@@ -37,92 +37,294 @@
 
 
 #include <assert.h>
+#include <string.h>
 #include <exos/netinet/cksum.h>
 
+/*
+ * Internet checksum (RFC 1071) loops.  Partial sums are accumulated 32
+ * bits at a time, either in a 64-bit C accumulator or with an unrolled
+ * adcl chain, and are returned folded to 16 bits so that callers can
+ * keep adding them together.  The copy variants store the data to a
+ * second buffer in the same pass, so that data which has to be copied
+ * anyway is only read once.
+ *
+ * There are no MMX/SSE versions: xok does not save that state for us.
+ */
+
+typedef unsigned long long cksum_acc;
+
+static inline uint cksum_fold (cksum_acc acc)
+{
+   uint sum;
+
+   acc = (acc & 0xffffffff) + (acc >> 32);
+   acc = (acc & 0xffffffff) + (acc >> 32);
+   sum = (uint) acc;
+   sum = (sum & 0xffff) + (sum >> 16);
+   sum = (sum & 0xffff) + (sum >> 16);
+   return (sum);
+}
+
+
+static uint cksum_c64 (const char *p, int count, uint start)
+{
+   register cksum_acc acc = start;
+
+   while (count >= 32) {
+      acc += ((uint32 *)p)[0];
+      acc += ((uint32 *)p)[1];
+      acc += ((uint32 *)p)[2];
+      acc += ((uint32 *)p)[3];
+      acc += ((uint32 *)p)[4];
+      acc += ((uint32 *)p)[5];
+      acc += ((uint32 *)p)[6];
+      acc += ((uint32 *)p)[7];
+      p += 32;
+      count -= 32;
+   }
+   while (count >= 4) {
+      acc += *(uint32 *)p;
+      p += 4;
+      count -= 4;
+   }
+   if (count >= 2) {
+      acc += *(uint16 *)p;
+      p += 2;
+      count -= 2;
+   }
+   /*  Add left-over byte, if any */
+   if (count > 0) {
+      acc += *(uint8 *)p;
+   }
+   return (cksum_fold (acc));
+}
+
+
+static uint cksum_copy_c64 (const char *src, char *dst, int count, uint start)
+{
+   register cksum_acc acc = start;
+   uint32 w0, w1, w2, w3;
+
+   while (count >= 16) {
+      w0 = ((uint32 *)src)[0];
+      w1 = ((uint32 *)src)[1];
+      w2 = ((uint32 *)src)[2];
+      w3 = ((uint32 *)src)[3];
+      ((uint32 *)dst)[0] = w0;
+      ((uint32 *)dst)[1] = w1;
+      ((uint32 *)dst)[2] = w2;
+      ((uint32 *)dst)[3] = w3;
+      acc += w0;
+      acc += w1;
+      acc += w2;
+      acc += w3;
+      src += 16;
+      dst += 16;
+      count -= 16;
+   }
+   while (count >= 4) {
+      w0 = *(uint32 *)src;
+      *(uint32 *)dst = w0;
+      acc += w0;
+      src += 4;
+      dst += 4;
+      count -= 4;
+   }
+   if (count >= 2) {
+      w0 = *(uint16 *)src;
+      *(uint16 *)dst = w0;
+      acc += w0;
+      src += 2;
+      dst += 2;
+      count -= 2;
+   }
+   if (count > 0) {
+      *dst = *src;
+      acc += *(uint8 *)src;
+   }
+   return (cksum_fold (acc));
+}
+
+
+/* 32 bytes per iteration with the carry chained through adcl; leal and */
+/* decl leave the carry flag alone.  The tail is done in C.             */
+static uint cksum_adc (const char *p, int count, uint start)
+{
+   uint sum = start;
+   int n = count >> 5;
+
+   if (n > 0) {
+      asm ("clc\n"
+	   "1:\tadcl 0(%1),%0\n"
+	   "\tadcl 4(%1),%0\n"
+	   "\tadcl 8(%1),%0\n"
+	   "\tadcl 12(%1),%0\n"
+	   "\tadcl 16(%1),%0\n"
+	   "\tadcl 20(%1),%0\n"
+	   "\tadcl 24(%1),%0\n"
+	   "\tadcl 28(%1),%0\n"
+	   "\tleal 32(%1),%1\n"
+	   "\tdecl %2\n"
+	   "\tjnz 1b\n"
+	   "\tadcl $0,%0\n"
+	   : "=r" (sum), "=r" (p), "=r" (n)
+	   : "0" (sum), "1" (p), "2" (n)
+	   : "cc", "memory");
+   }
+   return (cksum_c64 (p, (count & 31), sum));
+}
+
+
+#define CKSUM_COPY_ADC(off)			\
+	"\tmovl " #off "(%1),%%eax\n"		\
+	"\tmovl %%eax," #off "(%2)\n"		\
+	"\tadcl %%eax,%0\n"
+
+static uint cksum_copy_adc (const char *src, char *dst, int count, uint start)
+{
+   uint sum = start;
+   int n = count >> 5;
+
+   if (n > 0) {
+      asm ("clc\n"
+	   "1:\n"
+	   CKSUM_COPY_ADC(0)
+	   CKSUM_COPY_ADC(4)
+	   CKSUM_COPY_ADC(8)
+	   CKSUM_COPY_ADC(12)
+	   CKSUM_COPY_ADC(16)
+	   CKSUM_COPY_ADC(20)
+	   CKSUM_COPY_ADC(24)
+	   CKSUM_COPY_ADC(28)
+	   "\tleal 32(%1),%1\n"
+	   "\tleal 32(%2),%2\n"
+	   "\tdecl %3\n"
+	   "\tjnz 1b\n"
+	   "\tadcl $0,%0\n"
+	   : "=r" (sum), "=r" (src), "=r" (dst), "=r" (n)
+	   : "0" (sum), "1" (src), "2" (dst), "3" (n)
+	   : "eax", "cc", "memory");
+   }
+   return (cksum_copy_c64 (src, dst, (count & 31), sum));
+}
+
+
+struct cksum_impl {
+   char *name;
+   uint (*sum)(const char *p, int count, uint start);
+   uint (*copy)(const char *src, char *dst, int count, uint start);
+};
+
+static struct cksum_impl cksum_impls[] = {
+   {"c64", cksum_c64, cksum_copy_c64},
+   {"adc", cksum_adc, cksum_copy_adc},
+   {NULL, NULL, NULL}
+};
+
+static struct cksum_impl *cksum = NULL;
+char *inet_cksum_impl = NULL;
+
+
+/* CPU family from cpuid, or 4 if the processor has no cpuid */
+static int cksum_cpufamily (void)
+{
+   uint f1, f2, eax;
+
+   asm ("pushfl\n"
+	"\tpopl %0\n"
+	"\tmovl %0,%1\n"
+	"\txorl $0x200000,%0\n"
+	"\tpushl %0\n"
+	"\tpopfl\n"
+	"\tpushfl\n"
+	"\tpopl %0\n"
+	"\tpushl %1\n"
+	"\tpopfl\n"
+	: "=&r" (f1), "=&r" (f2) : : "cc");
+   if (((f1 ^ f2) & 0x200000) == 0) {
+      return (4);
+   }
+   /* %ebx is saved by hand, since it may be the PIC register */
+   asm ("pushl %%ebx\n"
+	"\tcpuid\n"
+	"\tpopl %%ebx\n"
+	: "=a" (eax) : "0" (1) : "ecx", "edx");
+   return ((eax >> 8) & 0xf);
+}
+
+
+int inet_cksum_select (char *name)
+{
+   struct cksum_impl *ci;
+
+   if (name == NULL) {
+      /* the adcl chain pipelines well from the Pentium on */
+      name = (cksum_cpufamily () >= 5) ? "adc" : "c64";
+   }
+   for (ci = cksum_impls; ci->name; ci++) {
+      if (strcmp (ci->name, name) == 0) {
+	 cksum = ci;
+	 inet_cksum_impl = ci->name;
+	 return (0);
+      }
+   }
+   return (-1);
+}
+
+
+static inline struct cksum_impl *cksum_get (void)
+{
+   if (cksum == NULL) {
+      inet_cksum_select (NULL);
+   }
+   return (cksum);
+}
+
+
 /* 
  * Compute Internet Checksum for "count" bytes beginning at location "addr".
- * Taken from RFC 1071.
- * 
- * Leave these rolled, the unrolled versions are later.
- *
+ * The sum is returned unfolded by inet_sum and complemented by inet_cksum.
  */
 
 long
 inet_sum(uint16 *addr, uint16 count, long start) {
-    register long sum = start;
-
-    /*  This is the inner loop */
-    while( count > 1 )  {
-	sum += * (unsigned short *) addr++;
-	count -= 2;
-    }
-    
-    /*  Add left-over byte, if any */
-    if(count > 0)
-	sum += * (unsigned char *) addr;
-
-    return sum;
+    return (cksum_get ()->sum ((char *) addr, count, start));
 }
 
 
 uint16 
 inet_cksum(uint16 *addr, uint16 count, long start) {
-    register long sum = start;
-
-    /*  This is the inner loop */
-    while( count > 1 )  {
-	sum += * (unsigned short *) addr++;
-	count -= 2;
-    }
-    
-    /*  Add left-over byte, if any */
-    if(count > 0)
-	sum += * (unsigned char *) addr;
-    /*  Fold 32-bit sum to 16 bits */
-    while (sum>>16)
-	sum = (sum & 0xffff) + (sum >> 16);
-    return ~sum;
+    return (~cksum_get ()->sum ((char *) addr, count, start));
 }
 
 /************************************************************************/
 
 uint inet_checksum(unsigned short *addr, int count, uint start, int last)
 {
-    register long sum = start;
-    /* An unrolled loop */
-    while ( count > 15 ) {
-       sum += * (unsigned short *) &addr[0];
-       sum += * (unsigned short *) &addr[1];
-       sum += * (unsigned short *) &addr[2];
-       sum += * (unsigned short *) &addr[3];
-       sum += * (unsigned short *) &addr[4];
-       sum += * (unsigned short *) &addr[5];
-       sum += * (unsigned short *) &addr[6];
-       sum += * (unsigned short *) &addr[7];
-       addr += 8;
-       count -= 16;
-    }
-    /*  This is the inner loop */
-    while( count > 1 )  {
-        sum += * (unsigned short *) addr++;
-        count -= 2;
-    }
-    /*  Add left-over byte, if any */
-    if(count > 0)
-        sum += * (unsigned char *) addr;
+    uint sum = cksum_get ()->sum ((char *) addr, count, start);
+
     if (last) {
-       /*  Fold 32-bit sum to 16 bits */
-       while (sum>>16) {
-          sum = (sum & 0xffff) + (sum >> 16);
+       sum = ~sum & 0xffff;
+       if (sum == 0) {
+          sum = 0xffff;
        }
+    }
+    return sum;
+}
+
+
+/* inet_checksum of src, which is also copied to dst */
+uint inet_checksum_copy(unsigned short *src, unsigned short *dst, int count, uint start, int last)
+{
+    uint sum = cksum_get ()->copy ((char *) src, (char *) dst, count, start);
+
+    if (last) {
        sum = ~sum & 0xffff;
        if (sum == 0) {
           sum = 0xffff;
        }
-       return (sum);
     }
     return sum;
 }
 
 /************************************************************************/
-
@@ -50,18 +50,28 @@
 
 int _exos_brk_heap_zero = -1;
 
+/* Heap pages below the break are faulted in up to BRK_FAULT_PAGES at a */
+/* time, with a single insert_pte_range call, since malloc hands out    */
+/* heap memory in ascending order and will touch the next pages soon.   */
+#define BRK_FAULT_PAGES 8
+
 static int
 brk_handler(struct mregion_ustruct *mru, void *faddr, unsigned int errcode)
 {
   u_int page = PGROUNDDOWN((u_int)faddr);
+  u_int end = PGROUNDUP(__brkpt);
+  u_int n;
+
   /* if page not present then make one present! */
   if (!(errcode & FEC_PR)) {
-    if (__vm_alloc_region(page, 1, 0, PG_U|PG_W|PG_P) < 0)
+    for (n = 1; n < BRK_FAULT_PAGES && page + n*NBPG < end &&
+	   !isvamapped(page + n*NBPG); n++);
+    if (__vm_alloc_region(page, n*NBPG, 0, PG_U|PG_W|PG_P) < 0)
       return 0;
     if (_exos_brk_heap_zero == -1)
       _exos_brk_heap_zero = getenv("HEAP_ZERO") ? 1 : 0;
     if (_exos_brk_heap_zero)
-      bzero ((char *)page, NBPG);
+      bzero ((char *)page, n*NBPG);
     return 1;
   }
   return 0;
@@ -61,17 +61,18 @@
 static u_int find_ipcprint() {
 #if defined(PROCESS_TABLE) || defined(PROCD)
   int i;
+  u_int envid;
   static struct Uenv cu;
   /* look for ipc printer */
   for (i = 0; i < PID_MAX; i++) {
-    if (pid2envid(i) == 0) {
+    if ((envid = pid2envid(i)) == 0) {
       continue;
     }
-    if (sys_rdu(CAP_ROOT, pid2envid(i), &cu) < 0) {
+    if (sys_rdu(CAP_ROOT, envid, &cu) < 0) {
       continue;
     }
     if (!strstr(cu.name, "ipcprint")) continue;
-    return pid2envid(i);
+    return envid;
   }
 #endif
 
@@ -109,7 +109,7 @@ static int mmap_init()
 static inline void close_filp(struct file *filp) {
   int fd;
 
-  for (fd = NR_OPEN - 1; fd >= 0; fd--)
+  for (fd = __current->nr_open - 1; fd >= 0; fd--)
     if (__current->fd[fd] == NULL) {
       __current->fd[fd] = filp;
       break;
@@ -330,7 +330,7 @@ static int mmap_fault_handler(struct mregion_ustruct *mru, void *faddr,
 
     /* find a free file descriptor to use with the file pointer during
        the fault */
-    for (fd = NR_OPEN - 1; fd >= 0; fd--)
+    for (fd = __current->nr_open - 1; fd >= 0; fd--)
       if (__current->fd[fd] == NULL) {
 	__current->fd[fd] = m->mmap_filp;
 	break;
@@ -507,7 +507,7 @@ void *mmap (void *addr, size_t len, int prot, int flags, int fd,
   }
 
   if ((flags & MAP_ANON) == 0) {
-    if (fd < 0 || fd > NR_OPEN || __current->fd[fd] == NULL) {
+    if (fd < 0 || fd >= __current->nr_open || __current->fd[fd] == NULL) {
       errno = EBADF;
       OSCALLEXIT(OSCALL_mmap);
       return (caddr_t)-1;
@@ -665,7 +665,7 @@ static void msync_set_modtimes(struct file *filp) {
   int fd;
 
   /* XXX */ return;
-  for (fd = NR_OPEN - 1; fd >= 0; fd--) {
+  for (fd = __current->nr_open - 1; fd >= 0; fd--) {
     if (__current->fd[fd] == NULL) {
       __current->fd[fd] = filp;
       assert(futimes(fd, NULL) == 0);
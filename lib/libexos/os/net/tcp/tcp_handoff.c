@@ -125,7 +125,7 @@ search_n_handoff(int parent) {
 
 
   printf("start search_n_handoff: %d\n",parent);
-  for(fd = 0; fd < NR_OPEN ; fd++) {
+  for(fd = 0; fd < __current->nr_open ; fd++) {
     if (__current->fd[fd] != NULL) {
       filp = __current->fd[fd];
       if (filp->op_type == TCP_SOCKET_TYPE) {
@@ -583,7 +583,9 @@ proc_table_ipc_setstat(int code, int signed_envid, int stat, int xstat,
 	  }
 	  sp->s_ttyvp = NULL;
 	}
+	proc_wbegin(p);
 	sp->s_leader = NULL;
+	proc_wend(p);
       }
 
       fixjobc(p, p->p_pgrp, 0);
@@ -834,7 +836,9 @@ proc_reparent(proc_p child, proc_p parent) {
   
   LIST_REMOVE(child, p_sibling);
   LIST_INSERT_HEAD(&parent->p_children, child, p_sibling);
+  proc_wbegin(child);
   child->p_pptr = parent;
+  proc_wend(child);
 }
 
 pid_t 
@@ -908,8 +912,10 @@ proc_table_ipc_fork(int code, int signed_envid_parent, int signed_envid_child,
 	  envidc,caller,p2->p_pid);
 
   /* XXX the pid of p2 is set by proc_alloc */
+  proc_wbegin(p2);
   p2->p_pgrp = p1->p_pgrp;
   p2->p_pptr = p1;
+  proc_wend(p2);
 
 
   /* insert new process as child of old process */
@@ -920,7 +926,7 @@ proc_table_ipc_fork(int code, int signed_envid_parent, int signed_envid_child,
   p2->p_xstat = 0;
   p2->nxchildren = 0;
   p2->p_stat = SRUN;
-  p2->envid = envidc;
+  proc_setenvid(p2, envidc);
   ret = p2->p_pid;
 		    done:
   EXOS_UNLOCK(PROCD_LOCK);
@@ -988,7 +994,7 @@ proc_table_ipc_exec(int code, int signed_envid_parent, int signed_envid_child,
   if (p == NULL) {
     ret = -ESRCH; 
   } else {
-    p->envid = envidc;
+    proc_setenvid(p, envidc);
     p->p_flag |= P_EXEC;
     if (p->p_flag & P_PPWAIT) {
       p->p_flag &= ~P_PPWAIT;
@@ -1004,34 +1010,14 @@ proc_table_ipc_exec(int code, int signed_envid_parent, int signed_envid_child,
 #ifdef PROCD
 u_int 
 pid2envid(pid_t pid) {
-  proc_p p;
-  u_int envid;
-  dlockputs(__PROCD_LD,"pid2envid get lock ");
-  EXOS_LOCK(PROCD_LOCK);
-  dlockputs(__PROCD_LD,"... got lock\n");
-  EnterCritical();
-  p = __pd_pfind(pid);
-  envid = (p) ? p->envid : 0;
-  EXOS_UNLOCK(PROCD_LOCK);
-  dlockputs(__PROCD_LD,"pid2envid release lock\n");
-  ExitCritical();
-  return envid;
+  struct proc_info pi;
+  return (proc_lookup(0, pid, &pi) == 0) ? pi.pi_envid : 0;
 }
 
 pid_t
 envid2pid(u_int envid) {
-  proc_p p;
-  pid_t pid;
-  dlockputs(__PROCD_LD,"envid2pid get lock ");
-  EXOS_LOCK(PROCD_LOCK);
-  dlockputs(__PROCD_LD,"... got lock\n");
-  EnterCritical();
-  p = efind(envid);
-  pid = (p) ? p->p_pid : 0;
-  EXOS_UNLOCK(PROCD_LOCK);
-  dlockputs(__PROCD_LD,"envid2pid release lock\n");
-  ExitCritical();
-  return pid;
+  struct proc_info pi;
+  return (proc_lookup(envid, 0, &pi) == 0) ? pi.pi_pid : 0;
 }
 #endif
 
@@ -100,6 +100,12 @@
    - getppid()
    - getlogin()
    - iterate_pgrp_pids
+
+   Only procd writes the table, so the lookups above do not take
+   PROCD_LOCK.  Instead procd makes an entry's p_seq odd while it
+   changes the entry and even again afterwards, and readers retry if
+   the sequence number moved under them (see proc_lookup).  pids index
+   procs[] directly; envids are found through the envhash chains.
    */
 typedef struct proc    proc_t, *proc_p;
 typedef struct pgrp    pgrp_t,*pgrp_p;
@@ -133,6 +139,8 @@ struct proc {
   int	      p_flag;		/* P_* flags. */
   u_int       nxchildren;	/* # of changes of xstat of children */
   u_int       envid;		/* envid, when it is 0 means entry is free */
+  pid_t       p_envnext;	/* next pid on this envid hash chain */
+  volatile u_int p_seq;		/* odd while procd is changing this entry */
 };
 
 struct pgrp {
@@ -174,8 +182,14 @@ extern proc_p curproc;
 #define PID_MAX MAXPROC
 #define NO_PID (PID_MAX + 1)
 
+/* envid -> pid hash; pid 0 is never allocated so it ends a chain */
+#define PROC_ENVHASH 256
+#define proc_envhash(envid) ((envid) & (PROC_ENVHASH - 1))
+
 typedef struct proc_table {
   unsigned int procd_envid;
+  volatile u_int envhash_seq;	/* odd while procd is changing envhash */
+  pid_t envhash[PROC_ENVHASH];
   bitstr_t bit_decl(sessions_used,MAXSESSION);
   bitstr_t bit_decl(pgrps_used,MAXPGRP);
   bitstr_t bit_decl(procs_used,MAXPROC);
@@ -187,6 +201,27 @@ typedef struct proc_table {
 extern proc_table_p proc_table;
 int proc_table_init(void);
 
+/* procd brackets every change to an entry lock-free readers look at */
+static inline void proc_wbegin(proc_p p) {
+  p->p_seq++;
+  asm volatile ("" : : : "memory");
+}
+static inline void proc_wend(proc_p p) {
+  asm volatile ("" : : : "memory");
+  p->p_seq++;
+}
+void proc_setenvid(proc_p p, u_int envid);
+
+/* what proc_lookup copies out of an entry */
+struct proc_info {
+  pid_t pi_pid;
+  pid_t pi_ppid;
+  pid_t pi_pgid;
+  pid_t pi_sid;			/* -1 if the session has no leader */
+  u_int pi_envid;
+};
+int proc_lookup(u_int envid, pid_t pid, struct proc_info *pi);
+
 
 void protect_proc_table(void);
 void unprotect_proc_table(void);
@@ -12,6 +12,7 @@
 #include <sys/tty.h>
 
 #include <exos/cap.h>
+#include <exos/process.h>	/* for yield */
 #include <errno.h>
 
 
@@ -25,13 +26,65 @@
 proc_p 
 efind(unsigned int envid) {
   proc_p p;
-  int iter = init_iter_proc_p();
-  while( (p = iter_proc_p (&iter)) ) {
+  pid_t pid = proc_table->envhash[proc_envhash(envid)];
+  int n;
+  /* bounded, since a lock-free reader can see a chain procd is relinking */
+  for (n = 0; pid && n < MAXPROC; n++) {
+    p = &proc_table->procs[pid];
     if (p->envid == envid) return p;
+    pid = p->p_envnext;
   }
   return (proc_p) 0;
 }
 
+/*
+ * Copy out the entry for envid (or for pid, if envid is 0) without
+ * taking PROCD_LOCK: returns 0, or -1 if there is no such process.
+ * If procd changed the entry or the envid hash while we were looking,
+ * look again.
+ */
+int
+proc_lookup(u_int envid, pid_t pid, struct proc_info *pi) {
+  proc_p p, pp, l;
+  pgrp_p pg;
+  session_p s;
+  u_int seq, hseq;
+
+  for (;; yield(-1)) {
+    hseq = proc_table->envhash_seq;
+    asm volatile ("" : : : "memory");
+    p = envid ? efind(envid) : __pd_pfind(pid);
+    if (p == NULL) {
+      asm volatile ("" : : : "memory");
+      if (hseq & 1 || hseq != proc_table->envhash_seq) continue;
+      return -1;
+    }
+    seq = p->p_seq;
+    if (seq & 1) continue;
+    asm volatile ("" : : : "memory");
+
+    pi->pi_pid = p->p_pid;
+    pi->pi_envid = p->envid;
+    pp = p->p_pptr;
+    pi->pi_ppid = pp ? pp->p_pid : 0;
+    pg = p->p_pgrp;
+    pi->pi_pgid = pg ? pg->pg_id : 0;
+    s = pg ? pg->pg_session : NULL;
+    l = s ? s->s_leader : NULL;
+    pi->pi_sid = l ? l->p_pid : -1;
+
+    asm volatile ("" : : : "memory");
+    if (seq != p->p_seq) continue;
+    /* the entry may have been freed or rebound before we got to it */
+    if (!bit_test(proc_table->procs_used, pi->pi_pid) ||
+	(envid ? pi->pi_envid != envid : pi->pi_pid != pid)) {
+      if (hseq != proc_table->envhash_seq) continue;
+      return -1;
+    }
+    return 0;
+  }
+}
+
 
 /* ITERATORS */
 /* iterate over all processes on the system */
@@ -121,12 +174,10 @@ inferior(proc_p p1, proc_p p2) {
  */
 proc_p 
 __pd_pfind(pid_t pid) {
-  proc_p p;
-  int iter = init_iter_proc_p();
-  while( (p = iter_proc_p (&iter)) ) {
-    if (p->p_pid == pid) return p;
-  }
-  return (proc_p)0;
+  /* a pid is its slot in procs[] (see proc_alloc) */
+  if (pid <= 0 || pid >= MAXPROC || !bit_test(proc_table->procs_used,pid))
+    return (proc_p)0;
+  return &proc_table->procs[pid];
 }
 
 
@@ -212,7 +263,9 @@ enterpgrp(proc_p p, pid_t pgid, int mksess) {
   LIST_REMOVE(p, p_pglist);
   if (p->p_pgrp->pg_members.lh_first == 0)
     pgdelete(p->p_pgrp);
+  proc_wbegin(p);
   p->p_pgrp = pgrp;
+  proc_wend(p);
   LIST_INSERT_HEAD(&pgrp->pg_members, p, p_pglist);
   return (0);
 }
@@ -225,7 +278,9 @@ leavepgrp(proc_p p) {
   LIST_REMOVE(p, p_pglist);
   if (p->p_pgrp->pg_members.lh_first == 0)
     pgdelete(p->p_pgrp);
+  proc_wbegin(p);
   p->p_pgrp = 0;
+  proc_wend(p);
   return (0);
 }
 
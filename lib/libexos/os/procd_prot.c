@@ -15,75 +15,52 @@
 #define dprintf(fmt, args...) if (0) kprintf(fmt, ## args)
 
 #ifdef PROCD
+/* The lookups below read procd's table directly, see proc_lookup. */
 pid_t 
 getpid(void) {
-  proc_p p;
+  struct proc_info pi;
   pid_t pid;
   OSCALLENTER(OSCALL_getpid);
   
-  dlockputs(__PROCD_LD,"getpid get lock ");
-  EXOS_LOCK(PROCD_LOCK);
-  dlockputs(__PROCD_LD,"... got lock\n");
-  EnterCritical();
-  p = efind(__envid);
-  if (p) {
-    pid =  p->p_pid;
+  if (proc_lookup(__envid, 0, &pi) == 0) {
+    pid =  pi.pi_pid;
   } else {
     fprintf(stderr,"Warning: getpid process (%d) not registered with procd\n",__envid);
     pid = PID_MAX;
   }
-  EXOS_UNLOCK(PROCD_LOCK);
-  dlockputs(__PROCD_LD,"getpid release lock\n");
-  ExitCritical();
   OSCALLEXIT(OSCALL_getpid);
   return pid;
 }
 
 pid_t 
 getppid(void) {
-  proc_p p;
+  struct proc_info pi;
   pid_t ppid;
   OSCALLENTER(OSCALL_getppid);
-  dlockputs(__PROCD_LD,"getppid get lock ");
-  EXOS_LOCK(PROCD_LOCK);
-  dlockputs(__PROCD_LD,"... got lock\n");
-  EnterCritical();
-  p = efind(__envid);
-  if (p) {
-    ppid =  p->p_pptr->p_pid;
+  if (proc_lookup(__envid, 0, &pi) == 0) {
+    ppid =  pi.pi_ppid;
   } else {
     fprintf(stderr,"Warning: getppid process (%d) not registered with procd\n",__envid);
     ppid = PID_MAX;
   }
-  EXOS_UNLOCK(PROCD_LOCK);
-  dlockputs(__PROCD_LD,"getppid release lock\n");
-  ExitCritical();
   OSCALLEXIT(OSCALL_getppid);
   return ppid;
 }
 /* Get process group ID; note that POSIX getpgrp takes no parameter */
 pid_t 
 getpgrp(void) {
-  proc_p p;
+  struct proc_info pi;
   pid_t pgrp;
 
   dprintf("%d getpgrp()\n",getpid());
   OSCALLENTER(OSCALL_getpgrp);
-  dlockputs(__PROCD_LD,"getpgrp get lock ");
-  EXOS_LOCK(PROCD_LOCK);
-  dlockputs(__PROCD_LD,"... got lock\n");
-  EnterCritical();
-  p = efind(__envid);
-  if (p) {
-    pgrp =  p->p_pgrp->pg_id;
+  if (proc_lookup(__envid, 0, &pi) == 0) {
+    pgrp =  pi.pi_pgid;
   } else {
     fprintf(stderr,"Warning: getpgrp process (%d) not registered with procd\n",__envid);
     assert(0);
     pgrp = PID_MAX;
   }
-  EXOS_UNLOCK(PROCD_LOCK);
-  dlockputs(__PROCD_LD,"getpgrp release lock\n");
-  ExitCritical();
   OSCALLEXIT(OSCALL_getpgrp);
   return pgrp;
 }
@@ -94,28 +71,16 @@ getpgrp(void) {
 /* no OSCALL number */
 pid_t
 getpgid(pid_t pid) {
-  proc_p p;
+  struct proc_info pi;
   dprintf("%d getpgid(%d)\n",getpid(),pid);
-  dlockputs(__PROCD_LD,"getpgid get lock ");
-  EXOS_LOCK(PROCD_LOCK);
-  dlockputs(__PROCD_LD,"... got lock\n");
-  EnterCritical();
-  if (pid == 0) 
-    p = efind(__envid);
-  else 
-    p = __pd_pfind(pid);
-
-  if (p) {
-    pid = p->p_pgid;
+  if (proc_lookup((pid == 0) ? __envid : 0, pid, &pi) == 0) {
+    pid = pi.pi_pgid;
   } else {
     if (pid == 0)		/* only for the case of our pid */
       fprintf(stderr,"Warning: getpgid process not registered with procd\n");
     errno = ESRCH;
     pid = 0;
   }
-  EXOS_UNLOCK(PROCD_LOCK);
-  dlockputs(__PROCD_LD,"getpgid release lock\n");
-  ExitCritical();
   return pid;
 }
 
@@ -125,29 +90,17 @@ getpgid(pid_t pid) {
 /* no OSCALL number */
 pid_t
 getsid(pid_t pid) {
-  proc_p p;
+  struct proc_info pi;
   dprintf("%d getsid(%d)\n",getpid(),pid);
-  dlockputs(__PROCD_LD,"getsid get lock ");
-  EXOS_LOCK(PROCD_LOCK);
-  dlockputs(__PROCD_LD,"... got lock\n");
-  EnterCritical();
-  if (pid == 0) {
-    p = efind(__envid);
-  } else {
-    p = __pd_pfind(pid);
-  }
-
-  if (p) {
-    pid =  p->p_session->s_leader->p_pid;
+  if (proc_lookup((pid == 0) ? __envid : 0, pid, &pi) == 0 &&
+      pi.pi_sid != -1) {
+    pid =  pi.pi_sid;
   } else {
     if (pid == 0)
       fprintf(stderr,"Warning: getsid, process not registered with procd\n");
     errno = ESRCH;
     pid = -1;
   }
-  EXOS_UNLOCK(PROCD_LOCK);
-  dlockputs(__PROCD_LD,"getsid release lock\n");
-  ExitCritical();
   return pid;
 
 }
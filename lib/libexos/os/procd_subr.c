@@ -69,7 +69,7 @@ proc_table_init(void) {
     p->p_stat = SRUN;
     p->p_xstat = 0;
     p->nxchildren = 0;
-    p->envid = __envid;
+    proc_setenvid(p, __envid);
     
     
     fprintf(stderr,"done initializing first process\n");
@@ -128,6 +128,8 @@ initialize_proc_table(void) {
   bit_nclear(proc_table->procs_used,0,MAXPROC - 1);
   bit_nclear(proc_table->sessions_used,0,MAXSESSION - 1);
   bit_nclear(proc_table->pgrps_used,0,MAXPGRP - 1);
+  proc_table->envhash_seq = 0;
+  bzero(proc_table->envhash,sizeof(proc_table->envhash));
   /* register ipc handlers */
   ipc_register(IPC_PROC_SETSID,proc_table_ipc_setsid);
   ipc_register(IPC_PROC_SETPGID,proc_table_ipc_setpgid);
@@ -150,6 +152,40 @@ get_procd_envid(void) {
 void
 set_procd_envid(unsigned int envid) {proc_table->procd_envid = envid;}
 
+/* ENVID HASH */
+static void
+envhash_remove(proc_p p) {
+  pid_t *pidp = &proc_table->envhash[proc_envhash(p->envid)];
+  while (*pidp) {
+    if (*pidp == p->p_pid) {
+      *pidp = p->p_envnext;
+      return;
+    }
+    pidp = &proc_table->procs[*pidp].p_envnext;
+  }
+}
+
+/* rebind p to envid (0 unbinds it) and keep envhash in step */
+void
+proc_setenvid(proc_p p, u_int envid) {
+  pid_t *head;
+
+  proc_table->envhash_seq++;
+  asm volatile ("" : : : "memory");
+  proc_wbegin(p);
+  if (p->envid)
+    envhash_remove(p);
+  p->envid = envid;
+  if (envid) {
+    head = &proc_table->envhash[proc_envhash(envid)];
+    p->p_envnext = *head;
+    *head = p->p_pid;
+  }
+  proc_wend(p);
+  asm volatile ("" : : : "memory");
+  proc_table->envhash_seq++;
+}
+
 /* 
  * Allocators and deallocators 
  */
@@ -161,6 +197,7 @@ proc_alloc(void) {
   /* never allocate 0 */
   static unsigned int lastpid = 1;
   proc_p p;
+  u_int seq;
   for(offset = lastpid; offset < MAXPROC; offset++) 
     if (!bit_test(proc_table->procs_used,offset)) goto ready;
   for(offset = 1; offset < lastpid; offset++) 
@@ -172,10 +209,15 @@ ready:
   lastpid = offset + 1;
   if (lastpid >= MAXPROC) lastpid = 1;
 
-  bit_set(proc_table->procs_used,offset);
   p = &proc_table->procs[offset];
+  /* keep the sequence number going so readers of the old entry notice */
+  proc_wbegin(p);
+  seq = p->p_seq;
   bzero(p,sizeof(proc_t));
+  p->p_seq = seq;
   p->p_pid = offset;
+  bit_set(proc_table->procs_used,offset);
+  proc_wend(p);
   return p;
 }
 void 
@@ -183,7 +225,10 @@ proc_dealloc(proc_p p) {
   int offset = (((u_int)p - (u_int)proc_table->procs) / sizeof (proc_t));
   if (!bit_test(proc_table->procs_used,offset))
     kprintf("Warning proc_dealloc on a unused entry %p\n",p);
- bit_clear(proc_table->procs_used,offset);
+  proc_setenvid(p, 0);
+  proc_wbegin(p);
+  bit_clear(proc_table->procs_used,offset);
+  proc_wend(p);
 }
 pgrp_p
 pgrp_alloc(void) {
@@ -390,6 +390,24 @@ setup_new_stack_simple(char *const argv[], char *const env[],
 }
 
 
+/* mmap flags for the text and data of a program loaded into another
+   environment.  Rather than copying the binary at exec time, text is
+   mapped straight from the buffer cache and shared read-only by every
+   process running it, and data is mapped copy-on-write from the same
+   pages, so a data page is only copied when the program first writes
+   it.  NO_DEMAND_LOAD restores the copying behaviour, as it does for
+   dynamic programs in __load_prog_fd. */
+static void
+__load_flags (u_int *tflags, u_int *dflags)
+{
+  if (getenv("NO_DEMAND_LOAD"))
+    *tflags = *dflags = MAP_FILE | MAP_FIXED | MAP_COPY;
+  else {
+    *tflags = MAP_FILE | MAP_FIXED | MAP_SHARED;
+    *dflags = MAP_FILE | MAP_FIXED | MAP_PRIVATE;
+  }
+}
+
 /* load an EXOS_MAGIC binary */
 int
 __do_simple_load (int fd, struct Env *e)
@@ -400,6 +418,7 @@ __do_simple_load (int fd, struct Env *e)
   struct exec hdr;
   u_int text_size, data_size, bss_size, overlap_size;
   u_int envid = e->env_id;
+  u_int tflags, dflags;
 
 
   /* read a.out headers */
@@ -455,8 +474,9 @@ __do_simple_load (int fd, struct Env *e)
 
 
   /* mmap the text segment readonly */
+  __load_flags(&tflags, &dflags);
   if ((u_int)__mmap((void*)start_text_pg, text_size, PROT_READ  | PROT_EXEC, 
-		    MAP_FILE | MAP_FIXED | MAP_COPY, fd, (off_t)0, 0, envid)
+		    tflags, fd, (off_t)0, 0, envid)
 	!= start_text_pg) 
   {
     errornf("Error mmaping text segment\n");
@@ -464,8 +484,7 @@ __do_simple_load (int fd, struct Env *e)
 
   /* mmap the data segment read/write */
   if ((u_int)__mmap((void*)(start_text_pg + text_size), data_size,
-		    PROT_READ | PROT_WRITE | PROT_EXEC,
-		    MAP_FILE | MAP_FIXED | MAP_COPY,
+		    PROT_READ | PROT_WRITE | PROT_EXEC, dflags,
 		    fd, text_size, (off_t)0, envid)
 	!= start_text_pg + text_size) 
   {
@@ -1444,6 +1463,7 @@ __load_prog_fd(int fd, int _static, u_int envid)
   struct exec hdr;
   u_int text_size, data_size, bss_size, overlap_size;
   u_int dynamic, start_text_pg;
+  u_int tflags, dflags;
 
   /* read a.out headers */
   if (lseek(fd, 0, SEEK_SET) == -1 ||
@@ -1496,9 +1516,9 @@ __load_prog_fd(int fd, int _static, u_int envid)
 	data_size = PGROUNDDOWN(data_size);
       }
     /* mmap the text segment readonly */
+    __load_flags(&tflags, &dflags);
     if ((u_int)__mmap((void*)start_text_pg, text_size,
-		      PROT_READ  | PROT_EXEC, 
-		      MAP_FILE | MAP_FIXED | MAP_COPY, fd, (off_t)0, 0,
+		      PROT_READ  | PROT_EXEC, tflags, fd, (off_t)0, 0,
 		      envid)
 	!= start_text_pg) {
       fprintf(stderr,"Error mmaping text segment\n");
@@ -1506,8 +1526,7 @@ __load_prog_fd(int fd, int _static, u_int envid)
     }
     /* mmap the data segment read/write */
     if ((u_int)__mmap((void*)(start_text_pg + text_size), data_size,
-		      PROT_READ | PROT_WRITE | PROT_EXEC,
-		      MAP_FILE | MAP_FIXED | MAP_COPY,
+		      PROT_READ | PROT_WRITE | PROT_EXEC, dflags,
 		      fd, text_size, (off_t)0, envid)
 	!= start_text_pg + text_size) {
       fprintf(stderr,"Error mmaping data segment\n");
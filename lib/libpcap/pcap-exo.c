@@ -49,6 +49,7 @@ pcap_read (pcap_t *p, int cnt, pcap_handler callback, u_char *user)
 	register int caplen;
 	struct ae_recv *packet;
 	int fromlen;
+	int cut;
 	void * tmp;
 
  
@@ -66,6 +67,8 @@ pcap_read (pcap_t *p, int cnt, pcap_handler callback, u_char *user)
 	} while(packet == NULL);
 
 	fromlen = ae_recv_datacnt(packet);
+	/* what the kernel left off when cutting to the snapshot length */
+	cut = xio_net_wrap_wirelen(packet) - fromlen;
 
 	cc = ae_recv_datacpy(packet, bp, 0, fromlen);
 	xio_net_wrap_returnPacket (p->nwinfo, packet);
@@ -87,8 +90,10 @@ pcap_read (pcap_t *p, int cnt, pcap_handler callback, u_char *user)
         if (caplen > p->snapshot)
                 caplen = p->snapshot;
                         
-        if (p->fcode.bf_insns == NULL ||
-            bpf_filter(p->fcode.bf_insns, bp, cc, caplen)) {
+        /* With the filter in the kernel only matching packets, cut */
+        /* down to the snapshot length, get here                    */
+        if (p->fcode.bf_insns == NULL || p->md.use_bpf ||
+            bpf_filter(p->fcode.bf_insns, bp, cc + cut, caplen)) {
                 struct pcap_pkthdr h;
            
                 ++p->md.stat.ps_recv;
@@ -100,7 +105,7 @@ pcap_read (pcap_t *p, int cnt, pcap_handler callback, u_char *user)
 		 gettimeofday( &h.ts , tmp);
 
 
-		h.len = cc;
+		h.len = cc + cut;
 		h.caplen = caplen;
 		(*callback)(user, &h, bp);
 		return (1);
@@ -199,6 +204,15 @@ pcap_open_live(char *device, int snaplen, int promisc, int to_ms, char *ebuf)
         }
         p->snapshot = snaplen;
 
+	/*
+	 * Ethernet frames reach the tap ring as the filter expects them,
+	 * so the kernel can cut them to the snapshot length (and run
+	 * the filter, see pcap_setfilter) before copying them out.
+	 */
+	if (p->md.pad == 0 && p->md.skip == 0)
+		xio_net_wrap_filternettap (p->nwinfo, CAP_ROOT, tapno,
+					   NULL, 0, snaplen);
+
 	//kprintf ("got to end of open ok\n");
          
         return (p);
@@ -217,6 +231,17 @@ int
 pcap_setfilter(pcap_t *p, struct bpf_program *fp)
 {
   p->fcode = *fp;
+
+  /* run it on the tap in the kernel if we can, else in pcap_read */
+  p->md.use_bpf = 0;
+  if (p->md.pad == 0 && p->md.skip == 0) {
+    if (xio_net_wrap_filternettap (p->nwinfo, CAP_ROOT, p->xio_tapno,
+				   fp->bf_insns, fp->bf_len, p->snapshot) == 0)
+      p->md.use_bpf = 1;
+    else
+      xio_net_wrap_filternettap (p->nwinfo, CAP_ROOT, p->xio_tapno,
+				 NULL, 0, p->snapshot);
+  }
   return (0);
 
 }
@@ -49,6 +49,7 @@
 #include <xok/sysinfo.h>
 #include <xok/sys_ucall.h>
 #include <xok/ae_recv.h>
+#include <xok/pktring.h>
 
 #include <vos/proc.h>
 #include <vos/cap.h>
@@ -377,7 +378,7 @@ struct ae_recv * xio_net_wrap_getPacket (xio_nwinfo_t *nwinfo)
       xio_net_buf_t *tmpbuf = nwinfo->pollbuflist;
       nwinfo->pollbuflist = nwinfo->pollbuflist->next;
       assert (tmpbuf->n == 1);
-      tmpbuf->sz = tmpbuf->poll;
+      tmpbuf->sz = tmpbuf->poll & PKTRING_LENMASK;
       inpackets++;
       
       return ((struct ae_recv *) &tmpbuf->n);
@@ -618,6 +619,25 @@ int xio_net_wrap_delnettap (xio_nwinfo_t *nwinfo, u_int capno, int tapno)
 }
 
 
+/* bytes recv had on the wire: more than it holds if a tap cut it to */
+/* its snapshot length (see xio_net_wrap_filternettap)               */
+int xio_net_wrap_wirelen (struct ae_recv *recv)
+{
+   xio_net_buf_t *buf = recvtopollbuf (recv);
+
+   return (recv->r[0].sz + ((u_int) buf->poll >> PKTRING_LENBITS));
+}
+
+
+/* have the kernel run BPF program prog on the tap and copy only what it */
+/* accepts, at most snaplen bytes per packet (prog NULL: all packets)    */
+int xio_net_wrap_filternettap (xio_nwinfo_t *nwinfo, u_int capno, int tapno,
+			       struct bpf_insn *prog, u_int len, u_int snaplen)
+{
+   return (sys_nettap_filter (capno, tapno, prog, len, snaplen));
+}
+
+
 int xio_net_wrap_reroutedpf (xio_nwinfo_t *nwinfo, int demux_id)
 {
    int ret;
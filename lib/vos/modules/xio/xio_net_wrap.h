@@ -103,6 +103,9 @@ int xio_net_wrap_getdpf_tcprange (xio_nwinfo_t *nwinfo, int firstsrcport, int la
 int xio_net_wrap_freedpf (int demux_id);
 int xio_net_wrap_getnettap (xio_nwinfo_t *nwinfo, u_int capno, u_int interfaces);
 int xio_net_wrap_delnettap (xio_nwinfo_t *nwinfo, u_int capno, int tapno);
+struct bpf_insn;
+int xio_net_wrap_filternettap (xio_nwinfo_t *nwinfo, u_int capno, int tapno, struct bpf_insn *prog, u_int len, u_int snaplen);
+int xio_net_wrap_wirelen (struct ae_recv *recv);
 int xio_net_wrap_reroutedpf (xio_nwinfo_t *nwinfo, int demux_id);
 
 #endif  /* __XIO_NET_WRAP_H__ */
@@ -54,6 +54,7 @@
 #include <exos/cap.h>
 #include <exos/uwk.h>
 #include <xok/ae_recv.h>
+#include <xok/pktring.h>
 #include <exos/net/ae_net.h>
 #include <exos/net/ether.h>
 #include <exos/osdecl.h>
@@ -155,8 +156,10 @@ kprintf ("xio_net_send_wrap: netcardno %d, send_recv %p, copysz %d\n", netcardno
    /* XXX -- do we even need this check now that sys_net_xmit handles
       all ethernet card types? */
 
-   /* Most interfaces don't need any of this */
-   if (__sysinfo.si_networks[netcardno].cardtype != XOKNET_DE) {
+   /* Most interfaces don't need any of this (lo0 does when it is */
+   /* emulating a slow link, since it then holds frames for a while) */
+   if ((__sysinfo.si_networks[netcardno].cardtype != XOKNET_DE) &&
+       (!(__sysinfo.si_networks[netcardno].flags & XOKNET_FL_ASYNCXMIT))) {
       ret = ae_eth_sendv (send_recv, netcardno);
       goto send_done;
    }
@@ -361,7 +364,7 @@ struct ae_recv * xio_net_wrap_getPacket (xio_nwinfo_t *nwinfo)
       xio_net_buf_t *tmpbuf = nwinfo->pollbuflist;
       nwinfo->pollbuflist = nwinfo->pollbuflist->next;
       assert (tmpbuf->n == 1);
-      tmpbuf->sz = tmpbuf->poll;
+      tmpbuf->sz = tmpbuf->poll & PKTRING_LENMASK;
       inpackets++;
 /*
 kprintf ("(%d %d) xio_net_wrap_getPacket: returning %p for buffer %p [phys %x] (poll %d)\n", getpid(), __envid, &tmpbuf->n, tmpbuf, tmpbuf->poll, vpt[PGNO(((uint)tmpbuf))]);
@@ -557,6 +560,39 @@ int xio_net_wrap_getdpf_tcp (xio_nwinfo_t *nwinfo, int srcportno, int dstportno)
 }
 
 
+/* Like xio_net_wrap_getdpf_tcp for a listening port, but only accepts    */
+/* the connections whose remote port falls into bucket <way> of <nways>. */
+/* Several servers sharing one port can use this to split the flows     */
+/* among themselves without any software demultiplexing.  <nways> must  */
+/* be a power of two.                                                   */
+
+int xio_net_wrap_getdpf_tcpsteer (xio_nwinfo_t *nwinfo, int srcportno, int nways, int way)
+{
+   struct dpf_ir ir;
+   int demux_id;
+
+   assert ((nways > 0) && ((nways & (nways - 1)) == 0));
+   assert ((way >= 0) && (way < nways));
+
+   dpf_begin (&ir);
+
+	/* 36 is offset of destination TCP port! */
+   dpf_eq16 (&ir, 36, htons((uint16)srcportno));
+
+   if (nways > 1) {
+	/* 34 is offset of source TCP port -- its low bits are the flow hash */
+      dpf_meq16 (&ir, 34, htons((uint16)(nways - 1)), htons((uint16)way));
+   }
+
+   if ((demux_id = sys_self_dpf_insert (CAP_ROOT, CAP_ROOT, &ir, nwinfo->ringid)) < 0) {
+      kprintf ("Unable to install TCP filter for srcport %d, way %d of %d (%d)\n", srcportno, way, nways, demux_id);
+      return(-1);
+   }
+
+   return (demux_id);
+}
+
+
 int xio_net_wrap_getdpf_tcprange (xio_nwinfo_t *nwinfo, int firstsrcport, int lastsrcport, int firstdstport, int lastdstport)
 {
 	/* obviously not supported yet (in fact, DPF won't support it) */
@@ -590,6 +626,25 @@ int xio_net_wrap_delnettap (xio_nwinfo_t *nwinfo, u_int capno, int tapno)
 }
 
 
+/* bytes recv had on the wire: more than it holds if a tap cut it to */
+/* its snapshot length (see xio_net_wrap_filternettap)               */
+int xio_net_wrap_wirelen (struct ae_recv *recv)
+{
+   xio_net_buf_t *buf = recvtopollbuf (recv);
+
+   return (recv->r[0].sz + ((u_int) buf->poll >> PKTRING_LENBITS));
+}
+
+
+/* have the kernel run BPF program prog on the tap and copy only what it */
+/* accepts, at most snaplen bytes per packet (prog NULL: all packets)    */
+int xio_net_wrap_filternettap (xio_nwinfo_t *nwinfo, u_int capno, int tapno,
+			       struct bpf_insn *prog, u_int len, u_int snaplen)
+{
+   return (sys_nettap_filter (capno, tapno, prog, len, snaplen));
+}
+
+
 int xio_net_wrap_reroutedpf (xio_nwinfo_t *nwinfo, int demux_id)
 {
    int ret;
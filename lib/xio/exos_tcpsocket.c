@@ -255,7 +255,7 @@ static int exos_tcpsocket_pruneshared (exos_tcpsock_info_t *maininfo)
          sock = info->xio_info.livelist;
          assert ((sock == NULL) || (sock->livenext == NULL));
          if (sock != NULL) {
-            for (j=0; j<NR_OPEN; j++) {
+            for (j=0; j<__current->nr_open; j++) {
                if ((__current->fd[j]) && (FILEP_GETSOCKPTR(__current->fd[j]) == sock)) {
                   sock = NULL;
                   break;
@@ -424,7 +424,7 @@ static int exos_tcpsocket_exechandler(u_int k, int envid, int execonly)
       RETURNCRITICAL (0);
    }
 
-   for (fd = 0 ; fd < NR_OPEN ; fd++) {
+   for (fd = 0 ; fd < __current->nr_open ; fd++) {
       filp = __current->fd[fd];
       if ((filp) && (__current->cloexec_flag[fd] == 0) && (filp->op_type == TCP_SOCKET_TYPE)) {
          shared = 1;
@@ -450,7 +450,7 @@ static int exos_tcpsocket_exechandler(u_int k, int envid, int execonly)
 
 	/* move each shared socket into self-contained set of shared pages */
    shared = 0;
-   for (fd = 0 ; fd < NR_OPEN ; fd++) {
+   for (fd = 0 ; fd < __current->nr_open ; fd++) {
       filp = __current->fd[fd];
       if ((filp) && (__current->cloexec_flag[fd] == 0) && (filp->op_type == TCP_SOCKET_TYPE)) {
          /* got a shared one.  do the thing! */
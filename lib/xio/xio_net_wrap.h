@@ -95,10 +95,14 @@ void xio_net_wrap_waitforPacket (xio_nwinfo_t *nwinfo);
 
 int xio_net_wrap_getdpf_udp (xio_nwinfo_t *nwinfo, int srcportno, int dstportno);
 int xio_net_wrap_getdpf_tcp (xio_nwinfo_t *nwinfo, int srcportno, int dstportno);
+int xio_net_wrap_getdpf_tcpsteer (xio_nwinfo_t *nwinfo, int srcportno, int nways, int way);
 int xio_net_wrap_getdpf_tcprange (xio_nwinfo_t *nwinfo, int firstsrcport, int lastsrcport, int firstdstport, int lastdstport);
 int xio_net_wrap_freedpf (xio_nwinfo_t *nwinfo, int demux_id);
 int xio_net_wrap_getnettap (xio_nwinfo_t *nwinfo, u_int capno, u_int interfaces);
 int xio_net_wrap_delnettap (xio_nwinfo_t *nwinfo, u_int capno, int tapno);
+struct bpf_insn;
+int xio_net_wrap_filternettap (xio_nwinfo_t *nwinfo, u_int capno, int tapno, struct bpf_insn *prog, u_int len, u_int snaplen);
+int xio_net_wrap_wirelen (struct ae_recv *recv);
 int xio_net_wrap_reroutedpf (xio_nwinfo_t *nwinfo, int demux_id);
 
 #endif  /* __XIO_NET_WRAP_H__ */
@@ -61,8 +61,13 @@
 #include <xok/ae_recv.h>
 #include <xok/queue.h>
 
+#include "xio_tcpbuffer.h"
+
 #define TCP_RETRY       4
 
+/* Room in the header buffer for the options we put on a SYN */
+#define TCP_OPTIONS_MAXLEN	28	/* a SYN needs 12, 3 SACK blocks 28 */
+
 
 
 #define XIO_TCP_DEMULTIPLEXING_FIELDS \
@@ -83,6 +88,8 @@
 #define tcpsrc  tcpports.tps.ts
 #define tcpdst  tcpports.tps.td
 
+struct xio_tcp_cc;
+
 /* TCP control block, see RFC 793 */
 struct tcb {
 
@@ -147,6 +154,27 @@ struct tcb {
 #define START_RTT (TCP_RATE_HZ*1)
   unsigned int rtt;
 
+   /* Congestion control (RFC 5681, RFC 6582).  Windows are in bytes.  */
+   struct xio_tcp_cc *cc;	/* algorithm in use, see xio_tcp_cc.h */
+   uint32	cwnd;		/* congestion window */
+   uint32	ssthresh;	/* slow start threshold */
+   uint32	snd_recover;	/* snd_max when fast recovery was entered */
+   uint32	snd_holeend;	/* end of the hole being resent (TCB_FL_RESEND) */
+   int		dupacks;	/* consecutive duplicate acks seen */
+   uint32	cc_state[4];	/* private to the algorithm */
+
+   /* Window scale shifts (RFC 1323); both 0 unless negotiated on SYNs */
+   uint8	snd_wscale;
+   uint8	rcv_wscale;
+
+   /* SACK scoreboard (RFC 2018): sorted, disjoint blocks above snd_una */
+#define TCP_SACK_MAX	4
+   int		nsacks;
+   struct {
+      uint32 start;
+      uint32 end;
+   } sacks[TCP_SACK_MAX];
+
    /* Implementation specific send stuff */
 
    uint32	send_offset;	/* current data byte offset (next to send) */
@@ -167,7 +195,17 @@ struct tcpbuffer;
    struct tcpbuffer *inbuffers;
    struct tcpbuffer *outbuffers;
 
-   char snd_buf[64];
+   /* Reassembly queue: out-of-order data kept as sorted, disjoint    */
+   /* intervals of received-data offsets (see xio_tcpbuffer.c).  Only */
+   /* used if the socket layer supplies reasstbinfo.                  */
+#define XIO_TCP_REASS_MAXBUFS	16
+   xio_tbinfo_t *reasstbinfo;	/* where the queue's buffers come from */
+   struct tcpbuffer *reass;	/* the queue */
+   struct tcpbuffer *inready;	/* queued data this packet made in-order */
+   uint  inreadylen;		/* amount of data on inready */
+   uint32 reass_last;		/* seqno of the latest queued segment */
+
+   char snd_buf[64 + TCP_OPTIONS_MAXLEN];
 };
 
 /* Default maximum segment life time. */
@@ -239,9 +277,18 @@ struct tcp {
 #define TCP_OPTION_EOL  0
 #define TCP_OPTION_NOP  1
 #define TCP_OPTION_MSS  2
+#define TCP_OPTION_WSCALE	3
+#define TCP_OPTION_SACKOK	4
+#define TCP_OPTION_SACK		5
 
 /* Defines for tcp option lengths: */
 #define TCP_OPTION_MSS_LEN      4
+#define TCP_OPTION_WSCALE_LEN	3
+#define TCP_OPTION_SACKOK_LEN	2
+
+/* Window scaling: the shift we ask for, and the largest one allowed */
+#define TCP_WSCALE_DEFAULT	2
+#define TCP_WSCALE_MAX		14
 
 /* The default maximum segment size (excl. ip and tcp header). */
 #define TCP_MSS         536
@@ -264,6 +311,14 @@ struct tcp {
 #define SEQ_MAX(a,b)    (((int)((a)-(b)) >= 0) ? (a) : (b))
 
 
+/* TCB control flags that the socket layers look at (the rest are */
+/* private to xio_tcp_handlers.c).                                 */
+#define TCB_FL_RECOVERY		0x0040	/* in fast recovery */
+#define TCB_FL_RESEND		0x0080	/* resending up to snd_holeend */
+#define TCB_FL_SACKOK		0x0100	/* peer sent SACK-permitted */
+#define TCB_FL_WSCALE		0x0200	/* peer sent a window scale */
+
+
 /* Connection states */
 #define TCB_ST_FREE             0
 #define TCB_ST_LISTEN           1
@@ -378,9 +433,10 @@ static inline char * xio_tcp_getLiveInData (struct tcb *tcb) {
 				 ((tcb)->indata + (tcb)->inoffset));
 }
 
+/* (data made in-order from the reassembly queue follows the packet's) */
 static inline uint xio_tcp_getLiveInDataStart (struct tcb *tcb) {
    return ((!xio_tcp_getLiveInDataLen(tcb)) ? 0 : \
-	 (xio_tcp_received_offset(tcb) - (tcb)->indatalen + (tcb)->inoffset));
+	 (xio_tcp_received_offset(tcb) - (tcb)->inreadylen - (tcb)->indatalen + (tcb)->inoffset));
 }
 
 unsigned int xio_tcp_read_clock ();
@@ -393,10 +449,19 @@ static inline void xio_tcp_setrcvwnd (struct tcb *tcb, int window) {
    tcb->rcv_wnd = window;
 }
 
+/* the usable send window: the peer's offer, clamped by the congestion window */
+static inline uint32 xio_tcp_sndwnd (struct tcb *tcb) {
+  return (min (tcb->snd_wnd, tcb->cwnd));
+}
+
 static inline int xio_tcp_windowsz (struct tcb *tcb) {
-  return (tcb->snd_una + tcb->snd_wnd - tcb->snd_next);
+  return (tcb->snd_una + xio_tcp_sndwnd (tcb) - tcb->snd_next);
 }
 
+/* true while fast recovery is resending holes below snd_max; segments */
+/* prepared then may be shorter than an mss and must not be tossed.    */
+#define xio_tcp_resending(tcb)	((tcb)->flags & TCB_FL_RESEND)
+
 /* the amount of data that has been sent but not acknowledged yet */
 static inline int xio_tcp_unacked (struct tcb *tcb) {
   return (tcb->snd_max - tcb->snd_una);
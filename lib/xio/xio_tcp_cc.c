@@ -0,0 +1,324 @@
+
+/*
+ * Copyright (C) 1997 Massachusetts Institute of Technology 
+ *
+ * This software is being provided by the copyright holders under the
+ * following license. By obtaining, using and/or copying this software,
+ * you agree that you have read, understood, and will comply with the
+ * following terms and conditions:
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose and without fee or royalty is
+ * hereby granted, provided that the full text of this NOTICE appears on
+ * ALL copies of the software and documentation or portions thereof,
+ * including modifications, that you make.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS," AND COPYRIGHT HOLDERS MAKE NO
+ * REPRESENTATIONS OR WARRANTIES, EXPRESS OR IMPLIED. BY WAY OF EXAMPLE,
+ * BUT NOT LIMITATION, COPYRIGHT HOLDERS MAKE NO REPRESENTATIONS OR
+ * WARRANTIES OF MERCHANTABILITY OR FITNESS FOR ANY PARTICULAR PURPOSE OR
+ * THAT THE USE OF THE SOFTWARE OR DOCUMENTATION WILL NOT INFRINGE ANY
+ * THIRD PARTY PATENTS, COPYRIGHTS, TRADEMARKS OR OTHER RIGHTS. COPYRIGHT
+ * HOLDERS WILL BEAR NO LIABILITY FOR ANY USE OF THIS SOFTWARE OR
+ * DOCUMENTATION.
+ *
+ * The name and trademarks of copyright holders may NOT be used in
+ * advertising or publicity pertaining to the software without specific,
+ * written prior permission. Title to copyright in this software and any
+ * associated documentation will at all times remain with copyright
+ * holders. See the file AUTHORS which should have accompanied this software
+ * for a list of all copyright holders.
+ *
+ * This file may be derived from previously copyrighted software. This
+ * copyright applies only to those changes made by the copyright
+ * holders listed in the AUTHORS file. The rest of this file is covered by
+ * the copyright notices, if any, listed below.
+ */
+
+
+/*
+ * TCP congestion control: the window bookkeeping shared by all algorithms
+ * plus two algorithms, NewReno (RFC 5681, RFC 6582) and a CUBIC-style one
+ * (RFC 8312).  Fast retransmit and recovery themselves live in
+ * process_ack (xio_tcp_handlers.c), which calls in here.
+ */
+
+#include <sys/types.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "xio_tcp.h"
+#include "xio_tcp_handlers.h"
+#include "xio_tcp_cc.h"
+
+
+#define TCP_INFINITE_SSTHRESH	0x7fffffff
+
+
+static struct xio_tcp_cc *cc_algorithms[] = {
+   &xio_tcp_newreno,
+   &xio_tcp_cubic,
+   NULL
+};
+
+static struct xio_tcp_cc *cc_default = &xio_tcp_newreno;
+
+
+struct xio_tcp_cc *xio_tcp_cc_lookup (char *name)
+{
+   int i;
+
+   for (i = 0; cc_algorithms[i] != NULL; i++) {
+      if (strcmp (cc_algorithms[i]->name, name) == 0) {
+         return (cc_algorithms[i]);
+      }
+   }
+   return (NULL);
+}
+
+
+/* the algorithm given to connections set up from now on */
+void xio_tcp_cc_setdefault (struct xio_tcp_cc *cc)
+{
+   assert (cc != NULL);
+   cc_default = cc;
+}
+
+
+struct xio_tcp_cc *xio_tcp_cc_getdefault ()
+{
+   return (cc_default);
+}
+
+
+/* switch a connection's algorithm; it starts over from the current cwnd */
+void xio_tcp_cc_set (struct tcb *tcb, struct xio_tcp_cc *cc)
+{
+   assert (cc != NULL);
+   tcb->cc = cc;
+   bzero ((char *)tcb->cc_state, sizeof(tcb->cc_state));
+   cc->init (tcb);
+}
+
+
+/* initial window (RFC 3390) */
+static uint32 cc_initial_window (struct tcb *tcb)
+{
+   return (min ((4 * tcb->mss), max ((2 * tcb->mss), 4380)));
+}
+
+
+/* called from xio_tcp_resettcb, before the mss is known */
+void xio_tcp_cc_reset (struct tcb *tcb)
+{
+   tcb->cc = cc_default;
+   tcb->cwnd = cc_initial_window (tcb);
+   tcb->ssthresh = TCP_INFINITE_SSTHRESH;
+   tcb->snd_recover = tcb->snd_iss;
+   tcb->snd_holeend = 0;
+   tcb->dupacks = 0;
+   tcb->nsacks = 0;
+   bzero ((char *)tcb->cc_state, sizeof(tcb->cc_state));
+}
+
+
+/* called once the handshake is done and the mss has been negotiated */
+void xio_tcp_cc_init (struct tcb *tcb)
+{
+   tcb->cwnd = cc_initial_window (tcb);
+   tcb->ssthresh = TCP_INFINITE_SSTHRESH;
+   tcb->snd_recover = tcb->snd_una;
+   tcb->dupacks = 0;
+   bzero ((char *)tcb->cc_state, sizeof(tcb->cc_state));
+   tcb->cc->init (tcb);
+}
+
+
+/* New data has been acked outside of fast recovery.  Slow start uses */
+/* appropriate byte counting with a limit of 2 mss per ack (RFC 3465).  */
+void xio_tcp_cc_ack (struct tcb *tcb, uint acked)
+{
+   if (tcb->cwnd < tcb->ssthresh) {
+      tcb->cwnd += min (acked, (2 * tcb->mss));
+   } else {
+      tcb->cc->ack (tcb, acked);
+   }
+}
+
+
+/* a loss was detected by duplicate acks */
+void xio_tcp_cc_loss (struct tcb *tcb)
+{
+   tcb->ssthresh = max (tcb->cc->loss (tcb), (2 * tcb->mss));
+}
+
+
+/* the retransmission timer went off: back to one segment */
+void xio_tcp_cc_timeout (struct tcb *tcb)
+{
+   if (!(tcb->flags & TCB_FL_RECOVERY)) {
+      xio_tcp_cc_loss (tcb);
+   }
+   tcb->cwnd = tcb->mss;
+   tcb->snd_recover = tcb->snd_max;
+   tcb->dupacks = 0;
+   tcb->nsacks = 0;
+   tcb->flags &= ~(TCB_FL_RECOVERY|TCB_FL_RESEND);
+}
+
+
+/* ------------------------------- NewReno -------------------------------- */
+
+/* Congestion avoidance grows cwnd by one mss for every cwnd worth of */
+/* bytes acked (RFC 3465), so delayed acks do not slow it down.       */
+
+#define newreno_acked(tcb)	((tcb)->cc_state[0])
+
+static void newreno_init (struct tcb *tcb)
+{
+   newreno_acked(tcb) = 0;
+}
+
+
+static void newreno_ack (struct tcb *tcb, uint acked)
+{
+   newreno_acked(tcb) += acked;
+   if (newreno_acked(tcb) >= tcb->cwnd) {
+      newreno_acked(tcb) -= tcb->cwnd;
+      tcb->cwnd += tcb->mss;
+   }
+}
+
+
+static uint32 newreno_loss (struct tcb *tcb)
+{
+   newreno_acked(tcb) = 0;
+   return (xio_tcp_unacked (tcb) / 2);
+}
+
+
+struct xio_tcp_cc xio_tcp_newreno = {
+   "newreno",
+   newreno_init,
+   newreno_ack,
+   newreno_loss,
+};
+
+
+/* -------------------------------- CUBIC --------------------------------- */
+
+/*
+ * After a loss the window follows W(t) = C (t - K)^3 + Wmax, with K the
+ * time it takes to climb back to Wmax, so it probes cautiously near the
+ * old operating point and quickly away from it.  It never grows slower
+ * than Reno would (the "TCP-friendly" estimate).  Everything is integer:
+ * time is counted in units of 256 tcp ticks (~1 ms) and C = 0.4 is folded
+ * into the shift constants below.
+ */
+
+#define CUBIC_BETA		717	/* decrease factor 0.7, in 1024ths */
+#define CUBIC_FRIENDLY		542	/* 3(1-beta)/(1+beta), in 1024ths */
+#define CUBIC_TIMESHIFT		8	/* tcp ticks per time unit (log2) */
+#define CUBIC_MAXTIME		(1 << 17)	/* keeps t^3 * 59 in 64 bits */
+#define CUBIC_MAXWIN		(65535 << TCP_WSCALE_MAX)
+
+	/* C t^3 in segments is (59 t^3) >> 37 for t in time units; */
+	/* K^3 = (Wmax - cwnd) / C is (segs * 4441) << 19.           */
+#define CUBIC_CUBE(t)		((59 * (t) * (t) * (t)) >> 37)
+#define CUBIC_KCUBE(segs)	(((u_quad_t)(segs) * 4441) << 19)
+
+#define cubic_wmax(tcb)		((tcb)->cc_state[0])	/* window before last loss */
+#define cubic_epoch(tcb)	((tcb)->cc_state[1])	/* clock at epoch start, 0 if none */
+#define cubic_k(tcb)		((tcb)->cc_state[2])	/* time units to reach origin */
+#define cubic_west(tcb)		((tcb)->cc_state[3])	/* Reno-friendly estimate */
+
+
+/* integer cube root, by bisection (no 64-bit divides needed) */
+static uint32 cubic_cbrt (u_quad_t x)
+{
+   uint32 lo = 0;
+   uint32 hi = (1 << 21) - 1;
+
+   while (lo < hi) {
+      uint32 mid = (lo + hi + 1) >> 1;
+      if (((u_quad_t)mid * mid * mid) <= x) {
+         lo = mid;
+      } else {
+         hi = mid - 1;
+      }
+   }
+   return (lo);
+}
+
+
+static void cubic_init (struct tcb *tcb)
+{
+   cubic_wmax(tcb) = 0;
+   cubic_epoch(tcb) = 0;
+}
+
+
+static void cubic_ack (struct tcb *tcb, uint acked)
+{
+   uint32 now = xio_tcp_read_clock ();
+   uint32 segs = max ((tcb->cwnd / tcb->mss), 1);
+   uint32 target;
+   uint32 t;
+   u_quad_t d;		/* distance from K, then the cubic term in bytes */
+
+   if (cubic_epoch(tcb) == 0) {
+      /* first ack after a loss (or ever): start a new epoch.  If we are */
+      /* already past the old maximum, the curve is anchored right here. */
+      cubic_epoch(tcb) = (now) ? now : 1;
+      if (tcb->cwnd < cubic_wmax(tcb)) {
+         cubic_k(tcb) = cubic_cbrt (CUBIC_KCUBE ((cubic_wmax(tcb) - tcb->cwnd) / tcb->mss));
+      } else {
+         cubic_k(tcb) = 0;
+         cubic_wmax(tcb) = tcb->cwnd;
+      }
+      cubic_west(tcb) = tcb->cwnd;
+   }
+
+   t = min (((now - cubic_epoch(tcb)) >> CUBIC_TIMESHIFT), CUBIC_MAXTIME);
+   d = (t < cubic_k(tcb)) ? (cubic_k(tcb) - t) : (t - cubic_k(tcb));
+   d = min ((CUBIC_CUBE(d) * tcb->mss), CUBIC_MAXWIN);
+   if (t < cubic_k(tcb)) {
+      target = cubic_wmax(tcb) - min (d, cubic_wmax(tcb));
+   } else {
+      target = min ((cubic_wmax(tcb) + d), CUBIC_MAXWIN);
+   }
+
+   /* Reno would add 0.53 mss per window worth of acks in this region */
+   cubic_west(tcb) += (((acked * CUBIC_FRIENDLY) >> 10) * tcb->mss) / tcb->cwnd;
+   target = max (target, cubic_west(tcb));
+
+   if (target > tcb->cwnd) {
+      /* close (target - cwnd) / cwnd of the gap per mss acked, but */
+      /* never grow faster than slow start would.                   */
+      uint32 inc = ((target - tcb->cwnd) / segs) * max ((acked / tcb->mss), 1);
+      tcb->cwnd += min (inc, (acked / 2));
+   }
+}
+
+
+static uint32 cubic_loss (struct tcb *tcb)
+{
+   /* fast convergence: if we lost before reaching the previous maximum, */
+   /* release some bandwidth for newer flows.                            */
+   if (tcb->cwnd < cubic_wmax(tcb)) {
+      cubic_wmax(tcb) = (tcb->cwnd >> 11) * (1024 + CUBIC_BETA);
+   } else {
+      cubic_wmax(tcb) = tcb->cwnd;
+   }
+   cubic_epoch(tcb) = 0;
+   return ((tcb->cwnd >> 10) * CUBIC_BETA);
+}
+
+
+struct xio_tcp_cc xio_tcp_cubic = {
+   "cubic",
+   cubic_init,
+   cubic_ack,
+   cubic_loss,
+};
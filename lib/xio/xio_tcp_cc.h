@@ -0,0 +1,78 @@
+
+/*
+ * Copyright (C) 1997 Massachusetts Institute of Technology 
+ *
+ * This software is being provided by the copyright holders under the
+ * following license. By obtaining, using and/or copying this software,
+ * you agree that you have read, understood, and will comply with the
+ * following terms and conditions:
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose and without fee or royalty is
+ * hereby granted, provided that the full text of this NOTICE appears on
+ * ALL copies of the software and documentation or portions thereof,
+ * including modifications, that you make.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS," AND COPYRIGHT HOLDERS MAKE NO
+ * REPRESENTATIONS OR WARRANTIES, EXPRESS OR IMPLIED. BY WAY OF EXAMPLE,
+ * BUT NOT LIMITATION, COPYRIGHT HOLDERS MAKE NO REPRESENTATIONS OR
+ * WARRANTIES OF MERCHANTABILITY OR FITNESS FOR ANY PARTICULAR PURPOSE OR
+ * THAT THE USE OF THE SOFTWARE OR DOCUMENTATION WILL NOT INFRINGE ANY
+ * THIRD PARTY PATENTS, COPYRIGHTS, TRADEMARKS OR OTHER RIGHTS. COPYRIGHT
+ * HOLDERS WILL BEAR NO LIABILITY FOR ANY USE OF THIS SOFTWARE OR
+ * DOCUMENTATION.
+ *
+ * The name and trademarks of copyright holders may NOT be used in
+ * advertising or publicity pertaining to the software without specific,
+ * written prior permission. Title to copyright in this software and any
+ * associated documentation will at all times remain with copyright
+ * holders. See the file AUTHORS which should have accompanied this software
+ * for a list of all copyright holders.
+ *
+ * This file may be derived from previously copyrighted software. This
+ * copyright applies only to those changes made by the copyright
+ * holders listed in the AUTHORS file. The rest of this file is covered by
+ * the copyright notices, if any, listed below.
+ */
+
+
+#ifndef __XIO_TCP_CC_H__
+#define __XIO_TCP_CC_H__
+
+#include "xio_tcp.h"
+
+/*
+ * Pluggable congestion control.  The common code (xio_tcp_cc.c and
+ * process_ack in xio_tcp_handlers.c) does slow start, duplicate ack
+ * counting, fast retransmit and NewReno fast recovery.  An algorithm only
+ * decides how cwnd grows in congestion avoidance and where ssthresh lands
+ * after a loss.  It may keep private state in tcb->cc_state.
+ */
+
+struct xio_tcp_cc {
+   char *name;
+   void (*init) (struct tcb *tcb);		/* connection established */
+   void (*ack) (struct tcb *tcb, uint acked);	/* new data acked, cwnd >= ssthresh */
+   uint32 (*loss) (struct tcb *tcb);		/* loss detected: new ssthresh */
+};
+
+extern struct xio_tcp_cc xio_tcp_newreno;
+extern struct xio_tcp_cc xio_tcp_cubic;
+
+/* number of duplicate acks that trigger a fast retransmit */
+#define TCP_DUPACK_THRESH	3
+
+/* prototypes */
+
+struct xio_tcp_cc *xio_tcp_cc_lookup (char *name);
+void xio_tcp_cc_setdefault (struct xio_tcp_cc *cc);
+struct xio_tcp_cc *xio_tcp_cc_getdefault ();
+void xio_tcp_cc_set (struct tcb *tcb, struct xio_tcp_cc *cc);
+
+void xio_tcp_cc_reset (struct tcb *tcb);
+void xio_tcp_cc_init (struct tcb *tcb);
+void xio_tcp_cc_ack (struct tcb *tcb, uint acked);
+void xio_tcp_cc_loss (struct tcb *tcb);
+void xio_tcp_cc_timeout (struct tcb *tcb);
+
+#endif  /* __XIO_TCP_CC_H__ */
@@ -44,8 +44,7 @@
  * - eliminate interdependence on ether and ip
  * - externalize delayed ack control better
  * - data on a syn segment is deleted
- * - implement congestion control
- * - implement reassembly (not really needed)
+ * - a FIN on an out-of-order segment is dropped (it gets retransmitted)
  */
 
 #include <sys/types.h>
@@ -62,6 +61,7 @@
 #include "xio_tcp.h"
 #include "xio_tcp_handlers.h"
 #include "xio_tcp_stats.h"
+#include "xio_tcp_cc.h"
 
 #include <netinet/in.h>
 #include <exos/netinet/fast_ip.h>
@@ -210,10 +210,16 @@ void xio_tcp_resettcb (struct tcb *tcb)
 
   tcb->inbuffers = NULL;
   tcb->outbuffers = NULL;
+  tcb->reass = NULL;
+  tcb->inready = NULL;
+  tcb->inreadylen = 0;
   tcb->inpackets = 0;
   tcb->outpackets = 0;
 
   tcb->rcv_wnd = 8192;
+  tcb->snd_wscale = 0;
+  tcb->rcv_wscale = 0;
+  xio_tcp_cc_reset (tcb);
 
   tcb->rtt = START_RTT;		/* no rtt measurements yet */
   tcb->rtt_next_ndx = 0;
@@ -235,7 +241,7 @@ printf ("xio_tcp_inittcb: tcb %d, buf %d, buflen %d\n", (uint)tcb, (uint)buf, bu
    /* this bzero eliminates the need for setting many ind. values to zero */
    bzero ((char *)tcb, sizeof(struct tcb));
 
-   StaticAssert (64 >= (XIO_EIT_DATA + ETHER_ALIGN));
+   StaticAssert (sizeof(tcb->snd_buf) >= (XIO_EIT_DATA + ETHER_ALIGN + TCP_OPTIONS_MAXLEN));
 
    /* Set up pointers to headers in snd_recv; worry about alignment */
    tcb->snd_recv_n = 2;
@@ -283,6 +289,21 @@ void xio_tcp_initlistentcb (struct listentcb *listentcb, uint32 ipaddr,
 /* ------------------ general packet construction functions ----------------- */
 
 
+/* The window we advertise.  Windows on SYNs are never scaled (RFC 1323). */
+static inline uint16 xio_tcp_advwnd (struct tcb *tcb, int flag)
+{
+   uint32 wnd = (flag & TCP_FL_SYN) ? tcb->rcv_wnd : (tcb->rcv_wnd >> tcb->rcv_wscale);
+   return (min (wnd, 0xffff));
+}
+
+
+/* The window offered by an incoming (already byte-swapped) segment. */
+static inline uint32 xio_tcp_segwnd (struct tcb *tcb, struct tcp *tcp)
+{
+   return ((tcp->flags & TCP_FL_SYN) ? tcp->window : ((uint32)tcp->window << tcb->snd_wscale));
+}
+
+
 /*
  * Prepare a packet (in the tcb) to be sent, including the specified flags
  * and data (via tcb) at the specified seqno.  Provided checksum for data
@@ -321,7 +342,7 @@ static void xio_tcp_preparePacket (struct tcb *tcb, int flag, uint32 seqno, int
 
    tcp->seqno = htonl(seqno);
    tcp->ackno = htonl(tcb->rcv_next);
-   tcp->window = htons(tcb->rcv_wnd);
+   tcp->window = htons(xio_tcp_advwnd(tcb, flag));
 
    ip->totallength = htons(tcb->snd_recv_r0_sz - XIO_EIT_IP + len + len2);
    tcp->cksum = 0;
@@ -410,33 +431,228 @@ static void xio_tcp_prepRespPacket (char *newpacket, char *origpacket, int flag,
 }
 
 
+/*
+ * Prepare a SYN with options: always the MSS, and window scaling and
+ * SACK-permitted on our own SYN or when the peer's SYN carried them.
+ * Each of the latter is NOP-padded to 4 bytes.
+ */
 static void xio_tcp_prepOptionsPacket (struct tcb *tcb, int flag, uint32 seqno, int len, int len2, int datasum)
 {
    char *option = &tcb->snd_recv_r0_data[XIO_EIT_DATA];
    uint16 mss = htons(tcb->mss);
+   int optlen = 0;
+
+   option[optlen++] = TCP_OPTION_MSS;
+   option[optlen++] = TCP_OPTION_MSS_LEN;
+   memcpy (&option[optlen], &mss, sizeof(uint16));
+   optlen += sizeof(uint16);
+
+   if ((!(flag & TCP_FL_ACK)) || (tcb->flags & TCB_FL_WSCALE)) {
+      option[optlen++] = TCP_OPTION_NOP;
+      option[optlen++] = TCP_OPTION_WSCALE;
+      option[optlen++] = TCP_OPTION_WSCALE_LEN;
+      option[optlen++] = TCP_WSCALE_DEFAULT;
+   }
+   if ((!(flag & TCP_FL_ACK)) || (tcb->flags & TCB_FL_SACKOK)) {
+      option[optlen++] = TCP_OPTION_NOP;
+      option[optlen++] = TCP_OPTION_NOP;
+      option[optlen++] = TCP_OPTION_SACKOK;
+      option[optlen++] = TCP_OPTION_SACKOK_LEN;
+   }
+   assert (optlen <= TCP_OPTIONS_MAXLEN);
 
-   option[0] = TCP_OPTION_MSS;
-   option[1] = TCP_OPTION_MSS_LEN;
-   memcpy (&option[2], &mss, sizeof(uint16));
-
-   tcb->snd_recv_r0_sz += TCP_OPTION_MSS_LEN;
+   tcb->snd_recv_r0_sz += optlen;
    xio_tcp_preparePacket (tcb, flag, seqno, len, len2, datasum);
-   tcb->snd_recv_r0_sz -= TCP_OPTION_MSS_LEN;
+   tcb->snd_recv_r0_sz -= optlen;
    tcb->snd_recv_r1_data = option;
-   tcb->snd_recv_r1_sz = TCP_OPTION_MSS_LEN;
+   tcb->snd_recv_r1_sz = optlen;
    assert (tcb->snd_recv_n == 1);
    tcb->snd_recv_n = 2;
 }
 
 
+/*
+ * Collect up to max SACK blocks (start, end pairs in host order) describing
+ * the reassembly queue.  Adjacent queue buffers make up one block, and the
+ * block holding the latest queued segment goes first (RFC 2018).
+ */
+static int xio_tcp_sackblocks (struct tcb *tcb, uint32 *blocks, int max)
+{
+   xio_tcpbuf_t *tmp = tcb->reass;
+   uint32 base = tcb->rcv_irs + 1;	/* seqno of received offset 0 */
+   int n = 0;
+
+   while ((tmp) && (n < max)) {
+      uint32 start = base + tmp->start + tmp->offset;
+      uint32 end = start + tmp->len;
+      while ((tmp->next) && ((base + tmp->next->start + tmp->next->offset) == end)) {
+         tmp = tmp->next;
+         end += tmp->len;
+      }
+      tmp = tmp->next;
+      if ((n > 0) && (SEQ_GEQ(tcb->reass_last, start)) && (SEQ_LT(tcb->reass_last, end))) {
+         blocks[2*n] = blocks[0];
+         blocks[2*n+1] = blocks[1];
+         blocks[0] = start;
+         blocks[1] = end;
+      } else {
+         blocks[2*n] = start;
+         blocks[2*n+1] = end;
+      }
+      n++;
+   }
+   return (n);
+}
+
+
+/*
+ * Prepare a pure ack.  While out-of-order data is queued (and the peer
+ * allows it) the ack carries SACK blocks for it, passed the same way
+ * prepOptionsPacket passes SYN options.
+ */
+static void xio_tcp_prepAckPacket (struct tcb *tcb)
+{
+   char *option = &tcb->snd_recv_r0_data[XIO_EIT_DATA];
+   uint32 blocks[2 * ((TCP_OPTIONS_MAXLEN - 4) / 8)];
+   int optlen = 0;
+   int n, i;
+
+   if ((tcb->reass == NULL) || (!(tcb->flags & TCB_FL_SACKOK))) {
+      xio_tcp_preparePacket (tcb, TCP_FL_ACK, tcb->snd_next, 0, 0, 0);
+      return;
+   }
+
+   n = xio_tcp_sackblocks (tcb, blocks, ((TCP_OPTIONS_MAXLEN - 4) / 8));
+   option[optlen++] = TCP_OPTION_NOP;
+   option[optlen++] = TCP_OPTION_NOP;
+   option[optlen++] = TCP_OPTION_SACK;
+   option[optlen++] = 2 + (8 * n);
+   for (i = 0; i < (2 * n); i++) {
+      uint32 seqno = htonl(blocks[i]);
+      memcpy (&option[optlen], &seqno, sizeof(uint32));
+      optlen += sizeof(uint32);
+   }
+   assert (optlen <= TCP_OPTIONS_MAXLEN);
+
+   tcb->snd_recv_r0_sz += optlen;
+   xio_tcp_preparePacket (tcb, TCP_FL_ACK, tcb->snd_next, 0, 0, 0);
+   tcb->snd_recv_r0_sz -= optlen;
+   tcb->snd_recv_r1_data = option;
+   tcb->snd_recv_r1_sz = optlen;
+   assert (tcb->snd_recv_n == 1);
+   tcb->snd_recv_n = 2;
+}
+
+
+/* ------------------------- fast recovery helpers -------------------------- */
+
+
+/* Move snd_next (and send_offset with it) forward to seqno, skipping data */
+/* that has already been sent.  A sent FIN is never skipped over, since it */
+/* has no place in send_offset; close_timeout takes care of resending it.  */
+static void xio_tcp_skipto (struct tcb *tcb, uint32 seqno)
+{
+   if ((tcb->snd_fin) && (SEQ_GT(seqno, tcb->snd_fin))) {
+      seqno = tcb->snd_fin;
+   }
+   if (SEQ_GT(seqno, tcb->snd_next)) {
+      tcb->send_offset += seqno - tcb->snd_next;
+      tcb->snd_next = seqno;
+   }
+}
+
+
+/*
+ * Find the next stretch to resend at or after snd_next: a hole below a
+ * SACKed block.  snd_holeend marks its end.  Once no holes are left,
+ * stop resending and continue from snd_max.
+ */
+static void xio_tcp_nexthole (struct tcb *tcb)
+{
+   uint32 seqno = tcb->snd_next;
+   int i;
+
+   for (i = 0; i < tcb->nsacks; i++) {
+      if (SEQ_LT(seqno, tcb->sacks[i].start)) {
+         tcb->snd_holeend = tcb->sacks[i].start;
+         xio_tcp_skipto (tcb, seqno);
+         return;
+      }
+      if (SEQ_LT(seqno, tcb->sacks[i].end)) {
+         seqno = tcb->sacks[i].end;
+      }
+   }
+   tcb->flags &= ~TCB_FL_RESEND;
+   xio_tcp_skipto (tcb, tcb->snd_max);
+}
+
+
+/* Start resending from snd_una: the first hole if the peer sent SACKs, */
+/* otherwise just the one segment NewReno presumes lost.                */
+static void xio_tcp_resendhole (struct tcb *tcb)
+{
+   STINC(tcpstats, nretrans);
+   tcb->send_offset -= tcb->snd_next - tcb->snd_una;
+   tcb->snd_next = tcb->snd_una;
+   tcb->flags |= TCB_FL_RESEND;
+   if (tcb->nsacks == 0) {
+      tcb->snd_holeend = tcb->snd_una + tcb->mss;
+   } else {
+      xio_tcp_nexthole (tcb);
+   }
+}
+
+
 /* ------------------- action initiating external routines ------------------ */
 
 
+/* Number of bytes (of the n available) that xio_tcp_prepDataPacket will */
+/* put on the next segment, or 0 if it will not send one now.            */
+int xio_tcp_seglen (struct tcb *tcb, int n, uint flags)
+{
+   int close = flags & TCP_SEND_ALSOCLOSE;
+   int window;
+   int data_len = 0;
+
+   /* Compute first how much space is left in the window. */
+   window = xio_tcp_windowsz (tcb);
+
+   DPRINTF (4, ("xio_tcp_seglen: window %d, mss %d, close %d\n", window, tcb->mss, close));
+
+   /* GROK -- need to do something for case of window < mss */
+   /*         - answer may be to have a real mss and an effective mss */
+
+   /* GROK -- clean up this legacy if statement */
+   if ((n > 0) && (window >= min(2,n)) && ((min(n,tcb->mss) <= window) || 
+				(!(flags & TCP_SEND_MAXSIZEONLY)) || 
+				((close) && (n < min(window,tcb->mss))))) {
+
+	/* Compute number of bytes on segment: never more than the window
+	 * allows us and never more than 1 MSS.
+	 */
+      data_len = min(n, window);
+      data_len = min(data_len, tcb->mss);
+      if (tcb->flags & TCB_FL_RESEND) {
+         assert (SEQ_LT(tcb->snd_next, tcb->snd_holeend));
+         data_len = min(data_len, (tcb->snd_holeend - tcb->snd_next));
+      }
+	/* GROK -- is this needed for correct operation (see below)?? */
+      //data_len = (data_len == n) ? n : (data_len & ~(0x1));
+
+      assert (data_len > 0);
+   }
+
+   return (data_len);
+}
+
+
+/* sum is the partial checksum of the data that will be sent, or -1 to */
+/* have it computed here.  Callers that pass a sum must size it with   */
+/* xio_tcp_seglen.                                                     */
 int xio_tcp_prepDataPacket (struct tcb *tcb, char *addr, int sz, char *addr2, 
 			    int sz2, uint flags, uint sum)
 {
    int data_len = 0;
-   int window;
    int len1;
    int n = sz + sz2;
    int close = flags & TCP_SEND_ALSOCLOSE;
@@ -468,55 +684,20 @@ kprintf ("xio_tcp_senddata: tcb %p, addr %p, sz %d, addr2 %p, sz2 %d, flags %x,
 
    DPRINTF(2, ("xio_tcp_senddata %p: n %d una %u next %u snd_wnd %d\n", tcb, n, tcb->snd_una, tcb->snd_next, tcb->snd_wnd));
 
-   /* Compute first how much space is left in the window. */
-   window = xio_tcp_windowsz (tcb);
-
-   DPRINTF (4, ("xio_tcp_senddata: window %d, mss %d, close %d\n", window, tcb->mss, close));
-
-   /* GROK -- need to do something for case of window < mss */
-   /*         - answer may be to have a real mss and an effective mss */
-
-   /* GROK -- clean up this legacy if statement */
-   if ((window >= min(2,n)) && ((min(n,tcb->mss) <= window) || 
-				(!(flags & TCP_SEND_MAXSIZEONLY)) || 
-				((close) && (n < min(window,tcb->mss))))) {
-
-	/* Compute number of bytes on segment: never more than the window
-	 * allows us and never more than 1 MSS.
-	 */
-      data_len = min(n, window);
-      data_len = min(data_len, tcb->mss);
-	/* GROK -- is this needed for correct operation (see below)?? */
-      //data_len = (data_len == n) ? n : (data_len & ~(0x1));
-
-      assert (data_len > 0);
-
+   data_len = xio_tcp_seglen (tcb, n, flags);
+   if (data_len > 0) {
       len1 = min (data_len, sz);
 
       STINC(tcpstats, ndata);
       STINC_SIZE(tcpstats, snddata, log2(data_len));
 
-      /* quick and dirty -- can be prettier */
-	/* GROK -- will this function correctly if one of the lens is odd */
+	/* the second region starts at an odd offset within the segment */
+	/* if len1 is odd, in which case its partial sum is byte-swapped */
       if (sum == -1) {
-         sum = 0;
+         sum = inet_checksum ((uint16 *)tcb->snd_recv_r1_data, len1, 0, 0);
          if (data_len-len1) {
-            if (len1 & 0x1) {
-               u_char border[2];
-               sum = inet_checksum ((uint16 *)(&tcb->snd_recv_r2_data[1]), (data_len-len1-1), sum, 0);
-               border[0] = tcb->snd_recv_r1_data[len1-1];
-               border[1] = tcb->snd_recv_r2_data[0];
-               sum = inet_checksum ((uint16 *)(&border[0]), 2, sum, 0);
-            } else {
-               sum = inet_checksum ((uint16 *)tcb->snd_recv_r2_data, (data_len-len1), sum, 0);
-            }
-         }
-         if (len1) {
-            if ((len1 & 0x1) && (data_len - len1)) {
-               sum = inet_checksum((uint16 *)tcb->snd_recv_r1_data, (len1-1), sum, 0);
-            } else {
-               sum = inet_checksum((uint16 *)tcb->snd_recv_r1_data, len1, sum, 0);
-            }
+            uint sum2 = inet_checksum ((uint16 *)tcb->snd_recv_r2_data, (data_len-len1), 0, 0);
+            sum += (len1 & 0x1) ? inet_sum_swab (sum2) : sum2;
          }
       }
 
@@ -548,6 +729,10 @@ kprintf ("xio_tcp_senddata: tcb %p, addr %p, sz %d, addr2 %p, sz2 %d, flags %x,
       tcb->snd_max = SEQ_MAX(tcb->snd_next, tcb->snd_max);
       tcb->send_offset += data_len;
 
+      if ((tcb->flags & TCB_FL_RESEND) && (SEQ_GEQ(tcb->snd_next, tcb->snd_holeend))) {
+         xio_tcp_nexthole (tcb);
+      }
+
    } else if ((tcb->snd_wnd == 0) && (tcb->flags & TCB_FL_DOWINDPROBE)) {
       /* Send a window probe with one-byte data */
       STINC(tcpstats, nprobesnd);
@@ -710,6 +895,13 @@ static int write_timeout(struct tcb *tcb)
    }
 
    assert ((SEQ_GT(tcb->snd_max, tcb->snd_una)) || (tcb->snd_wnd == 0));
+
+   /* a timeout means the pipe has drained: restart from one segment */
+   if (SEQ_GT(tcb->snd_max, tcb->snd_una)) {
+      STINC(tcpstats, nrexmttimeout);
+      xio_tcp_cc_timeout (tcb);
+   }
+
    assert ((int)(tcb->snd_next - tcb->snd_una) <= tcb->send_offset);
    tcb->send_offset -= tcb->snd_next - tcb->snd_una;
    tcb->snd_next = tcb->snd_una;
@@ -800,30 +992,126 @@ int xio_tcp_timeout(struct tcb *tcb)
 /* ------------------------ packet handling functions ----------------------- */
 
 
+/*
+ * Record the SACK blocks of an incoming ack in the scoreboard, which is
+ * kept sorted and merged.  Blocks at or below snd_una are dropped, and so
+ * are new blocks that do not fit.
+ */
+static void process_sack(struct tcb *tcb, char *option, int len)
+{
+   int i, j;
+
+   STINC(tcpstats, nsackrcv);
+   for (; len >= 8; option += 8, len -= 8) {
+      uint32 start, end;
+      memcpy (&start, &option[0], sizeof(uint32));
+      memcpy (&end, &option[4], sizeof(uint32));
+      start = ntohl(start);
+      end = ntohl(end);
+      if ((SEQ_GEQ(start, end)) || (SEQ_LEQ(end, tcb->snd_una)) || (SEQ_GT(end, tcb->snd_max))) {
+         continue;
+      }
+      start = SEQ_MAX(start, tcb->snd_una);
+
+	/* find the insertion point, then absorb overlapping neighbours */
+      for (i = 0; (i < tcb->nsacks) && (SEQ_LT(tcb->sacks[i].end, start)); i++) ;
+      if ((i < tcb->nsacks) && (SEQ_LEQ(tcb->sacks[i].start, end))) {
+         if (SEQ_LT(start, tcb->sacks[i].start)) {
+            tcb->sacks[i].start = start;
+         }
+         tcb->sacks[i].end = SEQ_MAX(end, tcb->sacks[i].end);
+         while ((i+1 < tcb->nsacks) && (SEQ_LEQ(tcb->sacks[i+1].start, tcb->sacks[i].end))) {
+            tcb->sacks[i].end = SEQ_MAX(tcb->sacks[i].end, tcb->sacks[i+1].end);
+            for (j = i+1; j < tcb->nsacks-1; j++) {
+               tcb->sacks[j] = tcb->sacks[j+1];
+            }
+            tcb->nsacks--;
+         }
+      } else if (tcb->nsacks < TCP_SACK_MAX) {
+         for (j = tcb->nsacks; j > i; j--) {
+            tcb->sacks[j] = tcb->sacks[j-1];
+         }
+         tcb->sacks[i].start = start;
+         tcb->sacks[i].end = end;
+         tcb->nsacks++;
+      }
+   }
+}
+
+
+/* forget SACK blocks that snd_una has caught up with */
+static void prune_sacks(struct tcb *tcb)
+{
+   int i, n = 0;
+
+   for (i = 0; i < tcb->nsacks; i++) {
+      if (SEQ_GT(tcb->sacks[i].end, tcb->snd_una)) {
+         tcb->sacks[n].start = SEQ_MAX(tcb->sacks[i].start, tcb->snd_una);
+         tcb->sacks[n].end = tcb->sacks[i].end;
+         n++;
+      }
+   }
+   tcb->nsacks = n;
+}
+
+
 /* 
- * Deal with options. We check only for MSS option. Heh, processing
- * one option is better than processing no options.
- * If there are no options, TCP_MSS is used and process_options returns 0;
+ * Deal with options.  On SYNs we take the MSS, window scale and SACK-
+ * permitted options; afterwards only SACK blocks (if SACK was agreed on).
+ * Returns whether a SYN carried any option we understood, so that the
+ * SYN+ACK knows to carry options too.  If there are no options, TCP_MSS
+ * is used.
  */
-static int process_options(struct tcb *tcb, char *option)
+static int process_options(struct tcb *tcb, char *packet)
 {
+   struct tcp *tcp = (struct tcp *) &packet[XIO_EIT_TCP];
+   char *option = &packet[XIO_EIT_DATA];
+   int len = (((tcp->offset >> 4) & 0xF) << 2) - sizeof(struct tcp);
+   int syn = tcp->flags & TCP_FL_SYN;
+   int found = 0;
    uint16 mss;
 
    DPRINTF(2, ("process_options: options present %d\n", (int) option[0]));
-   if (option[0] == TCP_OPTION_MSS) {
-      switch(option[1]) {
-         case 4:			/* kind, length, and a 2-byte mss */
-            memcpy(&mss, &option[2], sizeof(short));
-            mss = ntohs(mss);
-            DPRINTF(2, ("proposed mss %d we %d\n", mss, DEFAULT_MSS));
-            tcb->mss = min(DEFAULT_MSS, mss);
-            return 1;
-         default:
-            DPRINTF(2, ("process_option: unrecognized length %d\n", option[1]));
-            return 0;
+   while (len > 0) {
+      int kind = (u_char) option[0];
+      int optlen;
+
+      if (kind == TCP_OPTION_EOL) {
+         break;
+      } else if (kind == TCP_OPTION_NOP) {
+         option++;
+         len--;
+         continue;
+      }
+      optlen = (len >= 2) ? (u_char) option[1] : 0;
+      if ((optlen < 2) || (optlen > len)) {
+         DPRINTF(2, ("process_option: bad length %d\n", optlen));
+         break;
       }
+
+      if ((syn) && (kind == TCP_OPTION_MSS) && (optlen == TCP_OPTION_MSS_LEN)) {
+         memcpy(&mss, &option[2], sizeof(short));
+         mss = ntohs(mss);
+         DPRINTF(2, ("proposed mss %d we %d\n", mss, DEFAULT_MSS));
+         tcb->mss = min(DEFAULT_MSS, mss);
+         found = 1;
+      } else if ((syn) && (kind == TCP_OPTION_WSCALE) && (optlen == TCP_OPTION_WSCALE_LEN)) {
+         tcb->flags |= TCB_FL_WSCALE;
+         tcb->snd_wscale = min((u_char) option[2], TCP_WSCALE_MAX);
+         tcb->rcv_wscale = TCP_WSCALE_DEFAULT;
+         found = 1;
+      } else if ((syn) && (kind == TCP_OPTION_SACKOK) && (optlen == TCP_OPTION_SACKOK_LEN)) {
+         tcb->flags |= TCB_FL_SACKOK;
+         found = 1;
+      } else if ((!syn) && (kind == TCP_OPTION_SACK) && (tcb->flags & TCB_FL_SACKOK)) {
+         process_sack(tcb, &option[2], (optlen - 2));
+      } else {
+         DPRINTF(2, ("process_option: unrecognized option %d (length %d)\n", kind, optlen));
+      }
+      option += optlen;
+      len -= optlen;
    }
-   return 0;
+   return found;
 }
 
 
@@ -831,12 +1119,12 @@ static void xio_tcp_prepSynRespPacket (struct tcb *tcb, char *packet)
 {
    struct tcp *tcp = (struct tcp *) &packet[XIO_EIT_TCP];
    int hlen = ((tcp->offset >> 4) & 0xF) << 2;
-   int mss_option = 0;
+   int syn_options = 0;
    if (hlen > sizeof(struct tcp)) { /* options? */
-      mss_option = process_options(tcb, &packet[XIO_EIT_DATA]);
+      syn_options = process_options(tcb, packet);
    }
    /* Send an syn + ack (the second step in the 3-way handshake). */
-   if (mss_option) {
+   if (syn_options) {
       /* Append options to reply. */
       xio_tcp_prepOptionsPacket (tcb, TCP_FL_SYN|TCP_FL_ACK, tcb->snd_iss, 0, 0, 0);
    } else {
@@ -891,6 +1179,9 @@ static int process_acceptable(struct tcb *tcb, char *packet)
       /* No, not acceptable: if not rst, send ack. */
 
       STINC(tcpstats, nunaccept);
+      if ((len > 0) && (SEQ_LEQ(tcp->seqno + len, tcb->rcv_next))) {
+         STINC(tcpstats, ndupseg);
+      }
 
 #if 0
       printf("process_acceptable %d: segment %x not accepted; expect %x (tcb->state %d)\n", len, tcp->seqno, tcb->rcv_next, tcb->state);
@@ -901,7 +1192,7 @@ static int process_acceptable(struct tcb *tcb, char *packet)
          if ((tcp->flags & TCP_FL_SYN) && (!(tcp->flags & TCP_FL_ACK)) && (tcp->seqno == tcb->rcv_irs)) {
             xio_tcp_prepSynRespPacket (tcb, packet);
          } else {
-            xio_tcp_preparePacket(tcb, TCP_FL_ACK, tcb->snd_next, 0, 0, 0);
+            xio_tcp_prepAckPacket(tcb);
          }
       }
       return 0;
@@ -954,20 +1245,97 @@ static int process_rst_syn_ack(struct tcb *tcb, char *packet)
 }
 
 
+/*
+ * A duplicate ack: the third one starts fast retransmit and recovery
+ * (RFC 6582), unless this window was already recovered or a FIN has
+ * gone out.  Further ones each mean a segment has left the network,
+ * which lets recovery send new data.
+ */
+static void process_dupack(struct tcb *tcb)
+{
+   STINC(tcpstats, ndupack);
+   tcb->dupacks++;
+
+   if (tcb->flags & TCB_FL_RECOVERY) {
+      tcb->cwnd += tcb->mss;
+   } else if ((tcb->dupacks == TCP_DUPACK_THRESH) && (tcb->snd_fin == 0) &&
+	      SEQ_GEQ(tcb->snd_una, tcb->snd_recover)) {
+      STINC(tcpstats, nfastrexmt);
+      xio_tcp_cc_loss (tcb);
+      tcb->snd_recover = tcb->snd_max;
+      tcb->flags |= TCB_FL_RECOVERY;
+      tcb->cwnd = tcb->ssthresh + (TCP_DUPACK_THRESH * tcb->mss);
+      xio_tcp_resendhole (tcb);
+   }
+}
+
+
+/*
+ * snd_una advanced by acked bytes.  Outside of recovery the window grows.
+ * In recovery, an ack covering everything outstanding at the loss ends it
+ * with cwnd deflated to ssthresh; a partial ack means the next hole was
+ * lost too and is resent at once.
+ */
+static void process_newack(struct tcb *tcb, uint32 acked)
+{
+   tcb->dupacks = 0;
+   if (tcb->nsacks) {
+      prune_sacks (tcb);
+   }
+
+   if (!(tcb->flags & TCB_FL_RECOVERY)) {
+      xio_tcp_cc_ack (tcb, acked);
+   } else if (SEQ_GEQ(tcb->snd_una, tcb->snd_recover)) {
+      tcb->flags &= ~(TCB_FL_RECOVERY|TCB_FL_RESEND);
+      xio_tcp_skipto (tcb, tcb->snd_max);
+      tcb->cwnd = min (tcb->ssthresh, (xio_tcp_unacked (tcb) + tcb->mss));
+   } else {
+      STINC(tcpstats, npartialack);
+      tcb->cwnd = ((tcb->cwnd > acked) ? (tcb->cwnd - acked) : 0) + tcb->mss;
+      if ((!(tcb->flags & TCB_FL_RESEND)) || (tcb->snd_next == tcb->snd_una)) {
+         xio_tcp_resendhole (tcb);
+      }
+   }
+
+   /* the ack may have carried snd_next past the hole being resent */
+   if ((tcb->flags & TCB_FL_RESEND) && (SEQ_GEQ(tcb->snd_next, tcb->snd_holeend))) {
+      xio_tcp_nexthole (tcb);
+   }
+}
+
+
 /* 
  * The last part of check 5 of RFC.
  */
 static void process_ack(struct tcb *tcb, char *packet)
 {
+   struct ip *ip = (struct ip *) &packet[XIO_EIT_IP];
    struct tcp *tcp = (struct tcp *) &packet[XIO_EIT_TCP];
+   int hlen = ((tcp->offset >> 4) & 0xF) << 2;
+   int len = ip->totallength - sizeof(struct ip) - hlen;
+   uint32 window = xio_tcp_segwnd (tcb, tcp);
+   uint32 acked;
 
    STINC(tcpstats, nack);
 
+   if (hlen > sizeof(struct tcp)) {
+      process_options(tcb, packet);
+   }
+
+   /* A duplicate ack (RFC 5681) carries no data and no window update and */
+   /* acks nothing new while data is outstanding.                         */
+   if ((tcp->flags & TCP_FL_ACK) && (tcp->ackno == tcb->snd_una) && (len == 0) &&
+       (!(tcp->flags & (TCP_FL_SYN|TCP_FL_FIN))) && (window == tcb->snd_wnd) &&
+       SEQ_GT(tcb->snd_max, tcb->snd_una)) {
+      process_dupack(tcb);
+   }
+
    /* If an acknowledgement and it is interesting, update una. */
    if ((tcp->flags & TCP_FL_ACK) && SEQ_GEQ(tcp->ackno, tcb->snd_una) && SEQ_LEQ(tcp->ackno, tcb->snd_max)) { 
 
       DPRINTF(2, ("process_ack %x ack %d: una %u next %u, max %u\n", (uint)tcb, tcp->ackno, tcb->snd_una, tcb->snd_next, tcb->snd_max));
 
+      acked = tcp->ackno - tcb->snd_una;
       tcb->snd_una = tcp->ackno;
 
       /* XXX shouldn't we only update rtt if this is an ack to the last
@@ -986,6 +1354,10 @@ static void process_ack(struct tcb *tcb, char *packet)
       assert (SEQ_LEQ(tcb->snd_una, tcb->snd_next));
       assert (SEQ_LEQ(tcb->snd_next, tcb->snd_max));
 
+      if (acked) {
+         process_newack(tcb, acked);
+      }
+
       /* Update time out event; we have received an interesting ack. */
 
       /* XXX -- fixme: this should compare against tcb->snd_next
@@ -1001,16 +1373,67 @@ static void process_ack(struct tcb *tcb, char *packet)
     /* If an acknowledgement and it is interesting, update snd_wnd. */
    if ((tcp->flags & TCP_FL_ACK) && (SEQ_LT(tcb->snd_wls, tcp->seqno) ||
        (tcb->snd_wls == tcp->seqno && SEQ_LT(tcb->snd_wla, tcp->ackno)) ||
-       (tcb->snd_wla == tcp->ackno && tcp->window > tcb->snd_wnd))) {
+       (tcb->snd_wla == tcp->ackno && window > tcb->snd_wnd))) {
 
-      DPRINTF(2, ("process_ack %x: old wnd %u wnd update %u\n", (uint)tcb, tcb->snd_wnd, tcp->window));
-      tcb->snd_wnd = tcp->window;
+      DPRINTF(2, ("process_ack %x: old wnd %u wnd update %u\n", (uint)tcb, tcb->snd_wnd, window));
+      tcb->snd_wnd = window;
       tcb->snd_wls = tcp->seqno;
       tcb->snd_wla = tcp->ackno;
    }
 }
 
 
+/*
+ * Queue an out-of-order segment, trimmed to the receive window.
+ */
+static void reass_insert(struct tcb *tcb, uint32 seqno, char *data, uint datalen)
+{
+   uint32 wndend = tcb->rcv_next + tcb->rcv_wnd;
+   int ret;
+
+   if (SEQ_GT(seqno + datalen, wndend)) {
+      if (SEQ_GEQ(seqno, wndend)) {
+         STINC(tcpstats, nooodropped);
+         return;
+      }
+      datalen = wndend - seqno;
+   }
+
+   ret = xio_tcpbuffer_insertdata (tcb->reasstbinfo, &tcb->reass, data, datalen,
+				   (seqno - tcb->rcv_irs - 1), XIO_TCP_REASS_MAXBUFS);
+   if (ret < 0) {
+      STINC(tcpstats, nooodropped);
+   } else if (ret == 0) {
+      STINC(tcpstats, noooduplicate);
+   } else {
+      STINC(tcpstats, noooqueued);
+   }
+   tcb->reass_last = seqno;
+}
+
+
+/*
+ * The segment just received may have closed the gap in front of queued
+ * data: hand whatever is now in order to the socket layer (on inready)
+ * and move rcv_next past it.  Returns the number of bytes moved.
+ */
+static int reass_pull(struct tcb *tcb, int flags)
+{
+   int point = xio_tcp_received_offset (tcb);
+   int len = xio_tcpbuffer_pullInOrder (tcb->reasstbinfo, &tcb->reass, &tcb->inready, point) - point;
+
+   if (len > 0) {
+      tcb->rcv_next += len;
+      tcb->inreadylen += len;
+      if (flags & TCP_RECV_ADJUSTRCVWND) {
+         tcb->rcv_wnd = max (0, (tcb->rcv_wnd - len));
+      }
+      STADD(tcpstats, nooobytes, len);
+   }
+   return (len);
+}
+
+
 /*
  * Process incoming data. fin records is a the last byte has been sent.
  * Process_data returns whether all data has been received
@@ -1019,11 +1442,12 @@ static int process_data(struct tcb *tcb, char *packet, int fin, int flags)
 {
    struct ip *ip = (struct ip *) &packet[XIO_EIT_IP];
    struct tcp *tcp = (struct tcp *) &packet[XIO_EIT_TCP];
-   char *data = &packet[XIO_EIT_DATA];
+   int hlen = ((tcp->offset >> 4) & 0xF) << 2;
+   char *data = &packet[XIO_EIT_TCP + hlen];
    uint datalen;
    int off;
    int all;
-   int hlen = ((tcp->offset >> 4) & 0xF) << 2;
+   int reassembled = 0;
 
    all = 0;
    datalen = ip->totallength - sizeof(struct ip) - hlen;
@@ -1057,6 +1481,9 @@ static int process_data(struct tcb *tcb, char *packet, int fin, int flags)
                tcb->rcv_wnd = max (0, (tcb->rcv_wnd-(datalen-off)));
             }
          }
+         if ((tcb->reass) && (!fin)) {
+            reassembled = reass_pull(tcb, flags);
+         }
 
 	/* Check for a fin */
          if (fin) {
@@ -1065,6 +1492,11 @@ static int process_data(struct tcb *tcb, char *packet, int fin, int flags)
             all = 1;
             STINC(tcpstats, nacksnd);
             xio_tcp_preparePacket(tcb, TCP_FL_ACK, tcb->snd_next, 0, 0, 0);
+         } else if ((reassembled) || (tcb->reass)) {
+	/* Segments that fill or leave a gap are acked at once (RFC 5681) */
+            STINC(tcpstats, nacksnd);
+            xio_tcp_prepAckPacket(tcb);
+            tcb->flags &= ~TCB_FL_DELACK;
          } else {
 	/* GROK - what about PSH flags?? */
 #ifdef USEDELACKS
@@ -1091,9 +1523,16 @@ static int process_data(struct tcb *tcb, char *packet, int fin, int flags)
          xio_tcp_preparePacket(tcb, TCP_FL_ACK, tcb->snd_next, 0, 0, 0);
       }
    } else if (SEQ_GT(tcp->seqno, tcb->rcv_next)) {
-	/* Segment contains data past rcv_next, keep it.  For now, drop it. */
+	/* Segment contains data past rcv_next: keep it in the reassembly */
+	/* queue, if we have one, and ack at once so that the sender sees */
+	/* a duplicate ack (with SACK blocks, if agreed on).              */
       STINC(tcpstats, noutorder);
       DPRINTF(2, ("process_data %p: segment seq %d is out of order n %d\n", tcb, tcp->seqno, tcb->rcv_next));
+      if ((datalen > 0) && (tcb->reasstbinfo)) {
+         reass_insert(tcb, tcp->seqno, data, datalen);
+      }
+      STINC(tcpstats, nacksnd);
+      xio_tcp_prepAckPacket(tcb);
    } else {
       kprintf ("tcb %p, state %d, tcpflags %x, seqno %d, rcv_next %d datalen %d\n", tcb, tcb->state, tcp->flags, tcp->seqno, tcb->rcv_next, datalen);
 	/* process_acceptable should have filtered this segment */
@@ -1120,7 +1559,6 @@ static void st_illegal(struct tcb *tcb, char *packet, int flags)
 static void st_syn_sent(struct tcb *tcb, char *packet, int flags)
 {
    struct tcp *tcp = (struct tcp *) &packet[XIO_EIT_TCP];
-   char *option = &packet[XIO_EIT_DATA];
    int hlen;
 
    DPRINTF(3, ("st_synsent\n"));
@@ -1170,8 +1608,13 @@ kprintf ("st_synsent: RST received -- dropping connection\n");
 
       hlen = ((tcp->offset >> 4) & 0xF) << 2;
       if (hlen > sizeof(struct tcp)) { /* options? */
-          process_options(tcb, option);
+          process_options(tcb, packet);
+      }
+      if (!(tcb->flags & TCB_FL_WSCALE)) {
+         tcb->snd_wscale = 0;	/* the peer did not agree to scaling */
+         tcb->rcv_wscale = 0;
       }
+      xio_tcp_cc_init (tcb);
 
       /* Complete handshake: send ack */
       STINC(tcpstats, nacksnd);
@@ -1215,10 +1658,11 @@ static void st_syn_received(struct tcb *tcb, char *packet, int flags)
       DPRINTF(2, ("st_syn_received: go to ESTABLISHED\n"));
       tcb->snd_una = tcp->ackno;
       xio_update_rtt (tcb, tcp->ackno);
-      tcb->snd_wnd = tcp->window;
+      tcb->snd_wnd = xio_tcp_segwnd (tcb, tcp);
       tcb->snd_wls = tcp->seqno;
       tcb->snd_wla = tcp->ackno;
       tcb->state = TCB_ST_ESTABLISHED;
+      xio_tcp_cc_init (tcb);
    } else {
       DPRINTF(2, ("st_syn_received: send RST\n"));
       kprintf ("st_syn_received: send RST\n");
@@ -1540,6 +1984,7 @@ void xio_tcp_handlePacket(struct tcb *tcb, char *packet, uint flags)
 
    tcb->inpackets++;
    tcb->indata = NULL;
+   tcb->inreadylen = 0;
 
    rcv_ip->totallength = ntohs(rcv_ip->totallength);
    tcp->ackno = ntohl(tcp->ackno);
@@ -1560,16 +2005,30 @@ DPRINTF (4, ("for comparison: snd_una %d, snd_wnd %d, snd_wls %d, snd_wla %d\n",
 
 #ifndef NO_HEADER_PREDICTION
     /* Header Prediction */
+	/* Segments with options, duplicate acks (a pure ack of nothing new) */
+	/* and anything during fast recovery or reassembly take the slow path. */
    if ((tcb->state == TCB_ST_ESTABLISHED) && (tcp->seqno == tcb->rcv_next) &&
-       (!(tcp->flags & (TCP_FL_FIN | TCP_FL_SYN | TCP_FL_RST | TCP_FL_URG)))) {
+       (!(tcp->flags & (TCP_FL_FIN | TCP_FL_SYN | TCP_FL_RST | TCP_FL_URG))) &&
+       ((tcp->offset >> 4) == (sizeof(struct tcp) >> 2)) &&
+       (!(tcb->flags & TCB_FL_RECOVERY)) && (tcb->reass == NULL) &&
+       ((rcv_ip->totallength > (sizeof(struct ip) + sizeof(struct tcp))) || SEQ_GT(tcp->ackno, tcb->snd_una))) {
       char *data = &packet[XIO_EIT_DATA];
       int datalen = rcv_ip->totallength - sizeof(struct ip) - sizeof(struct tcp);
+      uint32 window = xio_tcp_segwnd (tcb, tcp);
 
 	/* Test for expected ack */
       if (SEQ_GEQ(tcp->ackno, tcb->snd_una) && SEQ_LEQ(tcp->ackno, tcb->snd_next) && (tcb->snd_next == tcb->snd_max)) {
+         uint32 acked = tcp->ackno - tcb->snd_una;
          STINC(tcpstats, nackprd);
          tcb->snd_una = tcp->ackno;
 	 xio_update_rtt (tcb, tcp->ackno);
+         if (acked) {
+            tcb->dupacks = 0;
+            if (tcb->nsacks) {
+               prune_sacks (tcb);
+            }
+            xio_tcp_cc_ack (tcb, acked);
+         }
 
 	/* Update time out event; we have received an interesting ack */
          if (tcb->snd_una == tcb->snd_next) {
@@ -1581,8 +2040,8 @@ DPRINTF (4, ("for comparison: snd_una %d, snd_wnd %d, snd_wls %d, snd_wla %d\n",
 	/* If an acknowledgement and it is interesting, update snd_wnd. */
          if ((tcp->flags & TCP_FL_ACK) && (SEQ_LT(tcb->snd_wls, tcp->seqno) ||
              (tcb->snd_wls == tcp->seqno && SEQ_LT(tcb->snd_wla, tcp->ackno)) ||
-             (tcb->snd_wla == tcp->ackno && tcp->window > tcb->snd_wnd))) {
-            tcb->snd_wnd = tcp->window;
+             (tcb->snd_wla == tcp->ackno && window > tcb->snd_wnd))) {
+            tcb->snd_wnd = window;
             tcb->snd_wls = tcp->seqno;
             tcb->snd_wla = tcp->ackno;
          }
@@ -62,6 +62,7 @@ int xio_tcp_timeout (struct tcb *tcb);
 #define TCP_SEND_ALSOCLOSE	1
 #define TCP_SEND_MAXSIZEONLY	2
 
+int xio_tcp_seglen (struct tcb *tcb, int n, uint flags);
 int xio_tcp_prepDataPacket (struct tcb *tcb, char *buf, int len, char *buf2, int len2, uint flags, uint sum);
 void xio_tcp_prepCtlPacket (struct tcb *tcb);
 
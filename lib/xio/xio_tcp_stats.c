@@ -55,6 +55,8 @@ void xio_tcp_statprint (tcp_stat *stats)
    printf(" # unacceptable segments              %7d\n", stats->nunaccept);
    printf(" # acks received                      %7d\n", stats->nack);
    printf(" # acks predicted                     %7d\n", stats->nackprd);     
+   printf(" # duplicate acks received            %7d\n", stats->ndupack);
+   printf(" # acks with SACK blocks              %7d\n", stats->nsackrcv);
    printf(" # data predicted                     %7d\n", stats->ndataprd);
    printf(" # syns received                      %7d\n", stats->nsynrcv);
    printf(" # fins received                      %7d\n", stats->nfinrcv);     
@@ -64,6 +66,11 @@ void xio_tcp_statprint (tcp_stat *stats)
    printf(" # segments buffered                  %7d\n", stats->nbuf);
    printf(" # segments with data but no usr buf  %7d\n", stats->noutspace);
    printf(" # segments out of order              %7d\n", stats->noutorder);
+   printf(" #   queued for reassembly            %7d\n", stats->noooqueued);
+   printf(" #   already queued                   %7d\n", stats->noooduplicate);
+   printf(" #   dropped (queue full)             %7d\n", stats->nooodropped);
+   printf(" # bytes reassembled from the queue   %7d\n", stats->nooobytes);
+   printf(" # duplicate segments                 %7d\n", stats->ndupseg);
    printf(" # window probes received             %7d\n", stats->nprobercv);
    printf(" # segments with bad ip cksum         %7d\n", stats->nbadipcksum);
    printf(" # segments with bad tcp cksum        %7d\n", stats->nbadtcpcksum);
@@ -91,6 +98,9 @@ void xio_tcp_statprint (tcp_stat *stats)
    printf(" # window probes send                 %7d\n", stats->nprobesnd);
    printf(" # ether retransmissions              %7d\n", stats->nethretrans);
    printf(" # retransmissions                    %7d\n", stats->nretrans);
+   printf(" # fast retransmits                   %7d\n", stats->nfastrexmt);
+   printf(" # partial acks in fast recovery      %7d\n", stats->npartialack);
+   printf(" # retransmission timeouts            %7d\n", stats->nrexmttimeout);
    printf(" # segments dropped on send           %7d\n", stats->ndropsnd);
    r = 1;
    for (i = 0; i < NLOG2; i++) {
@@ -57,6 +57,11 @@ typedef struct {
     int         nbuf;           /* # segments buffered */
     int         noutspace;      /* # segments with data but no usr buffer */
     int         noutorder;      /* # segments out of order */
+    int         noooqueued;     /* # out of order segments queued */
+    int         noooduplicate;  /* # out of order segments already queued */
+    int         nooodropped;    /* # out of order segments not queued */
+    int         nooobytes;      /* # bytes made in order from the queue */
+    int         ndupseg;        /* # segments with only old data */
     int         nprobercv;      /* # window progbes */
     int         nprobesnd;      /* # window probes send */
     int         nseg;           /* # segments received */
@@ -78,6 +83,11 @@ typedef struct {
     int         nunaccept;      /* # unacceptable segments */
     int         nbadipcksum;    /* # segments with bad ip checksum */
     int         nbadtcpcksum;   /* # segments with bad tcp checksum */
+    int         ndupack;        /* # duplicate acks received */
+    int         nsackrcv;       /* # acks carrying SACK blocks */
+    int         nfastrexmt;     /* # fast retransmits */
+    int         npartialack;    /* # partial acks during fast recovery */
+    int         nrexmttimeout;  /* # retransmission timeouts with data out */
 #define NLOG2                   13      /* round up of 2 log MSS */
     int         rcvdata[NLOG2];
     int         snddata[NLOG2];
@@ -87,11 +97,13 @@ typedef struct {
 #ifndef NOSTATISTICS
 #define STINC(tcp_stat,field)		if (tcp_stat) {(tcp_stat)->field++;}
 #define STDEC(tcp_stat,field)		if (tcp_stat) {(tcp_stat)->field--;}
+#define STADD(tcp_stat,field,n)		if (tcp_stat) {(tcp_stat)->field += (n);}
 #define STINC_SIZE(tcp_stat,field,n)	if ((tcp_stat) && (n < NLOG2)) \
 					   {(tcp_stat)->field[n]++;}
 #else /* NOSTATISTICS */
 #define STINC(tcp_stat,field)
 #define STDEC(tcp_stat,field)
+#define STADD(tcp_stat,field,n)
 #define STINC_SIZE(tcp_stat,field,n)
 #endif
 
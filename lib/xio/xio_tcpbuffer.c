@@ -52,6 +52,8 @@
 #endif
 #endif
 
+#include <exos/netinet/cksum.h>
+
 #include "xio_tcpbuffer.h"
 
 
@@ -65,7 +67,36 @@ void xio_tcpbuffer_init (xio_tbinfo_t *tbinfo, char * (*pagealloc)(void *info, i
 }
 
 
-int xio_tcpbuffer_putdata (xio_tbinfo_t *tbinfo, xio_tcpbuf_t * *tblist, char *buffer, int len, int offset, int prunepoint)
+/* Copy len bytes to buf->data[index], either plainly or (if sum is set) */
+/* computing the checksums of the whole SUMBLK blocks being filled on the */
+/* way, for xio_tcpbuffer_sumdata to use later.                           */
+static void xio_tcpbuffer_copyin (xio_tcpbuf_t *buf, int index, char *src, int len, int sum)
+{
+   if (!sum) {
+      bcopy (src, &buf->data[index], len);
+      return;
+   }
+
+   while (len > 0) {
+      int blk = index / XIO_TCPBUFFER_SUMBLK;
+      int n;
+
+      if (((index % XIO_TCPBUFFER_SUMBLK) == 0) && (len >= XIO_TCPBUFFER_SUMBLK)) {
+         n = XIO_TCPBUFFER_SUMBLK;
+         buf->sums[blk] = inet_checksum_copy ((uint16 *) src, (uint16 *) &buf->data[index], n, 0, 0);
+         buf->sumvalid |= 1 << blk;
+      } else {
+         n = min (len, (XIO_TCPBUFFER_SUMBLK - (index % XIO_TCPBUFFER_SUMBLK)));
+         bcopy (src, &buf->data[index], n);
+      }
+      src += n;
+      index += n;
+      len -= n;
+   }
+}
+
+
+static int xio_tcpbuffer_put (xio_tbinfo_t *tbinfo, xio_tcpbuf_t * *tblist, char *buffer, int len, int offset, int prunepoint, int sum)
 {
    xio_tcpbuf_t *tmp = *tblist;
    int donelen = 0;
@@ -105,7 +136,7 @@ if (! ((len == 0) || (tmp == NULL) || ((tmp->start + tmp->offset + tmp->len) ==
    if ((tmp) && (tmp->maxlen > (tmp->offset + tmp->len))) {
       int tmplen = tmp->maxlen - tmp->offset - tmp->len;
       assert (offset == (tmp->start + tmp->offset + tmp->len));
-      bcopy (buffer, &tmp->data[(tmp->offset + tmp->len)], min(len, tmplen));
+      xio_tcpbuffer_copyin (tmp, (tmp->offset + tmp->len), buffer, min(len, tmplen), sum);
       tmp->len += min (len, tmplen);
       offset += min (len, tmplen);
       donelen += min (len, tmplen);
@@ -128,8 +159,9 @@ if (! ((len == 0) || (tmp == NULL) || ((tmp->start + tmp->offset + tmp->len) ==
       new->offset = 0;
       new->maxlen = XIO_TCPBUFFER_ALLOCSIZE - sizeof (xio_tcpbuf_t);
       new->data = (char *) new + sizeof (xio_tcpbuf_t);
+      new->sumvalid = 0;
       new->len = min (new->maxlen, len);
-      bcopy (&buffer[donelen], new->data, new->len);
+      xio_tcpbuffer_copyin (new, 0, &buffer[donelen], new->len, sum);
       offset += new->len;
       donelen += new->len;
       len -= new->len;
@@ -147,6 +179,51 @@ kprintf ("done: donelen %d\n", donelen);
 }
 
 
+int xio_tcpbuffer_putdata (xio_tbinfo_t *tbinfo, xio_tcpbuf_t * *tblist, char *buffer, int len, int offset, int prunepoint)
+{
+   return (xio_tcpbuffer_put (tbinfo, tblist, buffer, len, offset, prunepoint, 0));
+}
+
+
+/* putdata for data that will be sent: block checksums are computed as */
+/* the data is copied in.                                              */
+int xio_tcpbuffer_putdata_sum (xio_tbinfo_t *tbinfo, xio_tcpbuf_t * *tblist, char *buffer, int len, int offset, int prunepoint)
+{
+   return (xio_tcpbuffer_put (tbinfo, tblist, buffer, len, offset, prunepoint, 1));
+}
+
+
+/* Partial checksum of buf->data[index..index+len), using the block sums */
+/* kept by putdata_sum wherever whole blocks are covered.                */
+uint xio_tcpbuffer_sumdata (xio_tcpbuf_t *buf, int index, int len)
+{
+   uint sum = 0;
+   int done = 0;
+
+   while (len > 0) {
+      int blk = index / XIO_TCPBUFFER_SUMBLK;
+      uint tmpsum;
+      int n;
+
+      if (((index % XIO_TCPBUFFER_SUMBLK) == 0) && (len >= XIO_TCPBUFFER_SUMBLK) &&
+          (buf->sumvalid & (1 << blk))) {
+         n = XIO_TCPBUFFER_SUMBLK;
+         tmpsum = buf->sums[blk];
+      } else {
+         n = min (len, (XIO_TCPBUFFER_SUMBLK - (index % XIO_TCPBUFFER_SUMBLK)));
+         tmpsum = inet_checksum ((uint16 *) &buf->data[index], n, 0, 0);
+      }
+	/* pieces starting at an odd offset have their bytes swapped */
+      sum += (done & 0x1) ? inet_sum_swab (tmpsum) : tmpsum;
+      done += n;
+      index += n;
+      len -= n;
+   }
+
+   return (sum);
+}
+
+
 int xio_tcpbuffer_countBufferedData (xio_tbinfo_t *tbinfo, xio_tcpbuf_t * *tblist, int prunepoint)
 {
    int totallen = 0;
@@ -225,6 +302,138 @@ kprintf ("xio_tcpbuffer_getdata: len %d\n", len);
 }
 
 
+/* Reassembly queues are lists of disjoint intervals, sorted by offset.  */
+/* Each buffer holds data[offset..offset+len) for connection offsets     */
+/* start+offset onward, just like buffers on an inbuffer list, so that   */
+/* they can be moved onto one once the data is in order.                 */
+
+/* Store len bytes of data for connection offset offset in a reassembly */
+/* queue, skipping whatever the queue already holds.  No more than      */
+/* maxbufs buffers are used.  Returns the number of bytes that were new */
+/* or -1 if some of them had to be dropped for want of buffers.          */
+int xio_tcpbuffer_insertdata (xio_tbinfo_t *tbinfo, xio_tcpbuf_t **tblist, char *buffer, int len, int offset, int maxbufs)
+{
+   xio_tcpbuf_t **prevp = tblist;
+   xio_tcpbuf_t *prev = NULL;
+   xio_tcpbuf_t *tmp;
+   int base = offset;
+   int end = offset + len;
+   int newlen = 0;
+   int count = 0;
+
+   for (tmp = *tblist; tmp; tmp = tmp->next) {
+      count++;
+   }
+
+   while (offset < end) {
+      int gapend;
+      int n;
+
+	/* skip intervals that end before offset; stop if offset is covered */
+      while (((tmp = *prevp) != NULL) && ((tmp->start + tmp->offset + tmp->len) <= offset)) {
+         prev = tmp;
+         prevp = &tmp->next;
+      }
+      if ((tmp) && ((tmp->start + tmp->offset) <= offset)) {
+         offset = tmp->start + tmp->offset + tmp->len;
+         continue;
+      }
+
+	/* [offset, gapend) is missing: fill the previous buffer, if it */
+	/* ends right here and has room, else a new one.                */
+      gapend = (tmp) ? min (end, (tmp->start + tmp->offset)) : end;
+      if ((prev) && ((prev->start + prev->offset + prev->len) == offset) &&
+	  ((prev->offset + prev->len) < prev->maxlen)) {
+         n = min ((gapend - offset), (prev->maxlen - prev->offset - prev->len));
+         bcopy (&buffer[offset - base], &prev->data[(prev->offset + prev->len)], n);
+         prev->len += n;
+      } else {
+         xio_tcpbuf_t *new;
+         if (count >= maxbufs) {
+            return (-1);
+         }
+         if ((new = tbinfo->freelist) == NULL) {
+            new = (xio_tcpbuf_t *) tbinfo->pagealloc (tbinfo, XIO_TCPBUFFER_ALLOCSIZE);
+            tbinfo->bufcount++;
+         } else {
+            tbinfo->freelist = new->next;
+         }
+         assert (new != NULL);
+         tbinfo->writebufs++;
+         count++;
+         new->start = offset;
+         new->offset = 0;
+         new->maxlen = XIO_TCPBUFFER_ALLOCSIZE - sizeof (xio_tcpbuf_t);
+         new->data = (char *) new + sizeof (xio_tcpbuf_t);
+         new->sumvalid = 0;
+         n = min ((gapend - offset), new->maxlen);
+         new->len = n;
+         bcopy (&buffer[offset - base], new->data, n);
+         new->next = tmp;
+         *prevp = new;
+         prev = new;
+         prevp = &new->next;
+      }
+      offset += n;
+      newlen += n;
+   }
+
+   return (newlen);
+}
+
+
+/* Move the buffers at the head of a reassembly queue that continue the */
+/* in-order data ending at offset point to the tail of *ready, trimming */
+/* what is already there.  Returns the new end of the in-order data.    */
+int xio_tcpbuffer_pullInOrder (xio_tbinfo_t *tbinfo, xio_tcpbuf_t **tblist, xio_tcpbuf_t **ready, int point)
+{
+   xio_tcpbuf_t *tmp;
+
+   while ((ready) && (*ready)) {
+      ready = &(*ready)->next;
+   }
+
+   while (((tmp = *tblist) != NULL) && ((tmp->start + tmp->offset) <= point)) {
+      *tblist = tmp->next;
+      if ((tmp->start + tmp->offset + tmp->len) <= point) {
+         tmp->next = tbinfo->freelist;
+         tbinfo->freelist = tmp;
+         tbinfo->writebufs--;
+         continue;
+      }
+      tmp->len -= point - (tmp->start + tmp->offset);
+      tmp->offset = point - tmp->start;
+      point = tmp->start + tmp->offset + tmp->len;
+      tmp->next = NULL;
+      *ready = tmp;
+      ready = &tmp->next;
+   }
+
+   return (point);
+}
+
+
+/* Append the buffers on *bufs to tblist; they must continue its data. */
+void xio_tcpbuffer_appendBufs (xio_tbinfo_t *tbinfo, xio_tcpbuf_t **tblist, xio_tcpbuf_t **bufs)
+{
+   xio_tcpbuf_t *tmp = *tblist;
+
+   if (*bufs == NULL) {
+      return;
+   }
+   if (tmp == NULL) {
+      *tblist = *bufs;
+   } else {
+      while (tmp->next) {
+         tmp = tmp->next;
+      }
+      assert ((tmp->start + tmp->offset + tmp->len) == ((*bufs)->start + (*bufs)->offset));
+      tmp->next = *bufs;
+   }
+   *bufs = NULL;
+}
+
+
 /* stuff included to assist in movement of buffered data... */
 
 xio_tcpbuf_t * xio_tcpbuffer_yankBufPage (xio_tbinfo_t *tbinfo, xio_tcpbuf_t * *tblist)
@@ -48,9 +48,12 @@ typedef struct tcpbuffer {
    int offset;		/* current offset in buffer */
    int len;		/* remaining number of bytes in buffer */
    char *data;
+   u_int sumvalid;	/* bit i set if sums[i] holds the sum of block i */
+   u_int16_t sums[16];	/* checksums of XIO_TCPBUFFER_SUMBLK-byte blocks */
 } xio_tcpbuf_t;
 
 #define XIO_TCPBUFFER_ALLOCSIZE		4096
+#define XIO_TCPBUFFER_SUMBLK		(XIO_TCPBUFFER_ALLOCSIZE / 16)
 #define XIO_TCPBUFFER_DATAPERBUF	(XIO_TCPBUFFER_ALLOCSIZE - sizeof(struct tcpbuffer))
 
 	/* structure containing meta tcpbuffer state */
@@ -74,9 +77,15 @@ typedef struct {
 
 void xio_tcpbuffer_init (xio_tbinfo_t *tbinfo, char * (*page_alloc)(void *info, int len));
 int xio_tcpbuffer_putdata (xio_tbinfo_t *tbinfo, xio_tcpbuf_t **tblist, char *buffer, int len, int offset, int prunepoint);
+int xio_tcpbuffer_putdata_sum (xio_tbinfo_t *tbinfo, xio_tcpbuf_t **tblist, char *buffer, int len, int offset, int prunepoint);
+uint xio_tcpbuffer_sumdata (xio_tcpbuf_t *buf, int index, int len);
 int xio_tcpbuffer_countBufferedData (xio_tbinfo_t *tbinfo, xio_tcpbuf_t **tblist, int prunepoint);
 void xio_tcpbuffer_reclaimBuffers (xio_tbinfo_t *tbinfo, xio_tcpbuf_t **tblist);
 
+int xio_tcpbuffer_insertdata (xio_tbinfo_t *tbinfo, xio_tcpbuf_t **tblist, char *buffer, int len, int offset, int maxbufs);
+int xio_tcpbuffer_pullInOrder (xio_tbinfo_t *tbinfo, xio_tcpbuf_t **tblist, xio_tcpbuf_t **ready, int point);
+void xio_tcpbuffer_appendBufs (xio_tbinfo_t *tbinfo, xio_tcpbuf_t **tblist, xio_tcpbuf_t **bufs);
+
 //int xio_tcpbuffer_gotdata (xio_tbinfo_t *tbinfo, xio_tcpbuf_t **tblist, char *data, int len);
 int xio_tcpbuffer_getdata (xio_tbinfo_t *tbinfo, xio_tcpbuf_t **tblist, char *buffer, int len);
 
@@ -50,6 +50,7 @@
 
 #include "xio_tcpsocket.h"
 #include "xio_tcpcommon.h"
+#include <exos/netinet/cksum.h>
 
 #ifdef EXOPC
 #include <xok/mmu.h>	/* for NBPG */
@@ -97,6 +98,7 @@ void xio_tcpsocket_initsock (struct tcpsocket *sock, xio_tcpsock_info_t *info)
    sock->info = info;
    xio_tcp_inittcb (&sock->tcb);
    xio_tcp_setrcvwnd (&sock->tcb, sock->buf_max);
+   sock->tcb.reasstbinfo = &info->tbinfo;
 }
 
 
@@ -152,6 +154,8 @@ void xio_tcpsocket_freesock (struct tcpsocket *tcpsock)
 
    xio_tcpbuffer_reclaimBuffers (&info->tbinfo, &tcpsock->tcb.inbuffers);
    xio_tcpbuffer_reclaimBuffers (&info->tbinfo, &tcpsock->tcb.outbuffers);
+   xio_tcpbuffer_reclaimBuffers (&info->tbinfo, &tcpsock->tcb.reass);
+   xio_tcpbuffer_reclaimBuffers (&info->tbinfo, &tcpsock->tcb.inready);
 
    if (tcpsock->livenext) {
       tcpsock->livenext->liveprev = tcpsock->liveprev;
@@ -230,6 +234,7 @@ static struct tcb * xio_tcpsocket_gettcb (struct tcb *listentcb)
    newsock->next = listensock->next;
    listensock->next = newsock;
    xio_tcp_inittcb (&newsock->tcb);
+   newsock->tcb.reasstbinfo = &listensock->info->tbinfo;
 /*
 kprintf ("xio_tcpsocket_gettcb: listentcb %p, tcpsock %p\n", listentcb, newsock);
 */
@@ -270,17 +275,32 @@ static void xio_tcpsocket_senddata (struct tcpsocket *tcpsock)
    while (tmp) {
       int datamax;
       int ret;
+      int resending;
+      int seglen;
+      uint sum;
 
       while (((tmp->start + tmp->offset) <= tcb->send_offset) && ((tmp->start + tmp->offset + tmp->len) > tcb->send_offset)) {
          xio_tcpbuf_t *next = tmp->next;
          offset = tcb->send_offset - tmp->start - tmp->offset;
+         resending = xio_tcp_resending (tcb);
          if ((next == NULL) || ((next->start + next->offset) != (tmp->start + tmp->offset + tmp->len))) {
             datamax = tmp->len - offset;
             assert (next == NULL);
-            ret = xio_tcp_prepDataPacket (tcb, &tmp->data[offset], (tmp->len - offset), 0, 0, TCP_SEND_MAXSIZEONLY, -1);
+            seglen = xio_tcp_seglen (tcb, datamax, TCP_SEND_MAXSIZEONLY);
+            sum = xio_tcpbuffer_sumdata (tmp, offset, seglen);
+            ret = xio_tcp_prepDataPacket (tcb, &tmp->data[offset], (tmp->len - offset), 0, 0, TCP_SEND_MAXSIZEONLY, sum);
          } else {
             datamax = tmp->len + next->len - offset;
-            ret = xio_tcp_prepDataPacket (tcb, &tmp->data[offset], (tmp->len - offset), next->data, next->len, TCP_SEND_MAXSIZEONLY, -1);
+		/* sum from the block checksums cached when the data was */
+		/* written; the part in next is byte-swapped if it starts */
+		/* at an odd offset within the segment.                   */
+            seglen = xio_tcp_seglen (tcb, datamax, TCP_SEND_MAXSIZEONLY);
+            sum = xio_tcpbuffer_sumdata (tmp, offset, min (seglen, (tmp->len - offset)));
+            if (seglen > (tmp->len - offset)) {
+               uint sum2 = xio_tcpbuffer_sumdata (next, 0, (seglen - (tmp->len - offset)));
+               sum += ((tmp->len - offset) & 0x1) ? inet_sum_swab (sum2) : sum2;
+            }
+            ret = xio_tcp_prepDataPacket (tcb, &tmp->data[offset], (tmp->len - offset), next->data, next->len, TCP_SEND_MAXSIZEONLY, sum);
          }
 /*
 kprintf ("back from prepDataPacket: sendlen %d (%d) and ret %d\n", (tmp->len - offset), ((ret > (tmp->len - offset)) ? next->len : 0), ret);
@@ -288,7 +308,8 @@ kprintf ("back from prepDataPacket: sendlen %d (%d) and ret %d\n", (tmp->len - o
 		/* the comparison to mss provides higher performance by */
 		/* avoiding the sending of multiple small packets.      */
 /* GROK -- I'm concerned.  This is all a yucky mess and may now be bogus... */
-         if ((ret <= 0) || (ret < min (min (tcb->mss, tcb->snd_wnd), datamax))) {
+		/* (segments resending a hole are as long as the hole.) */
+         if ((ret <= 0) || ((!resending) && (ret < min (min (tcb->mss, tcb->snd_wnd), datamax)))) {
 if ((ret) && (tcb->send_ready)) {
    tcb->snd_next -= ret;	// back up to prepared point
    kprintf ("(%d) xio_tcpsocket_senddata INFO: tossing prepared packet (ret %d)\n", __envid, ret);
@@ -332,6 +353,14 @@ void xio_tcpsocket_handlePackets (xio_tcpsock_info_t *info)
             char *livedata = xio_tcp_getLiveInData (tcb);
             xio_tcpbuffer_putdata (&info->tbinfo, &tcb->inbuffers, livedata, livedatalen, xio_tcp_getLiveInDataStart(tcb), 0);
          }
+	 /* data released from the reassembly queue follows indata */
+         if (tcb->inready) {
+            if (((struct tcpsocket *)tcb)->sock_state & XIOSOCK_READABLE) {
+               xio_tcpbuffer_appendBufs (&info->tbinfo, &tcb->inbuffers, &tcb->inready);
+            } else {
+               xio_tcpbuffer_reclaimBuffers (&info->tbinfo, &tcb->inready);
+            }
+         }
 	 /* try to combine this with data/close sends below! */
          if (tcb->send_ready != TCP_FL_ACK) {
             xio_tcpcommon_sendPacket (tcb, 0);
@@ -783,7 +812,7 @@ kprintf ("xio_tcpsocket_write: writing %d bytes at offset %d (nonblocking %d, fl
          return (-1);
       }
       if (tmplen > 0) {
-         ret = xio_tcpbuffer_putdata (&sock->info->tbinfo, &sock->tcb.outbuffers, buffer, tmplen, sock->write_offset, xio_tcp_acked_offset(&sock->tcb));
+         ret = xio_tcpbuffer_putdata_sum (&sock->info->tbinfo, &sock->tcb.outbuffers, buffer, tmplen, sock->write_offset, xio_tcp_acked_offset(&sock->tcb));
          buffer += ret;
          retlen += ret;
          sock->write_offset += ret;
@@ -108,7 +108,7 @@ struct buf *bp;
   struct Env *e = 0;
 
 
-
+  TRACE(TR_DISKDONE, bp, 0);
   if (bp->b_flags & B_SCSICMD) {
     if (bp->b_resptr) {
       *(bp->b_resptr) -= 1;
@@ -79,21 +79,27 @@ extern ifnet_ret_t tulip_ifstart(struct ifnet *ifp);
 extern void tulip_media_print(tulip_softc_t * const sc);
 extern ifnet_ret_t tulip_ifstart(struct ifnet * const ifp);
 extern void tulip_init(tulip_softc_t * const sc);
+int tulip_intr(u_int irq);
 
 
 /*
- * tulip rx interrupt handler
+ * tulip rx interrupt handler: take up to budget frames off the receive
+ * ring and return how many there were. Accepted frames are handed to
+ * xok XOKPKT_BATCH at a time.
  */
-void
-tulip_rx_intr(tulip_softc_t * const sc)
+int
+tulip_rx_intr(tulip_softc_t * const sc, int budget)
 {
   tulip_ringinfo_t *const ri = &sc->tulip_rxinfo;
   struct ifnet *const ifp = &sc->tulip_if;
+  struct xokpkt *batch[XOKPKT_BATCH];
+  int nbatch = 0;
   int npkts = 0;
+  int nframes = 0;
 
   dprintf("tulip_rx_intr\n");
 
-  for (;;)
+  while (nframes < budget)
   {
     struct ether_header eh;
     tulip_desc_t *eop = ri->ri_nextin;
@@ -228,16 +234,64 @@ dequeue_retry:
           
 	q->freeArg = 0L;
         dprintf("handling pkt %p\n", q);
-	xokpkt_recv(q);
+	batch[nbatch++] = q;
+	if (nbatch == XOKPKT_BATCH)
+	{
+	  xokpkt_recv_batch(batch, nbatch);
+	  nbatch = 0;
+	}
       }
     }
 
     ifp->if_ipackets++;
+    nframes++;
     if (++eop == ri->ri_last)
       eop = ri->ri_first;
     ri->ri_nextin = eop;
   }
+  if (nbatch > 0)
+    xokpkt_recv_batch(batch, nbatch);
   ddprintf("tulip_rx_intr: got %d packets\n", npkts);
+  return nframes;
+}
+
+
+/*
+ * Polled receive. When an interrupt leaves frames on the ring we turn
+ * the receive interrupt off and xoknet_poll calls this from the clock
+ * tick and the idle loop until the ring is empty; then the interrupt
+ * goes back on. Anything that arrived in between is still latched in
+ * csr_status, so it interrupts as soon as it's unmasked.
+ */
+static int
+tulip_rx_poll(void *arg, int budget)
+{
+  tulip_softc_t * const sc = arg;
+  struct network *nw = sc->xoknet;
+  int n;
+
+  /* a reset turned the interrupt back on */
+  if ((sc->tulip_flags & TULIP_RXPOLL) == 0)
+    return 0;
+
+  /* tulip_intr has the card: try again next time */
+  if (test_and_set((unsigned long)&(nw->in_intr)) != 0)
+    return 1;
+
+  n = tulip_rx_intr(sc, budget);
+  nw->rxpolls++;
+  nw->rxpolled += n;
+  if (n < budget) {
+    sc->tulip_flags &= ~TULIP_RXPOLL;
+    sc->tulip_intrmask |= TULIP_STS_RXINTR;
+    TULIP_CSR_WRITE(sc, csr_intr, sc->tulip_intrmask);
+  }
+  nw->in_intr = 0;
+
+  /* an interrupt that came in while we had the card */
+  if (nw->intr_pending > 0)
+    tulip_intr(nw->irq);
+  return (sc->tulip_flags & TULIP_RXPOLL) != 0;
 }
 
 
@@ -298,7 +352,7 @@ tulip_tx_intr(tulip_softc_t * const sc)
 
 	if ((sc->tulip_flags & (TULIP_WANTSETUP | TULIP_TXPROBE_ACTIVE)) == 0)
 	{
-	  tulip_rx_intr(sc);
+	  tulip_rx_intr(sc, TULIP_RXDESCS);
 	  sc->tulip_cmdmode |= TULIP_CMD_RXRUN;
 	  sc->tulip_intrmask |= TULIP_STS_RXSTOPPED;
 
@@ -552,7 +606,25 @@ tulip_intr_handler (tulip_softc_t * const sc, int *progress_p, int realintr)
 	intr_charged = 1;
       }
 
-      tulip_rx_intr(sc);
+      if (sc->tulip_flags & TULIP_RXIGNORE)
+	tulip_rx_intr(sc, TULIP_RXDESCS);
+      else if ((sc->tulip_flags & TULIP_RXPOLL) == 0)
+      {
+	int n = tulip_rx_intr(sc, XOKNET_POLL_BUDGET);
+
+	sc->xoknet->rxintrpkts += n;
+	if (n == XOKNET_POLL_BUDGET)
+	{
+	  /*
+	   * Flooded: leave the rest to tulip_rx_poll.
+	   */
+	  sc->tulip_flags |= TULIP_RXPOLL;
+	  sc->tulip_intrmask &= ~TULIP_STS_RXINTR;
+	  TULIP_CSR_WRITE(sc, csr_intr, sc->tulip_intrmask);
+	  xoknet_poll_start(tulip_rx_poll, sc);
+	}
+      }
+
       if (sc->tulip_flags & TULIP_RXIGNORE)
       {
 	dprintf("restart receiver\n");
@@ -635,8 +707,10 @@ tulip_intr_handler (tulip_softc_t * const sc, int *progress_p, int realintr)
 
 /*
  * interrupt entry point for a specific irq: find the card that caused the
- * interrupt and call the interrupt handler. this is a level triggered
- * interrupt, it is masked by the kernel, so no need for synchronization.
+ * interrupt and call the interrupt handler. The irq being masked is not
+ * enough to keep us to ourselves, since tulip_rx_poll runs off the clock
+ * tick and idle loop on any cpu: whoever holds in_intr has the card, and
+ * runs the handler again for an interrupt that came in meanwhile.
  */
 int 
 tulip_intr (u_int irq)   
@@ -652,49 +726,27 @@ tulip_intr (u_int irq)
        
        if (xoknet->irq == irq) 
        {
-#ifdef __SMP__
-  	 extern int irq2trigger[];
-#endif
          intrmatched = 1;
-#ifdef __SMP__
-         if (irq2trigger[irq] != TRIGGER_LEVEL)
-	 {
-           test_and_set((unsigned long)&(xoknet->intr_pending));
-           while (xoknet->intr_pending > 0 &&
-               test_and_set((unsigned long)&(xoknet->in_intr)) == 0)
+         test_and_set((unsigned long)&(xoknet->intr_pending));
+         while (xoknet->intr_pending > 0 &&
+             test_and_set((unsigned long)&(xoknet->in_intr)) == 0)
+         {
+           while(xoknet->intr_pending > 0)
            {
-             while(xoknet->intr_pending > 0)
-             {
-#endif
-               xoknet->intrs++;
-               xoknet->intr_pending = 0;
+             xoknet->intrs++;
+             xoknet->intr_pending = 0;
   
-               ddprintf ("tulip_intr: irq %d cpu %d\n",irq,get_cpu_id());
+             ddprintf ("tulip_intr: irq %d cpu %d\n",irq,get_cpu_id());
   
-               if (xoknet->cardtype == XOKNET_DE)
-               {
-                 tulip_intr_handler(xoknet->cardstruct,
-                                    &progress,
-                                    (xoknet->irq == irq));
-               }
-#ifdef __SMP__
+             if (xoknet->cardtype == XOKNET_DE)
+             {
+               tulip_intr_handler(xoknet->cardstruct,
+                                  &progress,
+                                  (xoknet->irq == irq));
              }
-             xoknet->in_intr = 0;
            }
-	 } else {
-    
-	   ddprintf ("tulip_intr: irq %d cpu %d %qd\n",irq,get_cpu_id(),rdtsc());
-	 
-	   xoknet->intrs++;
-          
-	   if (xoknet->cardtype == XOKNET_DE) 
-	   {
-	     tulip_intr_handler(xoknet->cardstruct, 
-		                &progress, 
-			        (xoknet->irq == irq));
-	   }
-	 }
-#endif
+           xoknet->in_intr = 0;
+         }
        }
     }
 
@@ -114,7 +114,7 @@ static void tulip_ifmedia_status(struct ifnet * const ifp, struct ifmediareq *re
 #endif
 /* static void tulip_21140_map_media(tulip_softc_t *sc); */
 
-extern void tulip_rx_intr(tulip_softc_t * const sc);
+extern int tulip_rx_intr(tulip_softc_t * const sc, int budget);
 extern void tulip_return_buffer(struct xokpkt * pkt);
 extern int tulip_tx_intr(tulip_softc_t * const sc);
 extern void tulip_print_abnormal_interrupt(tulip_softc_t * const, u_int32_t);
@@ -3212,6 +3212,8 @@ tulip_reset(
     if (inreset)
 	return;
 
+    /* the receive interrupt is back on: see tulip_rx_poll */
+    sc->tulip_flags &= ~TULIP_RXPOLL;
     sc->tulip_intrmask |= TULIP_STS_NORMALINTR|TULIP_STS_RXINTR|TULIP_STS_TXINTR
 	|TULIP_STS_ABNRMLINTR|TULIP_STS_SYSERROR|TULIP_STS_TXSTOPPED
 	|TULIP_STS_TXUNDERFLOW|TULIP_STS_TXBABBLE|TULIP_STS_LINKFAIL
@@ -3271,7 +3273,7 @@ tulip_init(
 	}
 	sc->tulip_cmdmode |= TULIP_CMD_TXRUN;
 	if ((sc->tulip_flags & (TULIP_TXPROBE_ACTIVE|TULIP_WANTSETUP)) == 0) {
-	    tulip_rx_intr(sc);
+	    tulip_rx_intr(sc, TULIP_RXDESCS);
 	    sc->tulip_cmdmode |= TULIP_CMD_RXRUN;
 	    sc->tulip_intrmask |= TULIP_STS_RXSTOPPED;
 	} else {
@@ -3695,7 +3697,7 @@ tulip_ifwatchdog(
 	 * If the number of receive buffer is low, try to refill
 	 */
 	if (sc->tulip_flags & TULIP_RXBUFSLOW)
-	    tulip_rx_intr(sc);
+	    tulip_rx_intr(sc, TULIP_RXDESCS);
 
 	if (sc->tulip_flags & TULIP_SYSTEMERROR) {
 	    printf(TULIP_PRINTF_FMT ": %d system errors: last was %s\n",
@@ -653,7 +653,7 @@ struct _tulip_softc_t {
 #define	TULIP_INRESET		0x00000200
 #define	TULIP_NEEDRESET		0x00000400
 #define	TULIP_SQETEST		0x00000800
-#define	TULIP_xxxxxx0		0x00001000
+#define	TULIP_RXPOLL		0x00001000	/* rx intr off, see tulip_rx_poll */
 #define	TULIP_xxxxxx1		0x00002000
 #define	TULIP_WANTTXSTART	0x00004000
 #define	TULIP_NEWTXTHRESH	0x00008000
@@ -127,8 +127,12 @@ struct ed_softc {
         u_char  rec_page_start; /* first page of RX ring-buffer */
         u_char  rec_page_stop;  /* last page of RX ring-buffer */
         u_char  next_packet;    /* pointer to next unread RX packet */
+        u_char  rxpoll;         /* PRXE is off, see ed_rx_poll */
 };
 
+/* interrupts we run with; PRXE is off while the receiver is polled */
+#define ED_IMR_ON (ED_IMR_PRXE | ED_IMR_PTXE | ED_IMR_RXEE | ED_IMR_TXEE | \
+		   ED_IMR_OVWE)
 
 static void ed_start		__P((struct ed_softc *));
 void edintr			__P((int unit));
@@ -275,7 +279,7 @@ static void	ds_getmcaf	__P((struct ed_softc *, u_long *));
 
 static void	ed_get_packet	__P((struct ed_softc *, char *, u_short, int));
 
-static void	ed_rint		__P((struct ed_softc *));
+static int	ed_rint		__P((struct ed_softc *, int));
 static void	ed_xmit		__P((struct ed_softc *));
 static char *	ed_ring_copy	__P((struct ed_softc *, char *, char *,
 				  /* u_short */ int));
@@ -2089,6 +2093,9 @@ ed_init(xsc)
 	 */
 	outb(sc->nic_addr + ED_P0_ISR, 0xff);
 
+#if defined(EXOPC)
+	sc->rxpoll = 0;
+#endif
 	/*
 	 * Enable the following interrupts: receive/transmit complete,
 	 * receive/transmit error, and Receiver OverWrite.
@@ -2435,11 +2442,14 @@ outloop:
 #endif /* defined(EXOPC) */
 
 /*
- * Ethernet interface receiver interrupt.
+ * Ethernet interface receiver interrupt. Takes up to budget packets out
+ * of the ring (all of them if budget is negative) and returns how many
+ * there were.
  */
-static inline void
-ed_rint(sc)
+static inline int
+ed_rint(sc, budget)
 	struct ed_softc *sc;
+	int budget;
 {
 #if !defined(EXOPC)
 	struct ifnet *ifp = &sc->arpcom.ac_if;
@@ -2448,9 +2458,10 @@ ed_rint(sc)
 	u_short len;
 	struct ed_ring packet_hdr;
 	char   *packet_ptr;
+	int	n = 0;
 
 	if (sc->gone)
-		return;
+		return 0;
 
 	/*
 	 * Set NIC to page 1 registers to get 'current' pointer
@@ -2465,7 +2476,7 @@ ed_rint(sc)
 	 * here until the logical beginning equals the logical end (or in
 	 * other words, until the ring-buffer is empty).
 	 */
-	while (sc->next_packet != inb(sc->nic_addr + ED_P1_CURR)) {
+	while (n != budget && sc->next_packet != inb(sc->nic_addr + ED_P1_CURR)) {
 
 		/* get pointer to this buffer's header structure */
 		packet_ptr = sc->mem_ring +
@@ -2541,8 +2552,9 @@ ed_rint(sc)
 			ed_reset(ifp);
 #endif
 
-			return;
+			return n;
 		}
+		n++;
 
 		/*
 		 * Update next packet pointer
@@ -2570,8 +2582,48 @@ ed_rint(sc)
 		 */
 		outb(sc->nic_addr + ED_P0_CR, sc->cr_proto | ED_CR_PAGE_1 | ED_CR_STA);
 	}
+	return n;
 }
 
+#if defined(EXOPC)
+/*
+ * Polled receive. Once an interrupt finds the ring flooded, PRXE stays
+ * off and xoknet_poll calls us from the clock tick and the idle loop
+ * until the ring is empty. A packet that arrives before PRXE goes back
+ * on is still latched in the ISR, so it interrupts right away.
+ */
+static int
+ed_rx_poll(void *arg, int budget)
+{
+	struct ed_softc *sc = arg;
+	struct network *nw = sc->xoknet;
+	int n;
+
+	/* ed_init turned the interrupt back on */
+	if (!sc->rxpoll || sc->gone)
+		return 0;
+
+	/* edintr has the card: try again next time */
+	if (test_and_set((unsigned long)&(nw->in_intr)) != 0)
+		return 1;
+
+	n = ed_rint(sc, budget);
+	nw->rxpolls++;
+	nw->rxpolled += n;
+	outb(sc->nic_addr + ED_P0_CR, sc->cr_proto | ED_CR_STA);
+	if (n < budget) {
+		sc->rxpoll = 0;
+		outb(sc->nic_addr + ED_P0_IMR, ED_IMR_ON);
+	}
+	nw->in_intr = 0;
+
+	/* an interrupt that came in while we had the card */
+	if (nw->intr_pending > 0)
+		edintr(nw->irq);
+	return sc->rxpoll;
+}
+#endif
+
 /*
  * Ethernet interface interrupt processor, returns 1 if a real device interrupt
  * occured. 0 otherwise.
@@ -2805,8 +2857,26 @@ edintr_sc(sc)
 #if defined(EXOPC)
 				/* record the fact we received a packet */
 				sc->xoknet->rcvs++;
+				if (!sc->rxpoll) {
+					int n = ed_rint(sc, XOKNET_POLL_BUDGET);
+
+					sc->xoknet->rxintrpkts += n;
+					if (n == XOKNET_POLL_BUDGET) {
+						/*
+						 * Flooded: leave the rest to
+						 * ed_rx_poll.
+						 */
+						sc->rxpoll = 1;
+						outb(sc->nic_addr + ED_P0_CR,
+						     sc->cr_proto | ED_CR_STA);
+						outb(sc->nic_addr + ED_P0_IMR,
+						     ED_IMR_ON & ~ED_IMR_PRXE);
+						xoknet_poll_start(ed_rx_poll, sc);
+					}
+				}
+#else
+				ed_rint(sc, -1);
 #endif
-				ed_rint(sc);
 #if !defined(EXOPC)
 				/* disable 16bit access */
 				if (sc->isa16bit &&
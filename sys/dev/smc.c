@@ -82,7 +82,11 @@ const int ed_wd790_irq[] = { IRQUNK, 9, 3, 5, 7, 10, 11, 15 };
 
 void edintr (u_int);
 void ed_start (struct smc_softc *);
-void ed_rint (struct smc_softc *);
+int ed_rint (struct smc_softc *, int);
+
+/* interrupts we run with; PRXE is off while the receiver is polled */
+#define ED_IMR_ON (ED_IMR_PRXE | ED_IMR_PTXE | ED_IMR_RXEE | ED_IMR_TXEE | \
+		   ED_IMR_OVWE)
 
 #define	NIC_PUT(sc, off, val)	outb(sc->nic_addr + off, val)
 #define	NIC_GET(sc, off)	inb(sc->nic_addr + off)
@@ -414,6 +418,7 @@ ed_setup (struct smc_softc *sc)
   sc->xmits = 0;
   sc->rcvs = 0;
   sc->discards = 0;
+  sc->rxpoll = 0;
 
   /* Set interface for page 0, remote DMA complete, stopped. */
   NIC_PUT(sc, ED_P0_CR, sc->cr_proto | ED_CR_PAGE_0 | ED_CR_STP);
@@ -460,9 +465,7 @@ ed_setup (struct smc_softc *sc)
    *
    * Counter overflow and Remote DMA complete are *not* enabled.
    */
-  NIC_PUT(sc, ED_P0_IMR,
-	  ED_IMR_PRXE | ED_IMR_PTXE | ED_IMR_RXEE | ED_IMR_TXEE |
-	  ED_IMR_OVWE);
+  NIC_PUT(sc, ED_P0_IMR, ED_IMR_ON);
 
   /* Program command register for page 1. */
   NIC_PUT(sc, ED_P0_CR, sc->cr_proto | ED_CR_PAGE_1 | ED_CR_STP);
@@ -646,14 +649,19 @@ ed_read (struct smc_softc *sc, struct ed_ring *pkt_hdr, u_char *pkt, int len)
 }
 
 
-void
-ed_rint (struct smc_softc *sc)
+/*
+ * Take up to budget packets out of the receive ring and return how many
+ * there were.
+ */
+int
+ed_rint (struct smc_softc *sc, int budget)
 {
   u_char boundary, current;
   u_short len;
   u_char nlen;
   struct ed_ring packet_hdr;
   char *packet_ptr;
+  int n = 0;
 
 loop:
   /* Set NIC to page 1 registers to get 'current' pointer. */
@@ -668,8 +676,8 @@ loop:
    * words, until the ring-buffer is empty).
    */
   current = NIC_GET(sc, ED_P1_CURR);
-  if (sc->next_packet == current)
-    return;
+  if (sc->next_packet == current || n == budget)
+    return (n);
 
   /* Set NIC to page 0 registers to update boundary register. */
   NIC_PUT(sc, ED_P1_CR, sc->cr_proto | ED_CR_PAGE_0 | ED_CR_STA);
@@ -740,8 +748,9 @@ loop:
       printf ("ed_rint: NIC corrupt (%d bytes)!\n", (int) len);
       ed_halt (sc);
       ed_setup (sc);
-      return;
+      return (n);
     }
+    n++;
 
     /* Update next packet pointer. */
     sc->next_packet = packet_hdr.next_packet;
@@ -754,11 +763,39 @@ loop:
     if (boundary < sc->rec_page_start)
       boundary = sc->rec_page_stop - 1;
     NIC_PUT(sc, ED_P0_BNRY, boundary);
-  } while (sc->next_packet != current);
+  } while (sc->next_packet != current && n < budget);
 
   goto loop;
 }
 
+/*
+ * Polled receive.  Once an interrupt finds the ring flooded, PRXE stays
+ * off and xoknet_poll calls us from the clock tick and the idle loop
+ * until the ring is empty.  A packet that arrives before PRXE goes back
+ * on is still latched in the ISR, so it interrupts right away.
+ */
+static int
+ed_rx_poll (void *arg, int budget)
+{
+  struct smc_softc *sc = arg;
+  int n;
+
+  /* ed_setup turned the interrupt back on */
+  if (!sc->rxpoll)
+    return (0);
+
+  n = ed_rint (sc, budget);
+  sc->rxpolls++;
+  sc->rxpolled += n;
+  NIC_PUT(sc, ED_P0_CR, sc->cr_proto | ED_CR_PAGE_0 | ED_CR_STA);
+  if (n == budget)
+    return (1);
+
+  sc->rxpoll = 0;
+  NIC_PUT(sc, ED_P0_IMR, ED_IMR_ON);
+  return (0);
+}
+
 /* Ethernet interface interrupt processor. */
 void
 edintr(u_int irq)
@@ -917,7 +954,18 @@ edintr(u_int irq)
 	}
 #endif
 
-	ed_rint(sc);
+	if (!sc->rxpoll) {
+	  int n = ed_rint (sc, XOKNET_POLL_BUDGET);
+
+	  sc->rxintrpkts += n;
+	  if (n == XOKNET_POLL_BUDGET) {
+	    /* Flooded: leave the rest to ed_rx_poll. */
+	    sc->rxpoll = 1;
+	    NIC_PUT(sc, ED_P0_CR, sc->cr_proto | ED_CR_PAGE_0 | ED_CR_STA);
+	    NIC_PUT(sc, ED_P0_IMR, ED_IMR_ON & ~ED_IMR_PRXE);
+	    xoknet_poll_start (ed_rx_poll, sc);
+	  }
+	}
 
 #if 0
 	/* Disable 16-bit access. */
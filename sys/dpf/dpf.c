@@ -767,169 +767,3 @@ SYSCALL int dpf_insert_old(void *p, int sz) {
 
 void dpf_verbose(int v) 
 	{ verbose = v; }
-
-#include <xok/sysinfo.h>
-#include <xok/pkt.h>
-
-struct pkthold {
-	struct xokpkt *p;
-	struct pkthold *n;
-};
-
-#if 0
-struct msghold {
-	int m;
-	struct pkthold *pktlist;
-	struct msghold *n;
-};
-#endif
-
-struct msghold *msglist = NULL;
-
-/* need cleanup func that removes:
-   frags from pktring (hhmmm, can't do)
-   msghold lists that are too old
-   state entries that are too old
-*/
-
-void msgclean(void) {
-	struct msghold *cur, *last;
-	struct pkthold *tmp;
-	unsigned long long t;
-	int r;
-
-	t = SYSINFO_GET(si_system_ticks);
-	r = SYSINFO_GET(si_rate);
-
-	cur = last = msglist;
-	while(cur != NULL) {
-		if(cur->time < (t - (10000000 / r))) {
-printf("freeing %d\n",msglist->m);
-			while(cur->pktlist != NULL) {
-				tmp = cur->pktlist;
-				cur->pktlist = cur->pktlist->n;
-				free(tmp);
-			}
-			if(cur == msglist)
-				msglist = cur->n;
-			else
-				last->n = cur->n;
-			free(cur);
-		}
-		last = cur;
-		cur = cur->n;
-	}
-}
-
-void defilter(int msg, struct xokpkt *pkt) {
-	struct msghold *cur;
-	struct pkthold *tmp;
-//struct eiu *eiu = (struct eiu *)pkt->data;
-
-	cur = msglist;
-	while(cur != NULL) {
-		if(cur->m == msg) {
-			cur->time = SYSINFO_GET(si_system_ticks);
-
-//printf("adding pkt for %d\n", msg);
-			tmp = (struct pkthold *)malloc(sizeof(struct pkthold));
-			tmp->p = pkt;
-			tmp->n = cur->pktlist;
-			cur->pktlist = tmp;
-			return;
-		}
-		cur = cur->n;
-	}
-//printf("adding pktlist for %d\n", msg);
-//printf("adding pktlist for id %d offset %d length %d\n", eiu->ip.identification, (ntohs(eiu->ip.fragoffset) & IP_FRAGOFF) * 8, ntohs(eiu->ip.totallength));
-	cur = (struct msghold *)malloc(sizeof(struct msghold));
-	cur->m = msg;
-	cur->time = SYSINFO_GET(si_system_ticks);
-	cur->pktlist = (struct pkthold *)malloc(sizeof(struct pkthold));
-	cur->pktlist->p = pkt;
-	cur->pktlist->n = NULL;
-	cur->n = msglist;
-	msglist = cur;
-}
-
-void refilter(struct msghold *cur, struct msghold *last) {
-	struct pkthold *tmp;
-	struct xokpkt *pkt;
-	int filterid;
-	int ringid;
-	struct frag_return result;
-
-	while(cur->pktlist != NULL) {
-	  pkt = cur->pktlist->p;
-
-	  filterid = dpf_iptr (pkt->data, pkt->len, &result);
-
-	  if (filterid <= 0) {
-	    /* nobody wants this packet */
-	    if (pkt->discardcntP) {
-	      (*pkt->discardcntP)++;
-	    }
-	  } else if ((ringid = dpf_fid_getringval(filterid)) > 0) {
-	    /* somebody with a valid ring buffer wants this packet */
-	    pktring_handlepkt (ringid, (struct ae_recv *) &pkt->count);
-	  }
-	  tmp = cur->pktlist;
-	  cur->pktlist = cur->pktlist->n;
-	  free(tmp);
-	}
-	if(cur == msglist)
-	  msglist = cur->n;
-	else
-	  last->n = cur->n;
-	free(cur);
-}
-
-void refilterold(int msg) {
-	struct msghold *cur, *last;
-	struct pkthold *tmp;
-	struct xokpkt *pkt;
-
-	cur = msglist;
-	last = msglist;
-	while(cur != NULL) {
-	  if(cur->m == msg) {
-            while(cur->pktlist != NULL) { 
-	      pkt = cur->pktlist->p; 
-	      {   
-		int filterid;
-		int ringid;
-		struct frag_return result;
-  
-		filterid = dpf_iptr (pkt->data, pkt->len, &result);
-  
-		if (filterid <= 0) {
-		  printf("dumped on refilter\n");
-		  /* nobody wants this packet */
-		  if (pkt->discardcntP)
-		    (*pkt->discardcntP)++;
-		} 
-		
-		else if ((ringid = dpf_fid_getringval(filterid)) > 0) 
-		{
-		  /* somebody with a valid ring buffer wants this packet */
-		  pktring_handlepkt (ringid, (struct ae_recv *) &pkt->count);
-		} 
-		
-		else printf("no ash support\n"); 
-	      }
-	      tmp = cur->pktlist;
-	      cur->pktlist = cur->pktlist->n;
-	      free(tmp);
-	    }
-	    if(cur == msglist)
-	      msglist = cur->n;
-	    else 
-	      last->n = cur->n;
-	    free(cur);
-	    return;
-	  }
-	  last = cur;
-	  cur = cur->n;
-	}
-	//printf("refiltering fail for %d\n", msg);
-}
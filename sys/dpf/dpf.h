@@ -72,6 +72,13 @@ void dpf_begin(struct dpf_ir *ir);
 /* Called to classify a packet. */
 int (*dpf_iptr)(uint8 *msg, unsigned nbytes, struct frag_return *retmsg);
 
+/* 
+ * Classify a burst of n packets: fids[i] and retmsgs[i] are what 
+ * dpf_iptr would give for msgs[i]. 
+ */
+void dpf_classify_batch(uint8 **msgs, unsigned *nbytes, int n, int *fids, 
+			struct frag_return *retmsgs);
+
 /* 
  *  Filter creation routines.  nbits corresponds to 8, 16, 32 depending on
  * the operation.  msg[byte_offset:nbits] means to load nbits of the message
@@ -810,6 +810,45 @@ int (*dpf_compile (Atom trie)) ()
   return dpf_interp;
 }
 
+/* how many packets ahead dpf_classify_batch pulls in headers */
+#define DPF_PREFETCH	2
+
+/* start the cache lines holding the link, ip and transport headers */
+static inline void
+dpf_prefetch (uint8 * msg, unsigned nbytes)
+{
+  (void) *(volatile uint8 *) msg;
+  if (nbytes > 32)
+    (void) *(volatile uint8 *) (msg + 32);
+}
+
+/*
+ * Classify a burst of packets.  The walks run back to back on one or
+ * stack, so the atoms the packets share stay in the cache from one to
+ * the next, and the headers of the packets DPF_PREFETCH ahead are
+ * touched while the current one is in the trie.
+ */
+void
+dpf_classify_batch (uint8 ** msgs, unsigned *nbytes, int n, int *fids,
+		    struct frag_return *retmsgs)
+{
+  Atom orstack[256];
+  int i;
+
+  for (i = 0; i < n && i < DPF_PREFETCH; i++)
+    dpf_prefetch (msgs[i], nbytes[i]);
+
+  orstack[0] = &done_atom;
+  for (i = 0; i < n; i++)
+    {
+      if (i + DPF_PREFETCH < n)
+	dpf_prefetch (msgs[i + DPF_PREFETCH], nbytes[i + DPF_PREFETCH]);
+      retmsgs[i].headtail = 0;
+      fids[i] = fast_interp (msgs[i], nbytes[i], dpf_base->kids.lh_first, 0,
+			     orstack + 1, &retmsgs[i]);
+    }
+}
+
 /*
  * Compute what special-case optimizations we can do.  Currently
  * optimize for:
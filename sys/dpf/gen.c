@@ -43,7 +43,7 @@
 	   a collision.
 	2. Need support for incremental linkage (vcode mod).
 	3. Simplicity has been emphasized, at the cost of a few extra loads.
-		Could eliminate them.
+		The vcode optimizer (v_setopt) now eliminates most of them.
 	4. Need to cleanup the vcode perl script so that it will work 
 	on systems with fragile perls. 
 
@@ -171,9 +171,16 @@ static void gen_lookup(v_label_t out) {
 	 for(hte = ht[val & (ht->htsz - 1)]; hte != 0; hte = hte->or)
 		if(hte->val == val)
 			goto hte->label;
+ *
+ * If there are no collisions each bucket holds at most one entry, so 
+ * we index a jump table emitted in the code itself and let the entry
+ * check the value.  Returns the table (its slots are filled in by 
+ * compile_hte) or 0 if we generated the loop.
  */
-static void compile_ht(Ht ht, v_label_t l) {
-	v_label_t loop, elsel;
+static void **compile_ht(Ht ht, v_label_t l) {
+	v_label_t loop, elsel, table;
+	void **tab;
+	int i;
 
 	/* Allocate hash table registers (should allocate statically). */
 	if(!v_getreg(&hte_r, V_P, V_TEMP) 
@@ -181,6 +188,29 @@ static void compile_ht(Ht ht, v_label_t l) {
 	|| !v_getreg(&label_r, V_P, V_TEMP))
 		fatal(Out of registers);
 
+	/* 
+	 * goto tab[val & (ht->htsz - 1)];
+	 */
+	if(!ht->coll) {
+		table = v_genlabel();
+		v_andui(val_r, src_r, (ht->htsz-1)); 	  /* compute hash function */
+		v_lshui(val_r, val_r, log2(sizeof tab[0]));  /* compute index */
+		v_setlabel(hte_r, table);		  /* load table address */
+		v_ldp(label_r, val_r, hte_r); 		  /* load label */
+		v_jp(label_r);
+
+		/* Empty buckets fail. */
+		tab = (void **)v_dalloc(table, ht->htsz * sizeof tab[0]);
+		for(i = 0; i < ht->htsz; i++)
+			if(!ht->ht[i])
+				v_dlabel(&tab[i], l);
+
+		v_putreg(hte_r, V_P);
+		v_putreg(val_r, V_U);
+		v_putreg(label_r, V_P);
+		return tab;
+	}
+
 	/* 
 	 * hte = ht[val & (ht->htsz - 1)]; 
 	 */
@@ -199,25 +229,19 @@ static void compile_ht(Ht ht, v_label_t l) {
 	 * 	3. ht w/o collisions and all terminals.
 	 * 	4. ht w/o collisions and one or more non-terminals.
  	 * 
-	 * We just do two right now (collisions and no collisions). 
-	 * Could, I suppose, unroll the collision loop to the length 
-	 * of the longest chain.
+	 * We just do two right now (collisions, and the jump table
+	 * above for no collisions). Could, I suppose, unroll the 
+	 * collision loop to the length of the longest chain.
 	 */
-	
-	/* elide loop if there are no collisions. */
-	if(!ht->coll) {
-		gen_lookup(l);
-	} else {
-		loop = v_genlabel(); elsel = v_genlabel();
+	loop = v_genlabel(); elsel = v_genlabel();
 
+	gen_lookup(elsel);
+	v_label(loop);
 		gen_lookup(elsel);
-		v_label(loop);
-			gen_lookup(elsel);
 
-		v_label(elsel);
-			v_ldpi(hte_r, hte_r, offsetof(struct atom, or));
-			v_bnepi(hte_r, 0, loop); 	/* hte == 0, goto loop */
-	}
+	v_label(elsel);
+		v_ldpi(hte_r, hte_r, offsetof(struct atom, or));
+		v_bnepi(hte_r, 0, loop); 	/* hte == 0, goto loop */
 
 	/* Failure: jump to label. Could optimize away for short matches. */
 	v_jv(l);   
@@ -226,6 +250,7 @@ static void compile_ht(Ht ht, v_label_t l) {
 	v_putreg(hte_r, V_P);
 	v_putreg(val_r, V_U);
 	v_putreg(label_r, V_P);
+	return 0;
 }
 
 /* 
@@ -238,8 +263,13 @@ static void emit_bounds_check(int shiftp, uint32 offset, v_label_t l) {
 		v_bleui(nbytes_r, offset, l);
 }
 
-/* Generate code for hte entry. */
-static void compile_hte(Atom hte, v_label_t elsel, int alignment, int shiftp) {
+/* 
+ * Generate code for hte entry.  If it is reached through jump table
+ * slot, the hash only picked the bucket: check the value, going to 
+ * fail if it doesn't match.
+ */
+static void 
+compile_hte(Atom hte, void *slot, v_label_t fail, v_label_t elsel, int alignment, int shiftp) {
 	v_label_t label;
 	int pid;
 
@@ -249,6 +279,10 @@ static void compile_hte(Atom hte, v_label_t elsel, int alignment, int shiftp) {
 	label = v_genlabel(); 		/* Allocate label for indirect goto. */
 	v_label(label); 		/* Mark the location of code. */
 	v_dlabel(&hte->label, label); 	/* Store address for indirect goto. */
+	if(slot) {
+		v_dlabel(slot, label);
+		v_bneui(src_r, hte->ir.eq.val, fail);
+	}
 
 	pid = hte->pid;
 
@@ -334,13 +368,14 @@ compile_eq(Atom a, v_label_t l, v_label_t clabel, int alignment, int shiftp) {
 	if((ht = a->ht)) {
 		int i,n;
 		Atom hte;
+		void **tab;
 
-		compile_ht(a->ht, l);
+		tab = compile_ht(a->ht, l);
 
 		/* Generate code for all entries in the hash table. */
 		for(i = 0, n = ht->htsz; i < n; i++)
 			for(hte = ht->ht[i]; hte; hte = hte->or)
-				compile_hte(hte, clabel, alignment,shiftp);
+				compile_hte(hte, tab ? &tab[i] : 0, l, clabel, alignment,shiftp);
 	} else {
 #		ifndef MIPS
 			v_bneui(src_r, e->val, l);
@@ -460,7 +495,10 @@ v_iptr dpf_compile(Atom trie) {
         static v_code insn[2048];      
 	v_reg_t args[2];
 	v_label_t no_match;
+	v_iptr ip;
+	int old;
 	
+	old = v_setopt(V_OPT_ALL);
         v_lambda("dpf-filter", "%p%u", args, V_LEAF, insn, sizeof insn);
 		shift_init();
 
@@ -479,5 +517,7 @@ v_iptr dpf_compile(Atom trie) {
 
 		v_label(no_match);	/* jump here if no matches */
 			v_retii(0);
-	return v_end(0).i;
+	ip = v_end(0).i;
+	v_setopt(old);
+	return ip;
 }
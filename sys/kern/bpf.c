@@ -0,0 +1,547 @@
+
+/*
+ * Copyright (C) 1997 Massachusetts Institute of Technology 
+ *
+ * This software is being provided by the copyright holders under the
+ * following license. By obtaining, using and/or copying this software,
+ * you agree that you have read, understood, and will comply with the
+ * following terms and conditions:
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose and without fee or royalty is
+ * hereby granted, provided that the full text of this NOTICE appears on
+ * ALL copies of the software and documentation or portions thereof,
+ * including modifications, that you make.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS," AND COPYRIGHT HOLDERS MAKE NO
+ * REPRESENTATIONS OR WARRANTIES, EXPRESS OR IMPLIED. BY WAY OF EXAMPLE,
+ * BUT NOT LIMITATION, COPYRIGHT HOLDERS MAKE NO REPRESENTATIONS OR
+ * WARRANTIES OF MERCHANTABILITY OR FITNESS FOR ANY PARTICULAR PURPOSE OR
+ * THAT THE USE OF THE SOFTWARE OR DOCUMENTATION WILL NOT INFRINGE ANY
+ * THIRD PARTY PATENTS, COPYRIGHTS, TRADEMARKS OR OTHER RIGHTS. COPYRIGHT
+ * HOLDERS WILL BEAR NO LIABILITY FOR ANY USE OF THIS SOFTWARE OR
+ * DOCUMENTATION.
+ *
+ * The name and trademarks of copyright holders may NOT be used in
+ * advertising or publicity pertaining to the software without specific,
+ * written prior permission. Title to copyright in this software and any
+ * associated documentation will at all times remain with copyright
+ * holders. See the file AUTHORS which should have accompanied this software
+ * for a list of all copyright holders.
+ *
+ * This file may be derived from previously copyrighted software. This
+ * copyright applies only to those changes made by the copyright
+ * holders listed in the AUTHORS file. The rest of this file is covered by
+ * the copyright notices, if any, listed below.
+ */
+
+/*
+ * Network taps run libpcap's BPF programs in the kernel so that only
+ * matching packets are copied out.  A program is checked by
+ * bpf_validate and then compiled to native code with vcode, the same
+ * way wk.c compiles wakeup predicates: A and X live in registers, the
+ * scratch memory in locals, every jump target becomes a label and
+ * every packet load is bounds checked against buflen (a load past the
+ * end rejects the packet, as in bpf_filter).
+ *
+ * bpf_validate is from the BSD bpf_filter.c, which is
+ *
+ * Copyright (c) 1990, 1991, 1992, 1993, 1994, 1995, 1996, 1997
+ *	The Regents of the University of California.  All rights reserved.
+ *
+ * and is covered by the Berkeley license in xok/bpf.h.
+ */
+
+#include <vcode/vcode.h>
+#include <xok/defs.h>
+#include <xok/bpf.h>
+#include <xok/malloc.h>
+#include <xok/kerrno.h>
+#include <xok/printf.h>
+
+/* worst case code for one instruction (a checked word load) */
+#define BPF_CODE_PER_INSN 64
+
+#define OVERRUN_SAFETY BPF_CODE_PER_INSN
+#define OVERRUN_CHECK							\
+{									\
+  if (v_ip > code + nbytes - OVERRUN_SAFETY) {				\
+    warn ("bpf_compile: out of code space\n");				\
+    goto error;								\
+  }									\
+}
+
+/* vcode has room for 256 labels, one of which is the epilogue, and
+   128 references to each (MAX_LABELS and MAX_REFS in vcode/opt.h) */
+#define BPF_MAXLABELS 255
+#define BPF_MAXREFS 128
+
+/* the labels of the reject path: a new one whenever one fills up */
+struct bpf_fail {
+  v_label_t l[2 * BPF_MAXINSNS / BPF_MAXREFS + 1];
+  int n;
+  int refs;
+};
+#define BPF_NFAIL(len) (2 * (len) / BPF_MAXREFS + 1)
+
+/*
+ * Return true if f is a program bpf_compile can take: known opcodes,
+ * forward jumps that stay inside the program, scratch memory
+ * references in range, no division by a constant 0, and a return at
+ * the end.
+ */
+int
+bpf_validate (struct bpf_insn *f, int len)
+{
+  int i;
+  struct bpf_insn *p;
+
+  if (len < 1 || len > BPF_MAXINSNS)
+    return 0;
+
+  for (i = 0; i < len; ++i)
+    {
+      p = &f[i];
+      switch (BPF_CLASS (p->code))
+	{
+	case BPF_LD:
+	case BPF_LDX:
+	  switch (BPF_MODE (p->code))
+	    {
+	    case BPF_IMM:
+	    case BPF_LEN:
+	      if (BPF_SIZE (p->code) != BPF_W)
+		return 0;
+	      break;
+	    case BPF_ABS:
+	    case BPF_IND:
+	      if (BPF_CLASS (p->code) == BPF_LDX ||
+		  BPF_SIZE (p->code) == 0x18)
+		return 0;
+	      break;
+	    case BPF_MSH:
+	      if (p->code != (BPF_LDX|BPF_B|BPF_MSH))
+		return 0;
+	      break;
+	    case BPF_MEM:
+	      if (BPF_SIZE (p->code) != BPF_W || (u_int) p->k >= BPF_MEMWORDS)
+		return 0;
+	      break;
+	    default:
+	      return 0;
+	    }
+	  break;
+	case BPF_ST:
+	case BPF_STX:
+	  if ((u_int) p->k >= BPF_MEMWORDS)
+	    return 0;
+	  break;
+	case BPF_ALU:
+	  switch (BPF_OP (p->code))
+	    {
+	    case BPF_DIV:
+	      /* constant division by 0 */
+	      if (BPF_SRC (p->code) == BPF_K && p->k == 0)
+		return 0;
+	      break;
+	    case BPF_ADD: case BPF_SUB: case BPF_MUL: case BPF_OR:
+	    case BPF_AND: case BPF_LSH: case BPF_RSH: case BPF_NEG:
+	      break;
+	    default:
+	      return 0;
+	    }
+	  break;
+	case BPF_JMP:
+	  /* jumps are forward, and within the code block */
+	  switch (BPF_OP (p->code))
+	    {
+	    case BPF_JA:
+	      if ((u_int) p->k >= (u_int) (len - i - 1))
+		return 0;
+	      break;
+	    case BPF_JEQ: case BPF_JGT: case BPF_JGE: case BPF_JSET:
+	      if (i + 1 + p->jt >= len || i + 1 + p->jf >= len)
+		return 0;
+	      break;
+	    default:
+	      return 0;
+	    }
+	  break;
+	case BPF_RET:
+	  if (BPF_RVAL (p->code) != BPF_K && BPF_RVAL (p->code) != BPF_A)
+	    return 0;
+	  break;
+	case BPF_MISC:
+	  if (BPF_MISCOP (p->code) != BPF_TAX &&
+	      BPF_MISCOP (p->code) != BPF_TXA)
+	    return 0;
+	  break;
+	}
+    }
+  return BPF_CLASS (f[len - 1].code) == BPF_RET;
+}
+
+/* load size bytes in network order from base+off into dst */
+static void
+bpf_load (v_reg_t dst, v_reg_t base, int off, int size, v_reg_t t)
+{
+  int i;
+
+  v_lduci (dst, base, off);
+  for (i = 1; i < size; i++)
+    {
+      v_lshui (dst, dst, 8);
+      v_lduci (t, base, off + i);
+      v_oru (dst, dst, t);
+    }
+}
+
+/* a reject label good for nrefs more branches */
+static v_label_t
+bpf_fail (struct bpf_fail *bf, int nrefs)
+{
+  if (bf->n == 0 || bf->refs + nrefs > BPF_MAXREFS)
+    {
+      bf->l[bf->n++] = v_genlabel ();
+      bf->refs = 0;
+    }
+  bf->refs += nrefs;
+  return bf->l[bf->n - 1];
+}
+
+/* branch to target if the test in jump instruction code comes out
+   sense */
+static void
+bpf_branch (u_short code, int sense, v_reg_t a, v_reg_t x, v_reg_t t,
+	    u_int k, v_label_t target)
+{
+  if (BPF_OP (code) == BPF_JSET)
+    {
+      if (BPF_SRC (code) == BPF_K)
+	v_andui (t, a, k);
+      else
+	v_andu (t, a, x);
+      a = t;
+      k = 0;
+      code = BPF_JMP|BPF_JEQ|BPF_K;
+      sense = !sense;
+    }
+
+  switch (BPF_OP (code) | BPF_SRC (code) | sense)
+    {
+    case BPF_JEQ|BPF_K|1: v_bequi (a, k, target); break;
+    case BPF_JEQ|BPF_K|0: v_bneui (a, k, target); break;
+    case BPF_JGT|BPF_K|1: v_bgtui (a, k, target); break;
+    case BPF_JGT|BPF_K|0: v_bleui (a, k, target); break;
+    case BPF_JGE|BPF_K|1: v_bgeui (a, k, target); break;
+    case BPF_JGE|BPF_K|0: v_bltui (a, k, target); break;
+    case BPF_JEQ|BPF_X|1: v_bequ (a, x, target); break;
+    case BPF_JEQ|BPF_X|0: v_bneu (a, x, target); break;
+    case BPF_JGT|BPF_X|1: v_bgtu (a, x, target); break;
+    case BPF_JGT|BPF_X|0: v_bleu (a, x, target); break;
+    case BPF_JGE|BPF_X|1: v_bgeu (a, x, target); break;
+    case BPF_JGE|BPF_X|0: v_bltu (a, x, target); break;
+    }
+}
+
+/*
+ * Compile a validated program.  Returns NULL if it doesn't validate
+ * or doesn't fit; the result is freed with bpf_free.
+ */
+bpf_func_t
+bpf_compile (struct bpf_insn *f, int len)
+{
+  static const int sizes[] = { 4, 2, 1 };
+  v_reg_t args[3], pkt, wirelen, buflen, a, x, t, u;
+  v_reg_t mem[BPF_MEMWORDS];
+  v_label_t *labels;
+  struct bpf_fail bf;
+  v_label_t fail;
+  char *code;
+  int nbytes;
+  int nlabels, usemem;
+  int i, oflags;
+
+  if (!bpf_validate (f, len))
+    return NULL;
+
+  /* room for the prologue, zeroing the scratch memory and the fail
+     path too */
+  nbytes = (len + 4) * BPF_CODE_PER_INSN;
+  code = (char *) malloc (nbytes);
+  labels = (v_label_t *) malloc (len * sizeof (v_label_t));
+  if (!code || !labels)
+    {
+      if (code) free (code);
+      if (labels) free (labels);
+      return NULL;
+    }
+
+  /* find the jump targets and whether scratch memory is used */
+  nlabels = usemem = 0;
+  for (i = 0; i < len; i++)
+    labels[i] = 0;
+  for (i = 0; i < len; i++)
+    {
+      if (BPF_CLASS (f[i].code) == BPF_JMP)
+	{
+	  if (BPF_OP (f[i].code) == BPF_JA)
+	    {
+	      if (f[i].k)
+		labels[i + 1 + f[i].k]++;
+	    }
+	  else
+	    {
+	      if (f[i].jt)
+		labels[i + 1 + f[i].jt]++;
+	      if (f[i].jf)
+		labels[i + 1 + f[i].jf]++;
+	    }
+	}
+      if (BPF_CLASS (f[i].code) == BPF_ST ||
+	  BPF_CLASS (f[i].code) == BPF_STX ||
+	  f[i].code == (BPF_LD|BPF_MEM) || f[i].code == (BPF_LDX|BPF_MEM))
+	usemem = 1;
+    }
+  for (i = 0; i < len; i++)
+    {
+      if (labels[i] > BPF_MAXREFS)
+	nlabels = BPF_MAXLABELS;
+      nlabels += labels[i] != 0;
+    }
+  if (nlabels + BPF_NFAIL (len) > BPF_MAXLABELS)
+    {
+      warn ("bpf_compile: too many jumps\n");
+      free (labels);
+      free (code);
+      return NULL;
+    }
+
+  /* taps see every packet: keep the filters tight */
+  oflags = v_setopt (V_OPT_ALL);
+  v_lambda ("bpf", "%p%u%u", args, V_LEAF, code, nbytes);
+  if (!v_getreg (&pkt, V_P, V_TEMP) ||
+      !v_getreg (&a, V_U, V_TEMP) ||
+      !v_getreg (&x, V_U, V_TEMP) ||
+      !v_getreg (&t, V_U, V_TEMP) ||
+      !v_getreg (&u, V_U, V_TEMP))
+    panic ("bpf_compile: architecture doesn't have enough registers.");
+  wirelen = args[1];
+  buflen = args[2];
+
+  bf.n = 0;
+  for (i = 0; i < len; i++)
+    labels[i] = labels[i] ? v_genlabel () : -1;
+
+  v_movp (pkt, args[0]);
+  v_setu (a, 0);
+  v_setu (x, 0);
+  if (usemem)
+    for (i = 0; i < BPF_MEMWORDS; i++)
+      {
+	mem[i] = v_local (V_U);
+	v_movu (mem[i], a);
+      }
+
+  for (i = 0; i < len; i++)
+    {
+      struct bpf_insn *p = &f[i];
+      u_int k = p->k;
+      int size = sizeof (u_int);
+
+      OVERRUN_CHECK;
+      if (labels[i] >= 0)
+	v_label (labels[i]);
+
+      switch (p->code)
+	{
+	case BPF_RET|BPF_K:
+	  v_retui (k);
+	  break;
+	case BPF_RET|BPF_A:
+	  v_retu (a);
+	  break;
+
+	case BPF_LD|BPF_W|BPF_ABS:
+	case BPF_LD|BPF_H|BPF_ABS:
+	case BPF_LD|BPF_B|BPF_ABS:
+	  size = sizes[BPF_SIZE (p->code) >> 3];
+	  fail = bpf_fail (&bf, 1);
+	  if (k > ~0U - size)
+	    {
+	      v_jv (fail);
+	    }
+	  else
+	    {
+	      v_bltui (buflen, k + size, fail);
+	      bpf_load (a, pkt, k, size, t);
+	    }
+	  break;
+	case BPF_LD|BPF_W|BPF_IND:
+	case BPF_LD|BPF_H|BPF_IND:
+	case BPF_LD|BPF_B|BPF_IND:
+	  size = sizes[BPF_SIZE (p->code) >> 3];
+	  fail = bpf_fail (&bf, 2);
+	  v_addui (u, x, k);
+	  v_addui (t, u, size);
+	  v_bltu (t, u, fail);
+	  v_bgtu (t, buflen, fail);
+	  v_addp (u, pkt, u);
+	  bpf_load (a, u, 0, size, t);
+	  break;
+	case BPF_LDX|BPF_B|BPF_MSH:
+	  fail = bpf_fail (&bf, 1);
+	  if (k > ~0U - 1)
+	    {
+	      v_jv (fail);
+	    }
+	  else
+	    {
+	      v_bltui (buflen, k + 1, fail);
+	      v_lduci (x, pkt, k);
+	      v_andui (x, x, 0xf);
+	      v_lshui (x, x, 2);
+	    }
+	  break;
+
+	case BPF_LD|BPF_W|BPF_LEN:
+	  v_movu (a, wirelen);
+	  break;
+	case BPF_LDX|BPF_W|BPF_LEN:
+	  v_movu (x, wirelen);
+	  break;
+	case BPF_LD|BPF_IMM:
+	  v_setu (a, k);
+	  break;
+	case BPF_LDX|BPF_IMM:
+	  v_setu (x, k);
+	  break;
+	case BPF_LD|BPF_MEM:
+	  v_movu (a, mem[k]);
+	  break;
+	case BPF_LDX|BPF_MEM:
+	  v_movu (x, mem[k]);
+	  break;
+	case BPF_ST:
+	  v_movu (mem[k], a);
+	  break;
+	case BPF_STX:
+	  v_movu (mem[k], x);
+	  break;
+
+	case BPF_JMP|BPF_JA:
+	  if (k)
+	    {
+	      v_jv (labels[i + 1 + k]);
+	    }
+	  break;
+	case BPF_JMP|BPF_JEQ|BPF_K:
+	case BPF_JMP|BPF_JGT|BPF_K:
+	case BPF_JMP|BPF_JGE|BPF_K:
+	case BPF_JMP|BPF_JSET|BPF_K:
+	case BPF_JMP|BPF_JEQ|BPF_X:
+	case BPF_JMP|BPF_JGT|BPF_X:
+	case BPF_JMP|BPF_JGE|BPF_X:
+	case BPF_JMP|BPF_JSET|BPF_X:
+	  if (p->jt != 0)
+	    {
+	      bpf_branch (p->code, 1, a, x, t, k, labels[i + 1 + p->jt]);
+	      if (p->jf != 0)
+		{
+		  v_jv (labels[i + 1 + p->jf]);
+		}
+	    }
+	  else if (p->jf != 0)
+	    bpf_branch (p->code, 0, a, x, t, k, labels[i + 1 + p->jf]);
+	  break;
+
+	case BPF_ALU|BPF_ADD|BPF_K:
+	  v_addui (a, a, k);
+	  break;
+	case BPF_ALU|BPF_SUB|BPF_K:
+	  v_subui (a, a, k);
+	  break;
+	case BPF_ALU|BPF_MUL|BPF_K:
+	  v_mului (a, a, k);
+	  break;
+	case BPF_ALU|BPF_DIV|BPF_K:
+	  v_divui (a, a, k);
+	  break;
+	case BPF_ALU|BPF_AND|BPF_K:
+	  v_andui (a, a, k);
+	  break;
+	case BPF_ALU|BPF_OR|BPF_K:
+	  v_orui (a, a, k);
+	  break;
+	case BPF_ALU|BPF_LSH|BPF_K:
+	  v_lshui (a, a, k);
+	  break;
+	case BPF_ALU|BPF_RSH|BPF_K:
+	  v_rshui (a, a, k);
+	  break;
+	case BPF_ALU|BPF_ADD|BPF_X:
+	  v_addu (a, a, x);
+	  break;
+	case BPF_ALU|BPF_SUB|BPF_X:
+	  v_subu (a, a, x);
+	  break;
+	case BPF_ALU|BPF_MUL|BPF_X:
+	  v_mulu (a, a, x);
+	  break;
+	case BPF_ALU|BPF_DIV|BPF_X:
+	  fail = bpf_fail (&bf, 1);
+	  v_bequi (x, 0, fail);
+	  v_divu (a, a, x);
+	  break;
+	case BPF_ALU|BPF_AND|BPF_X:
+	  v_andu (a, a, x);
+	  break;
+	case BPF_ALU|BPF_OR|BPF_X:
+	  v_oru (a, a, x);
+	  break;
+	case BPF_ALU|BPF_LSH|BPF_X:
+	  v_lshu (a, a, x);
+	  break;
+	case BPF_ALU|BPF_RSH|BPF_X:
+	  v_rshu (a, a, x);
+	  break;
+	case BPF_ALU|BPF_NEG:
+	  v_negu (a, a);
+	  break;
+
+	case BPF_MISC|BPF_TAX:
+	  v_movu (x, a);
+	  break;
+	case BPF_MISC|BPF_TXA:
+	  v_movu (a, x);
+	  break;
+
+	default:
+	  /* bpf_validate lets through an encoding we don't handle */
+	  warn ("bpf_compile: bad instruction 0x%x at %d\n", p->code, i);
+	  goto error;
+	}
+    }
+
+  OVERRUN_CHECK;
+  for (i = 0; i < bf.n; i++)
+    v_label (bf.l[i]);
+  v_retui (0);
+  v_end (NULL);
+
+  v_setopt (oflags);
+  free (labels);
+  return ((bpf_func_t) code);
+
+error:
+  v_setopt (oflags);
+  free (labels);
+  free (code);
+  return NULL;
+}
+
+void
+bpf_free (bpf_func_t fn)
+{
+  free ((void *) fn);
+}
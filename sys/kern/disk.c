@@ -386,6 +386,7 @@ sys_disk_scsicmd (u_int sn, u_int k, struct buf *reqbp)
   /* This is fine as long as all disks actually go to the same strategy      */
   /* routine.                                                                */
    di = SYSINFO_PTR_AT(si_disks,0);
+   TRACE(TR_DISKREQ, bp, 0);
    di->d_strategy (bp);
 
    return (0);
@@ -471,6 +472,7 @@ sys_disk_mbr (u_int sn, int write, u_int dev, int k, char *buffer, int *resptr)
   ppage_pin (pa2pp ((va2pa (buffer))));
 
   /* start the request */
+  TRACE(TR_DISKREQ, diskbuf, 512);
   (SYSINFO_PTR_AT(si_disks,dev))->d_strategy (diskbuf);
 
   return 0;
@@ -627,6 +629,7 @@ sys_disk_request (u_int sn, struct Xn_name *xn_user, struct buf *reqbp,
   if (resptr) ppage_pin (kva2pp((u_int) resptr));
 
   /* call appropriate strategy routine */
+  TRACE(TR_DISKREQ, reqbp, bcount);
   di->d_strategy (reqbp);
 
 #ifdef MEASURE_DISK_TIMES
@@ -734,6 +737,7 @@ disk_bc_request (struct buf *bp)
   bp->b_resid = NBPG;
 
   /* call appropriate strategy routine */
+  TRACE(TR_DISKREQ, bp, bp->b_sgtot);
   (SYSINFO_PTR_AT(si_disks,bp->b_dev))->d_strategy (bp);
 
   return 0;
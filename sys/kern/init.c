@@ -154,16 +154,25 @@ random_trap (int trap, int errcode)
 {
   tfp tf;
 
+  /* performance counter overflow NMIs from the sampling profiler */
+  if (trap == 2 && prof_mode == PROF_PCTR) {
+    tfp_set (tf, trap, tf_edi);
+    if (prof_nmi (tf))
+      return;
+  }
+
   printf ("just got TRAP %d in env 0x%x on CPU %d", trap,
 	  curenv ? curenv->env_id : -1, cpu_id);
 
+  /* the NMI vector saves registers with pushal, the double fault
+     vector only saves the caller-saved ones (see trap.conf) */
   if (trap >= 8 && trap < 32) {
     printf ("; error code = 0x%x\n", errcode);
     tfp_set (tf, errcode, tf_edx);
   }
   else {
     printf ("\n");
-    tfp_set (tf, trap, tf_edx);
+    tfp_set (tf, trap, tf_edi);
   }
 
   printf ("  eip = 0x%x;", tf->tf_eip);
@@ -0,0 +1,377 @@
+
+/*
+ * Copyright (C) 1997 Massachusetts Institute of Technology 
+ *
+ * This software is being provided by the copyright holders under the
+ * following license. By obtaining, using and/or copying this software,
+ * you agree that you have read, understood, and will comply with the
+ * following terms and conditions:
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose and without fee or royalty is
+ * hereby granted, provided that the full text of this NOTICE appears on
+ * ALL copies of the software and documentation or portions thereof,
+ * including modifications, that you make.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS," AND COPYRIGHT HOLDERS MAKE NO
+ * REPRESENTATIONS OR WARRANTIES, EXPRESS OR IMPLIED. BY WAY OF EXAMPLE,
+ * BUT NOT LIMITATION, COPYRIGHT HOLDERS MAKE NO REPRESENTATIONS OR
+ * WARRANTIES OF MERCHANTABILITY OR FITNESS FOR ANY PARTICULAR PURPOSE OR
+ * THAT THE USE OF THE SOFTWARE OR DOCUMENTATION WILL NOT INFRINGE ANY
+ * THIRD PARTY PATENTS, COPYRIGHTS, TRADEMARKS OR OTHER RIGHTS. COPYRIGHT
+ * HOLDERS WILL BEAR NO LIABILITY FOR ANY USE OF THIS SOFTWARE OR
+ * DOCUMENTATION.
+ *
+ * The name and trademarks of copyright holders may NOT be used in
+ * advertising or publicity pertaining to the software without specific,
+ * written prior permission. Title to copyright in this software and any
+ * associated documentation will at all times remain with copyright
+ * holders. See the file AUTHORS which should have accompanied this software
+ * for a list of all copyright holders.
+ *
+ * This file may be derived from previously copyrighted software. This
+ * copyright applies only to those changes made by the copyright
+ * holders listed in the AUTHORS file. The rest of this file is covered by
+ * the copyright notices, if any, listed below.
+ */
+
+#define __IPFRAG_MODULE__
+
+#include <xok/sysinfo.h>
+#include <xok/defs.h>
+#include <xok/types.h>
+#include <xok/queue.h>
+#include <xok/pkt.h>
+#include <xok/pktring.h>
+#include <xok/ipfrag.h>
+#include <xok/scheduler.h>
+#include <xok/malloc.h>
+#include <xok/printf.h>
+#include <machine/endian.h>
+#include <xok_include/net/ip.h>
+#include <xok_include/net/ether.h>
+#include <xok_include/string.h>
+
+/* IP fragment reassembly, see xok/ipfrag.h.  Each fragment is copied   */
+/* once, into a piece kept in offset order on its datagram's queue; the */
+/* first piece holds the whole frame, headers and all, so that it can   */
+/* be given to DPF as is.  Pieces may not overlap: a fragment that      */
+/* overlaps one already held (a duplicate, usually) is dropped.  The    */
+/* completed datagram goes to the ring straight from the pieces.        */
+
+#define ETHER_HDRLEN	14
+#define IP(frame)	((struct ip_pkt *) ((char *) (frame) + ETHER_HDRLEN))
+#define IP_OFFFIELD(ip)	(((u_short *) (ip))[3])	/* flags and offset */
+#define IP_DF		0x4000
+#define IP_MF		0x2000
+#define IP_OFFMASK	0x1fff
+#define IP_MAXPACKET	65535
+
+struct ipfrag {
+  struct ipfrag *next;		/* next piece, in offset order */
+  u_int off;			/* offset of the piece's payload */
+  u_int len;			/* length of the piece's payload */
+  u_int sz;			/* bytes at data to deliver */
+  u_char data[0];		/* the payload, or for offset 0 the frame */
+};
+
+struct ipfragq {
+  LIST_ENTRY (ipfragq) link;	/* hash chain, or free list */
+  u_int src, dst;		/* network order */
+  u_short id;			/* network order */
+  u_char proto;
+  u_int nfrags;
+  u_int total;			/* payload length, 0 until the last piece */
+  u_int have;			/* payload bytes held */
+  uint64 expire;		/* tick at which to give up */
+  uint64 *discardcntP;		/* of the interface it came in on */
+  struct ipfrag *frags;
+};
+LIST_HEAD (ipfragq_list, ipfragq);
+
+static struct ipfragq ipfragqs[IPFRAG_MAXQ];
+static struct ipfragq_list ipfrag_hash[IPFRAG_HASH];
+static struct ipfragq_list ipfrag_free;
+static struct kspinlock ipfrag_lock;
+static int ipfrag_timerset;
+
+#define ipfrag_hashq(src, dst, id) \
+  (&ipfrag_hash[((src) ^ (dst) ^ (id) ^ ((id) >> 8)) & (IPFRAG_HASH - 1)])
+
+
+void
+ipfrag_init (void)
+{
+  int i;
+
+  MP_SPINLOCK_INIT (&ipfrag_lock);
+  for (i = 0; i < IPFRAG_HASH; i++)
+    LIST_INIT (&ipfrag_hash[i]);
+  LIST_INIT (&ipfrag_free);
+  for (i = 0; i < IPFRAG_MAXQ; i++)
+    LIST_INSERT_HEAD (&ipfrag_free, &ipfragqs[i], link);
+  bzero (SYSINFO_PTR (si_ipfrag), sizeof (struct ipfrag_stats));
+  ipfrag_timerset = 0;
+}
+
+
+static inline u_int
+ipfrag_ticks (u_int secs)
+{
+  return ((secs * 1000000) / SYSINFO_GET (si_rate));
+}
+
+
+static void
+ipfrag_free_pieces (struct ipfrag *f)
+{
+  struct ipfrag *next;
+
+  for (; f != NULL; f = next)
+    {
+      next = f->next;
+      free (f);
+    }
+}
+
+
+/* Free q and its pieces.  Called with ipfrag_lock held. */
+static void
+ipfrag_drop (struct ipfragq *q)
+{
+  LIST_REMOVE (q, link);
+  ipfrag_free_pieces (q->frags);
+  q->frags = NULL;
+  LIST_INSERT_HEAD (&ipfrag_free, q, link);
+  SYSINFO_PTR (si_ipfrag)->is_pending--;
+}
+
+
+/* Drop every datagram that has timed out, and come back in a second */
+/* if any are left.  Called with ipfrag_lock held.                   */
+static void ipfrag_timer (void *arg);
+
+static void
+ipfrag_expire (void)
+{
+  uint64 now = SYSINFO_GET (si_system_ticks);
+  struct ipfragq *q, *next;
+  int i;
+
+  for (i = 0; i < IPFRAG_HASH; i++)
+    for (q = ipfrag_hash[i].lh_first; q != NULL; q = next)
+      {
+	next = q->link.le_next;
+	if (q->expire <= now)
+	  {
+	    SYSINFO_PTR (si_ipfrag)->is_timeouts++;
+	    ipfrag_drop (q);
+	  }
+      }
+  if ((SYSINFO_PTR (si_ipfrag)->is_pending) && (ipfrag_timerset == 0) &&
+      (timeout (ipfrag_timer, NULL, ipfrag_ticks (1)) == 0))
+    ipfrag_timerset = 1;
+}
+
+
+static void
+ipfrag_timer (void *arg)
+{
+  MP_SPINLOCK_GET (&ipfrag_lock);
+  ipfrag_timerset = 0;
+  ipfrag_expire ();
+  MP_SPINLOCK_RELEASE (&ipfrag_lock);
+}
+
+
+/* Find the queue of the datagram ip belongs to, or start one, making */
+/* room by dropping the one closest to timing out if need be.         */
+static struct ipfragq *
+ipfrag_lookup (struct ip_pkt *ip, uint64 *discardcntP)
+{
+  struct ipfragq_list *hq = ipfrag_hashq (ip->ip_src, ip->ip_dst, ip->ip_id);
+  struct ipfragq *q;
+  int i;
+
+  for (q = hq->lh_first; q != NULL; q = q->link.le_next)
+    if ((q->id == ip->ip_id) && (q->src == ip->ip_src) &&
+	(q->dst == ip->ip_dst) && (q->proto == ip->ip_p))
+      return (q);
+
+  if ((q = ipfrag_free.lh_first) == NULL)
+    {
+      q = &ipfragqs[0];
+      for (i = 1; i < IPFRAG_MAXQ; i++)
+	if (ipfragqs[i].expire < q->expire)
+	  q = &ipfragqs[i];
+      SYSINFO_PTR (si_ipfrag)->is_evicted++;
+      ipfrag_drop (q);
+    }
+  LIST_REMOVE (q, link);
+
+  q->src = ip->ip_src;
+  q->dst = ip->ip_dst;
+  q->id = ip->ip_id;
+  q->proto = ip->ip_p;
+  q->nfrags = q->total = q->have = 0;
+  q->expire = SYSINFO_GET (si_system_ticks) + ipfrag_ticks (IPFRAG_TIMEOUT);
+  q->discardcntP = discardcntP;
+  q->frags = NULL;
+  LIST_INSERT_HEAD (hq, q, link);
+  SYSINFO_PTR (si_ipfrag)->is_pending++;
+
+  if ((ipfrag_timerset == 0) &&
+      (timeout (ipfrag_timer, NULL, ipfrag_ticks (1)) == 0))
+    ipfrag_timerset = 1;
+  return (q);
+}
+
+
+static u_short
+ipfrag_cksum (u_short *p, int len)
+{
+  u_int sum = 0;
+
+  for (; len > 1; len -= 2)
+    sum += *p++;
+  sum = (sum >> 16) + (sum & 0xffff);
+  sum += (sum >> 16);
+  return (~sum);
+}
+
+
+/* The pieces f make up a whole datagram of total payload bytes: make */
+/* the first one describe all of it, hand them to whoever wants it and */
+/* free them.  Called without ipfrag_lock, the pieces being ours now.  */
+static void
+ipfrag_deliver (struct ipfrag *frags, u_int total, uint64 *discardcntP)
+{
+  struct ae_recv recv;
+  struct frag_return result;
+  struct ipfrag *f;
+  struct ip_pkt *ip = IP (frags->data);
+  int iphl = ip->ip_hl << 2;
+  int filterid, ringid;
+
+  ip->ip_len = htons (iphl + total);
+  IP_OFFFIELD (ip) &= htons (IP_DF);
+  ip->ip_sum = 0;
+  ip->ip_sum = ipfrag_cksum ((u_short *) ip, iphl);
+
+  for (recv.n = 0, f = frags; f != NULL; f = f->next, recv.n++)
+    {
+      recv.r[recv.n].data = f->data;
+      recv.r[recv.n].sz = f->sz;
+    }
+
+  filterid = TRACE_CLASSIFY (dpf_iptr (frags->data, frags->sz, &result));
+  if ((filterid > 0) && ((ringid = dpf_fid_getringval (filterid)) > 0) &&
+      pktring_handlechain (ringid, &recv))
+    SYSINFO_PTR (si_ipfrag)->is_delivered++;
+  else
+    {
+      SYSINFO_PTR (si_ipfrag)->is_dropped++;
+      if (discardcntP)
+	(*discardcntP)++;
+    }
+  ipfrag_free_pieces (frags);
+}
+
+
+/* Called for every packet that comes in, before classification.  recv */
+/* is the packet and hdr a contiguous copy of (at least) its first     */
+/* hlen bytes.  If it is an IP fragment, it is held or dropped and 1   */
+/* is returned: the caller should do nothing more with the packet      */
+/* than free it.  Otherwise 0 is returned.                             */
+int
+ipfrag_input (struct ae_recv *recv, char *hdr, int hlen, uint64 *discardcntP)
+{
+  struct ip_pkt *ip = IP (hdr);
+  struct ipfragq *q;
+  struct ipfrag *f, *prev, *frags;
+  u_int iphl, off, len, flags, skip, total;
+
+  if ((hlen < ETHER_HDRLEN + sizeof (struct ip_pkt)) ||
+      (((struct ether_pkt *) hdr)->ether_type != htons (ETHERTYPE_IP)))
+    return (0);
+  flags = ntohs (IP_OFFFIELD (ip));
+  if ((flags & (IP_MF | IP_OFFMASK)) == 0)
+    return (0);
+
+  /* it is a fragment, and ours from here on */
+  MP_SPINLOCK_GET (&ipfrag_lock);
+  SYSINFO_PTR (si_ipfrag)->is_frags++;
+  iphl = ip->ip_hl << 2;
+  len = ntohs (ip->ip_len);
+  off = (flags & IP_OFFMASK) << 3;
+  if ((iphl < sizeof (struct ip_pkt)) || (hlen < ETHER_HDRLEN + iphl) ||
+      (len <= iphl) || (ETHER_HDRLEN + len > ae_recv_datacnt (recv)) ||
+      ((flags & IP_MF) && ((len - iphl) & 7)) ||
+      (off + len > IP_MAXPACKET))
+    goto bad;
+  len -= iphl;
+
+  q = ipfrag_lookup (ip, discardcntP);
+
+  /* find its place, refusing overlaps and anything past the end */
+  for (prev = NULL, f = q->frags; (f != NULL) && (f->off < off); f = f->next)
+    prev = f;
+  if (((f != NULL) && (off + len > f->off)) ||
+      ((prev != NULL) && (prev->off + prev->len > off)) ||
+      ((q->total) && (off + len > q->total)) ||
+      (!(flags & IP_MF) && ((f != NULL) || (q->total))))
+    goto bad;
+  if (q->nfrags == IPFRAG_MAXFRAGS)
+    {
+      ipfrag_drop (q);
+      goto bad;
+    }
+
+  /* keep the headers of the first piece, only the payload of others */
+  skip = (off == 0) ? 0 : ETHER_HDRLEN + iphl;
+  if ((f = (struct ipfrag *) malloc (sizeof (struct ipfrag) + ETHER_HDRLEN +
+				     iphl + len - skip)) == NULL)
+    goto bad;
+  f->off = off;
+  f->len = len;
+  f->sz = ae_recv_datacpy (recv, f->data, skip,
+			   ETHER_HDRLEN + iphl + len - skip);
+  if (prev == NULL)
+    {
+      f->next = q->frags;
+      q->frags = f;
+    }
+  else
+    {
+      f->next = prev->next;
+      prev->next = f;
+    }
+  q->nfrags++;
+  q->have += len;
+  if (!(flags & IP_MF))
+    q->total = off + len;
+
+  if ((q->total == 0) || (q->have != q->total))
+    {
+      MP_SPINLOCK_RELEASE (&ipfrag_lock);
+      return (1);
+    }
+
+  /* complete: take the pieces and deliver them with the table unlocked */
+  SYSINFO_PTR (si_ipfrag)->is_reassembled++;
+  frags = q->frags;
+  total = q->total;
+  discardcntP = q->discardcntP;
+  q->frags = NULL;
+  ipfrag_drop (q);
+  MP_SPINLOCK_RELEASE (&ipfrag_lock);
+  ipfrag_deliver (frags, total, discardcntP);
+  return (1);
+
+bad:
+  SYSINFO_PTR (si_ipfrag)->is_dropped++;
+  MP_SPINLOCK_RELEASE (&ipfrag_lock);
+  if (discardcntP)
+    (*discardcntP)++;
+  return (1);
+}
@@ -42,32 +42,230 @@
 #include <xok/syscallno.h>
 #include <xok/pkt.h>
 #include <xok/ae_recv.h>
+#include <xok/env.h>
+#include <xok/kerrno.h>
+#include <xok/capability.h>
+#include <xok/network.h>
+#include <xok/loopback.h>
+#include <xok/ipfrag.h>
+#include <xok/scheduler.h>
+#include <xok/pctr.h>
 #include <xok/printf.h>
 #include <xok_include/assert.h>
 #include <xok_include/string.h>
 #include <xok_include/net/ether.h>
 
-/* XXX - need better size determination */
-static char pktinfo[sizeof(struct xokpkt) + NBPG + 3];
-static struct xokpkt *pkt = (struct xokpkt *)&pktinfo;
+/* The loopback interface hands the sender's frame straight to the    */
+/* receive side: sys_net_xmit has already pinned the pages named by the */
+/* gather list, so nothing is copied until pktring_handlepkt moves the  */
+/* data into the receiver's ring.  When impairments are configured, the */
+/* (still pinned) frame waits in a delay line ordered by delivery time, */
+/* and is released from a timeout or from the next transmit.  Times are */
+/* kept in cycles so that no 64-bit division is needed.                 */
+
+/* bytes copied to the stack for classification when the first gather */
+/* entry is too short to hold the headers                              */
+#define LOOPBACK_HDRLEN	128
+
+struct lo_frame {
+   TAILQ_ENTRY (lo_frame) link;
+   struct xokpkt *pkt;		/* sender's packet, pages pinned */
+   uint64 due;			/* cycle count at which to deliver */
+};
+TAILQ_HEAD (lo_frame_list, lo_frame);
+
+static struct {
+   struct network *xoknet;
+   struct lo_impair imp;
+   struct lo_stats stats;
+   struct lo_frame_list q;
+   uint64 busy;			/* cycle at which the link goes idle */
+   u_int bytecost;		/* cycles per byte at li_rate, << 4 */
+   u_int rand;			/* generator state */
+   int timerset;
+} lo;
+
+
+static u_int lo_random (void)
+{
+   /* xorshift, so runs are repeatable from li_seed */
+   lo.rand ^= lo.rand << 13;
+   lo.rand ^= lo.rand >> 17;
+   lo.rand ^= lo.rand << 5;
+   return (lo.rand);
+}
+
+
+static inline int lo_chance (u_int ppm)
+{
+   return ((ppm) && ((lo_random () % LOOPBACK_PPM) < ppm));
+}
+
+
+static inline uint64 lo_usec2cyc (u_int usec)
+{
+   return ((uint64) usec * SYSINFO_GET(si_mhz));
+}
+
+
+static inline int lo_impaired (void)
+{
+   return ((lo.imp.li_delay) || (lo.imp.li_jitter) || (lo.imp.li_loss) ||
+	   (lo.imp.li_rate));
+}
+
+
+/* Hand a frame to whoever's filter accepts it.  This is xokpkt_recv for */
+/* a gather list: DPF looks at a contiguous copy of the headers if need  */
+/* be, and the pktring copies from the sender's pages.  Nettaps already  */
+/* saw the frame on its way out through sys_net_xmit.                    */
+static void lo_input (struct network *xoknet, struct ae_recv *recv)
+{
+   char hdr[LOOPBACK_HDRLEN];
+   char *data = recv->r[0].data;
+   int len = ae_recv_datacnt (recv);
+   int hlen = recv->r[0].sz;
+   struct frag_return result;
+   int filterid;
+   int ringid;
+
+   if (hlen < min (len, LOOPBACK_HDRLEN)) {
+      hlen = ae_recv_datacpy (recv, hdr, 0, LOOPBACK_HDRLEN);
+      data = hdr;
+   }
+
+   xoknet->rcvs++;
+   if (ipfrag_input (recv, data, hlen, &xoknet->discards)) {
+      return;
+   }
+   filterid = TRACE_CLASSIFY (dpf_iptr (data, hlen, &result));
+
+   if (filterid <= 0) {
+      /* nobody wants this packet */
+      xoknet->discards++;
+   } else if ((ringid = dpf_fid_getringval (filterid)) > 0) {
+      pktring_handlepkt (ringid, recv);
+   }
+}
+
+
+static void lo_timer (void *arg);
+
+/* Deliver every frame whose time has come, and make sure a timeout is */
+/* pending for the rest.  Called with the interface lock held.          */
+static void lo_run (void)
+{
+   struct lo_frame *f;
+   uint64 now = rdtsc ();
+
+   while (((f = lo.q.tqh_first) != NULL) && (f->due <= now)) {
+      TAILQ_REMOVE (&lo.q, f, link);
+      lo.stats.ls_qlen--;
+      lo.stats.ls_delivered++;
+      lo_input (lo.xoknet, &f->pkt->recv);
+      f->pkt->freeFunc (f->pkt);
+      free (f);
+   }
+
+   if ((f) && (lo.timerset == 0)) {
+      /* the tick is coarse: fire a little early and re-arm if need be */
+      u_int tickcyc = SYSINFO_GET(si_rate) * SYSINFO_GET(si_mhz);
+      uint64 wait = f->due - now;
+      u_int ticks = (u_int) min (wait, 0x7fffffff) / tickcyc;
+      if (timeout (lo_timer, NULL, max (ticks, 1)) == 0) {
+	 lo.timerset = 1;
+      }
+   }
+}
+
+
+static void lo_timer (void *arg)
+{
+   MP_SPINLOCK_GET (&lo.xoknet->slock);
+   lo.timerset = 0;
+   lo_run ();
+   MP_SPINLOCK_RELEASE (&lo.xoknet->slock);
+}
+
+
+/* Put a frame in the delay line, or drop it, according to lo.imp. */
+static void lo_enqueue (struct xokpkt *pkt, int len)
+{
+   struct lo_frame *f;
+   struct lo_frame *tmp;
+   u_int qlimit = (lo.imp.li_qlimit) ? lo.imp.li_qlimit : LOOPBACK_QLIMIT;
+   uint64 now = rdtsc ();
+
+   if (lo_chance (lo.imp.li_loss)) {
+      lo.stats.ls_lossdrops++;
+      pkt->freeFunc (pkt);
+      return;
+   }
+   if ((lo.stats.ls_qlen >= qlimit) ||
+       ((f = (struct lo_frame *) malloc (sizeof (struct lo_frame))) == NULL)) {
+      lo.stats.ls_qdrops++;
+      pkt->freeFunc (pkt);
+      return;
+   }
+   f->pkt = pkt;
+
+   /* the link is busy for len bytes at li_rate, then the frame is delayed */
+   if (lo.busy < now) {
+      lo.busy = now;
+   }
+   if (lo.bytecost) {
+      lo.busy += ((uint64) len * lo.bytecost) >> 4;
+   }
+   f->due = lo.busy;
+   if (lo_chance (lo.imp.li_reorder)) {
+      lo.stats.ls_reordered++;
+   } else {
+      f->due += lo_usec2cyc (lo.imp.li_delay);
+      if (lo.imp.li_jitter) {
+	 f->due += lo_usec2cyc (lo_random () % (lo.imp.li_jitter + 1));
+      }
+   }
+
+   /* keep the line sorted by due time; most frames go at the end */
+   for (tmp = lo.q.tqh_first; tmp; tmp = tmp->link.tqe_next) {
+      if (tmp->due > f->due) {
+	 break;
+      }
+   }
+   if (tmp) {
+      TAILQ_INSERT_BEFORE (tmp, f, link);
+   } else {
+      TAILQ_INSERT_TAIL (&lo.q, f, link);
+   }
+
+   lo.stats.ls_queued++;
+   if (++lo.stats.ls_qlen > lo.stats.ls_maxqlen) {
+      lo.stats.ls_maxqlen = lo.stats.ls_qlen;
+   }
+}
 
 
 static int loopback_xmit (void *cardstruct, struct ae_recv *recv, int xmitintr)
 {
    struct network *xoknet = cardstruct;
-   int len;
-   int ret;
-
-   pkt->data = (char *)pkt + sizeof(struct xokpkt);
-   len = ae_recv_datacpy (recv, pkt->data, 0, ETHER_MAX_LEN);
-   ret = xokpkt_pktinit(pkt, len, xoknet->netno, &xoknet->discards);
-   pkt->freeFunc = ((struct xokpkt *) recv)->freeFunc;
-   pkt->freeArg = recv;
-   if (ret < 0) return (ret);
-   xokpkt_recv (pkt);
+   /* sys_net_xmit's recv is the head of its xokpkt */
+   struct xokpkt *pkt = (struct xokpkt *) recv;
+   int len = ae_recv_datacnt (recv);
 
    xoknet->xmits++;
-   xoknet->rcvs++;
+
+   MP_SPINLOCK_GET (&xoknet->slock);
+   if ((lo_impaired ()) || (lo.q.tqh_first)) {
+      lo_enqueue (pkt, len);
+      lo_run ();
+      MP_SPINLOCK_RELEASE (&xoknet->slock);
+      return (0);
+   }
+   lo.stats.ls_direct++;
+   MP_SPINLOCK_RELEASE (&xoknet->slock);
+
+   lo_input (xoknet, recv);
+   pkt->freeFunc (pkt);
 
    /* If the packet is handled by an ash then we won't return from
       xokpkt_consume, so we preset the return value to 0. */
@@ -79,14 +277,74 @@ static int loopback_xmit (void *cardstruct, struct ae_recv *recv, int xmitintr)
 }
 
 
+/* Set the impairments for lo0 (if imp is non-NULL, which requires that */
+/* capability k dominate lo0's netcap) and return the current settings */
+/* and counters (if stats is non-NULL).                                 */
+int
+sys_loopback_impair (u_int sn, u_int k, struct lo_impair *imp, struct lo_stats *stats)
+{
+   struct network *xoknet = lo.xoknet;
+   struct lo_impair new;
+   cap c;
+   int r;
+
+   if (imp) {
+      if ((r = env_getcap (curenv, k, &c)) < 0) {
+	 return (r);
+      }
+      if ((r = acl_access (&c, &xoknet->netcap, 1, ACL_ALL)) < 0) {
+	 return (r);
+      }
+      if (!isreadable_varange ((u_int) imp, sizeof (*imp))) {
+	 return (-E_INVAL);
+      }
+      copyin (imp, &new, sizeof (new));
+      if ((new.li_loss > LOOPBACK_PPM) || (new.li_reorder > LOOPBACK_PPM)) {
+	 return (-E_INVAL);
+      }
+
+      MP_SPINLOCK_GET (&xoknet->slock);
+      lo.imp = new;
+      lo.rand = (new.li_seed) ? new.li_seed : 1;
+      lo.bytecost = (new.li_rate) ?
+		    ((SYSINFO_GET(si_mhz) * 8000 * 16) / new.li_rate) : 0;
+      /* senders must not wait for frames in the delay line */
+      if (lo_impaired ()) {
+	 xoknet->flags |= XOKNET_FL_ASYNCXMIT;
+      } else {
+	 xoknet->flags &= ~XOKNET_FL_ASYNCXMIT;
+      }
+      MP_SPINLOCK_RELEASE (&xoknet->slock);
+   }
+
+   if (stats) {
+      if (!iswriteable_varange ((u_int) stats, sizeof (*stats))) {
+	 return (-E_INVAL);
+      }
+      MP_SPINLOCK_GET (&xoknet->slock);
+      lo.stats.ls_impair = lo.imp;
+      copyout (&lo.stats, stats, sizeof (*stats));
+      MP_SPINLOCK_RELEASE (&xoknet->slock);
+   }
+
+   return (0);
+}
+
+
 void loopback_init ()
 {
    struct network * xoknet = xoknet_getstructure (XOKNET_LOOPBACK, loopback_xmit, NULL);
    xoknet->irq = 0xffffffff;
    bzero (xoknet->ether_addr, ETHER_ADDR_LEN);
    sprintf (xoknet->cardname, "lo0");
+   xoknet->maxlen = LOOPBACK_MAXLEN;
    xoknet->inited = 1;
    xoknet->cardstruct = xoknet;
+
+   bzero (&lo, sizeof (lo));
+   TAILQ_INIT (&lo.q);
+   lo.xoknet = xoknet;
+   lo.rand = 1;
 }
 
 
@@ -51,6 +51,14 @@
 #include <xok/printf.h>
 #include <xok/pctr.h>
 #include <xok/sys_proto.h>
+#include <xok/env.h>
+#include <xok/cpu.h>
+#include <xok/kerrno.h>
+#include <xok/malloc.h>
+#include <xok/trap.h>
+#ifdef __SMP__
+#include <xok/apic.h>
+#endif
 
 pctrval pctr_idlcnt;  /* NOTE: idle count not currently incremented */
 
@@ -237,3 +245,188 @@ sys_pctr (u_int sn, u_int cmd, u_int fflag, void *data)
 	  return -1;
     }
 }
+
+
+/*
+ * Sampling profiler, see xok/pctr.h.  Each cpu's ring has one writer,
+ * that cpu's clock interrupt or NMI, and one reader, sys_prof_read,
+ * which only moves the tail; a full ring drops new samples.
+ */
+
+u_int prof_mode = PROF_STOP;
+static u_int prof_fn;		/* P6 counter 0 event select */
+static u_int prof_period;	/* events between PROF_PCTR samples */
+static u_int prof_gen;		/* bumped when the settings change */
+
+static struct prof_cpu {
+  struct prof_sample *ring;
+  volatile u_int head;
+  volatile u_int tail;
+  u_int lost;
+  u_int gen;			/* prof_gen this cpu is set up for */
+  u_int mode;			/* prof_mode this cpu is set up for */
+} prof[NR_CPUS];
+
+static inline void
+prof_record (struct prof_cpu *p, tfp tf)
+{
+  struct prof_sample *ps;
+
+  if (p->head - p->tail >= PROF_NSAMPLES)
+    {
+      p->lost++;
+      return;
+    }
+  ps = &p->ring[p->head & (PROF_NSAMPLES - 1)];
+  ps->ps_eip = tf->tf_eip;
+  ps->ps_envid = curenv ? curenv->env_id : 0;
+  p->head++;
+}
+
+/* program this cpu's counter 0 and performance counter LVT for the
+   current settings */
+static void
+prof_arm (struct prof_cpu *p)
+{
+#ifdef __SMP__
+  if (p->mode == PROF_PCTR && prof_mode != PROF_PCTR)
+    {
+      wrmsr (P6MSR_CTRSEL0, 0);
+      apic_write (APIC_LVTPC, APIC_LVT_MASKED);
+    }
+  if (prof_mode == PROF_PCTR)
+    {
+      wrmsr (P6MSR_CTRSEL0, 0);
+      wrmsr (P6MSR_CTR0, -prof_period);
+      apic_write (APIC_LVTPC, SET_APIC_DELIVERY_MODE (0, APIC_MODE_NMI));
+      wrmsr (P6MSR_CTRSEL0, prof_fn);
+    }
+#endif
+  p->mode = prof_mode;
+  p->gen = prof_gen;
+}
+
+/* called from every clock interrupt */
+void
+prof_tick (tfp tf)
+{
+  struct prof_cpu *p = &prof[cpu_id];
+
+  if (p->gen != prof_gen)
+    prof_arm (p);
+  if (prof_mode == PROF_TIMER && p->ring)
+    prof_record (p, tf);
+}
+
+/* Called for NMIs while prof_mode is PROF_PCTR.  Returns 0 if counter 0
+   has not overflowed, so the NMI is not ours. */
+int
+prof_nmi (tfp tf)
+{
+#ifdef __SMP__
+  struct prof_cpu *p = &prof[cpu_id];
+
+  /* counter 0 counts up from -prof_period; bit 39 clears on overflow */
+  if (p->mode != PROF_PCTR || (rdmsr (P6MSR_CTR0) & 0x8000000000ULL))
+    return 0;
+  if (p->ring)
+    prof_record (p, tf);
+  /* the LVT masks itself on delivery */
+  wrmsr (P6MSR_CTR0, -prof_period);
+  apic_write (APIC_LVTPC, SET_APIC_DELIVERY_MODE (0, APIC_MODE_NMI));
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+/* Start (PROF_TIMER or PROF_PCTR) or stop (PROF_STOP) sampling.  For
+   PROF_PCTR, event is a P6 counter 0 event select and unit mask (the U
+   and K bits default to both) and period the number of events between
+   samples.  Other cpus pick up the change at their next clock tick.
+   Returns the number of samples dropped because a ring was full since
+   the last call.  Needs a zero length capability with all permissions. */
+int
+sys_prof_ctl (u_int sn, u_int k, u_int mode, u_int event, u_int period)
+{
+  cap c;
+  int r, i, lost = 0;
+
+  if ((r = env_getcap (curenv, k, &c)) < 0)
+    return (r);
+  if (c.c_len || c.c_perm != CL_ALL)
+    return (-E_CAP_INSUFF);
+
+  switch (mode)
+    {
+    case PROF_STOP:
+    case PROF_TIMER:
+      break;
+    case PROF_PCTR:
+#ifdef __SMP__
+      if (!usep6ctr || period < 1000)
+	return (-E_INVAL);
+      prof_fn = event | P6CTR_EN | P6CTR_INT;
+      if (!(event & (P6CTR_U | P6CTR_K)))
+	prof_fn |= P6CTR_U | P6CTR_K;
+      prof_period = period;
+      break;
+#else
+      return (-E_INVAL);
+#endif
+    default:
+      return (-E_INVAL);
+    }
+
+  if (mode != PROF_STOP)
+    for (i = 0; i < get_cpu_count (); i++)
+      if (!prof[i].ring)
+	{
+	  prof[i].ring = malloc (PROF_NSAMPLES * sizeof (struct prof_sample));
+	  if (!prof[i].ring)
+	    return (-E_NO_MEM);
+	}
+
+  for (i = 0; i < NR_CPUS; i++)
+    {
+      lost += prof[i].lost;
+      prof[i].lost = 0;
+    }
+
+  prof_mode = mode;
+  prof_gen++;
+  prof_arm (&prof[cpu_id]);
+  return (lost);
+}
+
+/* Copy up to n of cpu's samples to buf, oldest first, and return how
+   many were copied.  Needs a zero length capability with all
+   permissions. */
+int
+sys_prof_read (u_int sn, u_int k, u_int cpu, struct prof_sample *buf, u_int n)
+{
+  struct prof_cpu *p;
+  cap c;
+  int r;
+  u_int i, head;
+
+  if ((r = env_getcap (curenv, k, &c)) < 0)
+    return (r);
+  if (c.c_len || c.c_perm != CL_ALL)
+    return (-E_CAP_INSUFF);
+  if (cpu >= NR_CPUS)
+    return (-E_INVAL);
+  if (n > PROF_NSAMPLES)
+    n = PROF_NSAMPLES;
+  if (!iswriteable_varange ((u_int) buf, n * sizeof (*buf)))
+    return (-E_FAULT);
+
+  p = &prof[cpu];
+  if (!p->ring)
+    return (0);
+  head = p->head;
+  for (i = 0; i < n && p->tail != head; i++, p->tail++)
+    copyout (&p->ring[p->tail & (PROF_NSAMPLES - 1)], &buf[i],
+	     sizeof (*buf));
+  return (i);
+}
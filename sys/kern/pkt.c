@@ -53,6 +53,7 @@
 #include <xok/pkt.h>
 #include <xok/pctr.h>
 #include <xok/pktring.h>
+#include <xok/bpf.h>
 #include <xok/init.h>
 #include <xok/printf.h>
 
@@ -62,12 +63,23 @@ struct xokpkt *lastpkt = NULL;
 
 int xok_ed_xmit (void *, struct ae_recv *, int);
 
+/* drivers polling their receive rings, see xoknet_poll */
+#define XOKNET_MAXPOLL	XOKNET_MAXNETS
+static struct 
+{
+  int (*func) (void *, int);
+  void *arg;
+} xoknet_pollers[XOKNET_MAXPOLL];
+static int xoknet_npollers;
+static struct kspinlock xoknet_poll_lock;
+
 
 int
 xoknet_init (void)
 {
   int i;
   TAILQ_INIT (&pktq);
+  MP_SPINLOCK_INIT (&xoknet_poll_lock);
 
   bzero (SYSINFO_GET (si_networks), (XOKNET_MAXNETS * sizeof (struct network)));
 
@@ -78,6 +90,8 @@ xoknet_init (void)
       /* cap_init_zerolength (&si->si_networks[i].netcap); */
     }
 
+  ipfrag_init ();
+
   /* Initialize the loopback interface */
   loopback_init ();
 
@@ -202,11 +216,59 @@ xoknet_getstructure (int cardtype, int (*xmitfunc) (void *, struct ae_recv *, in
   xoknet->cardstruct = cardstruct;
   xoknet->xmitfunc = xmitfunc;
   xoknet->netno = i;
+  xoknet->maxlen = ETHER_MAX_LEN;
   MP_SPINLOCK_INIT(&xoknet->slock);
   return (xoknet);
 }
 
 
+/* Under a packet flood, taking an interrupt per frame leaves no time for */
+/* anything else.  A driver whose receive interrupt finds more than      */
+/* XOKNET_POLL_BUDGET frames on its ring can turn the interrupt off and  */
+/* register with xoknet_poll_start instead.  xoknet_poll, run from the   */
+/* clock tick and whenever the scheduler is about to idle, then calls    */
+/* pollfunc(arg, budget) to take up to budget frames off the ring.  The  */
+/* driver stays registered until pollfunc returns 0, having found the    */
+/* ring empty and turned its receive interrupt back on.                  */
+void
+xoknet_poll_start (int (*pollfunc) (void *, int), void *arg)
+{
+  int i;
+
+  MP_SPINLOCK_GET (&xoknet_poll_lock);
+  for (i = 0; i < xoknet_npollers; i++)
+    if (xoknet_pollers[i].func == pollfunc && xoknet_pollers[i].arg == arg)
+      break;
+  if (i == xoknet_npollers)
+    {
+      assert (i < XOKNET_MAXPOLL);
+      xoknet_pollers[i].func = pollfunc;
+      xoknet_pollers[i].arg = arg;
+      xoknet_npollers++;
+    }
+  MP_SPINLOCK_RELEASE (&xoknet_poll_lock);
+}
+
+void
+xoknet_poll (void)
+{
+  int i;
+
+  if (xoknet_npollers == 0)
+    return;
+
+  MP_SPINLOCK_GET (&xoknet_poll_lock);
+  for (i = 0; i < xoknet_npollers;)
+    {
+      if (xoknet_pollers[i].func (xoknet_pollers[i].arg, XOKNET_POLL_BUDGET))
+	i++;
+      else
+	xoknet_pollers[i] = xoknet_pollers[--xoknet_npollers];
+    }
+  MP_SPINLOCK_RELEASE (&xoknet_poll_lock);
+}
+
+
 /****************************************************************************/
 /* xok's system call for transmitting a packet on a network interface       */
 /* The four parameters are the interface number, an ae_recv structure       */
@@ -280,7 +342,7 @@ sys_net_xmit (u_int callno, int cardno, struct ae_recv *recv, int *resptr, int x
 	}
       segcnt += recv->r[i].sz;
     }
-  if ((segcnt < ETHER_MIN_LEN) || (segcnt > ETHER_MAX_LEN))
+  if ((segcnt < ETHER_MIN_LEN) || (segcnt > xoknet->maxlen))
     {
       printf ("net_xmit: trying to send packet that is too large or too small (%d)\n", segcnt);
       return (-2);
@@ -375,12 +437,43 @@ struct nettap
   int tap_id;
   int ringid;
   u_int interfaces;
+  bpf_func_t filter;		/* compiled BPF program, or NULL for all */
+  u_int snaplen;		/* bytes copied per packet, 0 for all */
   struct nettap *next;
 };
 
 static u_int next_tap_id = 1;
 static struct nettap *nettaps = NULL;
 
+static void
+nettap_free (struct nettap *nettap)
+{
+  if (nettap->filter)
+    bpf_free (nettap->filter);
+  free (nettap);
+}
+
+/* the caller's capability c must dominate the netcap of each interface */
+/* whose bit is set in `interfaces'                                     */
+static int
+nettap_access (cap *c, u_int interfaces)
+{
+  int i;
+  int r;
+
+  StaticAssert (XOKNET_MAXNETS <= (8 * sizeof (interfaces)));
+  StaticAssert (BV_SZ (XOKNET_MAXNETS) == 1);	
+
+  for (i = 0; i < XOKNET_MAXNETS; i++)
+    {
+      if ((bv_bt (&interfaces, i) &&
+	 ((r = acl_access (c, &(SYSINFO_PTR_AT (si_networks, i)->netcap), 1,
+			   ACL_ALL)) < 0)))
+	return r;
+    }
+  return (0);
+}
+
 /* Set up a "super-filter" to copy all packets sent to the network interfaces */
 /* whose corresponding bits are set in `interfaces' to ring `id'.  If         */
 /* `interfaces' is 0, then `id' identifies an existing network tap and the    */
@@ -391,7 +484,6 @@ sys_nettap (u_int sn, u_int k, int id, u_int interfaces)
 {
   cap c;
   struct nettap *nettap = NULL;
-  int i;
   int r;
 
   if ((r = env_getcap (curenv, k, &c)) < 0)
@@ -421,18 +513,10 @@ sys_nettap (u_int sn, u_int k, int id, u_int interfaces)
     }
 
   /* must have access to each network interface tapped */
-  StaticAssert (XOKNET_MAXNETS <= (8 * sizeof (interfaces)));
-  StaticAssert (BV_SZ (XOKNET_MAXNETS) == 1);	
-
-  for (i = 0; i < XOKNET_MAXNETS; i++)
+  if ((r = nettap_access (&c, interfaces)) < 0)
     {
-      if ((bv_bt (&interfaces, i) &&
-	 ((r = acl_access (&c, &(SYSINFO_PTR_AT (si_networks, i)->netcap), 1,
-			   ACL_ALL)) < 0)))
-	{
-	  MP_SPINLOCK_RELEASE (GLOCK(NETTAP_LOCK));
-	  return r;
-	}
+      MP_SPINLOCK_RELEASE (GLOCK(NETTAP_LOCK));
+      return r;
     }
 
   /* complete the tap deletion */
@@ -460,7 +544,7 @@ sys_nettap (u_int sn, u_int k, int id, u_int interfaces)
 	}
       /* successful completion */
       Sysinfo_si_num_nettaps_atomic_dec(si);
-      free (nettap);
+      nettap_free (nettap);
 
       MP_SPINLOCK_RELEASE (GLOCK(NETTAP_LOCK));
       return (0);
@@ -487,6 +571,8 @@ sys_nettap (u_int sn, u_int k, int id, u_int interfaces)
   next_tap_id++;
   nettap->ringid = id;
   nettap->interfaces = interfaces;
+  nettap->filter = NULL;
+  nettap->snaplen = 0;
   nettap->next = nettaps;
   nettaps = nettap;
 
@@ -507,7 +593,7 @@ xokpkt_nettap_delpktring (int ringid)
     {
       nettaps = nettap->next;
       Sysinfo_si_num_nettaps_atomic_dec(si);
-      free (nettap);
+      nettap_free (nettap);
       nettap = nettaps;
     }
   if (nettap != NULL)
@@ -519,7 +605,7 @@ xokpkt_nettap_delpktring (int ringid)
 	      struct nettap *del = nettap->next;
 	      nettap->next = del->next;
       	      Sysinfo_si_num_nettaps_atomic_dec(si);
-	      free (del);
+	      nettap_free (del);
 	    }
 	  else
 	    {
@@ -537,6 +623,113 @@ xokpkt_nettap_delpktring (int ringid)
   return (0);
 }
 
+/* Give tap `id' the BPF program `prog' (`len' instructions, in user     */
+/* space), replacing any it had; a NULL `prog' takes it off.  Only the   */
+/* packets the program accepts are copied to the tap's ring, and only as */
+/* many bytes as it returns and at most `snaplen' of them (0 for no      */
+/* limit).  The caller needs the same rights as to create the tap.       */
+int
+sys_nettap_filter (u_int sn, u_int k, int id, struct bpf_insn *prog,
+		   u_int len, u_int snaplen)
+{
+  cap c;
+  struct nettap *nettap;
+  struct bpf_insn *kprog;
+  bpf_func_t filter = NULL;
+  bpf_func_t old;
+  int r;
+
+  if ((r = env_getcap (curenv, k, &c)) < 0)
+    return r;
+
+  if (prog != NULL)
+    {
+      if (len == 0 || len > BPF_MAXINSNS)
+	return (-E_INVAL);
+      if (!isreadable_varange ((u_int) prog, len * sizeof (*prog)))
+	return (-E_FAULT);
+      kprog = (struct bpf_insn *) malloc (len * sizeof (*prog));
+      if (kprog == NULL)
+	return (-E_NO_MEM);
+      copyin (prog, kprog, len * sizeof (*prog));
+      filter = bpf_compile (kprog, len);
+      free (kprog);
+      if (filter == NULL)
+	return (-E_INVAL);
+    }
+
+  MP_SPINLOCK_GET (GLOCK(NETTAP_LOCK));
+
+  nettap = nettaps;
+  while ((nettap != NULL) && (nettap->tap_id != id))
+    nettap = nettap->next;
+  if (nettap == NULL)
+    r = -E_NOT_FOUND;
+  else
+    r = nettap_access (&c, nettap->interfaces);
+  if (r < 0)
+    {
+      MP_SPINLOCK_RELEASE (GLOCK(NETTAP_LOCK));
+      if (filter)
+	bpf_free (filter);
+      return r;
+    }
+
+  old = nettap->filter;
+  nettap->filter = filter;
+  nettap->snaplen = snaplen;
+
+  MP_SPINLOCK_RELEASE (GLOCK(NETTAP_LOCK));
+  if (old)
+    bpf_free (old);
+  return (0);
+}
+
+/* copy the part of `recv' that tap `nettap' wants to its ring */
+static inline void
+nettap_deliver (struct nettap *nettap, struct ae_recv *recv)
+{
+  struct ae_recv snap;
+  u_int wirelen, caplen;
+  int i;
+
+  if (nettap->filter == NULL && nettap->snaplen == 0)
+    {
+      pktring_handlepkt (nettap->ringid, recv);
+      return;
+    }
+
+  if (recv->n == 0)
+    return;
+  wirelen = caplen = ae_recv_datacnt (recv);
+
+  /* the filter sees the first buffer; that holds the headers of all */
+  /* but outgoing packets put together from several buffers          */
+  if (nettap->filter)
+    caplen = min (caplen, nettap->filter (recv->r[0].data, wirelen,
+					  recv->r[0].sz));
+  if (nettap->snaplen)
+    caplen = min (caplen, nettap->snaplen);
+
+  if (caplen == 0)
+    return;
+  if (caplen == wirelen)
+    {
+      pktring_handlepkt (nettap->ringid, recv);
+      return;
+    }
+
+  snap.n = 0;
+  for (i = 0; i < recv->n && caplen > 0; i++)
+    {
+      snap.r[i].data = recv->r[i].data;
+      snap.r[i].sz = min (recv->r[i].sz, caplen);
+      caplen -= snap.r[i].sz;
+      snap.n++;
+    }
+  pktring_handlesnap (nettap->ringid, &snap, wirelen);
+}
+
 void 
 xokpkt_nettap (struct xokpkt *pkt)
 {
@@ -548,7 +741,7 @@ xokpkt_nettap (struct xokpkt *pkt)
     {
       if (bv_bt (&nettap->interfaces, pkt->interface))
 	{
-	  pktring_handlepkt (nettap->ringid, (struct ae_recv *) &pkt->count);
+	  nettap_deliver (nettap, (struct ae_recv *) &pkt->count);
 	}
       nettap = nettap->next;
     }
@@ -557,6 +750,96 @@ xokpkt_nettap (struct xokpkt *pkt)
 }
 
 
+/*
+ * Batched xokpkt_recv.  The packets are classified together by
+ * dpf_classify_batch and runs of packets going to the same ring are
+ * handed to pktring_handlepkts at once; packets only get freed after
+ * the whole burst has been delivered.
+ */
+void
+xokpkt_recv_batch (struct xokpkt **pkts, int n)
+{
+  uint8 *msgs[XOKPKT_BATCH];
+  unsigned nbytes[XOKPKT_BATCH];
+  int fids[XOKPKT_BATCH];
+  struct frag_return results[XOKPKT_BATCH];
+  struct ae_recv *recvs[XOKPKT_BATCH];
+  int i, m, nrecv, ringid, lastring;
+
+  assert (n <= XOKPKT_BATCH);
+
+  for (i = m = 0; i < n; i++)
+    {
+#ifdef KDEBUG
+      if (kdebug_is_debug_pkt (pkts[i]->data, pkts[i]->len))
+	{
+	  kdebug_pkt (pkts[i]->data, pkts[i]->len);
+	  if (pkts[i]->freeFunc) pkts[i]->freeFunc (pkts[i]);
+	  continue;
+	}
+#endif
+      if (SYSINFO_GET (si_num_nettaps) > 0)
+	xokpkt_nettap (pkts[i]);
+      if (ipfrag_input ((struct ae_recv *) &pkts[i]->count, pkts[i]->data,
+			pkts[i]->len, pkts[i]->discardcntP))
+	{
+	  if (pkts[i]->freeFunc) pkts[i]->freeFunc (pkts[i]);
+	  continue;
+	}
+
+      pkts[m] = pkts[i];
+      msgs[m] = pkts[m]->data;
+      nbytes[m] = pkts[m]->len;
+      m++;
+    }
+  if ((n = m) == 0)
+    return;
+
+#ifdef ENABLE_TRACE
+  if (trace_hdr->th_mask & (1 << TR_CLASSIFY))
+    {
+      u_quad_t t = rdtsc ();
+      u_int per;
+
+      dpf_classify_batch (msgs, nbytes, n, fids, results);
+      per = (u_int) (rdtsc () - t) / n;
+      for (i = 0; i < n; i++)
+	trace (TR_CLASSIFY, fids[i], per);
+    }
+  else
+#endif
+    dpf_classify_batch (msgs, nbytes, n, fids, results);
+
+  nrecv = 0;
+  lastring = 0;
+  for (i = 0; i < n; i++)
+    {
+      ringid = fids[i] > 0 ? dpf_fid_getringval (fids[i]) : 0;
+
+      if (nrecv > 0 && ringid != lastring)
+	{
+	  pktring_handlepkts (lastring, recvs, nrecv);
+	  nrecv = 0;
+	}
+
+      if (fids[i] <= 0)
+	xokpkt_unwanted (pkts[i]);
+      else if (ringid > 0)
+	{
+	  recvs[nrecv++] = (struct ae_recv *) &pkts[i]->count;
+	  lastring = ringid;
+	}
+      else
+	xokpkt_noring (pkts[i], fids[i]);
+    }
+  if (nrecv > 0)
+    pktring_handlepkts (lastring, recvs, nrecv);
+
+  for (i = 0; i < n; i++)
+    if (pkts[i]->freeFunc) pkts[i]->freeFunc (pkts[i]);
+}
+
+
 void 
 xokpkt_free(struct xokpkt *pkt)
 {
@@ -56,6 +56,7 @@
 /* Don't use 0th ringid */
 static pktringent *rings[(MAX_PKTRING_COUNT + 1)];
 static int notify_when_empty[(MAX_PKTRING_COUNT + 1)];
+static u_int ringflags[(MAX_PKTRING_COUNT + 1)];	/* PKTRING_FL_ */
 static int ringused[(MAX_PKTRING_COUNT + 1)];
 
 #ifdef __SMP__
@@ -238,6 +239,7 @@ sys_pktring_setring (u_int sn, u_int k, u_int ringid,
 
   pktring_free (rings[ringid]);
   rings[ringid] = NULL;
+  ringflags[ringid] = 0;
 
   utmp = ringhead_user;
   do
@@ -396,6 +398,7 @@ sys_pktring_delring (u_int sn, u_int k, u_int ringid)
   
   pktring_free (rings[ringid]);
   rings[ringid] = NULL;
+  ringflags[ringid] = 0;
   ringused[ringid] = 0;
 
   /* let the nettap functionality know that a pktring has been deleted */
@@ -407,22 +410,54 @@ sys_pktring_delring (u_int sn, u_int k, u_int ringid)
 }
 
 
-void 
-pktring_handlepkt (int ringid, struct ae_recv *recv)
+/* set ring ringid's PKTRING_FL_ flags */
+int 
+sys_pktring_setflags (u_int sn, u_int k, u_int ringid, u_int flags)
+{
+  if (ringid <= 0 || ringid >= MAX_PKTRING_COUNT)
+    return -E_INVAL;
+  if (flags & ~PKTRING_FL_CHAIN)
+    return -E_INVAL;
+
+  MP_SPINLOCK_GET(&ring_spinlocks[ringid]);
+  if (ringused[ringid] == 0)
+    {
+      MP_SPINLOCK_RELEASE(&ring_spinlocks[ringid]);
+      return (-E_NOT_FOUND);
+    }
+  ringflags[ringid] = flags;
+  MP_SPINLOCK_RELEASE(&ring_spinlocks[ringid]);
+  return (0);
+}
+
+
+/* copy up to len bytes of recv, starting off bytes in, into the ring
+   entry ktmp, returning how many fit */
+static inline int
+pktring_fill (pktringent *ktmp, struct ae_recv *recv, int off, int len)
 {
   int i;
-  pktringent *ktmp;
-  int len = ae_recv_datacnt (recv);
   int runlen = 0;
 
-  if (ringid < 0 || ringid >= MAX_PKTRING_COUNT)
+  for (i = 0; i < ktmp->recv.n && runlen < len; i++)
     {
-      warn ("pktring_handlepkt: bogus ringid passed in");
-      return;
+      int tmplen = min ((len - runlen), ktmp->recv.r[i].sz);
+      ae_recv_datacpy (recv, ktmp->recv.r[i].data, off + runlen, tmplen);
+      runlen += tmplen;
     }
+  return runlen;
+}
+
+
+/* copy recv into the next free entry of ring ringid, which is locked;
+   cut is how many bytes of the packet recv leaves off */
+static inline void
+pktring_deliver (int ringid, struct ae_recv *recv, u_int cut)
+{
+  pktringent *ktmp;
+  int len = ae_recv_datacnt (recv);
+  int runlen;
 
-  MP_SPINLOCK_GET(&ring_spinlocks[ringid]);
-   
   ktmp = rings[ringid];
   if ((ktmp == NULL) || (len == 0) || (*(ktmp->owner) != 0))
     {
@@ -432,30 +467,132 @@ pktring_handlepkt (int ringid, struct ae_recv *recv)
 	  printf ("pktring full (ringid %d, len %d, fid %d)\n", 
 	      ringid, len, dpf_ringval_getfid (ringid));
 	}
-      
-      MP_SPINLOCK_RELEASE(&ring_spinlocks[ringid]);
       return;
     }
 
   rings[ringid] = ktmp->next;
-  for (i = 0; i < ktmp->recv.n; i++)
+  runlen = pktring_fill (ktmp, recv, 0, len);
+
+  if (runlen != len)
     {
-      int tmplen = min ((len - runlen), ktmp->recv.r[i].sz);
-      ae_recv_datacpy (recv, ktmp->recv.r[i].data, runlen, tmplen);
-      runlen += tmplen;
-      if (runlen >= len)
+      printf ("remaining runlen %d (len %d, recv.n %d, recv.r[0].sz %d)\n", runlen, len, ktmp->recv.n, ((ktmp->recv.n) ? ktmp->recv.r[0].sz : 0));
+    }
+  *(ktmp->owner) = len | (min (cut, PKTRING_CUTMAX) << PKTRING_LENBITS);
+}
+
+
+void 
+pktring_handlepkt (int ringid, struct ae_recv *recv)
+{
+  if (ringid < 0 || ringid >= MAX_PKTRING_COUNT)
+    {
+      warn ("pktring_handlepkt: bogus ringid passed in");
+      return;
+    }
+
+  MP_SPINLOCK_GET(&ring_spinlocks[ringid]);
+  pktring_deliver (ringid, recv, 0);
+  MP_SPINLOCK_RELEASE(&ring_spinlocks[ringid]);
+}
+
+
+/* the same for the first part of a packet that was wirelen bytes long
+   (see nettap_deliver) */
+void 
+pktring_handlesnap (int ringid, struct ae_recv *recv, u_int wirelen)
+{
+  if (ringid < 0 || ringid >= MAX_PKTRING_COUNT)
+    {
+      warn ("pktring_handlesnap: bogus ringid passed in");
+      return;
+    }
+
+  MP_SPINLOCK_GET(&ring_spinlocks[ringid]);
+  pktring_deliver (ringid, recv, wirelen - ae_recv_datacnt (recv));
+  MP_SPINLOCK_RELEASE(&ring_spinlocks[ringid]);
+}
+
+
+/* the same for a burst of packets that all go to ring ringid, taking
+   its lock once (see xokpkt_recv_batch) */
+void 
+pktring_handlepkts (int ringid, struct ae_recv **recvs, int n)
+{
+  int i;
+
+  if (ringid < 0 || ringid >= MAX_PKTRING_COUNT)
+    {
+      warn ("pktring_handlepkts: bogus ringid passed in");
+      return;
+    }
+
+  MP_SPINLOCK_GET(&ring_spinlocks[ringid]);
+  for (i = 0; i < n; i++)
+    pktring_deliver (ringid, recvs[i], 0);
+  MP_SPINLOCK_RELEASE(&ring_spinlocks[ringid]);
+}
+
+
+/* Deliver recv, which may not fit in one ring entry, into as many
+   consecutive free entries of ring ringid as it takes; each entry's
+   owner field gets the number of bytes put there.  The first entry is
+   marked last, so once the application sees it the rest is in place.
+   Unless there is room for all of it, nothing is delivered.  This is
+   how reassembled IP datagrams (see kern/ipfrag.c) reach rings made of
+   MTU-sized entries.  Only rings whose owner asked for that with
+   PKTRING_FL_CHAIN get packets that need more than one entry; others
+   only get ones that fit in the next entry.  Returns 1 if recv was
+   delivered, 0 if not. */
+int 
+pktring_handlechain (int ringid, struct ae_recv *recv)
+{
+  pktringent *ents[PKTRING_MAXCHAIN];
+  int lens[PKTRING_MAXCHAIN];
+  pktringent *ktmp;
+  int len = ae_recv_datacnt (recv);
+  int i, n, room, runlen;
+
+  if (ringid < 0 || ringid >= MAX_PKTRING_COUNT)
+    {
+      warn ("pktring_handlechain: bogus ringid passed in");
+      return (0);
+    }
+
+  MP_SPINLOCK_GET(&ring_spinlocks[ringid]);
+  ktmp = rings[ringid];
+  for (n = 0, room = 0; room < len; n++)
+    {
+      if ((n > 0) && !(ringflags[ringid] & PKTRING_FL_CHAIN))
+	{
+	  /* too big for one entry, and the ring can't take a chain */
+	  MP_SPINLOCK_RELEASE(&ring_spinlocks[ringid]);
+	  return (0);
+	}
+      if ((ktmp == NULL) || (n == PKTRING_MAXCHAIN) || (*(ktmp->owner) != 0) ||
+	  ((n > 0) && (ktmp == rings[ringid])))
 	{
-	  break;
+	  if (notify_when_empty[ringid])
+	    printf ("pktring full (ringid %d, len %d, %d entries free)\n",
+		    ringid, len, n);
+	  MP_SPINLOCK_RELEASE(&ring_spinlocks[ringid]);
+	  return (0);
 	}
+      ents[n] = ktmp;
+      for (i = 0; i < ktmp->recv.n; i++)
+	room += ktmp->recv.r[i].sz;
+      ktmp = ktmp->next;
     }
+  rings[ringid] = ktmp;
 
-  if (runlen != len)
+  for (i = 0, runlen = 0; i < n; i++)
     {
-      printf ("remaining runlen %d (len %d, recv.n %d, recv.r[0].sz %d)\n", runlen, len, ktmp->recv.n, ((ktmp->recv.n) ? ktmp->recv.r[0].sz : 0));
+      lens[i] = pktring_fill (ents[i], recv, runlen, len - runlen);
+      runlen += lens[i];
     }
-  *(ktmp->owner) = len;
-
+  while (n-- > 0)
+    *(ents[n]->owner) = lens[n];
   MP_SPINLOCK_RELEASE(&ring_spinlocks[ringid]);
+  return (1);
 }
 
 
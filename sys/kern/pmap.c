@@ -502,7 +502,17 @@ ppage_init (void) __XOK_NOSYNC
 
     /* allocate space for the XN registry and disk free map */
     /* defined in ubb/xn.h */
+#ifdef ENABLE_TRACE
+    /* ...and the trace rings after them, at UTRACE */
+    __xn_free_map = ptspace_alloc (&xnmap_upt, UXNMAP_SIZE + UXN_SIZE
+				   + UTRACE_SIZE);
+    trace_hdr = (struct trace_hdr *) ((char *) __xn_free_map + UXNMAP_SIZE
+				      + UXN_SIZE);
+    trace_hdr->th_ncpus = get_cpu_count ();
+    trace_hdr->th_nev = TRACE_NEV;
+#else
     __xn_free_map = ptspace_alloc (&xnmap_upt, UXNMAP_SIZE + UXN_SIZE);
+#endif
     xn_registry = (struct xr *) ((char *) __xn_free_map + UXNMAP_SIZE);
   }
 #endif
@@ -2071,6 +2081,7 @@ page_fault_handler (u_int trapno, u_int errcode)
 #endif
 
   asm volatile ("movl %%cr2,%0":"=r" (va):);
+  TRACE(TR_TRAP, trapno, va);
 
   /* Always propagate if the fault from user mode */
   if (errcode & FEC_U)
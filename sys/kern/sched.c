@@ -52,6 +52,7 @@
 #include <xok/kerrno.h>
 #include <xok/malloc.h>
 #include <xok/printf.h>
+#include <xok/pctr.h>
 
 
 
@@ -553,6 +554,8 @@ sched_runnext (void)
        */
       if (curq == icq && cycled_thru_qlist)
 	{
+	  /* nothing to run: drain any receive rings in polled mode */
+	  xoknet_poll ();
 #ifdef __SMP__
 	  if (env_localize(env0) != 0)
 	  {
@@ -640,6 +643,14 @@ sched_intr (int trapno)
   int cpu = cpu_id;
   
   irq_eoi (0);
+  TRACE(TR_TRAP, trapno, 0);
+
+  /* sampling profiler, see sys_prof_ctl */
+  {
+    tfp tf;
+    tfp_set (tf, trapno, tf_edi);
+    prof_tick (tf);
+  }
 
   /* no need to lock this... always sync updates */
   INC_FIELD_AT(si,Sysinfo,si_percpu_ticks,cpu,1); 
@@ -676,6 +687,9 @@ sched_intr (int trapno)
     to_done->to_func (to_done->to_arg);
     free (to_done);
   }
+
+  /* network receivers that turned their interrupts off under load */
+  xoknet_poll ();
   
   if (in_revocation)
   {
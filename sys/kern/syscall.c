@@ -36,6 +36,7 @@
  */
 
 #define __VIA_SYSCALL__
+#define __SYSCALL_MODULE__
 
 #include <xok/sysinfo.h>
 #include <xok/env.h>
@@ -45,6 +46,7 @@
 #include <xok/printf.h>
 #include <xok/pctr.h>
 #include <xok/mplock.h>
+#include <xok/cpu.h>
 
 
 
@@ -60,6 +62,75 @@ sys_get_nsyscalls (u_int sn)
 }
 
 
+
+/* Per-syscall statistics in si_scstats.  locore.S only calls
+   scstat_enter and scstat_exit while scstat_enabled is set, so they cost
+   a compare and branch per syscall otherwise.  Each CPU only updates its
+   own counters, with interrupts off, so no locking is needed. */
+
+u_int scstat_enabled = 0;
+
+static struct {
+  uint64 start;			/* tsc at syscall entry */
+  u_int sn;			/* syscall number + 1, 0 if none */
+} scstat_cur[NR_CPUS];
+
+void
+scstat_enter (u_int sn)
+{
+  scstat_cur[cpu_id].sn = sn + 1;
+  scstat_cur[cpu_id].start = rdtsc ();
+}
+
+void
+scstat_exit (u_int sn)
+{
+  struct scstat *ss;
+  u_int cycles, b;
+
+  /* syscalls that ended up in env_run never get here; the next syscall
+     on this cpu overwrote their start */
+  if (scstat_cur[cpu_id].sn != sn + 1)
+    return;
+  scstat_cur[cpu_id].sn = 0;
+  cycles = rdtsc () - scstat_cur[cpu_id].start;
+
+  ss = &SYSINFO_PTR_AT(si_scstats, cpu_id)->sc_sys[sn];
+  ss->ss_count++;
+  ss->ss_cycles += cycles;
+  if (cycles > ss->ss_max)
+    ss->ss_max = cycles;
+  for (b = 0; b < SC_NBUCKETS - 1 && cycles >> (SC_BUCKET0 + b); b++);
+  ss->ss_hist[b]++;
+}
+
+/* Turn syscall statistics on or off (SCSTAT_ENABLE) and optionally
+   zero them (SCSTAT_RESET).  Returns the old SCSTAT_ENABLE state.
+   Needs a zero length capability with all permissions. */
+int
+sys_scstat_ctl (u_int sn, u_int k, u_int flags)
+{
+  cap c;
+  int r, i;
+  u_int old = scstat_enabled;
+
+  if ((r = env_getcap (curenv, k, &c)) < 0)
+    return (r);
+  if (c.c_len || c.c_perm != CL_ALL)
+    return (-E_CAP_INSUFF);
+
+  scstat_enabled = 0;
+  if (flags & SCSTAT_RESET)
+    {
+      for (i = 0; i < NR_CPUS; i++)
+	bzero (SYSINFO_PTR_AT(si_scstats, i), sizeof (struct scstat_cpu));
+    }
+  scstat_enabled = (flags & SCSTAT_ENABLE) ? 1 : 0;
+  SYSINFO_ASSIGN(si_scstat_enabled, scstat_enabled);
+  return (old);
+}
+
+
   
 void
 sys_null (u_int sn)
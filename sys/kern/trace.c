@@ -0,0 +1,88 @@
+
+/*
+ * Copyright (C) 1997 Massachusetts Institute of Technology 
+ *
+ * This software is being provided by the copyright holders under the
+ * following license. By obtaining, using and/or copying this software,
+ * you agree that you have read, understood, and will comply with the
+ * following terms and conditions:
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose and without fee or royalty is
+ * hereby granted, provided that the full text of this NOTICE appears on
+ * ALL copies of the software and documentation or portions thereof,
+ * including modifications, that you make.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS," AND COPYRIGHT HOLDERS MAKE NO
+ * REPRESENTATIONS OR WARRANTIES, EXPRESS OR IMPLIED. BY WAY OF EXAMPLE,
+ * BUT NOT LIMITATION, COPYRIGHT HOLDERS MAKE NO REPRESENTATIONS OR
+ * WARRANTIES OF MERCHANTABILITY OR FITNESS FOR ANY PARTICULAR PURPOSE OR
+ * THAT THE USE OF THE SOFTWARE OR DOCUMENTATION WILL NOT INFRINGE ANY
+ * THIRD PARTY PATENTS, COPYRIGHTS, TRADEMARKS OR OTHER RIGHTS. COPYRIGHT
+ * HOLDERS WILL BEAR NO LIABILITY FOR ANY USE OF THIS SOFTWARE OR
+ * DOCUMENTATION.
+ *
+ * The name and trademarks of copyright holders may NOT be used in
+ * advertising or publicity pertaining to the software without specific,
+ * written prior permission. Title to copyright in this software and any
+ * associated documentation will at all times remain with copyright
+ * holders. See the file AUTHORS which should have accompanied this software
+ * for a list of all copyright holders.
+ *
+ * This file may be derived from previously copyrighted software. This
+ * copyright applies only to those changes made by the copyright
+ * holders listed in the AUTHORS file. The rest of this file is covered by
+ * the copyright notices, if any, listed below.
+ */
+
+/*
+ * Kernel event tracing; see xok/trace.h.  The rings themselves are set
+ * up in ppage_init, right after the XN free map in the same page table.
+ */
+
+#include <xok/sys_proto.h>
+#include <xok/env.h>
+#include <xok/kerrno.h>
+#include <xok/trace.h>
+
+#ifdef ENABLE_TRACE
+struct trace_hdr *trace_hdr;
+#endif
+
+/* Trace the event types set in mask (1 << TR_x) from now on and return
+   the old mask.  Needs a zero length capability with all permissions. */
+int
+sys_trace_ctl (u_int sn, u_int k, u_int mask)
+{
+#ifdef ENABLE_TRACE
+  cap c;
+  int r;
+  u_int old;
+
+  if ((r = env_getcap (curenv, k, &c)) < 0)
+    return (r);
+  if (c.c_len || c.c_perm != CL_ALL)
+    return (-E_CAP_INSUFF);
+
+  old = trace_hdr->th_mask;
+  trace_hdr->th_mask = mask & TR_ALL;
+  return (old);
+#else
+  return (-E_INVAL);
+#endif
+}
+
+#ifdef ENABLE_TRACE
+/* called around every syscall from locore.S */
+void
+trace_syscall (u_int sn)
+{
+  TRACE(TR_SYSCALL, sn, 0);
+}
+
+void
+trace_sysret (u_int sn, u_int ret)
+{
+  TRACE(TR_SYSRET, sn, ret);
+}
+#endif
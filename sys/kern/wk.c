@@ -85,9 +85,12 @@ static int wk_compile (struct wk_term *t, int sz, char *code,
   struct Ppage *pp;
   u_int ppn;
   int ret = 0;
+  int oflags;
 
   next_pp = 0;
 
+  /* predicates run on every scheduling decision: keep them tight */
+  oflags = v_setopt (V_OPT_ALL);
   v_lambda ("", "", NULL, 1, code, WK_MAX_CODE_BYTES);
   if (!v_getreg (&r1, V_U, V_TEMP) ||
       !v_getreg (&r2, V_U, V_TEMP) ||
@@ -218,6 +221,7 @@ static int wk_compile (struct wk_term *t, int sz, char *code,
   v_end (NULL);
 
 error:
+  v_setopt (oflags);
   /* have to do this even on error so that our caller can just call
      wk_free to clean memory/ref counts up */
   pred_pages[next_pp] = 0;
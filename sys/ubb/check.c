@@ -81,7 +81,7 @@ int u_set_eq(udf_ext *s1, udf_ext *s2) {
 		if(v1->lb != v2->lb || v1->ub != v2->ub)
 			return 0;
 	}
-	return i < UDF_EXT_MAX;
+	return i == s1->n;
 }
 
 static int valid_op(unsigned op) {
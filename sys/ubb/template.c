@@ -104,6 +104,7 @@ static xn_err_t tdelete(xn_elem_t type) {
 
 	ensure((t = tlookup(type)) && t->active, XN_BOGUS_TYPE);
 	t->active = 0;
+	udf_jit_flush(t->t);
 	return XN_SUCCESS;
 }
 
@@ -173,6 +174,7 @@ void tmplt_shutdown(void) {
 	udf_type *t;
 
 	ntemplates = 1;
+	udf_jit_flush(0);
 	for(i = XN_ROOT_TYPE; i <= XN_DB; i++) {
 		t = type_lookup(i);
 		free(t);
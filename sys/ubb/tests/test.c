@@ -41,9 +41,16 @@
 #include <xn.h>
 #include <kernel/virtual-disk.h>
 
+#include <sys/time.h>
+
 #include "ffs.h"
 #include "lib/demand.h"
 #include "root-catalogue.h"
+#include "xn-struct.h"
+#include "udf.h"
+#include "template.h"
+#include "lib/set.h"
+#include "lib/kexcept.h"
 
 static db_t install_root(char *name, cap_t c, xn_elem_t t) {
 	int res;
@@ -253,6 +260,203 @@ static void rules_test(struct u_inode *slash) {
 	no_fail(sys_xn_writeback(da_to_db(slash->da), 1, &cnt));
 }
 
+/* 
+ * Run each owns UDF of type ty through the interpreter and the JIT
+ * over the same random meta data: results must agree.  Then time
+ * both.
+ */
+#define JIT_ITERS 1000
+
+extern Set udf_access;
+
+static double usecs(struct timeval *start, struct timeval *end) {
+	return (end->tv_sec - start->tv_sec) * 1e6 
+		+ (end->tv_usec - start->tv_usec);
+}
+
+static void jit_test_type(xn_elem_t ty) {
+	struct udf_type *t;
+	struct udf_fun *owns;
+	struct udf_ext *r, none;
+	struct timeval start, end;
+	static unsigned char meta[XN_BLOCK_SIZE];
+	unsigned i, k, n;
+	int ri, rj;
+	Set si, sj;
+	double ti, tj;
+
+	if(!(t = type_lookup(ty)) || t->class != UDF_BASE_TYPE)
+		return;
+	demand(t->nbytes <= sizeof meta, type too big);
+	if(!(n = t->u.t.nowns))
+		return;
+
+	for(i = 0; i < t->nbytes; i++)
+		meta[i] = random();
+	memset(&none, 0, sizeof none);
+	owns = &t->u.t.owns;
+	r = malloc(n * sizeof *r);
+	assert(r);
+
+	for(i = 0; i < n; i++) {
+		udf_getset(&r[i], &t->u.t.read_f, i);
+
+		udf_access = set_new();
+		ri = udf_interp(owns, 0, meta, &i, 1, &r[i], &none);
+		si = udf_access;
+		udf_access = set_new();
+		rj = udf_jit_run(owns, 0, meta, &i, 1, &r[i], &none, 0);
+		sj = udf_access;
+
+		if(ri != rj || !set_eq(si, sj)) {
+			printf("%s: owns(%d): interp = %d, jit = %d\n", 
+				t->type_name, i, ri, rj);
+			set_print("interp", si);
+			set_print("jit", sj);
+			fatal(JIT disagrees with interpreter);
+		}
+		Arena_free(sys_arena);
+	}
+
+	gettimeofday(&start, 0);
+	for(k = 0; k < JIT_ITERS; k++) {
+		for(i = 0; i < n; i++) {
+			udf_access = set_new();
+			udf_interp(owns, 0, meta, &i, 1, &r[i], &none);
+		}
+		Arena_free(sys_arena);
+	}
+	gettimeofday(&end, 0);
+	ti = usecs(&start, &end);
+
+	gettimeofday(&start, 0);
+	for(k = 0; k < JIT_ITERS; k++) {
+		for(i = 0; i < n; i++) {
+			udf_access = set_new();
+			udf_jit_run(owns, 0, meta, &i, 1, &r[i], &none, 0);
+		}
+		Arena_free(sys_arena);
+	}
+	gettimeofday(&end, 0);
+	tj = usecs(&start, &end);
+
+	printf("%-16s %3d owns: interp %6.3f us, jit %6.3f us per call\n",
+		t->type_name, n, ti / (JIT_ITERS * n), tj / (JIT_ITERS * n));
+	free(r);
+}
+
+static void jit_test(void) {
+	jit_test_type(inode_t);
+	jit_test_type(s_indir_t);
+	jit_test_type(d_indir_t);
+	jit_test_type(t_indir_t);
+	jit_test_type(meta_t);
+
+	printf("jit: %u compiled, %u failed, %u native runs, %u interpreted, "
+		"%u checks elided, %u left\n", 
+		udf_jit_stats.compiled, udf_jit_stats.failed, 
+		udf_jit_stats.runs, udf_jit_stats.interp,
+		udf_jit_stats.elided, udf_jit_stats.checks);
+}
+
+/*
+ * Allocate and then free NBATCH direct blocks of ui, first one op at
+ * a time, then as one sys_xn_batch each way, and compare the time
+ * spent verifying.  Also makes sure a failing batch changes nothing.
+ */
+#define NBATCH		8
+#define BATCH_ROUNDS	100
+
+static void batch_ops(u_inode *ui, struct xn_batch_op *v, 
+			struct xn_m_vec *mv, int kind, db_t *dbs) {
+	int i;
+
+	for(i = 0; i < NBATCH; i++) {
+		v[i].kind = kind;
+		v[i].da = ui->da;
+		if(kind == XN_BATCH_ALLOC)
+			ffs_db_alloc(&v[i].op, i, dbs[i], ui->uid);
+		else
+			ffs_db_free(&v[i].op, i, dbs[i], ui->uid);
+		/* ffs_write_db hands out one static m_vec: copy it. */
+		mv[i] = *v[i].op.m.mv;
+		v[i].op.m.mv = &mv[i];
+	}
+}
+
+static void find_dbs(db_t *dbs) {
+	int i;
+
+	for(i = 0; i < NBATCH; i++) {
+		dbs[i] = db_find_free(i ? dbs[i-1] + 1 : 0, 1);
+		assert(dbs[i]);
+	}
+}
+
+static void batch_bench(u_inode *ui) {
+	struct xn_batch_op v[NBATCH];
+	struct xn_m_vec mv[NBATCH];
+	struct timeval start, end;
+	double ts, tb;
+	db_t dbs[NBATCH];
+	xn_cnt_t cnt;
+	int i, r;
+
+	AssertNow(NBATCH <= XN_BATCH_MAX && NBATCH <= NDIRECT);
+
+	/* Overlapping allocs: must fail and leave the inode alone. */
+	find_dbs(dbs);
+	dbs[NBATCH-1] = dbs[0];
+	batch_ops(ui, v, mv, XN_BATCH_ALLOC, dbs);
+	must_fail(sys_xn_batch(v, NBATCH));
+	no_fail(ffs_alloc_block(ui, 0, dbs[0]));
+	no_fail(ffs_free_block(ui, 0));
+	no_fail(sys_xn_writeback(da_to_db(ui->da), 1, &cnt));
+
+	/* A free the UDF does not agree with rolls back the whole batch. */
+	find_dbs(dbs);
+	batch_ops(ui, v, mv, XN_BATCH_ALLOC, dbs);
+	no_fail(sys_xn_batch(v, NBATCH));
+	for(i = 0; i < NBATCH; i++)
+		ui->incore.db[i] = dbs[i];
+	batch_ops(ui, v, mv, XN_BATCH_FREE, dbs);
+	v[NBATCH-1].op.u.db = dbs[0];
+	must_fail(sys_xn_batch(v, NBATCH));
+	/* Only succeeds if every pointer was restored. */
+	batch_ops(ui, v, mv, XN_BATCH_FREE, dbs);
+	no_fail(sys_xn_batch(v, NBATCH));
+	no_fail(sys_xn_writeback(da_to_db(ui->da), 1, &cnt));
+
+	ts = tb = 0;
+	for(r = 0; r < BATCH_ROUNDS; r++) {
+		find_dbs(dbs);
+		gettimeofday(&start, 0);
+		for(i = 0; i < NBATCH; i++)
+			no_fail(ffs_alloc_block(ui, i, dbs[i]));
+		for(i = 0; i < NBATCH; i++)
+			no_fail(ffs_free_block(ui, i));
+		gettimeofday(&end, 0);
+		ts += usecs(&start, &end);
+		no_fail(sys_xn_writeback(da_to_db(ui->da), 1, &cnt));
+
+		find_dbs(dbs);
+		gettimeofday(&start, 0);
+		batch_ops(ui, v, mv, XN_BATCH_ALLOC, dbs);
+		no_fail(sys_xn_batch(v, NBATCH));
+		for(i = 0; i < NBATCH; i++)
+			ui->incore.db[i] = dbs[i];
+		batch_ops(ui, v, mv, XN_BATCH_FREE, dbs);
+		no_fail(sys_xn_batch(v, NBATCH));
+		gettimeofday(&end, 0);
+		tb += usecs(&start, &end);
+		no_fail(sys_xn_writeback(da_to_db(ui->da), 1, &cnt));
+	}
+
+	printf("xn batch: %d ops: one at a time %6.2f us, batched %6.2f us per op\n",
+		NBATCH, ts / (BATCH_ROUNDS * 2 * NBATCH), 
+		tb / (BATCH_ROUNDS * 2 * NBATCH));
+}
+
 int main(int argc, char *argv[]) {
 	db_t root;
 	int i;
@@ -273,6 +477,8 @@ loop:
 	/* Install our types. */
 	if(specify_ffs_meta() < 0)
 		fatal(Failed);
+	if(!j)
+		jit_test();
 	
 	c = 0;
 	root = install_root("ffs-root", c, inode_t);
@@ -293,6 +499,8 @@ loop:
 
 	no_fail(ffs_set_type(&ui, meta_t, 0));
 
+	if(!j)
+		batch_bench(&ui);
 
 	/* Allocate some space for it. */
 	for(i = 0; i < 10; i++)
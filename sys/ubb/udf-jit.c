@@ -0,0 +1,695 @@
+
+/*
+ * Copyright (C) 1997 Massachusetts Institute of Technology 
+ *
+ * This software is being provided by the copyright holders under the
+ * following license. By obtaining, using and/or copying this software,
+ * you agree that you have read, understood, and will comply with the
+ * following terms and conditions:
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose and without fee or royalty is
+ * hereby granted, provided that the full text of this NOTICE appears on
+ * ALL copies of the software and documentation or portions thereof,
+ * including modifications, that you make.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS," AND COPYRIGHT HOLDERS MAKE NO
+ * REPRESENTATIONS OR WARRANTIES, EXPRESS OR IMPLIED. BY WAY OF EXAMPLE,
+ * BUT NOT LIMITATION, COPYRIGHT HOLDERS MAKE NO REPRESENTATIONS OR
+ * WARRANTIES OF MERCHANTABILITY OR FITNESS FOR ANY PARTICULAR PURPOSE OR
+ * THAT THE USE OF THE SOFTWARE OR DOCUMENTATION WILL NOT INFRINGE ANY
+ * THIRD PARTY PATENTS, COPYRIGHTS, TRADEMARKS OR OTHER RIGHTS. COPYRIGHT
+ * HOLDERS WILL BEAR NO LIABILITY FOR ANY USE OF THIS SOFTWARE OR
+ * DOCUMENTATION.
+ *
+ * The name and trademarks of copyright holders may NOT be used in
+ * advertising or publicity pertaining to the software without specific,
+ * written prior permission. Title to copyright in this software and any
+ * associated documentation will at all times remain with copyright
+ * holders. See the file AUTHORS which should have accompanied this software
+ * for a list of all copyright holders.
+ *
+ * This file may be derived from previously copyrighted software. This
+ * copyright applies only to those changes made by the copyright
+ * holders listed in the AUTHORS file. The rest of this file is covered by
+ * the copyright notices, if any, listed below.
+ */
+
+/*
+ * Translate UDFs to native code with vcode.
+ *
+ * The generated code follows udf_interp instruction for instruction,
+ * quirks included (AND uses its immediate, MOVI/NEGI/NOTI read U_IMM).
+ * Anything we cannot translate exactly is handed back to the
+ * interpreter.  The one difference is the instruction budget: we
+ * charge a whole basic block on entry, so a looping UDF that ends
+ * within a block of INST_BUDGET may be stopped where the interpreter
+ * would have finished.
+ *
+ * The UBB register file stays in memory (jit_regs): x86 does not have
+ * U_REG_MAX registers to spare and UDFs are short.  The win over the
+ * interpreter is dispatch and decode, plus the bounds checks we can
+ * prove at translation time: when the address of a load or store is a
+ * known constant we check it once, against the access set we compile
+ * for, and the code is then only reused with an equal set.  We only
+ * do this when the caller says its sets are stable (the type's own
+ * type_access, raw_read and raw_write); per-call sets get a single
+ * translation that checks everything at run time.
+ *
+ * Compiled code is cached by UDF and stable flag, and remembers the
+ * instructions it was made from: an entry whose UDF has changed under
+ * it is retranslated.  When the cache is full the least recently used
+ * entry goes.  template.c flushes a type's entries when the type
+ * leaves the catalogue.
+ */
+#include <kernel.h>
+#include <vcode/vcode.h>
+#include "ubb.h"
+#include "udf.h"
+#include "ubb-inst.h"
+#include "demand.h"
+#include "kexcept.h"
+
+#define INST_BUDGET	1024		/* must match interp.c */
+
+#define JIT_CODE_BYTES	4096
+#define JIT_OVERRUN	128		/* largest single translation. */
+#define JIT_MAX		64		/* translations we keep. */
+#define JIT_HASH	32
+
+typedef struct udf_jit {
+	struct udf_jit *next;
+	struct udf_fun *f;
+	struct udf_fun fn;	/* copy of *f that code was made from. */
+	int (*code)(void);	/* nil: cannot translate, interpret. */
+	char *mem;
+	unsigned used;		/* jit_clock at last lookup. */
+	int stable;		/* caller's r and w never change. */
+	int specialized;	/* code only valid for r and w below. */
+	struct udf_ext r, w;
+} udf_jit;
+
+static udf_jit *jit_tab[JIT_HASH];
+static int jit_n;
+static unsigned jit_clock;
+
+#define jit_hash(f) ((((unsigned)(f)) >> 4) % JIT_HASH)
+
+/* Run-time state of the executing UDF, read by generated code. */
+static unsigned jit_regs[U_REG_MAX];
+static int jit_ninsts;
+static void *jit_xn, *jit_xn_orig;
+static struct udf_ext *jit_r, *jit_w, *jit_r_orig, *jit_w_orig;
+static struct udf_ctx *jit_ctx;
+
+struct udf_jit_stats udf_jit_stats;
+
+/*
+ * Helpers called from generated code.
+ */
+
+enum { JIT_DEATH, JIT_BUDGET, JIT_NOTYET, JIT_BADOP };
+
+static void jit_fatal(int why) {
+	switch(why) {
+	case JIT_DEATH:		fatal(death);
+	case JIT_BUDGET:	fatal(Runtime exceeded);
+	case JIT_NOTYET:	fatal(Not handling yet.);
+	default:		fatal(Should not get here.);
+	}
+}
+
+static int jit_nil(void) {
+	check(0, Hit nil inst in UDF; should not get here, 0);
+	return 0;
+}
+
+static int jit_legal(unsigned off, int nbytes, int write) {
+	return !udf_illegal_access(off, nbytes, write ? jit_w : jit_r);
+}
+
+static int jit_sw_seg(int n) {
+	if(n != UDF_SELF)
+		try(udf_switch_seg(jit_ctx, n, &jit_xn, &jit_r, &jit_w));
+	else {
+		jit_xn = jit_xn_orig;
+		jit_r = jit_r_orig;
+		jit_w = jit_w_orig;
+	}
+	return 0;
+}
+
+/*
+ * Translation.
+ */
+
+#define REG(n)	((int)&jit_regs[n])
+#define VAR(v)	((int)&(v))
+
+/* Operations whose only effect is a fatal error; value is the reason. */
+static int jit_fatal_op(uop_t op) {
+	switch(op) {
+	case U_INDEX_LDI:
+		return JIT_NOTYET;
+	case U_SW_SEGI: case U_J: case U_STB: case U_STS: case U_STI:
+	case U_LDB: case U_LDS: case U_LDI: case U_INDEX_LD:
+		return JIT_BADOP;
+	default:
+		return -1;
+	}
+}
+
+/* The interpreter dispatches these to its NIL label. */
+#define jit_nil_op(op) (!u_valid_op(op))
+
+static int jit_branches(uop_t op) {
+	switch(op) {
+	case U_BEQ: case U_BNE: case U_BLT: case U_BLE: case U_BGT: case U_BGE:
+	case U_BEQI: case U_BNEI: case U_BLTI: case U_BLEI: case U_BGTI:
+	case U_BGEI: case U_JI:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/* Does control continue to the next instruction? */
+static int jit_falls_through(uop_t op) {
+	return op != U_JI && op != U_RET && op != U_RETI 
+		&& !jit_nil_op(op) && jit_fatal_op(op) < 0;
+}
+
+static int jit_target(struct udf_inst *ip, int i) {
+	return U_OP(ip) == U_JI ? i + (int)U_IMM(ip) : i + (int)U_IMM(ip) + 1;
+}
+
+/* Which fields an instruction uses as registers, and whether it sets RD. */
+enum { J_RD = 1, J_RS1 = 2, J_RS2 = 4, J_SET = 8 };
+
+static int jit_regs_used(uop_t op) {
+	switch(op) {
+	case U_ADD: case U_SUB: case U_DIV: case U_MUL: case U_OR: case U_XOR:
+		return J_RD | J_RS1 | J_RS2 | J_SET;
+	case U_AND: case U_ADDI: case U_SUBI: case U_MULI: case U_DIVI:
+	case U_ANDI: case U_ORI: case U_XORI:
+	case U_MOV: case U_NEG: case U_NOT:
+	case U_LDII: case U_LDSI: case U_LDBI:
+		return J_RD | J_RS1 | J_SET;
+	case U_MOVI: case U_NEGI: case U_NOTI:
+		return J_RD | J_SET;
+	case U_BEQ: case U_BNE: case U_BLT: case U_BLE: case U_BGT: case U_BGE:
+	case U_STII: case U_STSI: case U_STBI:
+		return J_RD | J_RS1;
+	case U_BEQI: case U_BNEI: case U_BLTI: case U_BLEI: case U_BGTI:
+	case U_BGEI: case U_RET:
+		return J_RD;
+	case U_ADD_EXT:		return J_RD | J_RS1 | J_RS2;
+	case U_ADD_EXTI:	return J_RD | J_RS1;
+	case U_ADD_CEXT:	return J_RD | J_RS2;
+	case U_ADD_CEXTI:	return J_RD;
+	default:
+		return 0;
+	}
+}
+
+static int jit_regs_ok(struct udf_inst *ip) {
+	int u;
+
+	u = jit_regs_used(U_OP(ip));
+	return (!(u & J_RD) || u_valid_reg(U_RD(ip)))
+		&& (!(u & J_RS1) || u_valid_reg(U_RS1(ip)))
+		&& (!(u & J_RS2) || u_valid_reg(U_RS2(ip)));
+}
+
+static void jit_branch(uop_t op, v_reg_t a, v_reg_t b, unsigned imm, v_label_t l) {
+	switch(op) {
+	case U_BEQ:	v_bequ(a, b, l); break;
+	case U_BNE:	v_bneu(a, b, l); break;
+	case U_BLT:	v_bltu(a, b, l); break;
+	case U_BLE:	v_bleu(a, b, l); break;
+	case U_BGT:	v_bgtu(a, b, l); break;
+	case U_BGE:	v_bgeu(a, b, l); break;
+	case U_BEQI:	v_bequi(a, imm, l); break;
+	case U_BNEI:	v_bneui(a, imm, l); break;
+	case U_BLTI:	v_bltui(a, imm, l); break;
+	case U_BLEI:	v_bleui(a, imm, l); break;
+	case U_BGTI:	v_bgtui(a, imm, l); break;
+	case U_BGEI:	v_bgeui(a, imm, l); break;
+	default:	fatal(Bogus branch);
+	}
+}
+
+/* Fold an immediate op over a known constant.  Returns 0 if we cannot. */
+static int jit_fold(uop_t op, unsigned x, unsigned imm, unsigned *res) {
+	switch(op) {
+	case U_ADDI:	*res = x + imm; return 1;
+	case U_SUBI:	*res = x - imm; return 1;
+	case U_MULI:	*res = x * imm; return 1;
+	case U_DIVI:	if(!imm) return 0; *res = x / imm; return 1;
+	case U_AND:
+	case U_ANDI:	*res = x & imm; return 1;
+	case U_ORI:	*res = x | imm; return 1;
+	case U_XORI:	*res = x ^ imm; return 1;
+	default:	return 0;
+	}
+}
+
+/*
+ * Emit a load or store.  If RS1 holds a known constant and we may
+ * prove things, the access is checked here instead of at run time.
+ */
+static void 
+jit_mem(udf_jit *e, struct udf_inst *ip, int known, unsigned base, int prove,
+	v_reg_t z, v_reg_t a, v_reg_t b, v_label_t death) {
+	int nbytes, write;
+	struct udf_ext *s;
+	v_reg_t ret;
+
+	switch(U_OP(ip)) {
+	case U_LDII: case U_STII:	nbytes = sizeof(unsigned); break;
+	case U_LDSI: case U_STSI:	nbytes = sizeof(unsigned short); break;
+	default:			nbytes = sizeof(unsigned char); break;
+	}
+	write = U_OP(ip) == U_STII || U_OP(ip) == U_STSI || U_OP(ip) == U_STBI;
+	s = write ? &e->w : &e->r;
+
+	if(known && prove) {
+		e->specialized = 1;
+		if(!u_in_set(s, base + U_IMM(ip), nbytes)) {
+			/* Fails every time; so does the interpreter. */
+			v_jv(death);
+			return;
+		}
+		udf_jit_stats.elided++;
+	} else {
+		v_ldui(a, z, REG(U_RS1(ip)));
+		v_addui(a, a, U_IMM(ip));
+		ret = v_scalli((v_iptr)jit_legal, "%u%I%I", a, nbytes, write);
+		v_movu(b, ret);
+		v_putreg(ret, V_U);
+		v_beqii(b, 0, death);
+		udf_jit_stats.checks++;
+	}
+
+	/* b = xn + RS1; the access is at b + IMM. */
+	v_ldui(b, z, VAR(jit_xn));
+	if(known)
+		v_addui(b, b, base);
+	else {
+		v_ldui(a, z, REG(U_RS1(ip)));
+		v_addu(b, b, a);
+	}
+
+	if(write) {
+		v_ldui(a, z, REG(U_RD(ip)));
+		switch(nbytes) {
+		case 4:	v_stui(a, b, U_IMM(ip)); break;
+		case 2:	v_stusi(a, b, U_IMM(ip)); break;
+		default: v_stuci(a, b, U_IMM(ip)); break;
+		}
+	} else {
+		switch(nbytes) {
+		case 4:	v_ldui(a, b, U_IMM(ip)); break;
+		case 2:	v_ldusi(a, b, U_IMM(ip)); break;
+		default: v_lduci(a, b, U_IMM(ip)); break;
+		}
+		v_stui(a, z, REG(U_RD(ip)));
+	}
+}
+
+/* 
+ * Compile f into e->mem.  Returns 0 if f cannot be translated exactly,
+ * in which case the caller interprets it.
+ */
+static int jit_compile(udf_jit *e, struct udf_fun *f) {
+	struct udf_inst *ip;
+	int i, t, n, loops, sw_seg, len, why, prove;
+	char leader[UDF_INST_MAX + 1];
+	v_label_t label[UDF_INST_MAX], death, budget;
+	v_reg_t z, a, b, c, ret;
+	unsigned known[U_REG_MAX], kval[U_REG_MAX], x;
+	int writes_r0;
+	union v_fp fp;
+	v_label_t l;
+
+	if((n = f->ninst) <= 0 || n > UDF_INST_MAX)
+		return 0;
+
+	/* Find basic blocks; refuse anything the interpreter would run off. */
+	memset(leader, 0, sizeof leader);
+	leader[0] = 1;
+	loops = sw_seg = writes_r0 = 0;
+	for(i = 0; i < n; i++) {
+		ip = &f->insts[i];
+		if((unsigned)U_OP(ip) > U_END || !jit_regs_ok(ip))
+			return 0;
+		if(U_OP(ip) == U_SW_SEG)
+			sw_seg = 1;
+		if((jit_regs_used(U_OP(ip)) & J_SET) && U_RD(ip) == 0)
+			writes_r0 = 1;
+		if(jit_branches(U_OP(ip))) {
+			t = jit_target(ip, i);
+			if(t < 0 || t >= n)
+				return 0;
+			leader[t] = 1;
+			leader[i + 1] = 1;
+			if(t <= i)
+				loops = 1;
+		} else if(!jit_falls_through(U_OP(ip)))
+			leader[i + 1] = 1;
+	}
+	if(jit_falls_through(U_OP(&f->insts[n - 1])))
+		return 0;
+
+	/* 
+	 * Constant addresses are only ours to prove against stable sets,
+	 * and only if we never switch.
+	 */
+	prove = e->stable && !sw_seg;
+
+	v_lambda("", "", NULL, V_NLEAF, e->mem, JIT_CODE_BYTES);
+	if(!v_getreg(&z, V_U, V_VAR) || !v_getreg(&a, V_U, V_VAR) ||
+	   !v_getreg(&b, V_U, V_VAR) || !v_getreg(&c, V_U, V_VAR))
+		fatal(Not enough registers);
+	v_setu(z, 0);
+
+	for(i = 0; i < n; i++)
+		label[i] = v_genlabel();
+	death = v_genlabel();
+	budget = v_genlabel();
+
+	for(i = 0; i < n; i++) {
+		if(v_ip > e->mem + JIT_CODE_BYTES - JIT_OVERRUN)
+			return 0;
+
+		ip = &f->insts[i];
+		if(leader[i]) {
+			v_label(label[i]);
+			memset(known, 0, sizeof known);
+			if(!writes_r0)
+				known[0] = 1, kval[0] = 0;
+
+			/* 
+			 * Charge the whole block on entry.  This can trip
+			 * the budget up to a block before the interpreter.
+			 */
+			if(loops) {
+				for(len = 1; i + len < n && !leader[i + len]; len++)
+					;
+				v_ldui(a, z, VAR(jit_ninsts));
+				v_addui(a, a, len);
+				v_stui(a, z, VAR(jit_ninsts));
+				v_bgtui(a, INST_BUDGET, budget);
+			}
+		}
+
+		if((why = jit_fatal_op(U_OP(ip))) >= 0) {
+			v_scallv((v_vptr)jit_fatal, "%I", why);
+			v_retui(0);
+			continue;
+		}
+
+		if(jit_nil_op(U_OP(ip))) {
+			ret = v_scalli((v_iptr)jit_nil, "");
+			v_putreg(ret, V_U);
+			v_retui(0);
+			continue;
+		}
+
+		switch(U_OP(ip)) {
+		case U_ADD: case U_SUB: case U_DIV: case U_MUL: 
+		case U_OR: case U_XOR:
+			v_ldui(a, z, REG(U_RS1(ip)));
+			v_ldui(b, z, REG(U_RS2(ip)));
+			switch(U_OP(ip)) {
+			case U_ADD:	v_addu(a, a, b); break;
+			case U_SUB:	v_subu(a, a, b); break;
+			case U_DIV:	v_divu(a, a, b); break;
+			case U_MUL:	v_mulu(a, a, b); break;
+			case U_OR:	v_oru(a, a, b); break;
+			default:	v_xoru(a, a, b); break;
+			}
+			v_stui(a, z, REG(U_RD(ip)));
+			known[U_RD(ip)] = 0;
+			break;
+
+		/* AND uses the immediate in the interpreter, too. */
+		case U_AND:
+		case U_ADDI: case U_SUBI: case U_MULI: case U_DIVI:
+		case U_ANDI: case U_ORI: case U_XORI:
+			if(known[U_RS1(ip)] 
+			&& jit_fold(U_OP(ip), kval[U_RS1(ip)], U_IMM(ip), &x)) {
+				v_setu(a, x);
+				v_stui(a, z, REG(U_RD(ip)));
+				known[U_RD(ip)] = 1;
+				kval[U_RD(ip)] = x;
+				break;
+			}
+			v_ldui(a, z, REG(U_RS1(ip)));
+			switch(U_OP(ip)) {
+			case U_ADDI:	v_addui(a, a, U_IMM(ip)); break;
+			case U_SUBI:	v_subui(a, a, U_IMM(ip)); break;
+			case U_MULI:	v_mului(a, a, U_IMM(ip)); break;
+			case U_DIVI:	v_divui(a, a, U_IMM(ip)); break;
+			case U_ORI:	v_orui(a, a, U_IMM(ip)); break;
+			case U_XORI:	v_xorui(a, a, U_IMM(ip)); break;
+			default:	v_andui(a, a, U_IMM(ip)); break;
+			}
+			v_stui(a, z, REG(U_RD(ip)));
+			known[U_RD(ip)] = 0;
+			break;
+
+		case U_BEQ: case U_BNE: case U_BLT: case U_BLE: case U_BGT: 
+		case U_BGE:
+			v_ldui(a, z, REG(U_RD(ip)));
+			v_ldui(b, z, REG(U_RS1(ip)));
+			jit_branch(U_OP(ip), a, b, 0, label[jit_target(ip, i)]);
+			break;
+		case U_BEQI: case U_BNEI: case U_BLTI: case U_BLEI: case U_BGTI:
+		case U_BGEI:
+			v_ldui(a, z, REG(U_RD(ip)));
+			jit_branch(U_OP(ip), a, 0, U_RS1(ip), label[jit_target(ip, i)]);
+			break;
+		case U_JI:
+			v_jv(label[jit_target(ip, i)]);
+			break;
+
+		case U_MOV: case U_NEG: case U_NOT:
+			v_ldui(a, z, REG(U_RS1(ip)));
+			if(U_OP(ip) == U_NEG)
+				v_comu(a, a);
+			else if(U_OP(ip) == U_NOT)
+				v_notu(a, a);
+			v_stui(a, z, REG(U_RD(ip)));
+			if((known[U_RD(ip)] = known[U_RS1(ip)])) {
+				x = kval[U_RS1(ip)];
+				kval[U_RD(ip)] = U_OP(ip) == U_NEG ? ~x 
+					: U_OP(ip) == U_NOT ? !x : x;
+			}
+			break;
+		case U_MOVI: case U_NEGI: case U_NOTI:
+			x = U_IMM(ip);
+			x = U_OP(ip) == U_NEGI ? ~x : U_OP(ip) == U_NOTI ? !x : x;
+			v_setu(a, x);
+			v_stui(a, z, REG(U_RD(ip)));
+			known[U_RD(ip)] = 1;
+			kval[U_RD(ip)] = x;
+			break;
+
+		case U_LDII: case U_LDSI: case U_LDBI: 
+		case U_STII: case U_STSI: case U_STBI:
+			jit_mem(e, ip, known[U_RS1(ip)], kval[U_RS1(ip)], prove, 
+				z, a, b, death);
+			if(U_OP(ip) == U_LDII || U_OP(ip) == U_LDSI 
+			|| U_OP(ip) == U_LDBI)
+				known[U_RD(ip)] = 0;
+			break;
+
+		case U_RETI:
+			v_retui(U_IMM(ip));
+			break;
+		case U_RET:
+			if(f->result_t == UBB_SET) {
+				v_retui(1);
+			} else {
+				v_ldui(a, z, REG(U_RD(ip)));
+				v_retu(a);
+			}
+			break;
+
+		case U_SW_SEG:
+			ret = v_scalli((v_iptr)jit_sw_seg, "%I", U_IMM(ip));
+			v_movu(a, ret);
+			v_putreg(ret, V_U);
+			l = v_genlabel();
+			v_bgeii(a, 0, l);
+			v_retu(a);
+			v_label(l);
+			break;
+
+		case U_ADD_EXT: case U_ADD_EXTI: case U_ADD_CEXT: case U_ADD_CEXTI:
+			v_ldui(a, z, REG(U_RD(ip)));
+			if(U_OP(ip) == U_ADD_EXT || U_OP(ip) == U_ADD_EXTI)
+				v_ldui(b, z, REG(U_RS1(ip)));
+			else
+				v_setu(b, U_RS1(ip));
+			if(U_OP(ip) == U_ADD_EXT || U_OP(ip) == U_ADD_CEXT)
+				v_ldui(c, z, REG(U_RS2(ip)));
+			else
+				v_setu(c, U_IMM(ip));
+			v_scallv((v_vptr)udf_add, "%u%u%u", a, b, c);
+			break;
+
+		default:
+			return 0;
+		}
+	}
+
+	/* Out of line failure paths. */
+	v_label(death);
+	v_scallv((v_vptr)jit_fatal, "%I", JIT_DEATH);
+	v_retui(0);
+	v_label(budget);
+	v_scallv((v_vptr)jit_fatal, "%I", JIT_BUDGET);
+	v_retui(0);
+
+	fp = v_end(0);
+	if(!fp.i)
+		return 0;
+	e->code = fp.i;
+	return 1;
+}
+
+/*
+ * Cache.
+ */
+
+/* Is e's translation still of the UDF at f? */
+static int jit_same(udf_jit *e, struct udf_fun *f) {
+	return e->fn.ninst == f->ninst && f->ninst <= UDF_INST_MAX
+		&& e->fn.nargs == f->nargs && e->fn.result_t == f->result_t
+		&& !memcmp(e->fn.insts, f->insts, f->ninst * sizeof f->insts[0]);
+}
+
+/* (Re)translate f into e. */
+static void 
+jit_translate(udf_jit *e, struct udf_fun *f, struct udf_ext *r, struct udf_ext *w) {
+	e->fn = *f;
+	e->r = *r;
+	e->w = *w;
+	e->code = 0;
+	e->specialized = 0;
+
+	if((e->mem || (e->mem = malloc(JIT_CODE_BYTES))) && jit_compile(e, &e->fn))
+		udf_jit_stats.compiled++;
+	else {
+		/* Remember the failure so we do not retry on every call. */
+		if(e->mem)
+			free(e->mem);
+		e->mem = 0;
+		e->code = 0;
+		e->specialized = 0;
+		udf_jit_stats.failed++;
+	}
+}
+
+static void jit_free(udf_jit *e) {
+	if(e->mem)
+		free(e->mem);
+	free(e);
+	jit_n--;
+}
+
+/* Throw out the least recently used translation. */
+static void jit_evict(void) {
+	udf_jit *e, **p, **oldest;
+	int i;
+
+	for(oldest = 0, i = 0; i < JIT_HASH; i++)
+		for(p = &jit_tab[i]; (e = *p); p = &e->next)
+			if(!oldest || (int)(e->used - (*oldest)->used) < 0)
+				oldest = p;
+	if(!oldest)
+		return;
+	e = *oldest;
+	*oldest = e->next;
+	jit_free(e);
+	udf_jit_stats.evicted++;
+}
+
+static udf_jit *
+jit_lookup(struct udf_fun *f, struct udf_ext *r, struct udf_ext *w, int stable) {
+	udf_jit *e, **b;
+
+	b = &jit_tab[jit_hash(f)];
+	for(e = *b; e; e = e->next)
+		if(e->f == f && e->stable == stable)
+			break;
+
+	if(e) {
+		e->used = ++jit_clock;
+		if(!jit_same(e, f) || (e->specialized 
+		&& (!u_set_eq(&e->r, r) || !u_set_eq(&e->w, w)))) {
+			udf_jit_stats.stale++;
+			jit_translate(e, f, r, w);
+		}
+		return e;
+	}
+
+	if(jit_n >= JIT_MAX)
+		jit_evict();
+	if(!(e = calloc(1, sizeof *e)))
+		return 0;
+	e->f = f;
+	e->stable = stable;
+	e->used = ++jit_clock;
+	jit_translate(e, f, r, w);
+
+	e->next = *b;
+	*b = e;
+	jit_n++;
+	return e;
+}
+
+/* Drop translations of t's UDFs; all of them if t is nil. */
+void udf_jit_flush(struct udf_type *t) {
+	udf_jit *e, **p;
+	int i;
+
+	for(i = 0; i < JIT_HASH; i++) {
+		for(p = &jit_tab[i]; (e = *p); ) {
+			if(t && ((char *)e->f < (char *)t 
+			|| (char *)e->f >= (char *)(t + 1))) {
+				p = &e->next;
+				continue;
+			}
+			*p = e->next;
+			jit_free(e);
+		}
+	}
+}
+
+/* 
+ * Same result as udf_interp.  Stable is set if r_access and w_access
+ * are the same sets every time f is run through them.
+ */
+int udf_jit_run(struct udf_fun *f, struct udf_ctx *ctx, void *xn, unsigned *params, int nargs, struct udf_ext *r_access, struct udf_ext *w_access, int stable) {
+	udf_jit *e;
+
+	if(!(e = jit_lookup(f, r_access, w_access, stable)) || !e->code) {
+		udf_jit_stats.interp++;
+		return udf_interp(f, ctx, xn, params, nargs, r_access, w_access);
+	}
+	udf_jit_stats.runs++;
+
+	jit_ctx = ctx;
+	jit_xn = jit_xn_orig = xn;
+	jit_r = jit_r_orig = r_access;
+	jit_w = jit_w_orig = w_access;
+	jit_ninsts = 0;
+
+	jit_regs[0] = 0;
+	memcpy(&jit_regs[1], params, sizeof params[0] * nargs);
+
+	return e->code();
+}
@@ -308,6 +308,107 @@ int udf_move(int type, void *meta, xn_op *op, xn_update *o_add, xn_update *o_del
 	return meta_transaction(move, type, meta, op, 0);
 }
 
+/*
+ * Check a batch of modifications in one pass.  Ops that name the same
+ * UDF (meta data, type and own_id) form a group that shares its before
+ * and after sets: we run every group's UDF once before any op writes,
+ * apply all the writes, then run each once more.  With add/del the
+ * union of the group's allocs/frees, we require
+ *
+ *	del <= old,  add ^ old = nil,  new = (old - del) U add
+ *
+ * which is udf_move's rule; a group of writes only gets new = old.
+ * Caller is responsible for rolling back changes.
+ */
+int udf_batch(struct udf_bmod *v, int n) {
+	struct bgroup {
+		void *meta;
+		int type;
+		size_t index;
+		struct udf_fun *f;
+		struct udf_ext access;
+		Set old, add, del;
+	} g[XN_BATCH_MAX];
+	int grp[XN_BATCH_MAX];
+	struct udf_fun *read_f;
+	struct udf_bmod *m;
+	struct bgroup *b;
+	int i, ng, res;
+	size_t index;
+	Set new, u;
+
+	demand(n <= XN_BATCH_MAX, bogus batch size);
+
+	/* Before: one run per group. */
+	for(ng = i = 0; i < n; i++) {
+		m = &v[i];
+		grp[i] = -1;
+
+		/* hack since we subvert the type system */
+		if(xn_in_kernel && xn_isspecial(m->type))
+			continue;
+
+		index = m->op->m.own_id;
+		for(b = &g[0]; b < &g[ng]; b++)
+			if(b->meta == m->meta && b->type == m->type 
+			&& b->index == index)
+				break;
+
+		if(b == &g[ng]) {
+			b->meta = m->meta;
+			b->type = m->type;
+			b->index = index;
+			if(!(b->f = udf_lookup(&read_f, m->type, m->meta, 
+							index, m->op->m.cap))) {
+				set_free();
+				return XN_BOGUS_INDEX;
+			}
+			udf_getset(&b->access, read_f, index);
+			if(!(b->old = udf_run(m->meta, b->f, index, 
+						&b->access, &no_access))) {
+				set_free();
+				return XN_TYPE_ERROR;
+			}
+			b->add = set_new();
+			b->del = set_new();
+			ng++;
+		}
+		grp[i] = b - &g[0];
+
+		if(m->kind == XN_BATCH_ALLOC || m->kind == XN_BATCH_FREE) {
+			if(!(u = set_single(m->op->u))) {
+				set_free();
+				return XN_CANNOT_ALLOC;
+			}
+			if(m->kind == XN_BATCH_ALLOC)
+				b->add = set_union(b->add, u);
+			else
+				b->del = set_union(b->del, u);
+		}
+	}
+
+	/* Apply every write, in order. */
+	for(i = 0; i < n; i++)
+		if(grp[i] >= 0)
+			mv_write(v[i].meta, v[i].op->m.mv, v[i].op->m.n);
+
+	/* After: one more run per group. */
+	res = XN_SUCCESS;
+	for(b = &g[0]; b < &g[ng]; b++) {
+		new = udf_run(b->meta, b->f, b->index, &b->access, &no_access);
+		if(!new
+		|| !set_issubset(b->old, b->del)
+		|| set_size(set_diff(b->add, b->old)) != set_size(b->add)
+		|| !set_eq(new, set_union(set_diff(b->old, b->del), b->add))) {
+			res = XN_TYPE_ERROR;
+			break;
+		}
+	}
+
+	set_free();
+	return res;
+}
+
 static unsigned meta[PAGESIZ];
 
 int udf_type_init(struct udf_type *t) {
@@ -371,7 +472,7 @@ Set udf_run(void* meta, struct udf_fun *f, size_t index, struct udf_ext *r, stru
 
         udf_access = set_new();
 	params[0] = index;
-	return !udf_interp(f, 0, meta, params, 1, r, w) ? 0 : udf_access;
+	return !udf_jit_run(f, 0, meta, params, 1, r, w, 0) ? 0 : udf_access;
 }
 
 static struct udf_ext *udf_extent;
@@ -414,7 +515,7 @@ int udf_getset(struct udf_ext *e, struct udf_fun *f, int index) {
 	 * Is currently a strictly algebraic computation: not allowed to
 	 * look at meta data.
 	 */
-	res = udf_interp(f, 0, 0, params, 1, &no_access, &no_access);
+	res = udf_jit_run(f, 0, 0, params, 1, &no_access, &no_access, 1);
 
 	/* reset cache. */
 	last_f = f;
@@ -440,8 +541,8 @@ int udf_add_ext(size_t base, size_t len) {
 }
 
 int udf_get_union_type(udf_type *t, void *meta) {
- 	return udf_interp(&t->get_type, 0, meta,
-                        0, 0, &t->type_access, &no_access); 
+ 	return udf_jit_run(&t->get_type, 0, meta,
+                        0, 0, &t->type_access, &no_access, 1); 
 }
 
 /* Find what type is union really is. */
@@ -512,8 +613,8 @@ int udf_blk_access(int op, struct xr *xr, void *meta, cap_t cap, size_t index) {
 	params[0] = (unsigned)meta;
 	params[1] = (unsigned)&cap;
 	params[2] = (unsigned)index;
-	res = udf_interp(&t->u.t.block_access, &ctx, meta, 
-			params, 3, &t->u.t.raw_read, &t->u.t.raw_write);
+	res = udf_jit_run(&t->u.t.block_access, &ctx, meta, 
+			params, 3, &t->u.t.raw_read, &t->u.t.raw_write, 1);
 
 	if(res == 0)
 		return XN_BOGUS_CAP;
@@ -45,6 +45,15 @@ int udf_write(int type, void *meta, xn_op *op);
 int udf_alloc(int type, void *meta, xn_op *op);
 int udf_dealloc(int type, void *meta, xn_op *op);
 int udf_move(int type, void *meta, xn_op *op, xn_update *o_add, xn_update *o_del);
+
+/* One modification of a batch, resolved to its meta data. */
+struct udf_bmod {
+	int kind;		/* XN_BATCH_* */
+	int type;
+	void *meta;
+	xn_op *op;
+};
+int udf_batch(struct udf_bmod *v, int n);
 int udf_init(struct udf_type *t);
 struct udf_fun *udf_lookup(struct udf_fun **read_f, int type, void *meta, size_t own_id, cap_t c);
 void udf_tprint(struct udf_type *t);
@@ -55,8 +64,25 @@ int udf_illegal_access(size_t offset, size_t nbytes, struct udf_ext *e);
 int udf_type_check(struct udf_type *t);
 void udf_add(db_t db, size_t n, int type);
 int udf_interp(struct udf_fun *f, struct udf_ctx *ctx, void *xn, unsigned *params, int narg, struct udf_ext *r_access, struct udf_ext *w_access);
+
+/* udf-jit.c: native translation of UDFs, falls back on udf_interp. */
+int udf_jit_run(struct udf_fun *f, struct udf_ctx *ctx, void *xn, unsigned *params, int narg, struct udf_ext *r_access, struct udf_ext *w_access, int stable);
+void udf_jit_flush(struct udf_type *t);
+
+struct udf_jit_stats {
+	unsigned compiled;	/* translations made. */
+	unsigned failed;	/* UDFs we could not translate. */
+	unsigned evicted;	/* translations dropped for a full cache. */
+	unsigned stale;		/* retranslations of a changed UDF or set. */
+	unsigned runs;		/* native runs. */
+	unsigned interp;	/* runs handed to the interpreter. */
+	unsigned elided;	/* bounds checks proven at translation. */
+	unsigned checks;	/* bounds checks left to run time. */
+};
+extern struct udf_jit_stats udf_jit_stats;
 int udf_check(struct udf_fun *f);
 int u_in_set(struct udf_ext *s, size_t lb, size_t len);
+int u_set_eq(struct udf_ext *s1, struct udf_ext *s2);
 void udf_dis(struct udf_inst *ip, int n);
 
 int udf_blk_access(int op, struct xr *xr, void *meta, cap_t cap, size_t index);
@@ -72,6 +72,18 @@ struct xn_op {
         struct xn_modify m;     /* where to do it. */
 }; 
 
+/* One element of a batch (see sys_xn_batch). */
+#define XN_BATCH_MAX	16
+struct xn_batch_op {
+	enum { 
+		XN_BATCH_ALLOC = 1,	/* as sys_xn_alloc; u.db must be set. */
+		XN_BATCH_FREE,		/* as sys_xn_free. */
+		XN_BATCH_WRITE		/* modify, owned set must not change. */
+	} kind;
+	da_t da;		/* meta data being modified. */
+	struct xn_op op;
+};
+
 
 /* Probabily a device constant. */
 #define XN_MAX_IO_E        256
@@ -60,6 +60,11 @@ sys__xn_move (u_int sn, da_t da1, struct xn_op * op1,
   return sys_xn_move (da1, op1, da2, op2);
 }
 
+xn_err_t
+sys__xn_batch (u_int sn, struct xn_batch_op * v, size_t n) {
+  return sys_xn_batch (v, n);
+}
+
 xn_err_t
 sys__xn_writeb (u_int sn, da_t da, void * src, size_t nbytes, cap_t cap) {
   return sys_xn_writeb (da, src, nbytes, cap);
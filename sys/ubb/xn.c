@@ -478,6 +478,131 @@ xn_err_t sys_xn_swap(da_t v1, struct xn_op *op1, da_t v2, struct xn_op *op2) {
 	sys_return(XN_SUCCESS);
 }
 
+/*
+ * Run a batch of allocs, frees and writes as one transaction.  All
+ * preconditions are checked and all meta data checkpointed before
+ * anything changes; udf_batch then verifies the whole batch at once.
+ * Registry updates come last: allocs first, which we can still take
+ * back, then frees.  The frees cannot fail halfway: every block was
+ * found in the registry above and no two frees in the batch overlap.
+ */
+xn_err_t sys_xn_batch(struct xn_batch_op *v, size_t n) {
+	struct bstate {
+        	struct xr *p;
+		void *meta;
+		struct xr_td td;
+		size_t nblocks;
+		db_t db;
+		struct udf_ckpt chkpt;
+	} b[XN_BATCH_MAX];
+	struct udf_bmod m[XN_BATCH_MAX];
+	struct xn_op *op;
+        struct xr *p;
+        struct xr_td td;
+        size_t nblocks;
+        db_t db;
+	void *meta;
+	da_t da;
+	int i, j, na, ty, res;
+	sec_t sec;
+
+	ensure(n > 0 && n <= XN_BATCH_MAX,		XN_ILLEGAL_OP);
+	ensure(xn_in_kernel || read_accessible(v, n * sizeof *v), 
+							XN_CANNOT_ACCESS);
+
+	/* Preconditions. */
+	for(i = 0; i < n; i++) {
+		op = &v[i].op;
+		da = v[i].da;
+		build_env(0);
+
+		switch(v[i].kind) {
+		case XN_BATCH_ALLOC:
+			ensure(!p->locked,			XN_LOCKED);
+			ensure(db && nblocks,			XN_BOGUS_NAME);
+			ensure(db_isfree(db, nblocks),		XN_CANNOT_ALLOC);
+			for(j = 0; j < i; j++)
+				ensure(v[j].kind != XN_BATCH_ALLOC
+				|| db + nblocks <= b[j].db 
+				|| b[j].db + b[j].nblocks <= db,
+							XN_CANNOT_ALLOC);
+			break;
+		case XN_BATCH_FREE:
+			ensure(db > 0,				XN_BOGUS_NAME);
+			ensure(nblocks,				XN_TOO_SMALL);
+			ensure(!db_isfree(db, nblocks),		XN_CANNOT_FREE);
+			ensure((db+nblocks) <= SYSINFO_GET_AT(si_xn_blocks,0), 
+							XN_CANNOT_FREE);
+			for(j = 0; j < nblocks; j++)
+				ensure(xr_lookup(db + j),	XN_REGISTRY_MISS);
+			/* a second free of the same blocks would fail in commit */
+			for(j = 0; j < i; j++)
+				ensure(v[j].kind != XN_BATCH_FREE
+				|| db + nblocks <= b[j].db 
+				|| b[j].db + b[j].nblocks <= db,
+							XN_CANNOT_FREE);
+			break;
+		case XN_BATCH_WRITE:
+			break;
+		default:
+			sys_return(XN_ILLEGAL_OP);
+		}
+
+		b[i].p = p;
+		b[i].meta = meta;
+		b[i].td = td;
+		b[i].nblocks = nblocks;
+		b[i].db = db;
+
+		m[i].kind = v[i].kind;
+		m[i].type = ty;
+		m[i].meta = meta;
+		m[i].op = op;
+	}
+
+	/* Checkpoint everything before the first write. */
+	for(i = 0; i < n; i++)
+		ensure(checkpt(&b[i].chkpt, b[i].meta, b[i].p->td.size, 
+						&v[i].op), XN_CANNOT_ACCESS);
+
+	if((res = udf_batch(m, n)) < 0)
+		goto rollback;
+
+	/* Commit: allocs first, since we can take them back. */
+	for(na = 0; na < n; na++) {
+		if(v[na].kind != XN_BATCH_ALLOC)
+			continue;
+		da = v[na].da;
+		sec = off_to_sec(da, &v[na].op.m);
+		demand(sec == da_to_sec(da), Bogus sec);
+		demand(sec, bogus sector);
+		if((res = xr_alloc(b[na].db, b[na].nblocks, b[na].td, da, sec, 1)) < 0)
+			goto unalloc;
+	}
+	for(i = 0; i < n; i++)
+		if(v[i].kind == XN_BATCH_FREE 
+		&& (res = xr_delete(b[i].db, b[i].nblocks)) < 0)
+			goto unalloc;
+
+	for(i = 0; i < n; i++)
+		if(v[i].kind == XN_BATCH_ALLOC 
+		&& db_alloc(b[i].db, b[i].nblocks) < 0)
+			fatal(Cannot happen);
+	for(i = 0; i < n; i++)
+		xr_set_dirty(b[i].p);
+	sys_return(XN_SUCCESS);
+
+unalloc:
+	for(i = 0; i < na; i++)
+		if(v[i].kind == XN_BATCH_ALLOC)
+			xr_delete(b[i].db, b[i].nblocks);
+rollback:
+	/* Undo in reverse so that overlapping writes unwind correctly. */
+	for(i = n - 1; i >= 0; i--)
+		udf_rollback(b[i].meta, &b[i].chkpt);
+	sys_return(res);
+}
+
 /* 
  * Essentially simply free the disk block in src and allocate
  * it in dst.
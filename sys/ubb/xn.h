@@ -44,6 +44,7 @@ struct xn_m_vec;	/* specify update to meta data. */
 struct xn_modify;	/* specify how to modify meta data. */
 struct xn_update;	/* Specifies what external transition should occur. */
 struct xn_op;		/* Encapsulate the above state. */
+struct xn_batch_op;	/* One op of a batch. */
 struct ubb_type;	/* Specify a given type. */
 struct xn_iov;
 
@@ -126,6 +127,15 @@ xn_err_t sys_xn_swap(da_t v1, struct xn_op *m1, da_t v2, struct xn_op *m2);
 /* Identical to swap except that the destination contains a nil pointer. */
 xn_err_t sys_xn_move(da_t dst, struct xn_op *msrc, da_t src, struct xn_op *mdst);
 
+/*
+ * Perform v[0..n) (allocs, frees and writes) as one transaction: all
+ * happen or none do.  Ops that modify the same UDF share one before
+ * and one after run of it.  Fails for any reason its ops would, or if:
+ *	- n is 0 or larger than XN_BATCH_MAX.
+ *	- an alloc does not name its blocks, or two allocs overlap.
+ */
+xn_err_t sys_xn_batch(struct xn_batch_op *v, size_t n);
+
 /***************************************************************
  * Routines to move data from/to disk and from/to buffer cache.
  */
@@ -226,6 +236,7 @@ db_t sys_db_find_free (db_t hint, size_t nblocks);
 #define	sys_xn_free	sys__xn_free
 #define	sys_xn_swap	sys__xn_swap
 #define	sys_xn_move	sys__xn_move
+#define	sys_xn_batch	sys__xn_batch
 #define	sys_xn_writeb	sys__xn_writeb
 #define	sys_xn_set_type	sys__xn_set_type
 #define	sys_xn_readb	sys__xn_readb
@@ -0,0 +1,1617 @@
+
+/*
+ * Copyright (C) 1997 Massachusetts Institute of Technology 
+ *
+ * This software is being provided by the copyright holders under the
+ * following license. By obtaining, using and/or copying this software,
+ * you agree that you have read, understood, and will comply with the
+ * following terms and conditions:
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose and without fee or royalty is
+ * hereby granted, provided that the full text of this NOTICE appears on
+ * ALL copies of the software and documentation or portions thereof,
+ * including modifications, that you make.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS," AND COPYRIGHT HOLDERS MAKE NO
+ * REPRESENTATIONS OR WARRANTIES, EXPRESS OR IMPLIED. BY WAY OF EXAMPLE,
+ * BUT NOT LIMITATION, COPYRIGHT HOLDERS MAKE NO REPRESENTATIONS OR
+ * WARRANTIES OF MERCHANTABILITY OR FITNESS FOR ANY PARTICULAR PURPOSE OR
+ * THAT THE USE OF THE SOFTWARE OR DOCUMENTATION WILL NOT INFRINGE ANY
+ * THIRD PARTY PATENTS, COPYRIGHTS, TRADEMARKS OR OTHER RIGHTS. COPYRIGHT
+ * HOLDERS WILL BEAR NO LIABILITY FOR ANY USE OF THIS SOFTWARE OR
+ * DOCUMENTATION.
+ *
+ * The name and trademarks of copyright holders may NOT be used in
+ * advertising or publicity pertaining to the software without specific,
+ * written prior permission. Title to copyright in this software and any
+ * associated documentation will at all times remain with copyright
+ * holders. See the file AUTHORS which should have accompanied this software
+ * for a list of all copyright holders.
+ *
+ * This file may be derived from previously copyrighted software. This
+ * copyright applies only to those changes made by the copyright
+ * holders listed in the AUTHORS file. The rest of this file is covered by
+ * the copyright notices, if any, listed below.
+ */
+
+/*
+ * Post-emission optimizer for the x86 port of vcode.
+ *
+ * vcode turns each vcode instruction into a fixed sequence of x86
+ * instructions as it is generated, so the code it produces reloads
+ * values that are already sitting in registers, saves scratch
+ * registers that hold nothing of interest, and branches to branches.
+ * When asked to (see v_setopt), v_end hands the finished procedure to
+ * v_opt before it resolves any labels. v_opt decodes the bytes back
+ * into instructions--only the forms x86-codegen.h emits are recognized
+ * and anything else makes us leave the procedure alone--cleans them
+ * up and writes them back out:
+ *
+ *  V_OPT_LOADS	track which registers hold which constants, virtual
+ *		registers and memory words through each extended basic
+ *		block; delete or shorten redundant loads and fold
+ *		constants into compares and arithmetic when the register
+ *		holding them dies there.
+ *  V_OPT_LIVE	backwards liveness over the flow graph; delete dead
+ *		definitions, push/pop pairs around scratch registers
+ *		that are dead anyway, and the saves of callee saved
+ *		registers the procedure never touches.
+ *  V_OPT_JUMPS	branch chaining, conditional branches over jumps,
+ *		jumps to the next instruction and unreachable code.
+ *		Jumps to short return sequences (the epilogue) get a
+ *		copy of the sequence instead.
+ *  V_OPT_SHORT	8-bit branch displacements (iterated to a fixed
+ *		point), 8-bit immediates and displacements and the one
+ *		byte push, pop and mov forms.
+ *
+ * Blocks of data placed with v_dalloc are copied verbatim. ABSOLUTE
+ * label refs that live in the code pin the instruction holding them,
+ * which is then moved but never rewritten.
+ */
+
+#include <vcode/vcode.h>
+#include <vcode/opt.h>
+
+#include <xok_include/assert.h>
+
+#define OPT_MAXINSNS 1024	/* bigger procedures are left alone */
+#define OPT_MAXCODE 8192	/* size of the buffer we rewrite into */
+#define OPT_ROUNDS 4		/* max passes over the procedure */
+#define OPT_MAXHOPS 8		/* max jumps we chain through */
+#define OPT_DUPMAX 8		/* max bytes of return sequence we copy */
+
+/* register masks: one bit per physical register plus the flags */
+#define R(r) (1 << (r))
+#define FLAGS 0x100
+#define ALLREGS 0xff
+#define PINNED (R(__ESP) | R(__EBP))	/* never dead */
+
+/* the instructions we treat specially */
+enum {
+  I_OTHER,		/* anything described by its masks alone */
+  I_MOVIR,		/* mov $imm, rd */
+  I_MOVRR,		/* mov rs, rd */
+  I_LDV,		/* mov disp8(%ebp), rd: load virtual register */
+  I_STV,		/* mov rs, disp8(%ebp): store virtual register */
+  I_LDM,		/* mov mem, rd */
+  I_JCC,		/* conditional branch to target */
+  I_JMP,		/* jump to target */
+  I_CALL,		/* call to target or callee */
+  I_RET,
+  I_JIND,		/* indirect jump */
+  I_CIND,		/* indirect call */
+  I_PUSH,		/* push rd */
+  I_POP,		/* pop rd */
+  I_DATA		/* block of data, imm bytes long */
+};
+
+#define O_DEAD 0x001	/* deleted */
+#define O_LEADER 0x002	/* starts a basic block */
+#define O_FROZEN 0x004	/* holds an ABSOLUTE ref: move, don't touch */
+#define O_MEMR 0x008	/* reads memory */
+#define O_MEMW 0x010	/* writes memory */
+#define O_SLOT 0x020	/* memory operand is a virtual register */
+#define O_REACH 0x040	/* reachable from the entry point */
+#define O_ROOT 0x080	/* address taken or called */
+#define O_NOP 0x100	/* does nothing at all */
+#define O_SHORT 0x200	/* branch with an 8-bit displacement */
+#define O_DUP 0x400	/* jump replaced by a copy of its target */
+#define O_TAIL 0x800	/* copied by an O_DUP jump */
+
+struct oinsn {
+  v_code *pc;		/* where vcode put it */
+  v_code *npc;		/* where it ends up */
+  v_code *callee;	/* absolute target of a call */
+  int target;		/* index of branch target or called insn, or -1 */
+  int disp;		/* displacement of memory operand */
+  int imm;		/* immediate operand */
+  unsigned short flags;
+  unsigned short use, def;	/* registers read and written */
+  unsigned short named;	/* registers that appear in the encoding */
+  unsigned short addr;	/* registers used to address memory */
+  unsigned short live;	/* registers live after it */
+  short mrm, sib;	/* mod/rm and sib bytes or -1 */
+  unsigned char nop;	/* prefix and opcode bytes at the start of b */
+  unsigned char dsz, isz;	/* bytes of displacement and immediate */
+  unsigned char len;	/* bytes in b */
+  unsigned char kind, cc, rd, rs;
+  unsigned char b[16];	/* the encoding */
+};
+
+static struct oinsn ins[OPT_MAXINSNS];
+static int nins;
+static v_code *cend;		/* end of the original code */
+static v_code *nend;		/* end of the rewritten code */
+static v_code obuf[OPT_MAXCODE];
+static int stack[2*OPT_MAXINSNS];
+
+/* condition to use when the operands of a compare are swapped, -1 if
+   there isn't one */
+static const signed char swapcc[16] = {
+  -1, -1, __NBE, __BE, __EQ, __NE, __AE, __NAE,
+  -1, -1, -1, -1, __GT, __LE, __GE, __LT
+};
+
+/*
+ * ----------------------------------------------------------------------
+ * 		    Decoding and encoding
+ * ----------------------------------------------------------------------
+ */
+
+static int fetch (unsigned char *p, int n) {
+  switch (n) {
+  case 1: return (signed char)p[0];
+  case 2: return (short)(p[0] | p[1] << 8);
+  case 4: return p[0] | p[1] << 8 | p[2] << 16 | p[3] << 24;
+  }
+  return 0;
+}
+
+/* rebuild the bytes of an insn from its fields (the prefix and
+   opcode bytes in b are kept) */
+static void encode (struct oinsn *in) {
+  unsigned char *p = in->b + in->nop;
+  int i;
+
+  if (in->mrm >= 0) {
+    *p++ = in->mrm;
+    if (in->sib >= 0) {
+      *p++ = in->sib;
+    }
+  }
+  for (i = 0; i < in->dsz; i++) {
+    *p++ = in->disp >> (8*i);
+  }
+  for (i = 0; i < in->isz; i++) {
+    *p++ = in->imm >> (8*i);
+  }
+  in->len = p - in->b;
+}
+
+static void clear (struct oinsn *in, v_code *pc) {
+  in->pc = pc;
+  in->npc = in->callee = 0;
+  in->target = -1;
+  in->disp = in->imm = 0;
+  in->flags = in->use = in->def = in->named = in->addr = in->live = 0;
+  in->mrm = in->sib = -1;
+  in->nop = in->dsz = in->isz = in->len = 0;
+  in->kind = I_OTHER;
+  in->cc = in->rd = in->rs = 0;
+}
+
+/* the r/m operand is read and/or written */
+static void rm_use (struct oinsn *in, int rd, int wr) {
+  int r = in->mrm & 7;
+
+  if ((in->mrm >> 6) == 3) {
+    if (rd) in->use |= R(r);
+    if (wr) in->def |= R(r);
+  } else {
+    if (rd) in->flags |= O_MEMR;
+    if (wr) in->flags |= O_MEMW;
+  }
+}
+
+/* Decode the insn at pc into in. Returns its length or 0 if it isn't
+   something vcode emits. */
+static int decode (v_code *pc, struct oinsn *in) {
+  unsigned char *b = (unsigned char *)pc;
+  int n = 0, op, opsize = 0, modrm = 0, isz = 0;
+  int mod = 3, reg = 0, rm = 0, rg, i;
+
+  clear (in, pc);
+  if (b[n] == 0x66) {
+    opsize = 1;
+    n++;
+  }
+  op = b[n++];
+  if (op == 0x0f) {
+    op = 0x100 | b[n++];
+  }
+  in->nop = n;
+
+  /* how is it laid out? */
+  if ((op >= 0x40 && op <= 0x5f) || op == 0x90 || op == 0x99 ||
+      op == 0xc3 || op == 0xc9 || op == 0xcc) {
+    ;
+  } else if (op == 0x6a || op == 0xeb || (op >= 0x70 && op <= 0x7f)) {
+    isz = 1;
+  } else if (op == 0x68 || op == 0xe8 || op == 0xe9 ||
+	     (op >= 0xb8 && op <= 0xbf) || (op >= 0x180 && op <= 0x18f)) {
+    isz = 4;
+  } else if (op == 0x83 || op == 0xc1 || op == 0x6b) {
+    modrm = 1;
+    isz = 1;
+  } else if (op == 0x81 || op == 0x69 || op == 0xc7) {
+    modrm = 1;
+    isz = opsize ? 2 : 4;
+  } else if ((op >= 0x190 && op <= 0x19f) || op == 0x1af ||
+	     op == 0x1b6 || op == 0x1b7 || op == 0x1be || op == 0x1bf) {
+    modrm = 1;
+  } else {
+    switch (op) {
+    case 0x01: case 0x03: case 0x09: case 0x0b: case 0x21: case 0x23:
+    case 0x29: case 0x2b: case 0x31: case 0x33: case 0x39: case 0x3b:
+    case 0x85: case 0x87: case 0x88: case 0x89: case 0x8a: case 0x8b:
+    case 0x8d: case 0x8f: case 0xd1: case 0xd3: case 0xf7: case 0xff:
+      modrm = 1;
+      break;
+    default:
+      return 0;
+    }
+  }
+
+  if (modrm) {
+    in->mrm = b[n++];
+    mod = in->mrm >> 6;
+    reg = (in->mrm >> 3) & 7;
+    rm = in->mrm & 7;
+    if (mod != 3) {
+      if (rm == __SIB) {
+	in->sib = b[n++];
+	if (((in->sib >> 3) & 7) != __ESP) {
+	  in->addr |= R((in->sib >> 3) & 7);
+	}
+	if ((in->sib & 7) == __EBP && mod == 0) {
+	  in->dsz = 4;
+	} else {
+	  in->addr |= R(in->sib & 7);
+	}
+      } else if (rm == __EBP && mod == 0) {
+	in->dsz = 4;
+      } else {
+	in->addr |= R(rm);
+      }
+      if (mod == 1) {
+	in->dsz = 1;
+      } else if (mod == 2) {
+	in->dsz = 4;
+      }
+      if (mod == 1 && rm == __EBP) {
+	in->flags |= O_SLOT;
+      }
+      in->use |= in->addr;
+      in->named |= in->addr;
+    } else {
+      in->named |= R(rm);
+    }
+    if (op == 0xf7 && reg == 0) {
+      isz = opsize ? 2 : 4;
+    }
+  }
+  in->disp = fetch (b + n, in->dsz);
+  n += in->dsz;
+  in->isz = isz;
+  in->imm = fetch (b + n, isz);
+  n += isz;
+  in->len = n;
+  for (i = 0; i < n; i++) {
+    in->b[i] = b[i];
+  }
+
+  /* and what does it do? */
+  rg = R(reg);
+  switch (op) {
+  case 0x01: case 0x09: case 0x21: case 0x29: case 0x31:
+    /* op reg, r/m */
+    rm_use (in, 1, 1);
+    if (op == 0x31 && mod == 3 && reg == rm) {
+      in->use = 0;		/* xor r, r */
+    } else {
+      in->use |= rg;
+    }
+    in->named |= rg;
+    in->def |= FLAGS;
+    break;
+  case 0x39: case 0x85:
+    rm_use (in, 1, 0);
+    in->use |= rg;
+    in->named |= rg;
+    in->def |= FLAGS;
+    break;
+  case 0x03: case 0x0b: case 0x23: case 0x2b: case 0x33: case 0x3b:
+    /* op r/m, reg */
+    rm_use (in, 1, 0);
+    in->use |= rg;
+    in->named |= rg;
+    if (op != 0x3b) {
+      in->def |= rg;
+    }
+    in->def |= FLAGS;
+    break;
+  case 0x87:
+    rm_use (in, 1, 1);
+    in->use |= rg;
+    in->def |= rg;
+    in->named |= rg;
+    break;
+  case 0x88:
+    rm_use (in, 1, 1);
+    in->use |= rg;
+    in->named |= rg;
+    if (mod == 3) {
+      in->flags &= ~O_MEMR;
+    }
+    break;
+  case 0x89:
+    in->use |= rg;
+    in->named |= rg;
+    if (opsize) {
+      rm_use (in, 1, 1);
+    } else if (mod == 3) {
+      in->kind = I_MOVRR;
+      in->rs = reg;
+      in->rd = rm;
+      in->def |= R(rm);
+    } else {
+      rm_use (in, 0, 1);
+      if (in->flags & O_SLOT) {
+	in->kind = I_STV;
+	in->rs = reg;
+      }
+    }
+    break;
+  case 0x8a:
+    rm_use (in, 1, 0);
+    in->use |= rg;
+    in->def |= rg;
+    in->named |= rg;
+    break;
+  case 0x8b:
+    rm_use (in, 1, 0);
+    in->def |= rg;
+    in->named |= rg;
+    if (opsize) {
+      in->use |= rg;
+    } else if (mod == 3) {
+      in->kind = I_MOVRR;
+      in->rs = rm;
+      in->rd = reg;
+    } else {
+      in->kind = (in->flags & O_SLOT) ? I_LDV : I_LDM;
+      in->rd = reg;
+    }
+    break;
+  case 0x8d:
+    if (mod == 3) {
+      return 0;
+    }
+    in->def |= rg;
+    in->named |= rg;
+    break;
+  case 0x8f:
+    if (mod != 3 || reg != 0) {
+      return 0;
+    }
+    in->kind = I_POP;
+    in->rd = rm;
+    in->use |= R(__ESP);
+    in->def |= R(__ESP) | R(rm);
+    in->flags |= O_MEMR;
+    break;
+  case 0xc7:
+    if (reg != 0) {
+      return 0;
+    }
+    rm_use (in, 0, 1);
+    if (mod == 3 && !opsize) {
+      in->kind = I_MOVIR;
+      in->rd = rm;
+    }
+    break;
+  case 0x81: case 0x83:
+    rm_use (in, 1, reg != 7);
+    if (reg == 2 || reg == 3) {
+      in->use |= FLAGS;		/* adc, sbb */
+    }
+    in->def |= FLAGS;
+    break;
+  case 0xc1: case 0xd1: case 0xd3:
+    rm_use (in, 1, 1);
+    if (op == 0xd3) {
+      in->use |= R(__ECX);
+    }
+    in->use |= FLAGS;		/* a zero count leaves them alone */
+    in->def |= FLAGS;
+    break;
+  case 0x69: case 0x6b: case 0x1af:
+    rm_use (in, 1, 0);
+    if (op == 0x1af) {
+      in->use |= rg;
+    }
+    in->def |= rg | FLAGS;
+    in->named |= rg;
+    break;
+  case 0xf7:
+    switch (reg) {
+    case 0:			/* test */
+      rm_use (in, 1, 0);
+      in->def |= FLAGS;
+      break;
+    case 2:			/* not */
+      rm_use (in, 1, 1);
+      break;
+    case 3:			/* neg */
+      rm_use (in, 1, 1);
+      in->def |= FLAGS;
+      break;
+    case 4: case 5:		/* mul, imul */
+      rm_use (in, 1, 0);
+      in->use |= R(__EAX);
+      in->def |= R(__EAX) | R(__EDX) | FLAGS;
+      break;
+    case 6: case 7:		/* div, idiv */
+      rm_use (in, 1, 0);
+      in->use |= R(__EAX) | R(__EDX);
+      in->def |= R(__EAX) | R(__EDX) | FLAGS;
+      break;
+    default:
+      return 0;
+    }
+    break;
+  case 0xff:
+    switch (reg) {
+    case 0: case 1:		/* inc, dec */
+      rm_use (in, 1, 1);
+      in->use |= FLAGS;
+      in->def |= FLAGS;
+      break;
+    case 2:
+      in->kind = I_CIND;
+      rm_use (in, 1, 0);
+      break;
+    case 4:
+      in->kind = I_JIND;
+      rm_use (in, 1, 0);
+      break;
+    case 6:
+      rm_use (in, 1, 0);
+      in->use |= R(__ESP);
+      in->def |= R(__ESP);
+      if (mod == 3) {
+	in->kind = I_PUSH;
+	in->rd = rm;
+      }
+      break;
+    default:
+      return 0;
+    }
+    break;
+  case 0x1b6: case 0x1b7: case 0x1be: case 0x1bf:
+    rm_use (in, 1, 0);
+    in->def |= rg;
+    in->named |= rg;
+    break;
+  case 0x90:
+    in->flags |= O_NOP;
+    break;
+  case 0x99:
+    in->use |= R(__EAX);
+    in->def |= R(__EDX);
+    break;
+  case 0xc3:
+    in->kind = I_RET;
+    break;
+  case 0xc9:
+    in->use |= R(__EBP);
+    in->def |= R(__ESP) | R(__EBP);
+    in->flags |= O_MEMR;
+    break;
+  case 0xcc:
+    break;
+  case 0x68: case 0x6a:
+    in->use |= R(__ESP);
+    in->def |= R(__ESP);
+    break;
+  case 0xe8:
+    in->kind = I_CALL;
+    break;
+  case 0xe9: case 0xeb:
+    in->kind = I_JMP;
+    break;
+  default:
+    if (op >= 0x190 && op <= 0x19f) {		/* setcc */
+      rm_use (in, 1, 1);
+      if (mod == 3) {
+	in->flags &= ~O_MEMR;
+      }
+      in->use |= FLAGS;
+    } else if (op >= 0x180 && op <= 0x18f) {
+      in->kind = I_JCC;
+      in->cc = op & 0xf;
+    } else if (op >= 0x70 && op <= 0x7f) {
+      in->kind = I_JCC;
+      in->cc = op & 0xf;
+    } else if (op >= 0xb8 && op <= 0xbf) {
+      in->kind = I_MOVIR;
+      in->rd = op & 7;
+      in->named |= R(op & 7);
+    } else if (op >= 0x40 && op <= 0x4f) {	/* inc, dec */
+      in->use |= R(op & 7) | FLAGS;
+      in->def |= R(op & 7) | FLAGS;
+      in->named |= R(op & 7);
+    } else if (op >= 0x50 && op <= 0x57) {
+      in->kind = I_PUSH;
+      in->rd = op & 7;
+    } else {
+      in->kind = I_POP;
+      in->rd = op & 7;
+      in->flags |= O_MEMR;
+    }
+    break;
+  }
+
+  switch (in->kind) {
+  case I_MOVIR:
+    in->def |= R(in->rd);
+    break;
+  case I_JCC:
+    in->use |= FLAGS;
+    break;
+  case I_PUSH:
+    in->use |= R(in->rd) | R(__ESP);
+    in->def |= R(__ESP);
+    in->named |= R(in->rd);
+    break;
+  case I_POP:
+    in->use |= R(__ESP);
+    in->def |= R(in->rd) | R(__ESP);
+    in->named |= R(in->rd);
+    break;
+  case I_CALL: case I_CIND:
+    /* arguments are on the stack but the callee may be one of our
+       own labels, so assume it reads everything */
+    in->use |= ALLREGS;
+    in->def |= R(__EAX) | R(__ECX) | R(__EDX) | FLAGS;
+    in->flags |= O_MEMR | O_MEMW;
+    break;
+  case I_RET:
+    in->use |= R(__EAX) | R(__EDX) | R(__EBX) | R(__ESI) | R(__EDI) | PINNED;
+    break;
+  case I_JIND:
+    in->use |= ALLREGS;
+    break;
+  }
+  return n;
+}
+
+/*
+ * ----------------------------------------------------------------------
+ * 		    Flow graph
+ * ----------------------------------------------------------------------
+ */
+
+/* index of the insn at a, nins for the end of the code, -1 if a isn't
+   the start of an insn */
+static int lookup (v_code *a) {
+  int lo = 0, hi = nins - 1, mid;
+
+  if (a == cend) {
+    return nins;
+  }
+  while (lo <= hi) {
+    mid = (lo + hi) / 2;
+    if (ins[mid].pc == a) {
+      return mid;
+    } else if (ins[mid].pc < a) {
+      lo = mid + 1;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  return -1;
+}
+
+/* index of the insn a points into, or -1 */
+static int containing (v_code *a) {
+  int lo = 0, hi = nins - 1, mid;
+
+  if (nins == 0 || a < ins[0].pc || a >= cend) {
+    return -1;
+  }
+  while (lo < hi) {
+    mid = (lo + hi + 1) / 2;
+    if (ins[mid].pc <= a) {
+      lo = mid;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  return lo;
+}
+
+/* first insn at or after i that hasn't been deleted */
+static int next (int i) {
+  while (i < nins && (ins[i].flags & O_DEAD)) {
+    i++;
+  }
+  return i;
+}
+
+static void kill (int i) {
+  ins[i].flags |= O_DEAD;
+}
+
+/* address of the code for insn i in the rewritten procedure */
+static v_code *tpc (int i) {
+  i = next (i);
+  return (i < nins ? ins[i].npc : nend);
+}
+
+static int isjump (struct oinsn *in) {
+  return ((in->kind == I_JCC || in->kind == I_JMP) && !(in->flags & O_DUP));
+}
+
+/* mark the first insn of each basic block */
+static void leader (int i) {
+  if ((i = next (i)) < nins) {
+    ins[i].flags |= O_LEADER;
+  }
+}
+
+static void leaders () {
+  int i;
+
+  for (i = 0; i < nins; i++) {
+    ins[i].flags &= ~O_LEADER;
+  }
+  leader (0);
+  for (i = 0; i < nins; i++) {
+    if (ins[i].flags & O_ROOT) {
+      leader (i);
+    }
+    if (!(ins[i].flags & O_DEAD) && ins[i].target >= 0 &&
+	(isjump (&ins[i]) || ins[i].kind == I_CALL)) {
+      leader (ins[i].target);
+    }
+  }
+}
+
+static unsigned live_in (int i) {
+  i = next (i);
+  if (i >= nins) {
+    return ALLREGS | FLAGS;
+  }
+  return ins[i].use | (ins[i].live & ~ins[i].def);
+}
+
+/* iterate backwards liveness to a fixed point */
+static void liveness () {
+  int i, changed;
+  unsigned out;
+
+  for (i = 0; i < nins; i++) {
+    ins[i].live = 0;
+  }
+  do {
+    changed = 0;
+    for (i = nins - 1; i >= 0; i--) {
+      if (ins[i].flags & O_DEAD) {
+	continue;
+      }
+      switch (ins[i].kind) {
+      case I_JMP:
+	out = live_in (ins[i].target);
+	break;
+      case I_JCC:
+	out = live_in (ins[i].target) | live_in (i + 1);
+	break;
+      case I_RET: case I_DATA:
+	out = 0;
+	break;
+      case I_JIND:
+	out = ALLREGS;
+	break;
+      default:
+	out = live_in (i + 1);
+	break;
+      }
+      if (out != ins[i].live) {
+	ins[i].live = out;
+	changed = 1;
+      }
+    }
+  } while (changed);
+}
+
+/* delete everything that can't be reached from the entry point or
+   from an address taken label */
+static int reach () {
+  int i, j, sp = 0, changed = 0;
+
+  for (i = 0; i < nins; i++) {
+    ins[i].flags &= ~O_REACH;
+  }
+  for (i = 0; i < nins; i++) {
+    if (i == 0 || (ins[i].flags & O_ROOT)) {
+      stack[sp++] = next (i);
+    }
+  }
+  while (sp > 0) {
+    i = stack[--sp];
+    while (i < nins && !(ins[i].flags & O_REACH)) {
+      ins[i].flags |= O_REACH;
+      if (ins[i].kind == I_JMP || ins[i].kind == I_JCC) {
+	j = next (ins[i].target);
+	if (!(ins[i].flags & O_DUP) && j < nins && !(ins[j].flags & O_REACH)) {
+	  assert (sp < 2*OPT_MAXINSNS);
+	  stack[sp++] = j;
+	}
+      }
+      if (ins[i].kind == I_JMP || ins[i].kind == I_RET ||
+	  ins[i].kind == I_JIND || ins[i].kind == I_DATA) {
+	break;
+      }
+      i = next (i + 1);
+    }
+  }
+  for (i = 0; i < nins; i++) {
+    if (!(ins[i].flags & (O_DEAD | O_REACH | O_FROZEN)) &&
+	ins[i].kind != I_DATA) {
+      kill (i);
+      changed++;
+    }
+  }
+  return changed;
+}
+
+/*
+ * ----------------------------------------------------------------------
+ * 		    Redundant loads and constants
+ * ----------------------------------------------------------------------
+ */
+
+#define LOC_NONE 0
+#define LOC_SLOT 1		/* virtual register at disp8(%ebp) */
+#define LOC_MEM 2		/* memory word named by operand of insn mem */
+
+/* what we know about each register */
+static struct know {
+  int cvalid, cval;		/* holds constant cval */
+  int loc;			/* holds the word at loc */
+  int slot, mem;
+  unsigned deps;		/* registers the address of mem depends on */
+} k[8];
+
+static void forget_all () {
+  int r;
+
+  for (r = 0; r < 8; r++) {
+    k[r].cvalid = 0;
+    k[r].loc = LOC_NONE;
+  }
+}
+
+/* r has been written */
+static void clobber (int r) {
+  int s;
+
+  k[r].cvalid = 0;
+  k[r].loc = LOC_NONE;
+  for (s = 0; s < 8; s++) {
+    if ((k[s].loc == LOC_MEM && (k[s].deps & R(r))) ||
+	(k[s].loc == LOC_SLOT && r == __EBP)) {
+      k[s].loc = LOC_NONE;
+    }
+  }
+}
+
+/* memory has been written: just the virtual register at slot, or
+   anything at all */
+static void forget_mem (int slotonly, int slot) {
+  int s;
+
+  for (s = 0; s < 8; s++) {
+    if (k[s].loc == LOC_MEM ||
+	(k[s].loc == LOC_SLOT && (!slotonly || k[s].slot == slot))) {
+      k[s].loc = LOC_NONE;
+    }
+  }
+}
+
+/* do two memory loads name the same word? */
+static int memeq (struct oinsn *a, struct oinsn *b) {
+  return ((a->mrm & 0xc7) == (b->mrm & 0xc7) && a->sib == b->sib &&
+	  a->dsz == b->dsz && a->disp == b->disp);
+}
+
+/* a register already holding what load i is loading, preferring its
+   own destination, or -1 */
+static int holder (int i) {
+  struct oinsn *in = &ins[i];
+  int r, s = -1;
+
+  for (r = 0; r < 8; r++) {
+    if ((in->kind == I_LDV && k[r].loc == LOC_SLOT && k[r].slot == in->disp) ||
+	(in->kind == I_LDM && k[r].loc == LOC_MEM && memeq (&ins[k[r].mem], in))) {
+      if (r == in->rd) {
+	return r;
+      }
+      s = r;
+    }
+  }
+  return s;
+}
+
+/* do two registers hold the same value? */
+static int same (int r, int s) {
+  return ((k[r].cvalid && k[s].cvalid && k[r].cval == k[s].cval) ||
+	  (k[r].loc != LOC_NONE && k[r].loc == k[s].loc &&
+	   (k[r].loc == LOC_SLOT ? k[r].slot == k[s].slot :
+	    memeq (&ins[k[r].mem], &ins[k[s].mem]))));
+}
+
+/* turn insn into mov s, r */
+static void to_movrr (struct oinsn *in, int s, int r) {
+  in->b[0] = 0x89;
+  in->nop = 1;
+  in->mrm = 0xc0 | s << 3 | r;
+  in->sib = -1;
+  in->dsz = in->isz = 0;
+  encode (in);
+  in->kind = I_MOVRR;
+  in->rs = s;
+  in->rd = r;
+  in->use = R(s);
+  in->def = R(r);
+  in->named = R(s) | R(r);
+  in->addr = 0;
+  in->flags &= ~(O_MEMR | O_SLOT);
+}
+
+/* turn insn into the immediate form of ALU op d (the /digit of 0x81)
+   applied to r */
+static void to_imm (struct oinsn *in, int d, int r, int imm) {
+  in->b[0] = (imm == (signed char)imm) ? 0x83 : 0x81;
+  in->nop = 1;
+  in->mrm = 0xc0 | d << 3 | r;
+  in->sib = -1;
+  in->dsz = 0;
+  in->imm = imm;
+  in->isz = (in->b[0] == 0x83) ? 1 : 4;
+  encode (in);
+  in->use = R(r);
+  in->def = (d == 7 ? 0 : R(r)) | FLAGS;
+  in->named = R(r);
+}
+
+/* Fold a constant register operand of a two register ALU op or
+   compare into an immediate if the register dies here. A compare
+   whose first operand is the constant is turned around, which means
+   swapping the condition of the branch that follows it. */
+static int fold (int i) {
+  struct oinsn *in = &ins[i];
+  int dst, src, j;
+
+  if (in->nop != 1 || in->mrm < 0 || (in->mrm >> 6) != 3) {
+    return 0;
+  }
+  switch (in->b[0]) {
+  case 0x01: case 0x09: case 0x21: case 0x29: case 0x31: case 0x39:
+    dst = in->mrm & 7;
+    src = (in->mrm >> 3) & 7;
+    break;
+  case 0x03: case 0x0b: case 0x23: case 0x2b: case 0x33: case 0x3b:
+    dst = (in->mrm >> 3) & 7;
+    src = in->mrm & 7;
+    break;
+  default:
+    return 0;
+  }
+  if (src == dst) {
+    return 0;
+  }
+  if (k[src].cvalid && !(in->live & R(src))) {
+    to_imm (in, in->b[0] >> 3, dst, k[src].cval);
+    return 1;
+  }
+  if ((in->b[0] >> 3) == 7 && k[dst].cvalid && !(in->live & R(dst))) {
+    j = next (i + 1);
+    if (j < nins && ins[j].kind == I_JCC && swapcc[ins[j].cc] >= 0 &&
+	!(ins[j].flags & O_LEADER) && !(ins[j].live & FLAGS)) {
+      to_imm (in, 7, src, k[dst].cval);
+      ins[j].cc = swapcc[ins[j].cc];
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* mov $0, r; movb mem, r  =>  movzbl mem, r (and the same for words) */
+static int widen () {
+  int i, j, r, changed = 0;
+  struct oinsn *in;
+
+  for (i = 0; i < nins; i++) {
+    if ((ins[i].flags & (O_DEAD | O_FROZEN)) || ins[i].kind != I_MOVIR ||
+	ins[i].imm != 0) {
+      continue;
+    }
+    r = ins[i].rd;
+    j = next (i + 1);
+    if (j >= nins || (ins[j].flags & O_LEADER)) {
+      continue;
+    }
+    in = &ins[j];
+    if (in->mrm < 0 || (in->mrm >> 6) == 3 || ((in->mrm >> 3) & 7) != r ||
+	(in->addr & R(r))) {
+      continue;
+    }
+    if (in->nop == 1 && in->b[0] == 0x8a && r < __ESP) {
+      in->b[1] = 0xb6;
+    } else if (in->nop == 2 && in->b[0] == 0x66 && in->b[1] == 0x8b) {
+      in->b[1] = 0xb7;
+    } else {
+      continue;
+    }
+    in->b[0] = 0x0f;
+    in->nop = 2;
+    encode (in);
+    in->use = in->addr;
+    in->def = R(r);
+    kill (i);
+    changed++;
+  }
+  return changed;
+}
+
+static int loads () {
+  int i, r, s, changed;
+  struct oinsn *in;
+
+  changed = widen ();
+  forget_all ();
+  for (i = 0; i < nins; i++) {
+    in = &ins[i];
+    if (in->flags & O_DEAD) {
+      continue;
+    }
+    if (in->flags & O_LEADER) {
+      forget_all ();
+    }
+    r = in->rd;
+    if (!(R(r) & PINNED)) {
+      switch (in->kind) {
+      case I_MOVIR:
+	if (k[r].cvalid && k[r].cval == in->imm) {
+	  kill (i);
+	  changed++;
+	  continue;
+	}
+	clobber (r);
+	k[r].cvalid = 1;
+	k[r].cval = in->imm;
+	continue;
+      case I_MOVRR:
+	s = in->rs;
+	if (r == s || same (r, s)) {
+	  kill (i);
+	  changed++;
+	  continue;
+	}
+	clobber (r);
+	if (!(R(s) & PINNED)) {
+	  k[r] = k[s];
+	}
+	continue;
+      case I_LDV: case I_LDM:
+	s = holder (i);
+	if (s == r) {
+	  kill (i);
+	  changed++;
+	  continue;
+	}
+	clobber (r);
+	if (s >= 0) {
+	  to_movrr (in, s, r);
+	  k[r] = k[s];
+	  changed++;
+	} else if (in->kind == I_LDV) {
+	  k[r].loc = LOC_SLOT;
+	  k[r].slot = in->disp;
+	} else if (!(in->addr & R(r))) {
+	  k[r].loc = LOC_MEM;
+	  k[r].mem = i;
+	  k[r].deps = in->addr;
+	}
+	continue;
+      }
+    }
+    if (in->kind == I_STV && !(R(in->rs) & PINNED)) {
+      s = in->rs;
+      if (k[s].loc == LOC_SLOT && k[s].slot == in->disp) {
+	kill (i);
+	changed++;
+	continue;
+      }
+      forget_mem (1, in->disp);
+      k[s].loc = LOC_SLOT;
+      k[s].slot = in->disp;
+      continue;
+    }
+
+    changed += fold (i);
+    if (in->kind == I_CALL || in->kind == I_CIND) {
+      forget_all ();
+      continue;
+    }
+    for (r = 0; r < 8; r++) {
+      if (in->def & R(r)) {
+	clobber (r);
+      }
+    }
+    if (in->flags & O_MEMW) {
+      forget_mem (in->flags & O_SLOT, in->disp);
+    }
+  }
+  return changed;
+}
+
+/*
+ * ----------------------------------------------------------------------
+ * 		    Dead code and register saves
+ * ----------------------------------------------------------------------
+ */
+
+/* add, or, sub or xor of 0 to a register */
+static int noop_alu (struct oinsn *in) {
+  int d = (in->mrm >> 3) & 7;
+
+  return (in->nop == 1 && (in->b[0] == 0x81 || in->b[0] == 0x83) &&
+	  (in->mrm >> 6) == 3 && in->imm == 0 &&
+	  (d == 0 || d == 1 || d == 5 || d == 6));
+}
+
+/* the pop that restores the register pushed by insn i within its
+   basic block, or -1 if there isn't one or something in between
+   cares about the stack */
+static int matching_pop (int i) {
+  int j, depth = 0;
+  struct oinsn *in;
+
+  for (j = next (i + 1); j < nins; j = next (j + 1)) {
+    in = &ins[j];
+    if ((in->flags & O_LEADER) || (in->named & R(__ESP))) {
+      return -1;
+    }
+    if (in->kind == I_PUSH) {
+      depth++;
+    } else if (in->kind == I_POP) {
+      if (depth == 0) {
+	return (in->rd == ins[i].rd ? j : -1);
+      }
+      depth--;
+    } else if (in->kind != I_OTHER && in->kind != I_MOVIR &&
+	       in->kind != I_MOVRR && in->kind != I_LDV &&
+	       in->kind != I_STV && in->kind != I_LDM) {
+      return -1;
+    } else if (in->def & R(__ESP)) {
+      return -1;
+    }
+  }
+  return -1;
+}
+
+static int deadcode () {
+  int i, j, r, npush, npop, used, changed = 0;
+  struct oinsn *in;
+
+  for (i = 0; i < nins; i++) {
+    in = &ins[i];
+    if (in->flags & (O_DEAD | O_FROZEN)) {
+      continue;
+    }
+    if ((in->flags & O_NOP) || (noop_alu (in) && !(in->live & FLAGS))) {
+      kill (i);
+      changed++;
+      continue;
+    }
+    switch (in->kind) {
+    case I_OTHER: case I_MOVIR: case I_MOVRR: case I_LDV: case I_LDM:
+      if (in->def && !(in->flags & O_MEMW) && !(in->def & PINNED) &&
+	  !(in->def & in->live)) {
+	kill (i);
+	changed++;
+      }
+      break;
+    case I_PUSH:
+      /* save and restore of a scratch register that's dead anyway */
+      if ((j = matching_pop (i)) >= 0 &&
+	  !((ins[j].live | PINNED) & R(in->rd))) {
+	kill (i);
+	kill (j);
+	changed++;
+      }
+      break;
+    }
+  }
+
+  /* callee saved registers the procedure never mentions */
+  for (r = 0; r < 8; r++) {
+    if (r != __EBX && r != __ESI && r != __EDI) {
+      continue;
+    }
+    npush = npop = used = 0;
+    for (i = 0; i < nins; i++) {
+      in = &ins[i];
+      if (in->flags & O_DEAD) {
+	continue;
+      }
+      if (in->kind == I_PUSH && in->rd == r) {
+	npush++;
+      } else if (in->kind == I_POP && in->rd == r) {
+	npop++;
+      } else if (in->named & R(r)) {
+	used = 1;
+      }
+    }
+    if (used || npush == 0 || npush != npop) {
+      continue;
+    }
+    for (i = 0; i < nins; i++) {
+      in = &ins[i];
+      if (!(in->flags & O_DEAD) && (in->kind == I_PUSH || in->kind == I_POP) &&
+	  in->rd == r) {
+	kill (i);
+      }
+    }
+    changed++;
+  }
+  return changed;
+}
+
+/*
+ * ----------------------------------------------------------------------
+ * 		    Branches
+ * ----------------------------------------------------------------------
+ */
+
+static int jumps () {
+  int i, j, t, hops, changed = 0;
+  struct oinsn *in;
+
+  /* chain through jumps to jumps */
+  for (i = 0; i < nins; i++) {
+    in = &ins[i];
+    if ((in->flags & O_DEAD) || !isjump (in)) {
+      continue;
+    }
+    for (t = in->target, hops = 0; hops < OPT_MAXHOPS; hops++) {
+      j = next (t);
+      if (j >= nins || j == i || !isjump (&ins[j]) || ins[j].kind != I_JMP) {
+	break;
+      }
+      t = ins[j].target;
+    }
+    if (next (t) != next (in->target)) {
+      in->target = t;
+      changed++;
+    }
+  }
+  leaders ();
+
+  for (i = 0; i < nins; i++) {
+    in = &ins[i];
+    if ((in->flags & O_DEAD) || !isjump (in)) {
+      continue;
+    }
+    /* branch to the next insn */
+    if (next (in->target) == next (i + 1)) {
+      kill (i);
+      changed++;
+      continue;
+    }
+    /* jcc 1f; jmp l; 1:  =>  jncc l */
+    j = next (i + 1);
+    if (in->kind == I_JCC && j < nins && ins[j].kind == I_JMP &&
+	isjump (&ins[j]) && !(ins[j].flags & O_LEADER) &&
+	next (in->target) == next (j + 1)) {
+      in->cc ^= 1;
+      in->target = ins[j].target;
+      kill (j);
+      changed++;
+    }
+  }
+  return changed;
+}
+
+/* Bytes in the return sequence starting at insn t, or 0 if it isn't
+   one. Once the jumps have been marked the copied insns are the ones
+   marked O_TAIL: the originals may have been deleted by then. */
+static int tail (int t, int marked) {
+  int size = 0;
+
+  for (; t < nins; t++) {
+    if (marked ? !(ins[t].flags & O_TAIL) : (ins[t].flags & O_DEAD)) {
+      continue;
+    }
+    if (ins[t].flags & O_FROZEN) {
+      return 0;
+    }
+    switch (ins[t].kind) {
+    case I_RET:
+      return (size + ins[t].len);
+    case I_OTHER: case I_MOVIR: case I_MOVRR: case I_LDV: case I_STV:
+    case I_LDM: case I_PUSH: case I_POP:
+      size += ins[t].len;
+      break;
+    default:
+      return 0;
+    }
+  }
+  return 0;
+}
+
+/* replace jumps to short return sequences with a copy */
+static void duplicate () {
+  int i, t, size;
+
+  for (i = 0; i < nins; i++) {
+    if ((ins[i].flags & O_DEAD) || ins[i].kind != I_JMP) {
+      continue;
+    }
+    size = tail (ins[i].target, 0);
+    if (size <= 0 || size > OPT_DUPMAX) {
+      continue;
+    }
+    ins[i].flags |= O_DUP;
+    ins[i].flags &= ~O_SHORT;
+    for (t = next (ins[i].target); ; t = next (t + 1)) {
+      ins[t].flags |= O_TAIL;
+      if (ins[t].kind == I_RET) {
+	break;
+      }
+    }
+  }
+}
+
+/*
+ * ----------------------------------------------------------------------
+ * 		    Short encodings
+ * ----------------------------------------------------------------------
+ */
+
+static void compact () {
+  int i, enc;
+  struct oinsn *in;
+
+  for (i = 0; i < nins; i++) {
+    in = &ins[i];
+    if ((in->flags & (O_DEAD | O_FROZEN)) || in->kind == I_DATA) {
+      continue;
+    }
+    enc = 0;
+    /* 8-bit displacements */
+    if (in->mrm >= 0 && (in->mrm >> 6) == 2 && in->disp == (signed char)in->disp) {
+      in->mrm = (in->mrm & 0x3f) | 0x40;
+      in->dsz = 1;
+      enc = 1;
+    }
+    /* 8-bit immediates */
+    if (in->nop == 1 && in->imm == (signed char)in->imm) {
+      switch (in->b[0]) {
+      case 0x81: in->b[0] = 0x83; in->isz = 1; enc = 1; break;
+      case 0x69: in->b[0] = 0x6b; in->isz = 1; enc = 1; break;
+      case 0x68: in->b[0] = 0x6a; in->isz = 1; enc = 1; break;
+      }
+    }
+    /* one byte opcodes */
+    if (in->nop == 1 && in->mrm >= 0 && (in->mrm >> 6) == 3) {
+      if (in->kind == I_MOVIR && in->b[0] == 0xc7) {
+	in->b[0] = 0xb8 | in->rd;
+	in->mrm = -1;
+	enc = 1;
+      } else if (in->kind == I_PUSH && in->b[0] == 0xff) {
+	in->b[0] = 0x50 | in->rd;
+	in->mrm = -1;
+	enc = 1;
+      } else if (in->kind == I_POP && in->b[0] == 0x8f) {
+	in->b[0] = 0x58 | in->rd;
+	in->mrm = -1;
+	enc = 1;
+      }
+    }
+    if (enc) {
+      encode (in);
+    }
+  }
+}
+
+/*
+ * ----------------------------------------------------------------------
+ * 		    Layout and emission
+ * ----------------------------------------------------------------------
+ */
+
+static int size (int i) {
+  struct oinsn *in = &ins[i];
+
+  switch (in->kind) {
+  case I_DATA:
+    return (in->imm);
+  case I_JCC:
+    return ((in->flags & O_SHORT) ? 2 : 6);
+  case I_JMP:
+    if (in->flags & O_DUP) {
+      return (tail (in->target, 1));
+    }
+    return ((in->flags & O_SHORT) ? 2 : 5);
+  case I_CALL:
+    return (5);
+  }
+  return (in->len);
+}
+
+/* assign addresses, lengthening short branches that don't reach
+   until nothing changes. Returns the size of the code. */
+static int layout (v_code *code) {
+  v_code *a;
+  int i, d, changed;
+
+  do {
+    a = code;
+    for (i = 0; i < nins; i++) {
+      if (ins[i].flags & O_DEAD) {
+	continue;
+      }
+      if (ins[i].kind == I_DATA) {
+	a += -(int)a & 3;
+      }
+      ins[i].npc = a;
+      a += size (i);
+    }
+    nend = a;
+    changed = 0;
+    for (i = 0; i < nins; i++) {
+      if (!(ins[i].flags & O_DEAD) && (ins[i].flags & O_SHORT)) {
+	d = tpc (ins[i].target) - (ins[i].npc + 2);
+	if (d != (signed char)d) {
+	  ins[i].flags &= ~O_SHORT;
+	  changed = 1;
+	}
+      }
+    }
+  } while (changed);
+  return (nend - code);
+}
+
+static void put32 (unsigned char *p, int v) {
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+static void emit (v_code *code) {
+  unsigned char *p;
+  int i, j, n;
+  struct oinsn *in;
+
+  for (p = (unsigned char *)obuf; p < (unsigned char *)obuf + (nend - code); p++) {
+    *p = 0x90;
+  }
+  for (i = 0; i < nins; i++) {
+    in = &ins[i];
+    if (in->flags & O_DEAD) {
+      continue;
+    }
+    p = (unsigned char *)obuf + (in->npc - code);
+    switch (in->kind) {
+    case I_DATA:
+      for (j = 0; j < in->imm; j++) {
+	p[j] = in->pc[j];
+      }
+      break;
+    case I_JCC:
+      if (in->flags & O_SHORT) {
+	p[0] = 0x70 | in->cc;
+	p[1] = tpc (in->target) - (in->npc + 2);
+      } else {
+	p[0] = 0x0f;
+	p[1] = 0x80 | in->cc;
+	put32 (p + 2, tpc (in->target) - (in->npc + 6));
+      }
+      break;
+    case I_JMP:
+      if (in->flags & O_DUP) {
+	for (j = in->target; ; j++) {
+	  if (!(ins[j].flags & O_TAIL)) {
+	    continue;
+	  }
+	  for (n = 0; n < ins[j].len; n++) {
+	    *p++ = ins[j].b[n];
+	  }
+	  if (ins[j].kind == I_RET) {
+	    break;
+	  }
+	}
+      } else if (in->flags & O_SHORT) {
+	p[0] = 0xeb;
+	p[1] = tpc (in->target) - (in->npc + 2);
+      } else {
+	p[0] = 0xe9;
+	put32 (p + 1, tpc (in->target) - (in->npc + 5));
+      }
+      break;
+    case I_CALL:
+      p[0] = 0xe8;
+      put32 (p + 1, (in->target >= 0 ? tpc (in->target) : in->callee) -
+	     (in->npc + 5));
+      break;
+    default:
+      for (j = 0; j < in->len; j++) {
+	p[j] = in->b[j];
+      }
+      break;
+    }
+  }
+}
+
+v_code *v_opt (v_code *code, v_code *end, v_code *limit,
+	       v_label_rec *labels, int nlabels,
+	       v_data_rec *data, int ndata, int flags) {
+  v_code *p;
+  int i, j, d, t, n, round, changed;
+  struct oinsn *in;
+
+  /* decode */
+  for (nins = 0, p = code; p < end; nins++) {
+    if (nins >= OPT_MAXINSNS) {
+      return 0;
+    }
+    in = &ins[nins];
+    for (d = 0; d < ndata && data[d].addr != p; d++)
+      ;
+    if (d < ndata) {
+      clear (in, p);
+      in->kind = I_DATA;
+      in->imm = data[d].nbytes;
+      p += data[d].nbytes;
+    } else if ((n = decode (p, in)) > 0) {
+      p += n;
+    } else {
+      return 0;
+    }
+  }
+  if (p != end) {
+    return 0;
+  }
+  cend = end;
+
+  /* hook up branches, calls and address taken labels */
+  for (i = 0; i < nlabels; i++) {
+    if (labels[i].addr == 0) {
+      if (labels[i].num_refs > 0) {
+	return 0;		/* let labels_end complain */
+      }
+      continue;
+    }
+    if ((t = lookup (labels[i].addr)) < 0) {
+      return 0;
+    }
+    for (j = 0; j < labels[i].num_refs; j++) {
+      p = labels[i].refs[j];
+      if (labels[i].type[j] == RELATIVE) {
+	if ((d = containing (p)) < 0) {
+	  return 0;
+	}
+	in = &ins[d];
+	if (!(in->kind == I_JCC && in->nop == 2 && p == in->pc + 2) &&
+	    !((in->kind == I_JMP || in->kind == I_CALL) &&
+	      in->b[0] != 0xeb && p == in->pc + 1)) {
+	  return 0;
+	}
+	if (in->kind == I_CALL) {
+	  if (t >= nins) {
+	    return 0;
+	  }
+	  ins[t].flags |= O_ROOT;
+	}
+	in->target = t;
+      } else {
+	if (t < nins) {
+	  ins[t].flags |= O_ROOT;
+	}
+	if ((d = containing (p)) >= 0 && ins[d].kind != I_DATA) {
+	  ins[d].flags |= O_FROZEN;
+	  if (ins[d].kind != I_JIND && ins[d].kind != I_CIND) {
+	    ins[d].kind = I_OTHER;
+	  }
+	}
+      }
+    }
+  }
+  for (i = 0; i < nins; i++) {
+    in = &ins[i];
+    if ((in->kind == I_JCC || in->kind == I_JMP) && in->target < 0) {
+      return 0;
+    }
+    if (in->kind == I_CALL && in->target < 0) {
+      in->callee = in->pc + in->len + in->imm;
+    }
+    if ((flags & V_OPT_SHORT) && (in->kind == I_JCC || in->kind == I_JMP)) {
+      in->flags |= O_SHORT;
+    }
+  }
+
+  /* optimize */
+  for (round = 0, changed = 1; changed && round < OPT_ROUNDS; round++) {
+    changed = 0;
+    leaders ();
+    liveness ();
+    if (flags & V_OPT_LOADS) {
+      changed += loads ();
+    }
+    if (flags & V_OPT_LIVE) {
+      liveness ();
+      changed += deadcode ();
+    }
+    if (flags & V_OPT_JUMPS) {
+      changed += jumps ();
+      changed += reach ();
+    }
+  }
+  if (flags & V_OPT_SHORT) {
+    compact ();
+  }
+  if (flags & V_OPT_JUMPS) {
+    duplicate ();
+    reach ();
+  }
+
+  /* write it back */
+  n = layout (code);
+  if (n > OPT_MAXCODE || code + n > limit) {
+    return 0;
+  }
+  emit (code);
+  for (i = 0; i < n; i++) {
+    code[i] = obuf[i];
+  }
+
+  /* move ABSOLUTE refs that live in the code along with their insn,
+     drop the RELATIVE refs we've resolved and move the labels */
+  for (i = 0; i < nlabels; i++) {
+    for (j = t = 0; j < labels[i].num_refs; j++) {
+      if (labels[i].type[j] == RELATIVE) {
+	continue;
+      }
+      p = labels[i].refs[j];
+      if ((d = containing (p)) >= 0) {
+	p = ins[d].npc + (p - ins[d].pc);
+      }
+      labels[i].refs[t] = p;
+      labels[i].type[t++] = ABSOLUTE;
+    }
+    labels[i].num_refs = t;
+    if (labels[i].addr) {
+      labels[i].addr = tpc (lookup (labels[i].addr));
+    }
+  }
+  for (d = 0; d < ndata; d++) {
+    data[d].addr = ins[lookup (data[d].addr)].npc;
+  }
+  return (nend);
+}
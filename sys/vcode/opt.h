@@ -0,0 +1,83 @@
+
+/*
+ * Copyright (C) 1997 Massachusetts Institute of Technology 
+ *
+ * This software is being provided by the copyright holders under the
+ * following license. By obtaining, using and/or copying this software,
+ * you agree that you have read, understood, and will comply with the
+ * following terms and conditions:
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose and without fee or royalty is
+ * hereby granted, provided that the full text of this NOTICE appears on
+ * ALL copies of the software and documentation or portions thereof,
+ * including modifications, that you make.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS," AND COPYRIGHT HOLDERS MAKE NO
+ * REPRESENTATIONS OR WARRANTIES, EXPRESS OR IMPLIED. BY WAY OF EXAMPLE,
+ * BUT NOT LIMITATION, COPYRIGHT HOLDERS MAKE NO REPRESENTATIONS OR
+ * WARRANTIES OF MERCHANTABILITY OR FITNESS FOR ANY PARTICULAR PURPOSE OR
+ * THAT THE USE OF THE SOFTWARE OR DOCUMENTATION WILL NOT INFRINGE ANY
+ * THIRD PARTY PATENTS, COPYRIGHTS, TRADEMARKS OR OTHER RIGHTS. COPYRIGHT
+ * HOLDERS WILL BEAR NO LIABILITY FOR ANY USE OF THIS SOFTWARE OR
+ * DOCUMENTATION.
+ *
+ * The name and trademarks of copyright holders may NOT be used in
+ * advertising or publicity pertaining to the software without specific,
+ * written prior permission. Title to copyright in this software and any
+ * associated documentation will at all times remain with copyright
+ * holders. See the file AUTHORS which should have accompanied this software
+ * for a list of all copyright holders.
+ *
+ * This file may be derived from previously copyrighted software. This
+ * copyright applies only to those changes made by the copyright
+ * holders listed in the AUTHORS file. The rest of this file is covered by
+ * the copyright notices, if any, listed below.
+ */
+/*
+ * Interface between vcode.c and the post-emission optimizer in opt.c.
+ * Nothing outside of the vcode directory should include this.
+ */
+
+#ifndef __VCODE_OPT_H__
+#define __VCODE_OPT_H__
+
+/* build up a table of lables, the addresses they refer to, and 
+   any other refs we have to fill in once we know the label's
+   address. */
+
+#define MAX_LABELS 256
+#define MAX_REFS 128
+
+struct v_label_rec {
+  void *refs[MAX_REFS];
+  enum {RELATIVE, ABSOLUTE} type[MAX_REFS];
+  int num_refs;
+  v_code *addr;
+};
+typedef struct v_label_rec v_label_rec;
+
+/* blocks of data (jump tables and the like) that live in the
+   instruction stream. See v_dalloc. */
+
+#define MAX_DATA 32
+
+struct v_data_rec {
+  v_code *addr;
+  int nbytes;
+};
+typedef struct v_data_rec v_data_rec;
+
+/* Rewrite the procedure in [code, end) in place before its labels are
+   resolved. On success the RELATIVE refs have been consumed, label
+   addresses, in-code ABSOLUTE ref slots and data blocks have been
+   moved to where they now live, and the new end of the code is
+   returned. Returns 0 and leaves everything alone if the code uses
+   something the optimizer doesn't understand or the result would not
+   fit below limit. */
+
+v_code *v_opt (v_code *code, v_code *end, v_code *limit,
+	       v_label_rec *labels, int nlabels,
+	       v_data_rec *data, int ndata, int flags);
+
+#endif /* __VCODE_OPT_H__ */
@@ -54,6 +54,123 @@ static int __vdemand(char *bool, char *msg, char *file, int line, int (*ip)()) {
 }
 #define BITSPERBYTE 8
 
+/*
+ * Code size and speed with and without v_setopt, for the two kinds of
+ * procedure the kernel generates: a wakeup predicate (kern/wk.c) and a
+ * DPF style dispatch through a hash table of labels (dpf/gen.c).
+ */
+#define BENCH_CALLS 10000
+
+static unsigned wkvar[4];
+
+static unsigned long long cycles(void) {
+	unsigned long long v;
+
+	__asm __volatile (".byte 0xf, 0x31" : "=A" (v));
+	return v;
+}
+
+/* tag i+1 if wkvar[i] <= 3i && wkvar[i+1] == 7, for the first such i */
+static v_uptr wk_pred(v_code *code, int nbytes, int *n) {
+	v_reg_t r1, r2, z, tag;
+	v_label_t l;
+	int i;
+
+	v_lambda("wkpred", "", 0, V_LEAF, code, nbytes);
+	if(!v_getreg(&r1, V_U, V_TEMP) || !v_getreg(&r2, V_U, V_TEMP) ||
+	   !v_getreg(&z, V_U, V_TEMP) || !v_getreg(&tag, V_U, V_TEMP))
+		return 0;
+	v_setu(tag, -1);
+	v_setu(z, 0);
+	for(i = 0; i < 4; i++) {
+		l = v_genlabel();
+		v_ldui(r1, z, (int)&wkvar[i]);
+		v_setu(r2, 3 * i);
+		v_bgtu(r1, r2, l);
+		v_ldui(r1, z, (int)&wkvar[(i + 1) & 3]);
+		v_setu(r2, 7);
+		v_bneu(r1, r2, l);
+		v_setu(tag, i + 1);
+		v_retu(tag);
+		v_label(l);
+	}
+	v_retui(0);
+	return v_end(n).u;
+}
+
+/* switch on the low bits of the argument through a jump table */
+static v_uptr dispatch(v_code *code, int nbytes, int *n) {
+	v_reg_t arg[1], t, p;
+	v_label_t table, l[8];
+	void **tab;
+	int i;
+
+	v_lambda("dispatch", "%u", arg, V_LEAF, code, nbytes);
+	if(!v_getreg(&t, V_U, V_TEMP) || !v_getreg(&p, V_P, V_TEMP))
+		return 0;
+	table = v_genlabel();
+	v_andui(t, arg[0], 7);
+	v_lshui(t, t, 2);
+	v_setlabel(p, table);
+	v_ldp(p, t, p);
+	v_jp(p);
+	for(i = 0; i < 8; i++) {
+		l[i] = v_genlabel();
+		v_label(l[i]);
+		v_retui(i * i + 1);
+	}
+	tab = (void **)v_dalloc(table, 8 * sizeof(void *));
+	for(i = 0; i < 8; i++)
+		v_dlabel(&tab[i], l[i]);
+	return v_end(n).u;
+}
+
+static void opt_bench(void) {
+	static v_code c1[1000], c2[1000];
+	unsigned long long t;
+	unsigned u1, u2, arg;
+	int n1, n2, i, j, k, old;
+	v_uptr p1, p2;
+
+	for(k = 0; k < 2; k++) {
+		old = v_setopt(0);
+		p1 = k ? dispatch(c1, sizeof c1, &n1) : wk_pred(c1, sizeof c1, &n1);
+		v_setopt(V_OPT_ALL);
+		p2 = k ? dispatch(c2, sizeof c2, &n2) : wk_pred(c2, sizeof c2, &n2);
+		v_setopt(old);
+		if(!p1 || !p2) {
+			printf("%s: couldn't generate code\n", k ? "dispatch" : "wkpred");
+			v_errors++;
+			continue;
+		}
+
+		for(i = 0; i < BENCH_CALLS; i++) {
+			for(j = 0; j < 4; j++)
+				wkvar[j] = rand() % 16;
+			arg = rand();
+			u1 = k ? ((unsigned(*)(unsigned))p1)(arg) : p1();
+			u2 = k ? ((unsigned(*)(unsigned))p2)(arg) : p2();
+			if(u1 != u2) {
+				printf("%s: optimized code returned %u, not %u\n",
+					k ? "dispatch" : "wkpred", u2, u1);
+				v_errors++;
+				break;
+			}
+		}
+
+		printf("%s: %d bytes, %d optimized;", 
+			k ? "dispatch" : "wkpred", n1, n2);
+		t = cycles();
+		for(i = 0; i < BENCH_CALLS; i++)
+			k ? ((unsigned(*)(unsigned))p1)(i) : p1();
+		printf(" %u cycles/call,", (unsigned)(cycles() - t) / BENCH_CALLS);
+		t = cycles();
+		for(i = 0; i < BENCH_CALLS; i++)
+			k ? ((unsigned(*)(unsigned))p2)(i) : p2();
+		printf(" %u optimized\n", (unsigned)(cycles() - t) / BENCH_CALLS);
+	}
+}
+
 int main(int argc, char *argv[]) {
 	v_reg_t	arg_list[100];		/* make sure 100 is big enough */
 	static v_reg_t	zero;		/* hack */
@@ -86,6 +203,7 @@ int main(int argc, char *argv[]) {
 	v_iptr 	ip;
 	v_iptr 	ip2;
 	int 	iters = (argc == 2) ? atoi(argv[1]) : 1;
+	int	niters = iters, optimized = 0;
 	int 	aligned_offset, unaligned_offset;
 	int 	shifti, shiftu, shiftl, shiftul;
 
@@ -2529,6 +2647,16 @@ loop:
 
 	if(!v_errors && iters-- > 0) goto loop;
 
+	/* again, with everything run through the post-emission optimizer */
+	if(!v_errors && !optimized) {
+		optimized = 1;
+		iters = niters;
+		v_setopt(V_OPT_ALL);
+		goto loop;
+	}
+	if(!v_errors)
+		opt_bench();
+
 	if(!v_errors) {
 		printf("No errors!
 ");
@@ -36,6 +36,7 @@
  */
 
 #include <vcode/vcode.h>
+#include <vcode/opt.h>
 
 #include <xok_include/ctype.h>
 #include <xok_include/assert.h>
@@ -235,18 +236,8 @@ void register_test () {
 
 /* build up a table of lables, the addresses they refer to, and 
    any other refs we have to fill in once we know the label's
-   address. */
-
-#define MAX_LABELS 256
-#define MAX_REFS 128
-
-struct v_label_rec {
-  void *refs[MAX_REFS];
-  enum {RELATIVE, ABSOLUTE} type[MAX_REFS];
-  int num_refs;
-  v_code *addr;
-};
-typedef struct v_label_rec v_label_rec;
+   address. The table itself is described in opt.h since the
+   optimizer has to move things around in it. */
 
 static v_label_rec labels[MAX_LABELS];
 static int last_label = 0;
@@ -292,6 +283,27 @@ void v_dmark (v_code *addr, v_label_t l) {
   labels[l].refs[labels[l].num_refs++] = addr;
 }
 
+/* data placed in the instruction stream */
+
+static v_data_rec data[MAX_DATA];
+static int last_data = 0;
+
+/* Reserve nbytes of word aligned data (a jump table, say) at the
+   current point in the instruction stream and place label l on
+   it. The caller has to make sure control never falls into it. */
+
+v_code *v_dalloc (v_label_t l, int nbytes) {
+  assert (last_data < MAX_DATA);
+  while ((unsigned )v_ip & 3) {
+    __NOP;
+  }
+  v_label (l);
+  data[last_data].addr = v_ip;
+  data[last_data++].nbytes = nbytes;
+  v_ip += nbytes;
+  return (data[last_data-1].addr);
+}
+
 /* Called when we're done building a procedure.
 
    go through each defined label and fill in it's actual address
@@ -566,6 +578,8 @@ void proc_epilogue (v_code *backpatch) {
 static int is_leaf = 0;		/* 1 if current func is a leaf */
 static v_code *backpatch;	/* where write amount of local space needed */
 static v_code *code;		/* start of generated code */
+static v_code *code_limit;	/* end of space for it */
+static int opt_flags = 0;	/* V_OPT_* to apply in v_end */
 
 v_reg_t v_ra;		/* return EIP for this function */
 
@@ -606,6 +620,8 @@ void v_lambda (char *name,	/* name of function */
 
   is_leaf = leaf;
   v_ip = code = ip;
+  code_limit = ip + nbytes;
+  last_data = 0;
 
   registers_start ();
   labels_start ();
@@ -617,12 +633,29 @@ void v_lambda (char *name,	/* name of function */
   backpatch = proc_prologue (num_args);
 }
 
+/* Set the optimizations (V_OPT_*) v_end applies to the procedures
+   generated from now on. Returns the old setting so a caller can put
+   it back. */
+int v_setopt (int flags) {
+  int old = opt_flags;
+
+  opt_flags = flags;
+  return (old);
+}
+
 /* end the generation of a procedure and return a function pointer to it */
 union v_fp v_end (int *nbytes) {
   union v_fp f;
 
   /* we need to generate a prologue and backpatch labels in */
   proc_epilogue (backpatch);
+  if (opt_flags) {
+    v_code *end = v_opt (code, v_ip, code_limit, labels, last_label,
+			 data, last_data, opt_flags);
+    if (end) {
+      v_ip = end;
+    }
+  }
   if (labels_end () < 0) {
     f.v = (v_vptr )0;
     return (f);
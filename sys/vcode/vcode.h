@@ -149,6 +149,18 @@ void v_label (v_label_t l);
 void v_dlabel (void *addr, v_label_t l);
 void v_dmark (v_code *addr, v_label_t l);
 v_code *v_getlabel (v_label_t l);
+v_code *v_dalloc (v_label_t l, int nbytes);
+
+/* optimizations v_end can apply to a procedure after it has been
+   generated (see opt.c) */
+
+#define V_OPT_LOADS 0x1		/* redundant loads and constants */
+#define V_OPT_LIVE 0x2		/* dead code and register saves */
+#define V_OPT_JUMPS 0x4		/* branch chaining and unreachable code */
+#define V_OPT_SHORT 0x8		/* short branches and immediates */
+#define V_OPT_ALL 0xf
+
+int v_setopt (int flags);
 
 /*   XXX -- no chars or shorts yet. */
 
@@ -155,21 +155,21 @@
 /* AND variants */
 #define ANDV2RU(addr,reg) __cat3 (0x23, __modRM (__DISP8, __EBP_EF, reg), addr)
 #define ANDR2VU(reg,addr) __cat3 (0x21, __modRM (__DISP8, __EBP_EF, reg), addr)
-#define ANDR2RU(reg1,reg2) __cat2 (0x21, 0xc0 | (reg2 << 3) | reg1)
+#define ANDR2RU(reg1,reg2) __cat2 (0x21, 0xc0 | (reg1 << 3) | reg2)
 #define ANDI2VU(imm,addr) __cat3 (0x81, __modRM (__DISP8, __EBP_EF, 4), addr); __catWord (imm)
 #define ANDI2RU(imm,reg) __cat2 (0x81, 0xe0 | reg); __catWord (imm)
 
 /* OR variants */
 #define ORV2RU(addr,reg) __cat3 (0x0b, __modRM (__DISP8, __EBP_EF, reg), addr)
 #define ORR2VU(reg,addr) __cat3 (0x09, __modRM (__DISP8, __EBP_EF, reg), addr)
-#define ORR2RU(reg1,reg2) __cat2 (0x09, 0xc0 | (reg2 << 3) | reg1)
+#define ORR2RU(reg1,reg2) __cat2 (0x09, 0xc0 | (reg1 << 3) | reg2)
 #define ORI2VU(imm,addr) __cat3 (0x81, __modRM (__DISP8, __EBP_EF, 1), addr); __catWord (imm)
 #define ORI2RU(imm,reg) __cat2 (0x81, 0xc8 | reg); __catWord (imm)
 
 /* XOR variants */
 #define XORV2RU(addr,reg) __cat3 (0x33, __modRM (__DISP8, __EBP_EF, reg), addr)
 #define XORR2VU(reg,addr) __cat3 (0x31, __modRM (__DISP8, __EBP_EF, reg), addr)
-#define XORR2RU(reg1,reg2) __cat2 (0x31, 0xc0 | (reg2 << 3) | reg1)
+#define XORR2RU(reg1,reg2) __cat2 (0x31, 0xc0 | (reg1 << 3) | reg2)
 #define XORI2VU(imm,addr) __cat3 (0x81, __modRM (__DISP8, __EBP_EF, 0), addr); __catWord (imm)
 #define XORI2RU(imm,reg) __cat2 (0x81, 0xf0 | reg); __catWord (imm)
 
@@ -1159,6 +1159,9 @@ SHIFTI(RSH,RSH,I)
 #define v_setuc(rd,imm) _V_MOVUI_(rd,imm)
 UNARY_IMM(MOV,MOV,U)
 
+/* load the address of a label (it's filled in by v_end) */
+#define v_setlabel(rd,label) _V_MOVUI_(rd,0); v_dlabel (v_ip-4, label)
+
 #define v_comu(rd,rs) _V_COMU_(rd,rs)
 #define v_comi(rd,rs) _V_COMU_(rd,rs)
 #define v_coml(rd,rs) _V_COMU_(rd,rs)
@@ -118,6 +118,7 @@
 #define	GET_APIC_DEST_FIELD(x)	(((x)>>24)&0xFF)
 #define	SET_APIC_DEST_FIELD(x)	((x)<<24)
 #define	APIC_LVTT		0x320
+#define	APIC_LVTPC		0x340
 #define	APIC_LVT0		0x350
 #define	APIC_LVT_TIMER_PERIODIC	(1<<17)
 #define	APIC_LVT_MASKED		(1<<16)
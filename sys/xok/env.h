@@ -284,6 +284,7 @@ env_id2env (u_int envid, int *error)
 
 #include <xok/kclock.h>
 #include <machine/cpufunc.h>
+#include <xok/trace.h>
 
 void kill_env (struct Env *e);
 void backtrace (tfp);
@@ -479,6 +480,7 @@ env_run (struct Env *e)
   
   check_rtc_interrupt(e->env_u);
  
+  TRACE(TR_SWITCH, e->env_id, 0);
   env_ctx_switch(e);
   
   /* make sure TS bit in cr0 is set so that using the FPU will
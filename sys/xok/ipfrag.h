@@ -0,0 +1,67 @@
+
+/*
+ * Copyright (C) 1997 Massachusetts Institute of Technology 
+ *
+ * This software is being provided by the copyright holders under the
+ * following license. By obtaining, using and/or copying this software,
+ * you agree that you have read, understood, and will comply with the
+ * following terms and conditions:
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose and without fee or royalty is
+ * hereby granted, provided that the full text of this NOTICE appears on
+ * ALL copies of the software and documentation or portions thereof,
+ * including modifications, that you make.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS," AND COPYRIGHT HOLDERS MAKE NO
+ * REPRESENTATIONS OR WARRANTIES, EXPRESS OR IMPLIED. BY WAY OF EXAMPLE,
+ * BUT NOT LIMITATION, COPYRIGHT HOLDERS MAKE NO REPRESENTATIONS OR
+ * WARRANTIES OF MERCHANTABILITY OR FITNESS FOR ANY PARTICULAR PURPOSE OR
+ * THAT THE USE OF THE SOFTWARE OR DOCUMENTATION WILL NOT INFRINGE ANY
+ * THIRD PARTY PATENTS, COPYRIGHTS, TRADEMARKS OR OTHER RIGHTS. COPYRIGHT
+ * HOLDERS WILL BEAR NO LIABILITY FOR ANY USE OF THIS SOFTWARE OR
+ * DOCUMENTATION.
+ *
+ * The name and trademarks of copyright holders may NOT be used in
+ * advertising or publicity pertaining to the software without specific,
+ * written prior permission. Title to copyright in this software and any
+ * associated documentation will at all times remain with copyright
+ * holders. See the file AUTHORS which should have accompanied this software
+ * for a list of all copyright holders.
+ *
+ * This file may be derived from previously copyrighted software. This
+ * copyright applies only to those changes made by the copyright
+ * holders listed in the AUTHORS file. The rest of this file is covered by
+ * the copyright notices, if any, listed below.
+ */
+
+#ifndef _XOK_IPFRAG_H_
+#define _XOK_IPFRAG_H_
+
+#include <xok/types.h>
+#include <xok/ae_recv.h>
+
+/* IP fragment reassembly.  Fragments of IPv4 datagrams never reach the */
+/* packet filters: they are held in a table hashed on (source,         */
+/* destination, protocol, id) until the whole datagram is there.  It   */
+/* is then classified once, by its first fragment with the IP header   */
+/* made to describe the whole datagram, and handed to the ring of the  */
+/* matching filter as a gather list of the pieces (spilling over into  */
+/* the following ring entries if the ring has PKTRING_FL_CHAIN, else   */
+/* dropped if too big for one, see pktring_handlechain).  Datagrams    */
+/* still incomplete after IPFRAG_TIMEOUT seconds are thrown away, as   */
+/* is the oldest one when the table is full.  Counters are kept in     */
+/* si_ipfrag.                                                          */
+
+#define IPFRAG_HASH		64	/* hash buckets, a power of 2 */
+#define IPFRAG_MAXQ		32	/* datagrams being reassembled at once */
+#define IPFRAG_MAXFRAGS		AE_RECV_MAXSCATTER /* fragments per datagram */
+#define IPFRAG_TIMEOUT		5	/* seconds */
+
+#ifdef KERNEL
+void ipfrag_init (void);
+int ipfrag_input (struct ae_recv *recv, char *hdr, int hlen,
+		  uint64 *discardcntP);
+#endif
+
+#endif /* !_XOK_IPFRAG_H_ */
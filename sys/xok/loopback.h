@@ -0,0 +1,82 @@
+
+/*
+ * Copyright (C) 1997 Massachusetts Institute of Technology 
+ *
+ * This software is being provided by the copyright holders under the
+ * following license. By obtaining, using and/or copying this software,
+ * you agree that you have read, understood, and will comply with the
+ * following terms and conditions:
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose and without fee or royalty is
+ * hereby granted, provided that the full text of this NOTICE appears on
+ * ALL copies of the software and documentation or portions thereof,
+ * including modifications, that you make.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS," AND COPYRIGHT HOLDERS MAKE NO
+ * REPRESENTATIONS OR WARRANTIES, EXPRESS OR IMPLIED. BY WAY OF EXAMPLE,
+ * BUT NOT LIMITATION, COPYRIGHT HOLDERS MAKE NO REPRESENTATIONS OR
+ * WARRANTIES OF MERCHANTABILITY OR FITNESS FOR ANY PARTICULAR PURPOSE OR
+ * THAT THE USE OF THE SOFTWARE OR DOCUMENTATION WILL NOT INFRINGE ANY
+ * THIRD PARTY PATENTS, COPYRIGHTS, TRADEMARKS OR OTHER RIGHTS. COPYRIGHT
+ * HOLDERS WILL BEAR NO LIABILITY FOR ANY USE OF THIS SOFTWARE OR
+ * DOCUMENTATION.
+ *
+ * The name and trademarks of copyright holders may NOT be used in
+ * advertising or publicity pertaining to the software without specific,
+ * written prior permission. Title to copyright in this software and any
+ * associated documentation will at all times remain with copyright
+ * holders. See the file AUTHORS which should have accompanied this software
+ * for a list of all copyright holders.
+ *
+ * This file may be derived from previously copyrighted software. This
+ * copyright applies only to those changes made by the copyright
+ * holders listed in the AUTHORS file. The rest of this file is covered by
+ * the copyright notices, if any, listed below.
+ */
+
+#ifndef _XOK_LOOPBACK_H_
+#define _XOK_LOOPBACK_H_
+
+#include <xok/types.h>
+
+/* The loopback interface (lo0) accepts frames of up to LOOPBACK_MAXLEN */
+/* bytes, so that protocol stacks can be run with a jumbo MTU.          */
+
+#define LOOPBACK_MTU		16384
+#define LOOPBACK_MAXLEN		(LOOPBACK_MTU + 14)
+
+
+/* Link impairment emulation for lo0, set with sys_loopback_impair.  With */
+/* everything zero (the default), frames are delivered during the        */
+/* transmit system call.  Otherwise they wait in a delay line and the     */
+/* sender's pages stay pinned until the frame is delivered or dropped,    */
+/* which is signalled in the usual way (by decrementing *resptr).         */
+/* Probabilities are in parts per million.                                */
+
+#define LOOPBACK_PPM		1000000
+#define LOOPBACK_QLIMIT		256	/* default max frames in flight */
+
+struct lo_impair {
+  u_int li_delay;		/* one-way delay, in microseconds */
+  u_int li_jitter;		/* up to this much extra random delay (us) */
+  u_int li_loss;		/* drop probability (ppm) */
+  u_int li_reorder;		/* prob. (ppm) a frame skips the delay line */
+  u_int li_rate;		/* link rate in kbit/s, 0 for unlimited */
+  u_int li_qlimit;		/* max frames in flight, 0 for the default */
+  u_int li_seed;		/* seed for the loss/jitter/reorder choices */
+};
+
+struct lo_stats {
+  struct lo_impair ls_impair;	/* current settings */
+  u_int64_t ls_direct;		/* frames delivered without queueing */
+  u_int64_t ls_queued;		/* frames put in the delay line */
+  u_int64_t ls_delivered;	/* frames delivered from the delay line */
+  u_int64_t ls_reordered;	/* frames that skipped the delay line */
+  u_int64_t ls_lossdrops;	/* frames dropped by the loss emulation */
+  u_int64_t ls_qdrops;		/* frames dropped because of li_qlimit */
+  u_int ls_qlen;		/* frames in the delay line now */
+  u_int ls_maxqlen;		/* ... and at most */
+};
+
+#endif /* !_XOK_LOOPBACK_H_ */
@@ -217,7 +217,7 @@
 #define UPPAGES (UVPT - NBPD)
 /* Read only copy of the global sysinfo structure */
 #define SYSINFO (UPPAGES - NBPD)
-#define SYSINFO_SIZE (10 * NBPG)
+#define SYSINFO_SIZE (80 * NBPG)
 /* Read-only copies of all env structures (XXX) */
 #define UENVS (SYSINFO + SYSINFO_SIZE)
 /* Read-only copy of the buffer cache */
@@ -55,6 +55,11 @@
 #define XOKNET_LOOPBACK	3
 #define XOKNET_OSKIT	4
 
+/* flags */
+
+#define XOKNET_FL_ASYNCXMIT	0x1	/* transmission completes after
+					   sys_net_xmit returns */
+
 
 struct network
 {
@@ -67,6 +72,8 @@ struct network
   int inited;			/* is card initialized? */
   int netno;			/* network number for this card */
   int irq;			/* IRQ for the card */
+  u_int maxlen;			/* largest frame the card can send */
+  u_int flags;			/* XOKNET_FL_* */
   cap netcap;			/* capability covering this interface */
   u_int8_t ether_addr[ETHER_ADDR_LEN];	/* ethernet address */
   u_int64_t intrs;		/* interrupts taken since boot */
@@ -78,6 +85,9 @@ struct network
   u_int64_t discards;		/* packets discarded since boot */
   u_int32_t inerrs;		/* packet reception errors */
   u_int32_t outerrs;		/* packet transmission errors */
+  u_int64_t rxintrpkts;		/* packets taken in rcv interrupts */
+  u_int64_t rxpolls;		/* polls with the rcv interrupt off */
+  u_int64_t rxpolled;		/* packets taken in those polls */
   int (*xmitfunc)(void *, struct ae_recv *, int);  /* send function */
   struct kspinlock slock; 	/* queue lock for this device */
 };
@@ -87,5 +97,10 @@ struct network * xoknet_getstructure (int cardtype, int (*xmitfunc)(void *, stru
 
 void loopback_init ();
 
+/* receive polling (see kern/pkt.c) */
+#define XOKNET_POLL_BUDGET	32	/* most frames taken per poll */
+void xoknet_poll_start (int (*pollfunc)(void *, int), void *arg);
+void xoknet_poll (void);
+
 #endif /* !_XOK_NETWORK_H_ */
 
@@ -99,6 +99,28 @@ struct pctrst {
 
 #define _PATH_PCTR "/dev/pctr"
 
+#define P6CTR_INT 0x100000    /* Interrupt (through the local APIC) on overflow */
+
+/*
+ * Statistical profiler (sys_prof_ctl, sys_prof_read).  Every sample is
+ * the interrupted eip and environment, kept in a ring per cpu until read.
+ * PROF_TIMER samples at every clock tick, which cannot see the kernel
+ * since it runs with interrupts off.  PROF_PCTR samples every period
+ * events of P6 counter 0 with an NMI from the local APIC, so it sees
+ * kernel code too; it is only available on SMP kernels, which enable
+ * the local APIC.
+ */
+#define PROF_STOP 0
+#define PROF_TIMER 1
+#define PROF_PCTR 2
+
+#define PROF_NSAMPLES 4096    /* per cpu, power of two */
+
+struct prof_sample {
+  u_int ps_eip;
+  u_int ps_envid;             /* 0 if no environment was running */
+};
+
 
 #define __cpuid()				\
 ({						\
@@ -174,4 +196,11 @@ struct pctrst {
 #define wrmsr(msr, v) \
      __asm __volatile (".byte 0xf, 0x30" :: "A" ((u_quad_t) (v)), "c" (msr));
 
+#ifdef KERNEL
+struct Trapframe;
+extern u_int prof_mode;
+void prof_tick (struct Trapframe *);
+int prof_nmi (struct Trapframe *);
+#endif
+
 #endif /* ! _I386_PCTR_H_ */
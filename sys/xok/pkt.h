@@ -50,6 +50,8 @@
 #include <xok/malloc.h>
 #include <xok/mmu.h>
 #include <xok/ae_recv.h>
+#include <xok/trace.h>
+#include <xok/ipfrag.h>
 
 struct xokpkt {
   struct ae_recv recv;
@@ -144,18 +146,31 @@ static inline int xokpkt_send (struct ae_recv *recv, int interface)
    return 0;
 }
 
-struct msghold {
-        int m;
-	unsigned long long time;
-        struct pkthold *pktlist;
-        struct msghold *n;
-};
+/* A packet that matched no filter. */
+static inline void xokpkt_unwanted (struct xokpkt *pkt)
+{
+  /* nobody wants this packet */
+  if (pkt->discardcntP) (*pkt->discardcntP)++;
+}
 
-extern void defilter(int msg, struct xokpkt *pkt);
-extern void refilter(struct msghold *cur, struct msghold *last);
-extern void refilterold(int msg);
-extern struct msghold *msglist;
-extern void msgclean(void);
+/* A packet that matched filter filterid, which has no ring buffer. */
+static inline void xokpkt_noring (struct xokpkt *pkt, int filterid)
+{
+  printf("no one wants the packet...\n");
+
+#if ASH_ENABLE
+  /* XXX no longer uses ASHes */
+
+  /* 
+   * Somebody without a valid ring buffer wants this packet.  Until ASHes
+   * are officially deleted, this should be saved in a queue and forwarded
+   * upward at the very end of the interrupt routine (since ASHes do not
+   * return to the kernel where they left off...) 
+   */
+  pkt->filterid = filterid;
+  TAILQ_INSERT_TAIL (&pktq, pkt, link);
+#endif /* ASH_ENABLE */
+}
 
 /* This function hands a packet from a network device driver to xok. */
 /* It is expected that all fields, except filterid and link, are     */
@@ -185,62 +200,39 @@ static inline void xokpkt_recv (struct xokpkt *pkt)
     xokpkt_nettap (pkt);
   }
 
-  filterid = dpf_iptr (pkt->data, pkt->len, &result);
+  /* IP fragments only go on once the whole datagram is there */
+  if (ipfrag_input ((struct ae_recv *) &pkt->count, pkt->data, pkt->len,
+		    pkt->discardcntP)) {
+    if (pkt->freeFunc) pkt->freeFunc (pkt);
+    return;
+  }
+
+  filterid = TRACE_CLASSIFY (dpf_iptr (pkt->data, pkt->len, &result));
 
   if (filterid <= 0) 
   {
-#if DPF_FRAGMENTATION
-    if (result.headtail == 2) 
-    {
-      int len = pkt->len;
-      struct xokpkt *pkt_new =
-	(struct xokpkt*) malloc(sizeof(struct xokpkt)+len+3);
-      pkt_new->data = (char *)pkt_new + sizeof(struct xokpkt);
-      memmove(pkt_new,pkt,sizeof(struct xokpkt));
-      memmove(pkt_new->data,pkt->data,len);
-      pkt_new->freeFunc = xokpkt_free;
-      pkt_new->freeArg = pkt_new;
-      pkt_new->discardcntP = 0L;
-      defilter(result.msgid, pkt_new);
-    } 
-    else 
-#endif
-    {
-      /* nobody wants this packet */
-      if (pkt->discardcntP) (*pkt->discardcntP)++;
-    }
+    xokpkt_unwanted (pkt);
   } 
   
   else if ((ringid = dpf_fid_getringval(filterid)) > 0) 
   {
     /* somebody with a valid ring buffer wants this packet */
     pktring_handlepkt (ringid, (struct ae_recv *) &pkt->count);
-
-#if DPF_FRAGMENTATION
-    if (result.headtail == 1)
-      refilterold(result.msgid);
-#endif
   } 
   
   else 
   {
-    printf("no one wants the packet...\n");
-
-#if ASH_ENABLE
-    /* XXX no longer uses ASHes */
-
-    /* 
-     * Somebody without a valid ring buffer wants this packet.  Until ASHes
-     * are officially deleted, this should be saved in a queue and forwarded
-     * upward at the very end of the interrupt routine (since ASHes do not
-     * return to the kernel where they left off...) 
-     */
-    pkt->filterid = filterid;
-    TAILQ_INSERT_TAIL (&pktq, pkt, link);
-#endif /* ASH_ENABLE */
+    xokpkt_noring (pkt, filterid);
   }
     
   if (pkt->freeFunc) pkt->freeFunc (pkt);
 }
 
+/* Same as xokpkt_recv for a burst of at most XOKPKT_BATCH packets, in */
+/* arrival order.  Drivers that pull several frames off their ring per */
+/* interrupt should use this: the burst is classified in one pass and  */
+/* consecutive packets for the same ring are delivered under one lock. */
+#define XOKPKT_BATCH	16
+void xokpkt_recv_batch (struct xokpkt **pkts, int n);
+
 #endif /* __XOK_PKT_H__ */
@@ -49,6 +49,22 @@
 
 #define MAX_PKTRING_COUNT       127
 
+/* Most ring entries one packet can be spread over (pktring_handlechain). */
+
+#define PKTRING_MAXCHAIN	48
+
+/* Ring flags, set with sys_pktring_setflags. */
+
+#define PKTRING_FL_CHAIN	0x1	/* take packets spread over entries */
+
+/* An entry's owner field gets the number of bytes put there.  A nettap */
+/* that cut the packet short (see sys_nettap_filter) also puts how many */
+/* bytes it left off, up to PKTRING_CUTMAX, above PKTRING_LENBITS.      */
+
+#define PKTRING_LENBITS		16
+#define PKTRING_LENMASK		((1 << PKTRING_LENBITS) - 1)
+#define PKTRING_CUTMAX		0x7fff
+
 
 /* Constants determining who owns a particular pktring entry. */
 
@@ -74,6 +90,9 @@ typedef struct pktringent {
 int pktring_adddpfref (int usering, int filterid);
 void pktring_deldpfref (int usering, int filterid);
 void pktring_handlepkt (int filterid, struct ae_recv *recv);
+void pktring_handlepkts (int ringid, struct ae_recv **recvs, int n);
+void pktring_handlesnap (int ringid, struct ae_recv *recv, u_int wirelen);
+int pktring_handlechain (int ringid, struct ae_recv *recv);
 
 #endif
 
@@ -81,12 +81,15 @@ extern void (*syscall_pfcleanup)(u_int, u_int, u_int);
 #include <ubb/ubb_decl.h>
 #include <xok/ae_recv_decl.h>
 #include <xok/batch_decl.h>
+#include <xok/bpf_decl.h>
 #include <xok/buf_decl.h>
 #include <xok/capability_decl.h>
 #include <xok/console_decl.h>
 #include <xok/env_decl.h>
+#include <xok/loopback_decl.h>
 #include <xok/pktring_decl.h>
 #include <xok/msgring_decl.h>
+#include <xok/pctr_decl.h>
 #include <xok/pmap_decl.h>
 #include <xok/pxn_decl.h>
 #include <xok/scode_decl.h>
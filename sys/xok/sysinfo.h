@@ -163,6 +163,20 @@ ARRAY_SIMPLE_READER_DECL(Sysinfo,si_intr_stats,uint64*)
 #endif /* __PIC_MODULE__ */
 
 
+#if defined(__SYSCALL_MODULE__)
+FIELD_ASSIGN_DECL(Sysinfo,si_scstat_enabled,u_int)
+
+/* returns &Sysinfo->si_scstats[i] */
+ARRAY_PTR_READER_DECL(Sysinfo,si_scstats,struct scstat_cpu *)
+#endif /* __SYSCALL_MODULE__ */
+
+
+#if defined(__IPFRAG_MODULE__)
+/* returns &Sysinfo->si_ipfrag */
+FIELD_PTR_READER_DECL(Sysinfo,si_ipfrag,struct ipfrag_stats *)
+#endif /* __IPFRAG_MODULE__ */
+
+
 #if defined(__MPLOCK_MODULE__) 
 #ifdef __SMP__
 /* returns Sysinfo->si_global_slocks */
@@ -96,6 +96,13 @@ struct Sysinfo {
   /* incremented everytime a process dies */
   uint64 si_killed_envs;
 
+  /* syscall statistics, only kept while si_scstat_enabled */
+  u_int si_scstat_enabled;
+  struct scstat_cpu si_scstats[NR_CPUS];
+
+  /* IP fragment reassembly */
+  struct ipfrag_stats si_ipfrag;
+
   /* kernel spinlocks */
   struct kspinlock si_global_slocks[NR_GLOBAL_SLOCKS];
   struct kqueuelock si_global_qlocks[NR_GLOBAL_QLOCKS];
@@ -170,6 +177,18 @@ ARRAY_SIMPLE_READER(Sysinfo,si_intr_stats,uint64*)
 #endif /* __PIC_MODULE__ */
 
 
+#if defined(__SYSCALL_MODULE__)
+FIELD_ASSIGN(Sysinfo,si_scstat_enabled,u_int)
+
+ARRAY_PTR_READER(Sysinfo,si_scstats,struct scstat_cpu *)
+#endif /* __SYSCALL_MODULE__ */
+
+
+#if defined(__IPFRAG_MODULE__)
+FIELD_PTR_READER(Sysinfo,si_ipfrag,struct ipfrag_stats *)
+#endif /* __IPFRAG_MODULE__ */
+
+
 #if defined(__MPLOCK_MODULE__) 
 #ifdef __SMP__
 FIELD_SIMPLE_READER(Sysinfo,si_global_slocks,struct kspinlock *)
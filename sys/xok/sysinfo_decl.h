@@ -45,6 +45,40 @@ struct Sysinfo;
 #define MAX_SCSI_CTLR_CNT 1
 #define MAXOSID 128
 
+/* per-CPU, per-syscall counts and cycle histograms, see sys_scstat_ctl.
+   Bucket i counts calls that took less than 2^(SC_BUCKET0+i) cycles; the
+   last bucket counts everything slower. */
+#define SC_NSYSCALLS 256	/* MAX_SYSCALL */
+#define SC_NBUCKETS 12
+#define SC_BUCKET0 7
+
+struct scstat {
+  unsigned long long ss_cycles;	/* total cycles spent in the syscall */
+  unsigned int ss_count;	/* number of calls */
+  unsigned int ss_max;		/* slowest call, in cycles */
+  unsigned int ss_hist[SC_NBUCKETS];
+};
+
+struct scstat_cpu {
+  struct scstat sc_sys[SC_NSYSCALLS];
+};
+
+/* flags for sys_scstat_ctl */
+#define SCSTAT_ENABLE 1		/* keep statistics */
+#define SCSTAT_RESET 2		/* zero them first */
+
+/* IP fragment reassembly counters, see kern/ipfrag.c */
+struct ipfrag_stats {
+  unsigned long long is_frags;	/* fragments received */
+  unsigned long long is_reassembled; /* datagrams put back together */
+  unsigned long long is_delivered; /* ... and accepted by some ring */
+  unsigned long long is_timeouts; /* incomplete datagrams that timed out */
+  unsigned long long is_evicted; /* ... or made room for a newer one */
+  unsigned long long is_dropped; /* bad, overlapping or excess fragments,
+				    and datagrams no ring would take */
+  unsigned int is_pending;	/* datagrams being reassembled now */
+};
+
 #endif /* _SYSINFO_DECL_H_ */
 
 
@@ -0,0 +1,157 @@
+
+/*
+ * Copyright (C) 1997 Massachusetts Institute of Technology 
+ *
+ * This software is being provided by the copyright holders under the
+ * following license. By obtaining, using and/or copying this software,
+ * you agree that you have read, understood, and will comply with the
+ * following terms and conditions:
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose and without fee or royalty is
+ * hereby granted, provided that the full text of this NOTICE appears on
+ * ALL copies of the software and documentation or portions thereof,
+ * including modifications, that you make.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS," AND COPYRIGHT HOLDERS MAKE NO
+ * REPRESENTATIONS OR WARRANTIES, EXPRESS OR IMPLIED. BY WAY OF EXAMPLE,
+ * BUT NOT LIMITATION, COPYRIGHT HOLDERS MAKE NO REPRESENTATIONS OR
+ * WARRANTIES OF MERCHANTABILITY OR FITNESS FOR ANY PARTICULAR PURPOSE OR
+ * THAT THE USE OF THE SOFTWARE OR DOCUMENTATION WILL NOT INFRINGE ANY
+ * THIRD PARTY PATENTS, COPYRIGHTS, TRADEMARKS OR OTHER RIGHTS. COPYRIGHT
+ * HOLDERS WILL BEAR NO LIABILITY FOR ANY USE OF THIS SOFTWARE OR
+ * DOCUMENTATION.
+ *
+ * The name and trademarks of copyright holders may NOT be used in
+ * advertising or publicity pertaining to the software without specific,
+ * written prior permission. Title to copyright in this software and any
+ * associated documentation will at all times remain with copyright
+ * holders. See the file AUTHORS which should have accompanied this software
+ * for a list of all copyright holders.
+ *
+ * This file may be derived from previously copyrighted software. This
+ * copyright applies only to those changes made by the copyright
+ * holders listed in the AUTHORS file. The rest of this file is covered by
+ * the copyright notices, if any, listed below.
+ */
+
+#if defined(KERNEL) && defined(ENABLE_TRACE)
+/* outside the guard, since env.h includes this file for env_run */
+#include <xok/env.h>
+#endif
+
+#ifndef _XOK_TRACE_H_
+#define _XOK_TRACE_H_
+
+#include <xok/types.h>
+#include <xok/mmu.h>
+#include <machine/param.h>
+
+/* Kernel event tracing.  Each CPU appends typed, TSC-stamped events to */
+/* its own ring, which is mapped read-only at UTRACE in every env.  The */
+/* kernel runs with interrupts off, so a ring only ever has one writer  */
+/* and needs no lock.  A reader copies events out and keeps its own    */
+/* position; an event is only good if its te_seq matches its index    */
+/* both before and after it is copied (the writer may have lapped it). */
+/* Types are switched on and off with sys_trace_ctl, which needs a      */
+/* zero length capability with all permissions.  All of this is only    */
+/* compiled in if the kernel is built with ENABLE_TRACE.                */
+
+#define TR_SYSCALL	1	/* a0 = syscall number */
+#define TR_SYSRET	2	/* a0 = syscall number, a1 = return value */
+#define TR_TRAP		3	/* a0 = trap number, a1 = fault address */
+#define TR_SWITCH	4	/* a0 = envid being switched to */
+#define TR_CLASSIFY	5	/* a0 = filter id, a1 = cycles spent in dpf */
+#define TR_DISKREQ	6	/* a0 = request (kernel buf), a1 = bytes */
+#define TR_DISKDONE	7	/* a0 = request (kernel buf) */
+#define TR_NTYPES	8
+
+#define TR_ALL		(((1 << TR_NTYPES) - 1) & ~1)
+
+struct trace_ev {
+  u_quad_t te_tsc;		/* cycle counter when it happened */
+  volatile u_int te_seq;	/* index in the ring + 1 */
+  u_short te_type;		/* TR_ */
+  u_short te_pad;
+  u_int te_envid;		/* env that was running */
+  u_int te_a0;
+  u_int te_a1;
+  u_int te_pad2;
+};
+
+#define TRACE_NEV	2048	/* events per CPU, a power of two */
+
+struct trace_hdr {
+  u_int th_mask;		/* (1 << TR_x) set if TR_x is traced */
+  u_int th_ncpus;
+  u_int th_nev;			/* TRACE_NEV */
+  u_int th_pad[5];
+  struct {
+    volatile u_int tc_head;	/* events ever written by this CPU */
+    u_int tc_pad[7];		/* keep CPUs off each other's lines */
+  } th_cpu[NR_CPUS];
+};
+
+/* one page of header, then the rings one after another */
+#define UTRACE		(UXN + UXN_SIZE)
+#define UTRACE_SIZE	(NBPG + NR_CPUS * TRACE_NEV * sizeof (struct trace_ev))
+#define TRACE_RING(hdr, cpu) \
+  ((struct trace_ev *) ((char *) (hdr) + NBPG) + (cpu) * TRACE_NEV)
+
+#ifdef KERNEL
+
+#ifdef ENABLE_TRACE
+
+#include <xok/cpu.h>
+#include <xok/pctr.h>
+
+extern struct trace_hdr *trace_hdr;
+
+static inline void
+trace (u_int type, u_int a0, u_int a1)
+{
+  struct trace_ev *ev;
+  u_int cpu, h;
+
+  if (!(trace_hdr->th_mask & (1 << type)))
+    return;
+
+  cpu = cpu_id;
+  h = trace_hdr->th_cpu[cpu].tc_head++;
+  ev = TRACE_RING (trace_hdr, cpu) + (h & (TRACE_NEV - 1));
+  ev->te_seq = 0;
+  asm volatile ("" ::: "memory");
+  ev->te_tsc = rdtsc ();
+  ev->te_type = type;
+  ev->te_envid = curenv ? curenv->env_id : 0;
+  ev->te_a0 = a0;
+  ev->te_a1 = a1;
+  asm volatile ("" ::: "memory");
+  ev->te_seq = h + 1;
+}
+
+#define TRACE(type, a0, a1)	trace ((type), (u_int) (a0), (u_int) (a1))
+
+/* run a dpf classification, tracing the filter id and how long it took */
+#define TRACE_CLASSIFY(call)						\
+({									\
+  int __fid;								\
+  if (trace_hdr->th_mask & (1 << TR_CLASSIFY)) {			\
+    u_quad_t __t = rdtsc ();						\
+    __fid = (call);							\
+    trace (TR_CLASSIFY, __fid, (u_int) (rdtsc () - __t));		\
+  } else								\
+    __fid = (call);							\
+  __fid;								\
+})
+
+#else
+
+#define TRACE(type, a0, a1)
+#define TRACE_CLASSIFY(call)	(call)
+
+#endif /* ENABLE_TRACE */
+
+#endif /* KERNEL */
+
+#endif /* _XOK_TRACE_H_ */
@@ -0,0 +1,179 @@
+#include <sys/types.h>
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <exos/netinet/cksum.h>
+
+/*
+ * Throughput of the Internet checksum loops in libexos, for each of the
+ * implementations inet_cksum_select knows about.  For a range of sizes
+ * and source alignments it times the checksum alone, a bcopy followed
+ * by a checksum, and the fused inet_checksum_copy, and checks that all
+ * of the implementations agree with each other and with a plain RFC 1071
+ * reference, including odd lengths and empty buffers.
+ *
+ *	cksum [-i impl] [-n megabytes]
+ */
+
+static char *impls[] = { "c64", "adc", NULL };
+static int sizes[] = { 64, 256, 1024, 1460, 4096, 16384, 65536, 0 };
+static int oddsizes[] = { 0, 1, 3, 1499, -1 };
+
+#define MAXSIZE	65536
+
+static char srcbuf[MAXSIZE + 8];
+static char dstbuf[MAXSIZE + 8];
+
+static double
+now (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return (tv.tv_sec + tv.tv_usec / 1000000.0);
+}
+
+/* RFC 1071, a byte at a time; words are little-endian as on the x86 */
+static uint
+refsum (unsigned char *p, int len)
+{
+  uint sum = 0;
+  int i;
+
+  for (i = 0; i + 1 < len; i += 2)
+    sum += p[i] | (p[i + 1] << 8);
+  if (len & 1)
+    sum += p[len - 1];
+  while (sum >> 16)
+    sum = (sum & 0xffff) + (sum >> 16);
+  sum = ~sum & 0xffff;
+  return ((sum == 0) ? 0xffff : sum);
+}
+
+/* check both entry points against refsum at every source alignment */
+static void
+verify (int size)
+{
+  unsigned short *dst = (unsigned short *)dstbuf;
+  uint want, sum, copysum;
+  int a;
+
+  for (a = 0; a < 4; a++) {
+    want = refsum ((unsigned char *)&srcbuf[a], size);
+    sum = inet_checksum ((unsigned short *)&srcbuf[a], size, 0, 1);
+    copysum = inet_checksum_copy ((unsigned short *)&srcbuf[a], dst, size, 0, 1);
+    if (sum != want || copysum != want || bcmp (&srcbuf[a], dst, size) != 0) {
+      printf ("%s: %d bytes at alignment %d: sum %x, copy %x, reference %x\n",
+	      inet_cksum_impl, size, a, sum, copysum, want);
+      exit (1);
+    }
+  }
+}
+
+static double
+rate (int bytes, int iters, double t)
+{
+  return ((t > 0) ? ((double)bytes * iters / t / (1024 * 1024)) : 0);
+}
+
+/* returns the checksums so the caller can compare implementations */
+static void
+run (int size, int align, int iters, uint *sums)
+{
+  unsigned short *src = (unsigned short *)&srcbuf[align];
+  unsigned short *dst = (unsigned short *)dstbuf;
+  double t0, t1, t2, t3;
+  uint sum = 0, copysum = 0;
+  int i;
+
+  t0 = now ();
+  for (i = 0; i < iters; i++)
+    sum = inet_checksum (src, size, 0, 1);
+  t1 = now ();
+  for (i = 0; i < iters; i++) {
+    bcopy (src, dst, size);
+    sum = inet_checksum (dst, size, 0, 1);
+  }
+  t2 = now ();
+  for (i = 0; i < iters; i++)
+    copysum = inet_checksum_copy (src, dst, size, 0, 1);
+  t3 = now ();
+
+  if (copysum != sum || bcmp (src, dst, size) != 0) {
+    printf ("%s: copy+checksum of %d bytes at alignment %d is wrong\n",
+	    inet_cksum_impl, size, align);
+    exit (1);
+  }
+  sums[0] = sum;
+  sums[1] = inet_checksum (src, size - 1, 0, 1);
+
+  printf ("%-4s %6d %d %9.1f %9.1f %9.1f\n", inet_cksum_impl, size, align,
+	  rate (size, iters, t1 - t0), rate (size, iters, t2 - t1),
+	  rate (size, iters, t3 - t2));
+}
+
+int
+main (int argc, char **argv)
+{
+  uint sums[2][sizeof (sizes) / sizeof (sizes[0])][4][2];
+  char *only = NULL;
+  int megs = 64;
+  int c, i, s, a;
+
+  while ((c = getopt (argc, argv, "i:n:")) != -1) {
+    switch (c) {
+    case 'i':
+      only = optarg;
+      break;
+    case 'n':
+      megs = atoi (optarg);
+      break;
+    default:
+      fprintf (stderr, "usage: %s [-i impl] [-n megabytes]\n", argv[0]);
+      exit (1);
+    }
+  }
+
+  srandom (getpid ());
+  for (i = 0; i < sizeof (srcbuf); i++)
+    srcbuf[i] = random ();
+
+  inet_cksum_select (NULL);
+  printf ("default implementation: %s\n", inet_cksum_impl);
+  printf ("impl   size a      sum MB/s  copy+sum MB/s  fused MB/s\n");
+
+  for (i = 0; impls[i]; i++) {
+    if (only && strcmp (only, impls[i]) != 0)
+      continue;
+    if (inet_cksum_select (impls[i]) < 0) {
+      printf ("%s: unknown implementation\n", impls[i]);
+      exit (1);
+    }
+    for (s = 0; oddsizes[s] >= 0; s++)
+      verify (oddsizes[s]);
+    for (s = 0; sizes[s]; s++) {
+      verify (sizes[s]);
+      verify (sizes[s] - 1);
+      for (a = 0; a < 4; a++)
+	run (sizes[s], a, (megs * 1024 * 1024) / sizes[s], sums[i][s][a]);
+    }
+    printf ("%s matches the reference\n", inet_cksum_impl);
+  }
+
+  if (only == NULL) {
+    for (s = 0; sizes[s]; s++)
+      for (a = 0; a < 4; a++)
+	if (bcmp (sums[0][s][a], sums[1][s][a], sizeof (sums[0][s][a]))) {
+	  printf ("%s and %s disagree on %d bytes at alignment %d\n",
+		  impls[0], impls[1], sizes[s], a);
+	  exit (1);
+	}
+    printf ("implementations agree\n");
+  }
+
+  inet_cksum_select (NULL);
+  return (0);
+}
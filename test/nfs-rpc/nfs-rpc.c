@@ -0,0 +1,299 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+
+#include "fd/nfs/nfs_rpc.h"
+#include "fd/nfs/nfs_rpc_procs.h"
+#include "fd/nfs/nfs_struct.h"
+
+/*
+ * Exercises the windowed parallel NFS rpcs over loopback.  A child
+ * process stands in for an NFS server: it answers NULL, READ and WRITE
+ * calls on a single in-memory file, and can drop every n-th call to
+ * force retransmissions.  The parent writes the file with
+ * nfs_proc_writev, reads it back with nfs_proc_read (up to MAX_P_RPC
+ * rpcs per call) and with nfs_proc_readpages (the read-ahead path),
+ * checks the data and reports the rates and the rpc window.
+ *
+ * Finally it uses a second file handle, for which the server fails the
+ * one rpc at a given offset, to check that a failed reply in the middle
+ * of a parallel write or read-ahead is reported even though the replies
+ * after it succeed.  nfs_fetch_pages relies on this to keep the pages
+ * of a failed batch out of the buffer cache.
+ *
+ *	nfs-rpc [-k kilobytes] [-p port] [-d drop_every]
+ */
+
+#define DEFAULT_KB	1024
+#define DEFAULT_PORT	7124
+#define USAGE		"usage: %s [-k kilobytes] [-p port] [-d drop_every]\n"
+
+#define MAXFILE		(4*1024*1024)
+#define MAXMSG		9000
+
+static char file[MAXFILE];
+static char buf[MAXFILE];
+
+
+static double elapsed (struct timeval *start, struct timeval *end)
+{
+   return ((end->tv_sec - start->tv_sec) +
+	   ((end->tv_usec - start->tv_usec) / 1000000.0));
+}
+
+
+static int *put_fattr (int *p, int size)
+{
+   int i;
+
+   *p++ = htonl (NFREG);
+   *p++ = htonl (0644);
+   *p++ = htonl (1);
+   for (i = 0; i < 2; i++)	/* uid, gid */
+      *p++ = 0;
+   *p++ = htonl (size);
+   *p++ = htonl (NFSPGSZ);
+   *p++ = 0;			/* rdev */
+   *p++ = htonl ((size + 511) / 512);
+   *p++ = htonl (1);		/* fsid */
+   *p++ = htonl (2);		/* fileid */
+   for (i = 0; i < 6; i++)	/* times never change */
+      *p++ = 0;
+   return (p);
+}
+
+
+static void server (int port, int size, int drop)
+{
+   static int in[MAXMSG / 4], out[MAXMSG / 4];
+   struct sockaddr_in sin, from;
+   int s, len, fromlen, calls = 0;
+   int *p, *q, proc, n, off, count, failoff;
+
+   s = socket (AF_INET, SOCK_DGRAM, 0);
+   assert (s >= 0);
+   bzero ((char *)&sin, sizeof(sin));
+   sin.sin_family = AF_INET;
+   sin.sin_port = htons (port);
+   sin.sin_addr.s_addr = htonl (INADDR_ANY);
+   if (bind (s, (struct sockaddr *)&sin, sizeof(sin)) < 0) {
+      perror ("nfs-rpc: server");
+      exit (1);
+   }
+
+   for (;;) {
+      fromlen = sizeof (from);
+      len = recvfrom (s, (char *)in, sizeof(in), 0,
+		      (struct sockaddr *)&from, &fromlen);
+      if (len < 40)
+	 continue;
+      if ((drop) && ((++calls % drop) == 0))
+	 continue;
+
+      /* xid, call, rpc version, program, version, procedure, cred, verf */
+      p = &in[5];
+      proc = ntohl (*p++);
+      p++;
+      n = ntohl (*p++);
+      p += (n + 3) >> 2;
+      p++;
+      n = ntohl (*p++);
+      p += (n + 3) >> 2;
+
+      q = out;
+      *q++ = in[0];
+      *q++ = htonl (RPC_REPLY);
+      *q++ = htonl (RPC_MSG_ACCEPTED);
+      *q++ = htonl (RPC_AUTH_NULL);
+      *q++ = 0;
+      *q++ = htonl (RPC_SUCCESS);
+
+	/* a non-zero first word in the handle is an offset to fail at */
+      failoff = ntohl (p[0]);
+      p += NFS_FHSIZE / 4;
+      switch (proc) {
+      case NFSPROC_NULL:
+	 break;
+      case NFSPROC_READ:
+	 off = ntohl (p[0]);
+	 count = ntohl (p[1]);
+	 if ((failoff) && (off == failoff)) {
+	    *q++ = htonl (NFSERR_IO);
+	    break;
+	 }
+	 if (off > size) off = size;
+	 if (count > size - off) count = size - off;
+	 *q++ = htonl (NFS_OK);
+	 q = put_fattr (q, size);
+	 *q++ = htonl (count);
+	 bcopy (&file[off], (char *)q, count);
+	 q += (count + 3) >> 2;
+	 break;
+      case NFSPROC_WRITE:
+	 off = ntohl (p[1]);
+	 count = ntohl (p[3]);
+	 if ((failoff) && (off == failoff)) {
+	    *q++ = htonl (NFSERR_IO);
+	 } else if (off + count <= MAXFILE) {
+	    bcopy ((char *)&p[4], &file[off], count);
+	    *q++ = htonl (NFS_OK);
+	 } else {
+	    *q++ = htonl (NFSERR_FBIG);
+	 }
+	 q = put_fattr (q, size);
+	 break;
+      default:
+	 out[5] = htonl (RPC_PROC_UNAVAIL);
+	 break;
+      }
+      sendto (s, (char *)out, (char *)q - (char *)out, 0,
+	      (struct sockaddr *)&from, fromlen);
+   }
+}
+
+
+static void check (char *what, char *data, int len)
+{
+   int i;
+
+   for (i = 0; i < len; i++) {
+      if (data[i] != (char)(i * 7 + (i >> 12))) {
+	 printf ("nfs-rpc: %s: bad data at offset %d\n", what, i);
+	 exit (1);
+      }
+   }
+}
+
+
+int main (int argc, char **argv)
+{
+   struct generic_server *srv;
+   struct nfs_fh fh, badfh;
+   struct nfs_fattr fattr;
+   struct timeval start, end;
+   struct ae_recv r;
+   char *pages[NFS_RA_MAXPAGES];
+   int kb = DEFAULT_KB, port = DEFAULT_PORT, drop = 0;
+   int size, off, n, i, c, ret;
+   pid_t pid;
+
+   while ((c = getopt (argc, argv, "k:p:d:")) != -1) {
+      switch (c) {
+      case 'k': kb = atoi (optarg); break;
+      case 'p': port = atoi (optarg); break;
+      case 'd': drop = atoi (optarg); break;
+      default:
+	 fprintf (stderr, USAGE, argv[0]);
+	 exit (1);
+      }
+   }
+   size = kb * 1024;
+   if ((size <= 0) || (size > MAXFILE) || (size % (NFS_RA_MAXPAGES * NFSPGSZ))) {
+      fprintf (stderr, "nfs-rpc: size must be a multiple of %dK up to %dK\n",
+	       NFS_RA_MAXPAGES * NFSPGSZ / 1024, MAXFILE / 1024);
+      exit (1);
+   }
+
+   if ((pid = fork ()) == 0) {
+      server (port, size, drop);
+   }
+   sleep (1);
+
+   if ((srv = make_server ("127.0.0.1", port)) == NULL) {
+      printf ("nfs-rpc: make_server failed\n");
+      kill (pid, SIGKILL);
+      exit (1);
+   }
+   bzero (fh.data, NFS_FHSIZE);
+   fh.server = srv;
+   if (nfs_proc_null (&fh) != 0) {
+      printf ("nfs-rpc: NULL call failed\n");
+      goto fail;
+   }
+
+   for (i = 0; i < size; i++)
+      buf[i] = i * 7 + (i >> 12);
+
+	/* write-back path: 8K at a time, split across wsize rpcs */
+   gettimeofday (&start, NULL);
+   for (off = 0; off < size; off += 8192) {
+      r.n = 1;
+      r.r[0].data = &buf[off];
+      r.r[0].sz = 8192;
+      if ((ret = nfs_proc_writev (&fh, off, 8192, &r, &fattr)) != 0) {
+	 printf ("nfs-rpc: write at %d failed: %d\n", off, ret);
+	 goto fail;
+      }
+   }
+   gettimeofday (&end, NULL);
+   printf ("write:     %6.2f MB/s\n", size / elapsed (&start, &end) / (1024*1024));
+
+	/* uncached read path: MAX_P_RPC rpcs per call */
+   bzero (buf, size);
+   n = srv->rsize * MAX_P_RPC;
+   gettimeofday (&start, NULL);
+   for (off = 0; off < size; off += n) {
+      if ((ret = nfs_proc_read (&fh, off, n, &buf[off], &fattr)) != n) {
+	 printf ("nfs-rpc: read at %d returned %d\n", off, ret);
+	 goto fail;
+      }
+   }
+   gettimeofday (&end, NULL);
+   check ("read", buf, size);
+   printf ("read:      %6.2f MB/s\n", size / elapsed (&start, &end) / (1024*1024));
+
+	/* read-ahead path: NFS_RA_MAXPAGES separate pages per call */
+   bzero (buf, size);
+   gettimeofday (&start, NULL);
+   for (off = 0; off < size; off += NFS_RA_MAXPAGES * NFSPGSZ) {
+      for (i = 0; i < NFS_RA_MAXPAGES; i++)
+	 pages[i] = &buf[off + i * NFSPGSZ];
+      n = NFS_RA_MAXPAGES * NFSPGSZ;
+      if ((ret = nfs_proc_readpages (&fh, off, NFS_RA_MAXPAGES, pages, &fattr)) != n) {
+	 printf ("nfs-rpc: readpages at %d returned %d\n", off, ret);
+	 goto fail;
+      }
+   }
+   gettimeofday (&end, NULL);
+   check ("readpages", buf, size);
+   printf ("readpages: %6.2f MB/s\n", size / elapsed (&start, &end) / (1024*1024));
+
+	/* a failed reply in the middle of the batch fails the whole call */
+   badfh = fh;
+   *(int *)badfh.data = htonl (srv->wsize);
+   r.n = 1;
+   r.r[0].data = buf;
+   r.r[0].sz = 3 * srv->wsize;
+   if ((ret = nfs_proc_writev (&badfh, 0, 3 * srv->wsize, &r, &fattr)) == 0) {
+      printf ("nfs-rpc: writev with a failed middle rpc returned %d\n", ret);
+      goto fail;
+   }
+   *(int *)badfh.data = htonl (NFSPGSZ);
+   for (i = 0; i < NFS_RA_MAXPAGES; i++)
+      pages[i] = &buf[i * NFSPGSZ];
+   if ((ret = nfs_proc_readpages (&badfh, 0, NFS_RA_MAXPAGES, pages, &fattr)) >= 0) {
+      printf ("nfs-rpc: readpages with a failed middle rpc returned %d\n", ret);
+      goto fail;
+   }
+   printf ("failed middle rpcs are reported\n");
+
+   printf ("rpc window %d, %d timeouts\n", srv->window, srv->nrtimeouts);
+   free_server (srv);
+   kill (pid, SIGKILL);
+   waitpid (pid, NULL, 0);
+   return (0);
+
+fail:
+   free_server (srv);
+   kill (pid, SIGKILL);
+   waitpid (pid, NULL, 0);
+   exit (1);
+}
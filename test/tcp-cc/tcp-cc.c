@@ -0,0 +1,183 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+
+#include <exos/cap.h>
+#include <xok/sys_ucall.h>
+#include <xok/loopback.h>
+
+#include "xio/xio_tcp.h"
+#include "xio/xio_tcp_cc.h"
+#include "xio/xio_tcp_stats.h"
+
+/*
+ * Bulk TCP throughput over the loopback interface, for comparing the xio
+ * congestion control algorithms.  A child process sinks the data; the
+ * parent sends it with the chosen algorithm and reports the rate along
+ * with its TCP statistics (fast retransmits, timeouts, SACKs seen).
+ * The remaining options make lo0 emulate a worse link for the run.
+ *
+ *	tcp-cc [-c newreno|cubic] [-n megabytes] [-p port]
+ *	       [-d delay_us] [-j jitter_us] [-l loss_ppm] [-o reorder_ppm]
+ *	       [-r rate_kbps] [-s seed]
+ */
+
+#define DEFAULT_MB	16
+#define DEFAULT_PORT	7123
+#define CHUNK		8192
+#define USAGE		"usage: %s [-c newreno|cubic] [-n megabytes] [-p port]\n" \
+			"\t[-d delay_us] [-j jitter_us] [-l loss_ppm] [-o reorder_ppm]\n" \
+			"\t[-r rate_kbps] [-s seed]\n"
+
+extern tcp_stat *tcpstats;
+
+static char buf[CHUNK];
+
+
+static double elapsed (struct timeval *start, struct timeval *end)
+{
+   return ((end->tv_sec - start->tv_sec) +
+	   ((end->tv_usec - start->tv_usec) / 1000000.0));
+}
+
+
+static void sink (int port)
+{
+   struct sockaddr_in sin;
+   int s, conn, len;
+   int one = 1;
+
+   s = socket (AF_INET, SOCK_STREAM, 0);
+   assert (s >= 0);
+   setsockopt (s, SOL_SOCKET, SO_REUSEADDR, (char *)&one, sizeof(one));
+   bzero ((char *)&sin, sizeof(sin));
+   sin.sin_family = AF_INET;
+   sin.sin_port = htons (port);
+   sin.sin_addr.s_addr = htonl (INADDR_ANY);
+   if ((bind (s, (struct sockaddr *)&sin, sizeof(sin)) < 0) ||
+       (listen (s, 1) < 0)) {
+      perror ("tcp-cc: sink");
+      exit (1);
+   }
+   conn = accept (s, NULL, NULL);
+   assert (conn >= 0);
+   while ((len = read (conn, buf, CHUNK)) > 0) ;
+   close (conn);
+   close (s);
+   exit (0);
+}
+
+
+int main (int argc, char **argv)
+{
+   struct xio_tcp_cc *cc = xio_tcp_cc_getdefault ();
+   struct sockaddr_in sin;
+   struct timeval start, end;
+   struct lo_impair imp, none;
+   struct lo_stats ls;
+   int mb = DEFAULT_MB;
+   int port = DEFAULT_PORT;
+   int total, sent, s, c;
+   pid_t pid;
+   double secs;
+
+   bzero ((char *)&imp, sizeof(imp));
+   bzero ((char *)&none, sizeof(none));
+   while ((c = getopt (argc, argv, "c:n:p:d:j:l:o:r:s:")) != -1) {
+      switch (c) {
+      case 'c':
+         if ((cc = xio_tcp_cc_lookup (optarg)) == NULL) {
+            fprintf (stderr, "tcp-cc: unknown algorithm %s\n", optarg);
+            exit (1);
+         }
+         break;
+      case 'n':
+         mb = atoi (optarg);
+         break;
+      case 'p':
+         port = atoi (optarg);
+         break;
+      case 'd':
+         imp.li_delay = atoi (optarg);
+         break;
+      case 'j':
+         imp.li_jitter = atoi (optarg);
+         break;
+      case 'l':
+         imp.li_loss = atoi (optarg);
+         break;
+      case 'o':
+         imp.li_reorder = atoi (optarg);
+         break;
+      case 'r':
+         imp.li_rate = atoi (optarg);
+         break;
+      case 's':
+         imp.li_seed = atoi (optarg);
+         break;
+      default:
+         fprintf (stderr, USAGE, argv[0]);
+         exit (1);
+      }
+   }
+
+   if (sys_loopback_impair (CAP_ROOT, &imp, NULL) < 0) {
+      fprintf (stderr, "tcp-cc: cannot set lo0 impairments\n");
+      exit (1);
+   }
+
+   if ((pid = fork ()) == 0) {
+      sink (port);
+   }
+   assert (pid > 0);
+   sleep (1);			/* let the sink get to accept */
+
+   tcpstats = (tcp_stat *) malloc (sizeof(tcp_stat));
+   assert (tcpstats);
+   bzero ((char *)tcpstats, sizeof(tcp_stat));
+   xio_tcp_cc_setdefault (cc);
+
+   s = socket (AF_INET, SOCK_STREAM, 0);
+   assert (s >= 0);
+   bzero ((char *)&sin, sizeof(sin));
+   sin.sin_family = AF_INET;
+   sin.sin_port = htons (port);
+   sin.sin_addr.s_addr = inet_addr ("127.0.0.1");
+   if (connect (s, (struct sockaddr *)&sin, sizeof(sin)) < 0) {
+      perror ("tcp-cc: connect");
+      sys_loopback_impair (CAP_ROOT, &none, NULL);
+      kill (pid, SIGKILL);
+      exit (1);
+   }
+
+   total = mb * 1024 * 1024;
+   gettimeofday (&start, NULL);
+   for (sent = 0; sent < total; sent += c) {
+      if ((c = write (s, buf, ((total - sent) < CHUNK) ? (total - sent) : CHUNK)) <= 0) {
+         perror ("tcp-cc: write");
+         break;
+      }
+   }
+   close (s);
+   waitpid (pid, NULL, 0);
+   gettimeofday (&end, NULL);
+   sys_loopback_impair (CAP_ROOT, &none, &ls);
+
+   secs = elapsed (&start, &end);
+   printf ("%s: %d bytes in %.3f seconds, %.2f Mbit/s\n", cc->name, sent,
+	   secs, ((sent * 8.0) / (secs * 1000000.0)));
+   printf ("lo0: %qu direct, %qu queued (max %u), %qu reordered, %qu lost, %qu tail dropped\n",
+	   ls.ls_direct, ls.ls_queued, ls.ls_maxqlen, ls.ls_reordered,
+	   ls.ls_lossdrops, ls.ls_qdrops);
+   xio_tcp_statprint (tcpstats);
+   return (0);
+}